@@ -0,0 +1,120 @@
+//
+// alloc_count.c
+// debug-build counting of heap and symbol table use by the bindings
+//
+// This software was written in the Input Devices and Music Interaction
+// Laboratory at McGill University in Montreal, and is copyright those
+// found in the AUTHORS file.  It is licensed under the GNU Lesser Public
+// General License version 2.1 or later.  Please see COPYING for details.
+//
+
+#define _GNU_SOURCE
+#include "alloc_count.h"
+#include <dlfcn.h>
+#include <stddef.h>
+
+#define MAX_MODULES 16
+
+// glibc's own entry points, used by the wrappers below
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t num, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static const void *modules[MAX_MODULES];
+static int num_modules = 0;
+static int counting = 0;
+static int busy = 0;
+static t_alloc_counts counts;
+
+void alloc_count_module(const void *addr)
+{
+    Dl_info info;
+    int i;
+
+    if (!dladdr(addr, &info) || !info.dli_fbase)
+        return;
+    for (i = 0; i < num_modules; i++) {
+        if (modules[i] == info.dli_fbase)
+            return;
+    }
+    if (num_modules < MAX_MODULES)
+        modules[num_modules++] = info.dli_fbase;
+}
+
+// only calls made directly from binding code are counted, not those made by
+// libmapper or liblo on their behalf
+static int from_binding(const void *caller)
+{
+    Dl_info info;
+    int i, found = 0;
+
+    if (busy)
+        return 0;
+    busy = 1;
+    if (dladdr(caller, &info)) {
+        for (i = 0; i < num_modules; i++) {
+            if (modules[i] == info.dli_fbase) {
+                found = 1;
+                break;
+            }
+        }
+    }
+    busy = 0;
+    return found;
+}
+
+void alloc_count_begin(void)
+{
+    static int init = 0;
+    if (!init) {
+        // the executable itself, which includes or hosts the bindings
+        alloc_count_module((const void *)alloc_count_begin);
+        init = 1;
+    }
+    counts.malloc = counts.realloc = counts.free = counts.gensym = 0;
+    counting = 1;
+}
+
+void alloc_count_end(t_alloc_counts *result)
+{
+    counting = 0;
+    if (result)
+        *result = counts;
+}
+
+void alloc_count_gensym(void)
+{
+    if (counting)
+        ++counts.gensym;
+}
+
+// *********************************************************
+// -(wrappers)----------------------------------------------
+void *malloc(size_t size)
+{
+    if (counting && from_binding(__builtin_return_address(0)))
+        ++counts.malloc;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t num, size_t size)
+{
+    if (counting && from_binding(__builtin_return_address(0)))
+        ++counts.malloc;
+    return __libc_calloc(num, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (counting && from_binding(__builtin_return_address(0)))
+        ++counts.realloc;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    if (ptr && counting && from_binding(__builtin_return_address(0)))
+        ++counts.free;
+    __libc_free(ptr);
+}
@@ -0,0 +1,35 @@
+//
+// alloc_count.h
+// debug-build counting of heap and symbol table use by the bindings: when
+// compiled with -DALLOC_COUNT, malloc, calloc, realloc and free are wrapped
+// and calls made from the bindings (the executable and any registered
+// external) are counted while a region is open, along with every gensym()
+//
+// This software was written in the Input Devices and Music Interaction
+// Laboratory at McGill University in Montreal, and is copyright those
+// found in the AUTHORS file.  It is licensed under the GNU Lesser Public
+// General License version 2.1 or later.  Please see COPYING for details.
+//
+
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+
+typedef struct _alloc_counts
+{
+    long malloc;        // includes calloc
+    long realloc;
+    long free;
+    long gensym;
+} t_alloc_counts;
+
+// treat the module containing addr as binding code
+void alloc_count_module(const void *addr);
+
+// count calls until alloc_count_end(), which returns the totals
+void alloc_count_begin(void);
+void alloc_count_end(t_alloc_counts *counts);
+
+// called by the runtimes' gensym()
+void alloc_count_gensym(void);
+
+#endif // ALLOC_COUNT_H
@@ -0,0 +1,294 @@
+//
+// bench_mapper_pd.c
+// end-to-end benchmark for the puredata build of the mapper external:
+// two mapper objects are connected over loopback and driven headlessly
+//
+// This software was written in the Input Devices and Music Interaction
+// Laboratory at McGill University in Montreal, and is copyright those
+// found in the AUTHORS file.  It is licensed under the GNU Lesser Public
+// General License version 2.1 or later.  Please see COPYING for details.
+//
+
+#include "pd_runtime.h"
+#include <mapper/mapper.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#define RING_SIZE 65536         // outstanding send times, indexed by sequence
+#define MAX_SAMPLES (1 << 20)   // latency samples kept for percentiles
+#define SEQ_WRAP (1 << 24)      // sequence numbers stay exact as floats
+
+typedef struct _bench
+{
+    t_pd *src;
+    t_pd *dst;
+    char src_name[256];
+    char dst_name[256];
+    double send_time[RING_SIZE];
+    double *latency;
+    long num_latency;
+    long sent;
+    long received;
+    int measuring;
+} t_bench;
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+}
+
+static double cpu_us(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e6
+           + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+static int compare_dbl(const void *a, const void *b)
+{
+    double d = *(const double *)a - *(const double *)b;
+    return d < 0 ? -1 : d > 0;
+}
+
+// *********************************************************
+// -(outlet hook)-------------------------------------------
+static void bench_outlet(void *ctx, t_object *owner, int index,
+                         t_symbol *s, int argc, t_atom *argv)
+{
+    t_bench *b = (t_bench *)ctx;
+
+    if (index == 1) {
+        // device information: remember the full device name once ready
+        if (strcmp(s->s_name, "name") || !argc || argv->a_type != A_SYMBOL)
+            return;
+        if ((t_pd *)owner == b->src)
+            snprintf(b->src_name, 256, "%s", argv->a_w.w_symbol->s_name);
+        else if ((t_pd *)owner == b->dst)
+            snprintf(b->dst_name, 256, "%s", argv->a_w.w_symbol->s_name);
+        return;
+    }
+    if ((t_pd *)owner != b->dst || !argc || argv->a_type != A_FLOAT)
+        return;
+
+    ++b->received;
+    if (b->measuring && b->num_latency < MAX_SAMPLES) {
+        int seq = (int)argv->a_w.w_float;
+        b->latency[b->num_latency++] = now_us() - b->send_time[seq & (RING_SIZE - 1)];
+    }
+}
+
+// *********************************************************
+// -(connect signals)---------------------------------------
+static mpr_dev find_dev(mpr_graph g, const char *name)
+{
+    mpr_list devs = mpr_graph_get_list(g, MPR_DEV);
+    devs = mpr_list_filter(devs, MPR_PROP_NAME, NULL, 1, MPR_STR, name, MPR_OP_EQ);
+    return devs ? (mpr_dev)*devs : NULL;
+}
+
+static mpr_sig find_sig(mpr_dev dev, mpr_dir dir, const char *name)
+{
+    mpr_list sigs = mpr_dev_get_sigs(dev, dir);
+    sigs = mpr_list_filter(sigs, MPR_PROP_NAME, NULL, 1, MPR_STR, name, MPR_OP_EQ);
+    return sigs ? (mpr_sig)*sigs : NULL;
+}
+
+static int connect_signals(t_bench *b, int num_sigs, double timeout_ms)
+{
+    mpr_graph g = mpr_graph_new(MPR_OBJ);
+    mpr_map *maps = (mpr_map *)calloc(num_sigs, sizeof(mpr_map));
+    mpr_dev src = NULL, dst = NULL;
+    double waited = 0;
+    int i, ready = 0;
+    char name[64];
+
+    // wait for both devices and all of their signals to be known
+    while (waited < timeout_ms) {
+        mpr_graph_poll(g, 0);
+        pdrt_advance(10);
+        usleep(10000);
+        waited += 10;
+        if (!*b->src_name || !*b->dst_name)
+            continue;
+        if (!src)
+            src = find_dev(g, b->src_name);
+        if (!dst)
+            dst = find_dev(g, b->dst_name);
+        if (src && dst
+            && mpr_list_get_size(mpr_dev_get_sigs(src, MPR_DIR_OUT)) == num_sigs
+            && mpr_list_get_size(mpr_dev_get_sigs(dst, MPR_DIR_IN)) == num_sigs)
+            break;
+    }
+    if (waited >= timeout_ms) {
+        fprintf(stderr, "timed out waiting for devices\n");
+        return 1;
+    }
+
+    for (i = 0; i < num_sigs; i++) {
+        snprintf(name, 64, "sig/%d", i);
+        mpr_sig s = find_sig(src, MPR_DIR_OUT, name);
+        mpr_sig d = find_sig(dst, MPR_DIR_IN, name);
+        if (!s || !d)
+            continue;
+        maps[i] = mpr_map_new(1, &s, 1, &d);
+        mpr_obj_push(maps[i]);
+    }
+
+    while (waited < timeout_ms && ready < num_sigs) {
+        mpr_graph_poll(g, 0);
+        pdrt_advance(10);
+        usleep(10000);
+        waited += 10;
+        for (i = 0, ready = 0; i < num_sigs; i++)
+            ready += maps[i] && mpr_map_get_is_ready(maps[i]);
+    }
+    free(maps);
+    mpr_graph_free(g);
+    if (ready < num_sigs) {
+        fprintf(stderr, "timed out waiting for maps (%d/%d ready)\n", ready, num_sigs);
+        return 1;
+    }
+    return 0;
+}
+
+// *********************************************************
+// -(main)--------------------------------------------------
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-n signals] [-l length] [-r rate] [-d seconds] "
+            "[-w warmup] [-e external] [-v]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    const char *external = "../mapper/mapper.pd_linux";
+    int num_sigs = 16, len = 1, opt, verbose = 0, i, j;
+    double rate = 100, duration = 5, warmup = 1;
+    t_bench *b = (t_bench *)calloc(1, sizeof(t_bench));
+    t_symbol **names;
+    t_atom *vals;
+    char msg[256];
+
+    while ((opt = getopt(argc, argv, "n:l:r:d:w:e:vh")) != -1) {
+        switch (opt) {
+            case 'n': num_sigs = atoi(optarg);      break;
+            case 'l': len = atoi(optarg);           break;
+            case 'r': rate = atof(optarg);          break;
+            case 'd': duration = atof(optarg);      break;
+            case 'w': warmup = atof(optarg);        break;
+            case 'e': external = optarg;            break;
+            case 'v': verbose = 1;                  break;
+            default:  usage(argv[0]);               return 1;
+        }
+    }
+    if (num_sigs < 1 || len < 1 || rate <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    pdrt_init(verbose);
+    if (pdrt_load(external, "mapper"))
+        return 1;
+    pdrt_set_outlet_hook(bench_outlet, b);
+    b->latency = (double *)malloc(sizeof(double) * MAX_SAMPLES);
+
+    t_atom args[2];
+    SETSYMBOL(args, gensym("@alias"));
+    SETSYMBOL(args + 1, gensym("bench_src"));
+    b->src = pdrt_new("mapper", 2, args);
+    SETSYMBOL(args + 1, gensym("bench_dst"));
+    b->dst = pdrt_new("mapper", 2, args);
+    if (!b->src || !b->dst)
+        return 1;
+
+    names = (t_symbol **)malloc(sizeof(t_symbol *) * num_sigs);
+    vals = (t_atom *)malloc(sizeof(t_atom) * len);
+    for (i = 0; i < num_sigs; i++) {
+        snprintf(msg, 256, "add output sig/%d @type f @length %d", i, len);
+        pdrt_send(b->src, msg);
+        snprintf(msg, 256, "add input sig/%d @type f @length %d", i, len);
+        pdrt_send(b->dst, msg);
+        snprintf(msg, 256, "sig/%d", i);
+        names[i] = gensym(msg);
+    }
+    for (j = 0; j < len; j++)
+        SETFLOAT(vals + j, 0);
+
+    if (connect_signals(b, num_sigs, 10000))
+        return 1;
+
+    // drive all signals at the requested rate, polling between rounds
+    double period = 1e6 / rate, start = now_us(), last = start, cpu_start = 0;
+    double stop = start + (warmup + duration) * 1e6, measure_start = start + warmup * 1e6;
+    long rounds = 0, sent_start = 0, received_start = 0, seq = 0;
+
+    while (1) {
+        double t = now_us();
+        if (t >= stop)
+            break;
+        if (!b->measuring && t >= measure_start) {
+            b->measuring = 1;
+            sent_start = b->sent;
+            received_start = b->received;
+            cpu_start = cpu_us();
+            measure_start = t;
+        }
+        while (start + rounds * period <= t) {
+            for (i = 0; i < num_sigs; i++) {
+                SETFLOAT(vals, (t_float)seq);
+                b->send_time[seq & (RING_SIZE - 1)] = now_us();
+                pd_typedmess(b->src, names[i], len, vals);
+                seq = (seq + 1) % SEQ_WRAP;
+                ++b->sent;
+            }
+            ++rounds;
+        }
+        t = now_us();
+        pdrt_advance((t - last) * 1e-3);
+        last = t;
+        double next = start + rounds * period - now_us();
+        if (next > 0)
+            usleep(next < 1000 ? (useconds_t)next : 1000);
+    }
+
+    // let the last updates drain
+    for (i = 0; i < 20; i++) {
+        pdrt_advance(1);
+        usleep(1000);
+    }
+
+    double elapsed = (now_us() - measure_start) * 1e-6;
+    double cpu = cpu_us() - cpu_start;
+    long sent = b->sent - sent_start, received = b->received - received_start;
+
+    qsort(b->latency, b->num_latency, sizeof(double), compare_dbl);
+    double p50 = b->num_latency ? b->latency[b->num_latency / 2] : 0;
+    double p99 = b->num_latency ? b->latency[(long)(b->num_latency * 0.99)] : 0;
+
+    printf("signals:             %d\n", num_sigs);
+    printf("length:              %d\n", len);
+    printf("rate (Hz):           %g\n", rate);
+    printf("duration (s):        %g\n", elapsed);
+    printf("sent:                %ld\n", sent);
+    printf("received:            %ld\n", received);
+    printf("lost:                %ld\n", sent > received ? sent - received : 0);
+    printf("throughput (upd/s):  %.1f\n", received / elapsed);
+    printf("latency p50 (us):    %.1f\n", p50);
+    printf("latency p99 (us):    %.1f\n", p99);
+    printf("cpu per update (us): %.3f\n", sent ? cpu / sent : 0);
+
+    pdrt_free(b->src);
+    pdrt_free(b->dst);
+    free(names);
+    free(vals);
+    free(b->latency);
+    free(b);
+    return 0;
+}
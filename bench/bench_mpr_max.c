@@ -0,0 +1,313 @@
+//
+// bench_mpr_max.c
+// benchmark for the Max build of mpr.device, mpr.in and mpr.out: a patcher
+// holding one device and many signal objects is loaded headlessly, each
+// mpr.out is mapped to an mpr.in and driven at a fixed rate
+//
+// This software was written in the Input Devices and Music Interaction
+// Laboratory at McGill University in Montreal, and is copyright those
+// found in the AUTHORS file.  It is licensed under the GNU Lesser Public
+// General License version 2.1 or later.  Please see COPYING for details.
+//
+
+#include "max_runtime.h"
+#include <mapper/mapper.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#define RING_SIZE 65536         // outstanding send times, indexed by sequence
+#define MAX_SAMPLES (1 << 20)   // latency samples kept for percentiles
+#define SEQ_WRAP (1 << 24)      // sequence numbers stay exact as floats
+
+typedef struct _bench
+{
+    t_object *device;
+    char dev_name[256];
+    double send_time[RING_SIZE];
+    double *latency;
+    long num_latency;
+    long sent;
+    long received;
+    int measuring;
+} t_bench;
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+}
+
+static double cpu_us(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e6
+           + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+static size_t heap_bytes(void)
+{
+    return mallinfo2().uordblks;
+}
+
+static int compare_dbl(const void *a, const void *b)
+{
+    double d = *(const double *)a - *(const double *)b;
+    return d < 0 ? -1 : d > 0;
+}
+
+// *********************************************************
+// -(outlet hook)-------------------------------------------
+static void bench_outlet(void *ctx, t_object *owner, int index,
+                         t_symbol *s, int argc, t_atom *argv)
+{
+    t_bench *b = (t_bench *)ctx;
+
+    if (owner == b->device) {
+        // device properties: remember the full device name once ready
+        if (!strcmp(s->s_name, "name") && argc && argv->a_type == A_SYM)
+            snprintf(b->dev_name, 256, "%s", argv->a_w.w_sym->s_name);
+        return;
+    }
+    if (index || !argc || object_classname(owner) != gensym("mpr.in"))
+        return;
+
+    ++b->received;
+    if (b->measuring && b->num_latency < MAX_SAMPLES) {
+        int seq = (int)atom_getfloat(argv);
+        b->latency[b->num_latency++] = now_us() - b->send_time[seq & (RING_SIZE - 1)];
+    }
+}
+
+// *********************************************************
+// -(connect signals)---------------------------------------
+static mpr_sig find_sig(mpr_dev dev, mpr_dir dir, const char *name)
+{
+    mpr_list sigs = mpr_dev_get_sigs(dev, dir);
+    sigs = mpr_list_filter(sigs, MPR_PROP_NAME, NULL, 1, MPR_STR, name, MPR_OP_EQ);
+    return sigs ? (mpr_sig)*sigs : NULL;
+}
+
+static void step(double ms)
+{
+    maxrt_advance(ms);
+    usleep((useconds_t)(ms * 1000));
+}
+
+static int connect_signals(t_bench *b, int num_sigs, double timeout_ms)
+{
+    mpr_graph g = mpr_graph_new(MPR_OBJ);
+    mpr_map *maps = (mpr_map *)calloc(num_sigs, sizeof(mpr_map));
+    mpr_dev dev = NULL;
+    double waited = 0;
+    int i, ready = 0;
+    char name[64];
+
+    // wait for the device and all of its signals to be known
+    for (; waited < timeout_ms; waited += 10) {
+        mpr_graph_poll(g, 0);
+        step(10);
+        if (!*b->dev_name)
+            continue;
+        if (!dev) {
+            mpr_list devs = mpr_graph_get_list(g, MPR_DEV);
+            devs = mpr_list_filter(devs, MPR_PROP_NAME, NULL, 1, MPR_STR,
+                                   b->dev_name, MPR_OP_EQ);
+            dev = devs ? (mpr_dev)*devs : NULL;
+        }
+        if (dev
+            && mpr_list_get_size(mpr_dev_get_sigs(dev, MPR_DIR_OUT)) == num_sigs
+            && mpr_list_get_size(mpr_dev_get_sigs(dev, MPR_DIR_IN)) == num_sigs)
+            break;
+    }
+    if (waited >= timeout_ms) {
+        fprintf(stderr, "timed out waiting for device\n");
+        return 1;
+    }
+
+    for (i = 0; i < num_sigs; i++) {
+        snprintf(name, 64, "sig/out/%d", i);
+        mpr_sig s = find_sig(dev, MPR_DIR_OUT, name);
+        snprintf(name, 64, "sig/in/%d", i);
+        mpr_sig d = find_sig(dev, MPR_DIR_IN, name);
+        if (!s || !d)
+            continue;
+        maps[i] = mpr_map_new(1, &s, 1, &d);
+        mpr_obj_push(maps[i]);
+    }
+
+    for (; waited < timeout_ms && ready < num_sigs; waited += 10) {
+        mpr_graph_poll(g, 0);
+        step(10);
+        for (i = 0, ready = 0; i < num_sigs; i++)
+            ready += maps[i] && mpr_map_get_is_ready(maps[i]);
+    }
+    free(maps);
+    mpr_graph_free(g);
+    if (ready < num_sigs) {
+        fprintf(stderr, "timed out waiting for maps (%d/%d ready)\n", ready, num_sigs);
+        return 1;
+    }
+    return 0;
+}
+
+// *********************************************************
+// -(main)--------------------------------------------------
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-n signals] [-l length] [-r rate] [-d seconds] "
+            "[-w warmup] [-e external dir] [-v]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    const char *dir = ".";
+    int num_sigs = 16, len = 1, opt, verbose = 0, i, j;
+    double rate = 100, duration = 5, warmup = 1;
+    t_bench *b = (t_bench *)calloc(1, sizeof(t_bench));
+    t_object *patcher, **outs;
+    t_symbol *sel;
+    t_atom *vals;
+    char msg[256];
+
+    while ((opt = getopt(argc, argv, "n:l:r:d:w:e:vh")) != -1) {
+        switch (opt) {
+            case 'n': num_sigs = atoi(optarg);      break;
+            case 'l': len = atoi(optarg);           break;
+            case 'r': rate = atof(optarg);          break;
+            case 'd': duration = atof(optarg);      break;
+            case 'w': warmup = atof(optarg);        break;
+            case 'e': dir = optarg;                 break;
+            case 'v': verbose = 1;                  break;
+            default:  usage(argv[0]);               return 1;
+        }
+    }
+    if (num_sigs < 1 || len < 1 || len > 100 || rate <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    maxrt_init(verbose);
+    maxrt_set_outlet_hook(bench_outlet, b);
+    b->latency = (double *)malloc(sizeof(double) * MAX_SAMPLES);
+    outs = (t_object **)calloc(num_sigs, sizeof(t_object *));
+    vals = (t_atom *)malloc(sizeof(t_atom) * len);
+    sel = gensym(len > 1 ? "list" : "float");
+
+    // load the externals
+    double t0 = now_us();
+    const char *externals[] = {"mpr.device.so", "mpr.in.so", "mpr.out.so"};
+    for (i = 0; i < 3; i++) {
+        snprintf(msg, 256, "%s/%s", dir, externals[i]);
+        if (maxrt_load(msg))
+            return 1;
+    }
+    double load_ms = (now_us() - t0) * 1e-3;
+
+    // build the patcher
+    size_t heap = heap_bytes();
+    t0 = now_us();
+    patcher = maxrt_patcher_new(NULL);
+    if (!(b->device = maxrt_new(patcher, "mpr.device bench_max")))
+        return 1;
+    for (i = 0; i < num_sigs; i++) {
+        snprintf(msg, 256, "mpr.in sig/in/%d f %d", i, len);
+        if (!maxrt_new(patcher, msg))
+            return 1;
+        snprintf(msg, 256, "mpr.out sig/out/%d f %d", i, len);
+        if (!(outs[i] = maxrt_new(patcher, msg)))
+            return 1;
+    }
+    maxrt_loadbang(patcher);
+    double create_ms = (now_us() - t0) * 1e-3;
+    double create_kb = ((double)heap_bytes() - (double)heap) / 1024.;
+
+    if (connect_signals(b, num_sigs, 10000))
+        return 1;
+
+    // drive all signals at the requested rate, polling between rounds
+    double period = 1e6 / rate, start = now_us(), last = start, cpu_start = 0;
+    double stop = start + (warmup + duration) * 1e6, measure_start = start + warmup * 1e6;
+    double send_us = 0;
+    long rounds = 0, sent_start = 0, received_start = 0, seq = 0;
+
+    for (j = 0; j < len; j++)
+        atom_setfloat(vals + j, 0);
+
+    while (1) {
+        double t = now_us();
+        if (t >= stop)
+            break;
+        if (!b->measuring && t >= measure_start) {
+            b->measuring = 1;
+            sent_start = b->sent;
+            received_start = b->received;
+            cpu_start = cpu_us();
+            measure_start = t;
+        }
+        while (start + rounds * period <= t) {
+            double round_start = now_us();
+            for (i = 0; i < num_sigs; i++) {
+                atom_setfloat(vals, (double)seq);
+                b->send_time[seq & (RING_SIZE - 1)] = now_us();
+                typedmess(outs[i], sel, len, vals);
+                seq = (seq + 1) % SEQ_WRAP;
+                ++b->sent;
+            }
+            if (b->measuring)
+                send_us += now_us() - round_start;
+            ++rounds;
+        }
+        t = now_us();
+        maxrt_advance((t - last) * 1e-3);
+        last = t;
+        double next = start + rounds * period - now_us();
+        if (next > 0)
+            usleep(next < 1000 ? (useconds_t)next : 1000);
+    }
+
+    // let the last updates drain
+    for (i = 0; i < 20; i++)
+        step(1);
+
+    double elapsed = (now_us() - measure_start) * 1e-6;
+    double cpu = cpu_us() - cpu_start;
+    long sent = b->sent - sent_start, received = b->received - received_start;
+
+    t0 = now_us();
+    maxrt_patcher_free(patcher);
+    double free_ms = (now_us() - t0) * 1e-3;
+
+    qsort(b->latency, b->num_latency, sizeof(double), compare_dbl);
+    double p50 = b->num_latency ? b->latency[b->num_latency / 2] : 0;
+    double p99 = b->num_latency ? b->latency[(long)(b->num_latency * 0.99)] : 0;
+
+    printf("signals:              %d in, %d out\n", num_sigs, num_sigs);
+    printf("length:               %d\n", len);
+    printf("rate (Hz):            %g\n", rate);
+    printf("load externals (ms):  %.3f\n", load_ms);
+    printf("create patcher (ms):  %.3f\n", create_ms);
+    printf("heap per object (KB): %.2f\n", create_kb / (2 * num_sigs + 1));
+    printf("duration (s):         %g\n", elapsed);
+    printf("sent:                 %ld\n", sent);
+    printf("received:             %ld\n", received);
+    printf("lost:                 %ld\n", sent > received ? sent - received : 0);
+    printf("throughput (upd/s):   %.1f\n", received / elapsed);
+    printf("send path (us/upd):   %.3f\n", sent ? send_us / sent : 0);
+    printf("latency p50 (us):     %.1f\n", p50);
+    printf("latency p99 (us):     %.1f\n", p99);
+    printf("cpu per update (us):  %.3f\n", sent ? cpu / sent : 0);
+    printf("free patcher (ms):    %.3f\n", free_ms);
+
+    free(outs);
+    free(vals);
+    free(b->latency);
+    free(b);
+    return 0;
+}
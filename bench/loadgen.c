@@ -0,0 +1,446 @@
+//
+// loadgen.c
+// a standalone libmapper device that drives N outputs with ramps, noise or
+// bursts at a target aggregate rate, for finding the throughput limit of a
+// receiving `mapper` or `mpr.device` on the same host
+//
+// Updates are scheduled from absolute timer deadlines, so a late tick is
+// caught up on the next one rather than lowering the rate; the backlog is
+// capped at one second of updates, beyond which updates are skipped and
+// counted. Achieved versus requested rate is reported once a second.
+//
+// This software was written in the Input Devices and Music Interaction
+// Laboratory at McGill University in Montreal, and is copyright those
+// found in the AUTHORS file.  It is licensed under the GNU Lesser Public
+// General License version 2.1 or later.  Please see COPYING for details.
+//
+
+#include <mapper/mapper.h>
+#include "../common/capture.h"
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#define MAX_SIGS 4096
+#define MAX_LEN 1024
+#define MAX_INST 1024
+
+typedef enum _pattern
+{
+    PATTERN_RAMP,
+    PATTERN_NOISE,
+    PATTERN_BURST
+} t_pattern;
+
+typedef struct _loadgen
+{
+    mpr_dev dev;
+    mpr_sig *sigs;
+    int num_sigs;
+    int len;
+    int num_inst;
+    mpr_type type;
+    t_pattern pattern;
+    double rate;            // requested updates per second, all signals
+    double burst_ms;
+    double *phase;          // ramp position per signal and instance
+    void *value;
+    uint32_t noise;
+    int next_sig;           // round-robin position
+    int next_inst;
+    t_capture *capture;
+} t_loadgen;
+
+typedef struct _stats
+{
+    long sent;
+    long skipped;
+    long ticks;
+    long late;              // ticks that woke more than one period late
+    double max_lag;         // ms
+} t_stats;
+
+static volatile sig_atomic_t done = 0;
+
+static void accumulate(t_stats *total, t_stats *interval)
+{
+    total->sent += interval->sent;
+    total->skipped += interval->skipped;
+    total->ticks += interval->ticks;
+    total->late += interval->late;
+    if (interval->max_lag > total->max_lag)
+        total->max_lag = interval->max_lag;
+    memset(interval, 0, sizeof(t_stats));
+}
+
+static void stop(int sig)
+{
+    done = 1;
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double cpu_s(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec
+        + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-6;
+}
+
+static void sleep_until(double t)
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t)t;
+    ts.tv_nsec = (long)((t - ts.tv_sec) * 1e9);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) && !done)
+        ;
+}
+
+// *********************************************************
+// -(patterns)----------------------------------------------
+static double noise(t_loadgen *g)
+{
+    // xorshift32, cheap enough not to distort the measured rate
+    g->noise ^= g->noise << 13;
+    g->noise ^= g->noise >> 17;
+    g->noise ^= g->noise << 5;
+    return g->noise * (1. / 4294967296.);
+}
+
+static void fill_value(t_loadgen *g, int sig, int inst)
+{
+    double *phase = &g->phase[sig * g->num_inst + inst], v;
+    int i;
+
+    if (PATTERN_NOISE != g->pattern) {
+        *phase += 0.01;
+        if (*phase >= 1)
+            *phase -= 1;
+    }
+    for (i = 0; i < g->len; i++) {
+        if (PATTERN_NOISE == g->pattern)
+            v = noise(g);
+        else {
+            v = *phase + (double)i / g->len;
+            v -= floor(v);
+        }
+        switch (g->type) {
+            case MPR_INT32: ((int *)g->value)[i] = (int)(v * 1000);   break;
+            case MPR_DBL:   ((double *)g->value)[i] = v;              break;
+            default:        ((float *)g->value)[i] = (float)v;        break;
+        }
+    }
+}
+
+// updates due by elapsed seconds; bursts send each period's share at its start
+static double due(t_loadgen *g, double elapsed)
+{
+    if (PATTERN_BURST == g->pattern) {
+        double period = g->burst_ms * 0.001;
+        return g->rate * period * (floor(elapsed / period) + 1);
+    }
+    return g->rate * elapsed;
+}
+
+static void send_one(t_loadgen *g)
+{
+    mpr_sig sig = g->sigs[g->next_sig];
+
+    fill_value(g, g->next_sig, g->next_inst);
+    mpr_sig_set_value(sig, g->next_inst, g->len, g->type, g->value);
+    if (g->capture)
+        capture_update(g->capture, MPR_DIR_OUT, sig, g->next_inst, g->len,
+                       g->type, g->value, MPR_NOW);
+    if (++g->next_sig >= g->num_sigs) {
+        g->next_sig = 0;
+        if (++g->next_inst >= g->num_inst)
+            g->next_inst = 0;
+    }
+}
+
+// *********************************************************
+// -(mapping)-----------------------------------------------
+// match a device by its full name or by the name it was created with,
+// e.g. "mapper" matches "mapper.1"
+static mpr_dev find_dev(mpr_graph graph, const char *name)
+{
+    mpr_list devs = mpr_graph_get_list(graph, MPR_DEV);
+    size_t len = strlen(name);
+
+    while (devs) {
+        mpr_dev dev = (mpr_dev)*devs;
+        const char *dev_name = mpr_obj_get_prop_as_str(dev, MPR_PROP_NAME, NULL);
+        devs = mpr_list_get_next(devs);
+        if (!dev_name || strncmp(dev_name, name, len)
+            || (dev_name[len] && ('.' != dev_name[len] || strchr(name, '.'))))
+            continue;
+        mpr_list_free(devs);
+        return dev;
+    }
+    return NULL;
+}
+
+static mpr_sig find_sig(mpr_dev dev, const char *name)
+{
+    mpr_list sigs = mpr_dev_get_sigs(dev, MPR_DIR_IN);
+    mpr_sig sig = NULL;
+    sigs = mpr_list_filter(sigs, MPR_PROP_NAME, NULL, 1, MPR_STR, name, MPR_OP_EQ);
+    if (sigs) {
+        sig = (mpr_sig)*sigs;
+        mpr_list_free(sigs);
+    }
+    return sig;
+}
+
+// "device" maps each output to the input of the same name on that device,
+// "device/signal" maps every output to that one input
+static int map_outputs(t_loadgen *g, const char *dest, double timeout_ms)
+{
+    mpr_graph graph = mpr_obj_get_graph(g->dev);
+    mpr_map *maps = (mpr_map *)calloc(g->num_sigs, sizeof(mpr_map));
+    char dev_name[256], *sig_name;
+    mpr_dev dst = NULL;
+    double waited = 0;
+    int i, found = 0, mapped = 0, ready = 0;
+
+    snprintf(dev_name, 256, "%s", dest);
+    if ((sig_name = strchr(dev_name, '/')))
+        *sig_name++ = 0;
+
+    while (waited < timeout_ms && !done && (!dst || found < g->num_sigs)) {
+        mpr_dev_poll(g->dev, 10);
+        waited += 10;
+        if (!dst && (dst = find_dev(graph, dev_name)))
+            mpr_graph_subscribe(graph, dst, MPR_SIG, -1);
+        if (!dst)
+            continue;
+        for (i = 0, found = 0; i < g->num_sigs; i++) {
+            const char *name = sig_name ? sig_name
+                : mpr_obj_get_prop_as_str(g->sigs[i], MPR_PROP_NAME, NULL);
+            found += NULL != find_sig(dst, name);
+        }
+    }
+    if (!dst) {
+        fprintf(stderr, "device '%s' not found\n", dev_name);
+        free(maps);
+        return 1;
+    }
+
+    for (i = 0; i < g->num_sigs; i++) {
+        const char *name = sig_name ? sig_name
+            : mpr_obj_get_prop_as_str(g->sigs[i], MPR_PROP_NAME, NULL);
+        mpr_sig d = find_sig(dst, name);
+        if (!d) {
+            fprintf(stderr, "no input '%s' on '%s'\n", name,
+                    mpr_obj_get_prop_as_str(dst, MPR_PROP_NAME, NULL));
+            continue;
+        }
+        maps[i] = mpr_map_new(1, &g->sigs[i], 1, &d);
+        mpr_obj_push(maps[i]);
+        ++mapped;
+    }
+
+    while (waited < timeout_ms && !done && ready < mapped) {
+        mpr_dev_poll(g->dev, 10);
+        waited += 10;
+        for (i = 0, ready = 0; i < g->num_sigs; i++)
+            ready += maps[i] && mpr_map_get_is_ready(maps[i]);
+    }
+    free(maps);
+    if (!mapped || ready < mapped) {
+        fprintf(stderr, "%d/%d maps ready\n", ready, g->num_sigs);
+        return 1;
+    }
+    printf("mapped %d outputs to %s\n", mapped,
+           mpr_obj_get_prop_as_str(dst, MPR_PROP_NAME, NULL));
+    return 0;
+}
+
+// *********************************************************
+// -(main)--------------------------------------------------
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-n signals] [-T f|i|d] [-l length] [-i instances] "
+            "[-r updates/s] [-d seconds] [-P ramp|noise|burst] [-b burst ms] "
+            "[-t tick Hz] [-m device[/signal]] [-N name] [-w capture file]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    const char *name = "loadgen", *dest = NULL, *capture_path = NULL;
+    double duration = 10, tick_hz = 1000, start, next_report, deadline, cpu;
+    t_loadgen *g = (t_loadgen *)calloc(1, sizeof(t_loadgen));
+    t_stats total, interval;
+    long issued = 0;              // updates sent or skipped
+    int opt, i, ret = 0;
+    char sig_name[64];
+
+    g->num_sigs = 8;
+    g->len = 1;
+    g->num_inst = 1;
+    g->type = MPR_FLT;
+    g->rate = 10000;
+    g->burst_ms = 100;
+    g->noise = 2463534242u;
+    while ((opt = getopt(argc, argv, "n:T:l:i:r:d:P:b:t:m:N:w:h")) != -1) {
+        switch (opt) {
+            case 'n': g->num_sigs = atoi(optarg);       break;
+            case 'l': g->len = atoi(optarg);            break;
+            case 'i': g->num_inst = atoi(optarg);       break;
+            case 'r': g->rate = atof(optarg);           break;
+            case 'd': duration = atof(optarg);          break;
+            case 'b': g->burst_ms = atof(optarg);       break;
+            case 't': tick_hz = atof(optarg);           break;
+            case 'm': dest = optarg;                    break;
+            case 'N': name = optarg;                    break;
+            case 'w': capture_path = optarg;            break;
+            case 'T':
+                switch (optarg[0]) {
+                    case 'i': g->type = MPR_INT32;      break;
+                    case 'd': g->type = MPR_DBL;        break;
+                    case 'f': g->type = MPR_FLT;        break;
+                    default:  usage(argv[0]);           return 1;
+                }
+                break;
+            case 'P':
+                if (!strcmp(optarg, "ramp"))
+                    g->pattern = PATTERN_RAMP;
+                else if (!strcmp(optarg, "noise"))
+                    g->pattern = PATTERN_NOISE;
+                else if (!strcmp(optarg, "burst"))
+                    g->pattern = PATTERN_BURST;
+                else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:  usage(argv[0]);                   return 1;
+        }
+    }
+    if (g->num_sigs < 1 || g->num_sigs > MAX_SIGS || g->len < 1 || g->len > MAX_LEN
+        || g->num_inst < 1 || g->num_inst > MAX_INST || g->rate <= 0 || duration <= 0
+        || tick_hz <= 0 || g->burst_ms <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    g->sigs = (mpr_sig *)calloc(g->num_sigs, sizeof(mpr_sig));
+    g->phase = (double *)calloc(g->num_sigs * g->num_inst, sizeof(double));
+    g->value = calloc(g->len, sizeof(double));
+    g->dev = mpr_dev_new(name, NULL);
+    for (i = 0; i < g->num_sigs; i++) {
+        snprintf(sig_name, 64, "load/%d", i);
+        g->sigs[i] = mpr_sig_new(g->dev, MPR_DIR_OUT, sig_name, g->len, g->type, NULL,
+                                 NULL, NULL, g->num_inst > 1 ? &g->num_inst : NULL,
+                                 NULL, 0);
+        // spread the ramps so the signals are distinguishable
+        g->phase[i * g->num_inst] = (double)i / g->num_sigs;
+    }
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    while (!done && !mpr_dev_get_is_ready(g->dev))
+        mpr_dev_poll(g->dev, 25);
+    printf("%s: %d outputs, length %d, %d instance%s, %.0f updates/s\n",
+           mpr_obj_get_prop_as_str(g->dev, MPR_PROP_NAME, NULL), g->num_sigs, g->len,
+           g->num_inst, g->num_inst > 1 ? "s" : "", g->rate);
+    fflush(stdout);
+    if (dest && map_outputs(g, dest, 5000)) {
+        ret = 1;
+        goto out;
+    }
+
+    if (capture_path) {
+        if (!(g->capture = capture_open(capture_path)))
+            perror(capture_path);
+        for (i = 0; g->capture && i < g->num_sigs; i++)
+            capture_sig(g->capture, g->sigs[i]);
+    }
+
+    memset(&total, 0, sizeof(t_stats));
+    memset(&interval, 0, sizeof(t_stats));
+    cpu = cpu_s();
+    start = now_s();
+    next_report = start + 1;
+    deadline = start;
+    while (!done) {
+        double now, elapsed, lag, target;
+
+        deadline += 1. / tick_hz;
+        sleep_until(deadline);
+        now = now_s();
+        elapsed = now - start;
+        if (elapsed >= duration)
+            break;
+
+        if (now >= next_report) {
+            printf("%6.1f s  requested %9.0f/s  sent %9.0f/s  late ticks %4ld/%ld  "
+                   "max lag %7.3f ms", elapsed, g->rate,
+                   interval.sent / (now - next_report + 1), interval.late,
+                   interval.ticks, interval.max_lag);
+            if (interval.skipped)
+                printf("  skipped %ld", interval.skipped);
+            printf("\n");
+            fflush(stdout);
+            accumulate(&total, &interval);
+            next_report += 1;
+        }
+
+        lag = (now - deadline) * 1000;
+        ++interval.ticks;
+        if (lag > 1000. / tick_hz)
+            ++interval.late;
+        if (lag > interval.max_lag)
+            interval.max_lag = lag;
+
+        // the backlog is capped at one second of updates
+        target = due(g, elapsed);
+        if (target - issued > g->rate) {
+            interval.skipped += (long)(target - g->rate) - issued;
+            issued = (long)(target - g->rate);
+        }
+        for (; issued < (long)target; issued++) {
+            send_one(g);
+            ++interval.sent;
+        }
+        mpr_dev_update_maps(g->dev);
+        mpr_dev_poll(g->dev, 0);
+    }
+    accumulate(&total, &interval);
+
+    {
+        double elapsed = now_s() - start;
+        printf("requested %.0f/s, achieved %.0f/s (%.1f%%) over %.2f s: %ld updates, "
+               "%ld skipped, %ld/%ld late ticks, max lag %.3f ms, cpu %.1f%%\n",
+               g->rate, total.sent / elapsed, total.sent / elapsed / g->rate * 100,
+               elapsed, total.sent, total.skipped, total.late, total.ticks,
+               total.max_lag, (cpu_s() - cpu) / elapsed * 100);
+    }
+
+    if (g->capture) {
+        uint32_t dropped, records = capture_close(g->capture, &dropped);
+        printf("captured %u records to %s", records, capture_path);
+        if (dropped)
+            printf(", %u dropped", dropped);
+        printf("\n");
+    }
+
+out:
+    mpr_dev_free(g->dev);
+    free(g->value);
+    free(g->phase);
+    free(g->sigs);
+    free(g);
+    return ret;
+}
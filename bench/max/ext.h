@@ -0,0 +1,202 @@
+//
+// ext.h
+// stand-in for the subset of the Max SDK used by the mpr.* objects, so that
+// they can be compiled and driven headlessly on Linux by bench/max_runtime.c
+//
+// This software was written in the Input Devices and Music Interaction
+// Laboratory at McGill University in Montreal, and is copyright those
+// found in the AUTHORS file.  It is licensed under the GNU Lesser Public
+// General License version 2.1 or later.  Please see COPYING for details.
+//
+
+#ifndef _EXT_H_
+#define _EXT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef intptr_t t_ptr_int;
+typedef long t_atom_long;
+typedef double t_atom_float;
+typedef long t_max_err;
+typedef void *(*method)(void *, ...);
+
+typedef struct object t_object;
+typedef struct _class t_class;
+typedef struct _hashtab t_hashtab;
+typedef struct _atomarray t_atomarray;
+typedef struct _dictionary t_dictionary;
+
+typedef struct symbol
+{
+    char *s_name;
+    t_object *s_thing;
+} t_symbol;
+
+// the first four fields mirror the SDK; the rest is stand-in bookkeeping
+struct object
+{
+    t_class *o_messlist;
+    t_ptr_int o_magic;
+    void *o_inlet;
+    struct _outlet *o_outlet;
+    struct _obex_entry *o_obex;
+    struct _client *o_clients;
+    t_symbol *o_name;
+    t_object *o_patcher;
+    t_object *o_nextbox;
+};
+
+typedef union word
+{
+    t_atom_long w_long;
+    t_atom_float w_float;
+    t_symbol *w_sym;
+    t_object *w_obj;
+} t_word;
+
+typedef struct atom
+{
+    short a_type;
+    union word a_w;
+} t_atom;
+
+enum {
+    A_NOTHING = 0, A_LONG, A_FLOAT, A_SYM, A_OBJ, A_DEFLONG, A_DEFFLOAT,
+    A_DEFSYM, A_GIMME, A_CANT, A_SEMI, A_COMMA, A_DOLLAR, A_DOLLSYM, A_GIMMEBACK
+};
+
+enum {
+    MAX_ERR_NONE = 0, MAX_ERR_GENERIC = -1, MAX_ERR_INVALID_PTR = -2
+};
+
+typedef struct _hashtab_entry
+{
+    t_symbol *key;
+    t_object *value;
+    long flags;
+    struct _hashtab_entry *next;
+} t_hashtab_entry;
+
+#define CLASS_BOX                   gensym("box")
+#define CLASS_NOBOX                 gensym("nobox")
+#define OBJ_FLAG_REF                1
+#define ASSIST_INLET                1
+#define ASSIST_OUTLET               2
+#define PI_DEEP                     2
+#define ATTR_GET_OPAQUE_USER        0x00000100
+#define ATTR_SET_OPAQUE_USER        0x00000200
+#define MAX_PATH_CHARS              2048
+
+#define calcoffset(x, y)            ((long)offsetof(x, y))
+
+#define CLASS_ATTR_SYM(c, attrname, flags, structname, structmember) \
+    class_addattr((c), attr_offset_new(attrname, gensym("symbol"), (flags), \
+                  NULL, NULL, calcoffset(structname, structmember)))
+#define CLASS_ATTR_LONG(c, attrname, flags, structname, structmember) \
+    class_addattr((c), attr_offset_new(attrname, gensym("long"), (flags), \
+                  NULL, NULL, calcoffset(structname, structmember)))
+#define CLASS_ATTR_CHAR(c, attrname, flags, structname, structmember) \
+    class_addattr((c), attr_offset_new(attrname, gensym("char"), (flags), \
+                  NULL, NULL, calcoffset(structname, structmember)))
+#define CLASS_ATTR_FLOAT(c, attrname, flags, structname, structmember) \
+    class_addattr((c), attr_offset_new(attrname, gensym("float32"), (flags), \
+                  NULL, NULL, calcoffset(structname, structmember)))
+#define CLASS_ATTR_OBJ(c, attrname, flags, structname, structmember) \
+    class_addattr((c), attr_offset_new(attrname, gensym("object"), (flags), \
+                  NULL, NULL, calcoffset(structname, structmember)))
+#define CLASS_ATTR_ACCESSORS(c, attrname, getter, setter) \
+    class_attr_accessors((c), attrname, (method)(getter), (method)(setter))
+#define CLASS_ATTR_LABEL(c, attrname, flags, labelstr)
+
+// symbols
+t_symbol *gensym(const char *s);
+t_symbol *symbol_unique(void);
+
+// printing
+void post(const char *fmt, ...);
+void object_post(t_object *x, const char *fmt, ...);
+void object_error(t_object *x, const char *fmt, ...);
+
+// classes and objects
+t_class *class_new(const char *name, method mnew, method mfree, long size,
+                   method mmenu, short type, ...);
+t_max_err class_addmethod(t_class *c, method m, const char *name, ...);
+t_max_err class_register(t_symbol *name_space, t_class *c);
+t_object *attr_offset_new(const char *name, t_symbol *type, long flags,
+                          method mget, method mset, long offset);
+t_max_err class_addattr(t_class *c, t_object *attr);
+t_max_err class_attr_accessors(t_class *c, const char *attrname, method mget,
+                               method mset);
+void *object_alloc(t_class *c);
+t_max_err object_free(void *x);
+void *object_method(void *x, t_symbol *s, ...);
+void *typedmess(t_object *x, t_symbol *s, short argc, t_atom *argv);
+method zgetfn(t_object *x, t_symbol *s);
+t_symbol *object_classname(void *x);
+void *object_register(t_symbol *name_space, t_symbol *s, void *x);
+t_max_err object_unregister(void *x);
+void *object_attach_byptr(void *x, void *registeredobject);
+void *object_attach_byptr_register(void *x, void *object_to_attach,
+                                   t_symbol *reg_name_space);
+t_max_err object_detach_byptr(void *x, void *registeredobject);
+t_max_err object_notify(void *x, t_symbol *s, void *data);
+
+// attributes
+t_max_err object_attr_setvalueof(void *x, t_symbol *s, long argc, t_atom *argv);
+t_symbol *object_attr_getsym(void *x, t_symbol *s);
+char object_attr_getchar(void *x, t_symbol *s);
+t_atom_long object_attr_getlong(void *x, t_symbol *s);
+t_max_err object_attr_setlong(void *x, t_symbol *s, t_atom_long c);
+
+// outlets
+void *listout(void *x);
+void *outlet_new(void *x, const char *s);
+void *outlet_bang(void *o);
+void *outlet_int(void *o, t_atom_long n);
+void *outlet_float(void *o, double f);
+void *outlet_list(void *o, t_symbol *s, short ac, t_atom *av);
+void *outlet_anything(void *o, t_symbol *s, short ac, t_atom *av);
+
+// scheduling
+void *clock_new(void *obj, method fn);
+void clock_delay(void *x, long n);
+void clock_fdelay(void *x, double time);
+void clock_unset(void *x);
+void clock_free(void *x);
+void *defer_low(void *ob, method fn, t_symbol *sym, short argc, t_atom *argv);
+void *defer(void *ob, method fn, t_symbol *sym, short argc, t_atom *argv);
+
+// atoms
+t_max_err atom_setlong(t_atom *a, t_atom_long b);
+t_max_err atom_setfloat(t_atom *a, double b);
+t_max_err atom_setsym(t_atom *a, t_symbol *b);
+t_max_err atom_setobj(t_atom *a, void *b);
+t_atom_long atom_getlong(const t_atom *a);
+t_atom_float atom_getfloat(const t_atom *a);
+t_symbol *atom_getsym(const t_atom *a);
+void *atom_getobj(const t_atom *a);
+t_max_err atom_alloc(long *ac, t_atom **av, char *alloc);
+
+t_atomarray *atomarray_new(long ac, t_atom *av);
+t_max_err atomarray_getatoms(t_atomarray *x, long *ac, t_atom **av);
+void atomarray_appendatoms(t_atomarray *x, long ac, t_atom *av);
+
+// memory
+void *sysmem_newptr(long size);
+void *sysmem_newptrclear(long size);
+void *sysmem_resizeptr(void *ptr, long newsize);
+void sysmem_freeptr(void *ptr);
+
+// hashtab
+t_hashtab *hashtab_new(long slotcount);
+t_max_err hashtab_store(t_hashtab *x, t_symbol *key, t_object *val);
+t_max_err hashtab_storeflags(t_hashtab *x, t_symbol *key, t_object *val, long flags);
+t_max_err hashtab_lookup(t_hashtab *x, t_symbol *key, t_object **val);
+t_max_err hashtab_chuckkey(t_hashtab *x, t_symbol *key);
+t_max_err hashtab_chuck(t_hashtab *x);
+t_max_err hashtab_funall(t_hashtab *x, method fun, void *arg);
+t_max_err hashtab_methodall(t_hashtab *x, t_symbol *s, ...);
+t_atom_long hashtab_getsize(t_hashtab *x);
+
+#endif // _EXT_H_
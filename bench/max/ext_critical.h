@@ -0,0 +1,14 @@
+//
+// ext_critical.h
+// stand-in for the Max SDK critical region API, see ext.h
+//
+
+#ifndef _EXT_CRITICAL_H_
+#define _EXT_CRITICAL_H_
+
+typedef void *t_critical;
+
+void critical_enter(t_critical x);
+void critical_exit(t_critical x);
+
+#endif // _EXT_CRITICAL_H_
@@ -0,0 +1,14 @@
+//
+// ext_obex.h
+// stand-in for the Max SDK object extension API, see ext.h
+//
+
+#ifndef _EXT_OBEX_H_
+#define _EXT_OBEX_H_
+
+#include "ext.h"
+
+t_max_err object_obex_lookup(void *x, t_symbol *key, t_object **val);
+t_max_err object_obex_store(void *x, t_symbol *key, t_object *val);
+
+#endif // _EXT_OBEX_H_
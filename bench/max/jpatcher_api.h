@@ -0,0 +1,13 @@
+//
+// jpatcher_api.h
+// stand-in for the Max SDK patcher API, see ext.h
+//
+
+#ifndef _JPATCHER_API_H_
+#define _JPATCHER_API_H_
+
+#include "ext.h"
+
+t_object *jpatcher_get_parentpatcher(t_object *p);
+
+#endif // _JPATCHER_API_H_
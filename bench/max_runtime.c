@@ -0,0 +1,1265 @@
+//
+// max_runtime.c
+// a minimal headless stand-in for the Max runtime
+//
+// This software was written in the Input Devices and Music Interaction
+// Laboratory at McGill University in Montreal, and is copyright those
+// found in the AUTHORS file.  It is licensed under the GNU Lesser Public
+// General License version 2.1 or later.  Please see COPYING for details.
+//
+
+#include "max_runtime.h"
+#include "ext_obex.h"
+#include "ext_critical.h"
+#include "jpatcher_api.h"
+#ifdef ALLOC_COUNT
+#include "alloc_count.h"
+#endif
+#include <dlfcn.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// like the SDK itself, this file stores every callback as a generic method
+#pragma GCC diagnostic ignored "-Wcast-function-type"
+
+#define SYMTAB_SIZE 4096
+#define MAX_CLASSES 64
+#define MAX_ARGS 256
+#define DEFAULT_SLOTS 59
+#define MAGIC 1758379419L
+
+typedef void (*t_gimmefn)(void *x, t_symbol *s, long argc, t_atom *argv);
+typedef void *(*t_gimmenew)(t_symbol *s, long argc, t_atom *argv);
+typedef void (*t_freefn)(void *x);
+typedef t_max_err (*t_attr_getfn)(void *x, void *attr, long *argc, t_atom **argv);
+typedef t_max_err (*t_attr_setfn)(void *x, void *attr, long argc, t_atom *argv);
+typedef long (*t_iteratefn)(void *arg, t_object *obj);
+typedef void (*t_funallfn)(t_hashtab_entry *e, void *arg);
+typedef void (*t_deferfn)(void *ob, t_symbol *s, short argc, t_atom *argv);
+
+// *********************************************************
+// -(runtime structures)------------------------------------
+typedef struct _methodentry
+{
+    t_symbol *sel;
+    method fn;
+    short type;         // type of the first argument
+} t_methodentry;
+
+typedef struct _attr
+{
+    t_object ob;
+    t_symbol *name;
+    t_symbol *type;
+    long flags;
+    method get;
+    method set;
+    long offset;
+} t_attr;
+
+struct _class
+{
+    t_symbol *c_sym;
+    method c_new;
+    method c_free;
+    long c_size;
+    t_methodentry *methods;
+    int num_methods;
+    t_attr **attrs;
+    int num_attrs;
+};
+
+typedef struct _outlet
+{
+    t_object *owner;
+    struct _outlet *next;
+} t_outlet;
+
+typedef struct _obex_entry
+{
+    t_symbol *key;
+    t_object *value;
+    struct _obex_entry *next;
+} t_obex_entry;
+
+typedef struct _client
+{
+    t_object *obj;
+    struct _client *next;
+} t_client;
+
+typedef struct _patcher
+{
+    t_object ob;
+    t_object *boxes;
+} t_patcher;
+
+struct _hashtab
+{
+    t_object ob;
+    long slotcount;
+    long size;
+    t_hashtab_entry **slots;
+};
+
+struct _atomarray
+{
+    t_object ob;
+    long ac;
+    t_atom *av;
+};
+
+typedef struct _clock
+{
+    void *owner;
+    method fn;
+    double settime;     // < 0 when unset
+    struct _clock *next;
+} t_clock;
+
+typedef struct _deferred
+{
+    void *ob;
+    method fn;
+    t_symbol *s;
+    short argc;
+    t_atom *argv;
+    struct _deferred *next;
+} t_deferred;
+
+static t_symbol *symtab[SYMTAB_SIZE];
+static t_class *classes[MAX_CLASSES];
+static int num_classes = 0;
+static t_class *patcher_class, *hashtab_class, *atomarray_class, *attr_class;
+static t_clock *clocks = NULL;
+static t_deferred *deferred = NULL, **deferred_tail = &deferred;
+static double logical_time = 0;
+static long unique_count = 0;
+static int post_verbose = 0;
+static maxrt_outlet_fn outlet_hook = NULL;
+
+// symbols used while messages are passed, looked up once in maxrt_init()
+static t_symbol *ps_bang, *ps_int, *ps_float, *ps_list, *ps_anything, *ps_notify,
+    *ps_free, *ps_empty, *ps_patcher, *ps_entry_new, *ps_entry_free, *ps_symbol,
+    *ps_long, *ps_char, *ps_float32, *ps_object;
+static void *outlet_hook_ctx = NULL;
+
+// *********************************************************
+// -(symbols)-----------------------------------------------
+t_symbol *gensym(const char *s)
+{
+    unsigned int hash = 5381;
+    const char *c;
+    t_symbol **sym;
+
+#ifdef ALLOC_COUNT
+    alloc_count_gensym();
+#endif
+    for (c = s; *c; c++)
+        hash = hash * 33 + (unsigned char)*c;
+    hash &= (SYMTAB_SIZE - 1);
+
+    // symbols are chained through a hidden link after the public struct
+    for (sym = &symtab[hash]; *sym; sym = (t_symbol **)(*sym + 1)) {
+        if (strcmp((*sym)->s_name, s) == 0)
+            return *sym;
+    }
+    *sym = (t_symbol *)calloc(1, sizeof(t_symbol) + sizeof(t_symbol *));
+    (*sym)->s_name = strdup(s);
+    return *sym;
+}
+
+t_symbol *symbol_unique(void)
+{
+    char name[32];
+    snprintf(name, 32, "u%09ld", ++unique_count);
+    return gensym(name);
+}
+
+// *********************************************************
+// -(printing)----------------------------------------------
+void post(const char *fmt, ...)
+{
+    va_list args;
+    if (!post_verbose)
+        return;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
+
+void object_post(t_object *x, const char *fmt, ...)
+{
+    va_list args;
+    if (!post_verbose)
+        return;
+    fprintf(stderr, "%s: ", x ? object_classname(x)->s_name : "");
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
+
+void object_error(t_object *x, const char *fmt, ...)
+{
+    va_list args;
+    fprintf(stderr, "%s: ", x ? object_classname(x)->s_name : "");
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
+
+// *********************************************************
+// -(memory)------------------------------------------------
+void *sysmem_newptr(long size)
+{
+    return malloc(size);
+}
+
+void *sysmem_newptrclear(long size)
+{
+    return calloc(1, size);
+}
+
+void *sysmem_resizeptr(void *ptr, long newsize)
+{
+    return realloc(ptr, newsize);
+}
+
+void sysmem_freeptr(void *ptr)
+{
+    free(ptr);
+}
+
+// *********************************************************
+// -(classes)-----------------------------------------------
+t_class *class_new(const char *name, method mnew, method mfree, long size,
+                   method mmenu, short type, ...)
+{
+    t_class *c = (t_class *)calloc(1, sizeof(t_class));
+    c->c_sym = gensym(name);
+    c->c_new = mnew;
+    c->c_free = mfree;
+    c->c_size = size;
+    return c;
+}
+
+t_max_err class_addmethod(t_class *c, method m, const char *name, ...)
+{
+    va_list args;
+    t_methodentry *entry;
+
+    c->methods = (t_methodentry *)realloc(c->methods, sizeof(t_methodentry)
+                                          * (c->num_methods + 1));
+    entry = &c->methods[c->num_methods++];
+    entry->sel = gensym(name);
+    entry->fn = m;
+    va_start(args, name);
+    entry->type = (short)va_arg(args, int);
+    va_end(args);
+    return MAX_ERR_NONE;
+}
+
+t_max_err class_register(t_symbol *name_space, t_class *c)
+{
+    if (num_classes >= MAX_CLASSES)
+        return MAX_ERR_GENERIC;
+    classes[num_classes++] = c;
+    return MAX_ERR_NONE;
+}
+
+static t_class *class_find(t_symbol *name)
+{
+    int i;
+    for (i = 0; i < num_classes; i++) {
+        if (classes[i]->c_sym == name)
+            return classes[i];
+    }
+    return NULL;
+}
+
+static t_methodentry *class_findmethod(t_class *c, t_symbol *s)
+{
+    int i;
+    for (i = 0; i < c->num_methods; i++) {
+        if (c->methods[i].sel == s)
+            return &c->methods[i];
+    }
+    return NULL;
+}
+
+// *********************************************************
+// -(attributes)--------------------------------------------
+t_object *attr_offset_new(const char *name, t_symbol *type, long flags,
+                          method mget, method mset, long offset)
+{
+    t_attr *attr = (t_attr *)object_alloc(attr_class);
+    attr->name = gensym(name);
+    attr->type = type;
+    attr->flags = flags;
+    attr->get = mget;
+    attr->set = mset;
+    attr->offset = offset;
+    return (t_object *)attr;
+}
+
+t_max_err class_addattr(t_class *c, t_object *attr)
+{
+    c->attrs = (t_attr **)realloc(c->attrs, sizeof(t_attr *) * (c->num_attrs + 1));
+    c->attrs[c->num_attrs++] = (t_attr *)attr;
+    return MAX_ERR_NONE;
+}
+
+static t_attr *class_findattr(t_class *c, t_symbol *s)
+{
+    int i;
+    for (i = 0; i < c->num_attrs; i++) {
+        if (c->attrs[i]->name == s)
+            return c->attrs[i];
+    }
+    return NULL;
+}
+
+t_max_err class_attr_accessors(t_class *c, const char *attrname, method mget,
+                               method mset)
+{
+    t_attr *attr = class_findattr(c, gensym(attrname));
+    if (!attr)
+        return MAX_ERR_GENERIC;
+    attr->get = mget;
+    attr->set = mset;
+    return MAX_ERR_NONE;
+}
+
+t_max_err object_attr_setvalueof(void *x, t_symbol *s, long argc, t_atom *argv)
+{
+    t_attr *attr = class_findattr(((t_object *)x)->o_messlist, s);
+    char *field;
+
+    if (!attr || !argc)
+        return MAX_ERR_GENERIC;
+    if (attr->set)
+        return ((t_attr_setfn)attr->set)(x, attr, argc, argv);
+
+    field = (char *)x + attr->offset;
+    if (attr->type == ps_symbol)
+        *(t_symbol **)field = atom_getsym(argv);
+    else if (attr->type == ps_long)
+        *(t_atom_long *)field = atom_getlong(argv);
+    else if (attr->type == ps_char)
+        *(char *)field = (char)atom_getlong(argv);
+    else if (attr->type == ps_float32)
+        *(float *)field = (float)atom_getfloat(argv);
+    else if (attr->type == ps_object)
+        *(void **)field = atom_getobj(argv);
+    return MAX_ERR_NONE;
+}
+
+// read an attribute into a single atom, using its getter if it has one
+static int object_attr_get(void *x, t_symbol *s, t_atom *a)
+{
+    t_attr *attr = class_findattr(((t_object *)x)->o_messlist, s);
+    char *field;
+
+    if (!attr)
+        return 1;
+    if (attr->get) {
+        long argc = 0;
+        t_atom *argv = NULL;
+        ((t_attr_getfn)attr->get)(x, attr, &argc, &argv);
+        if (!argc || !argv)
+            return 1;
+        *a = *argv;
+        free(argv);
+        return 0;
+    }
+
+    field = (char *)x + attr->offset;
+    if (attr->type == ps_symbol)
+        atom_setsym(a, *(t_symbol **)field);
+    else if (attr->type == ps_long)
+        atom_setlong(a, *(t_atom_long *)field);
+    else if (attr->type == ps_char)
+        atom_setlong(a, *(char *)field);
+    else if (attr->type == ps_float32)
+        atom_setfloat(a, *(float *)field);
+    else if (attr->type == ps_object)
+        atom_setobj(a, *(void **)field);
+    return 0;
+}
+
+t_symbol *object_attr_getsym(void *x, t_symbol *s)
+{
+    t_atom a;
+    return object_attr_get(x, s, &a) ? NULL : atom_getsym(&a);
+}
+
+char object_attr_getchar(void *x, t_symbol *s)
+{
+    t_atom a;
+    return object_attr_get(x, s, &a) ? 0 : (char)atom_getlong(&a);
+}
+
+t_atom_long object_attr_getlong(void *x, t_symbol *s)
+{
+    t_atom a;
+    return object_attr_get(x, s, &a) ? 0 : atom_getlong(&a);
+}
+
+t_max_err object_attr_setlong(void *x, t_symbol *s, t_atom_long c)
+{
+    t_atom a;
+    atom_setlong(&a, c);
+    return object_attr_setvalueof(x, s, 1, &a);
+}
+
+// *********************************************************
+// -(objects)-----------------------------------------------
+void *object_alloc(t_class *c)
+{
+    t_object *x = (t_object *)calloc(1, c->c_size);
+    x->o_messlist = c;
+    x->o_magic = MAGIC;
+
+    // objects are created inside the patcher currently being loaded
+    x->o_patcher = ps_patcher->s_thing;
+    return x;
+}
+
+static void patcher_unlink(t_object *x)
+{
+    t_object **box;
+
+    if (!x->o_patcher)
+        return;
+    for (box = &((t_patcher *)x->o_patcher)->boxes; *box; box = &(*box)->o_nextbox) {
+        if (*box == x) {
+            *box = x->o_nextbox;
+            break;
+        }
+    }
+}
+
+t_max_err object_free(void *p)
+{
+    t_object *x = (t_object *)p;
+    t_outlet *o;
+    t_obex_entry *e;
+    t_client *c;
+
+    if (!x || x->o_magic != MAGIC)
+        return MAX_ERR_INVALID_PTR;
+
+    object_notify(x, ps_free, NULL);
+    if (x->o_messlist->c_free)
+        ((t_freefn)x->o_messlist->c_free)(x);
+    patcher_unlink(x);
+
+    while ((o = x->o_outlet)) {
+        x->o_outlet = o->next;
+        free(o);
+    }
+    while ((e = x->o_obex)) {
+        x->o_obex = e->next;
+        if (e->value)
+            object_free(e->value);
+        free(e);
+    }
+    while ((c = x->o_clients)) {
+        x->o_clients = c->next;
+        free(c);
+    }
+    x->o_magic = 0;
+    free(x);
+    return MAX_ERR_NONE;
+}
+
+t_symbol *object_classname(void *x)
+{
+    return ((t_object *)x)->o_messlist->c_sym;
+}
+
+method zgetfn(t_object *x, t_symbol *s)
+{
+    t_methodentry *m = class_findmethod(x->o_messlist, s);
+    return m ? m->fn : NULL;
+}
+
+void *object_method(void *x, t_symbol *s, ...)
+{
+    void *a[8];
+    va_list args;
+    method m;
+    int i;
+
+    if (!x || !(m = zgetfn((t_object *)x, s)))
+        return NULL;
+
+    // like the SDK, pass the caller's arguments through untyped
+    va_start(args, s);
+    for (i = 0; i < 8; i++)
+        a[i] = va_arg(args, void *);
+    va_end(args);
+    return m(x, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+}
+
+void *typedmess(t_object *x, t_symbol *s, short argc, t_atom *argv)
+{
+    t_methodentry *m = class_findmethod(x->o_messlist, s);
+
+    if (!m) {
+        if (!(m = class_findmethod(x->o_messlist, ps_anything))) {
+            post("%s: doesn't understand \"%s\"", object_classname(x)->s_name, s->s_name);
+            return NULL;
+        }
+        ((t_gimmefn)m->fn)(x, s, argc, argv);
+        return NULL;
+    }
+    switch (m->type) {
+        case A_GIMME:
+            ((t_gimmefn)m->fn)(x, s, argc, argv);
+            break;
+        case A_NOTHING:
+            ((void (*)(void *))m->fn)(x);
+            break;
+        case A_LONG:
+        case A_DEFLONG:
+            ((void (*)(void *, t_atom_long))m->fn)(x, argc ? atom_getlong(argv) : 0);
+            break;
+        case A_FLOAT:
+        case A_DEFFLOAT:
+            ((void (*)(void *, double))m->fn)(x, argc ? atom_getfloat(argv) : 0);
+            break;
+        case A_SYM:
+        case A_DEFSYM:
+            ((void (*)(void *, t_symbol *))m->fn)(x, argc ? atom_getsym(argv) : ps_empty);
+            break;
+        default:
+            post("%s: method \"%s\" can't be called by message",
+                 object_classname(x)->s_name, s->s_name);
+            break;
+    }
+    return NULL;
+}
+
+// *********************************************************
+// -(registration and notification)-------------------------
+void *object_register(t_symbol *name_space, t_symbol *s, void *x)
+{
+    ((t_object *)x)->o_name = s;
+    return x;
+}
+
+t_max_err object_unregister(void *x)
+{
+    ((t_object *)x)->o_name = NULL;
+    return MAX_ERR_NONE;
+}
+
+void *object_attach_byptr(void *x, void *registeredobject)
+{
+    t_object *obj = (t_object *)registeredobject;
+    t_client *c = (t_client *)malloc(sizeof(t_client));
+    c->obj = (t_object *)x;
+    c->next = obj->o_clients;
+    obj->o_clients = c;
+    return obj;
+}
+
+void *object_attach_byptr_register(void *x, void *object_to_attach,
+                                   t_symbol *reg_name_space)
+{
+    t_object *obj = (t_object *)object_to_attach;
+    if (!obj->o_name)
+        object_register(reg_name_space, symbol_unique(), obj);
+    return object_attach_byptr(x, obj);
+}
+
+t_max_err object_detach_byptr(void *x, void *registeredobject)
+{
+    t_client **c = &((t_object *)registeredobject)->o_clients;
+    while (*c) {
+        if ((*c)->obj == (t_object *)x) {
+            t_client *temp = *c;
+            *c = temp->next;
+            free(temp);
+            return MAX_ERR_NONE;
+        }
+        c = &(*c)->next;
+    }
+    return MAX_ERR_GENERIC;
+}
+
+t_max_err object_notify(void *x, t_symbol *s, void *data)
+{
+    t_object *obj = (t_object *)x;
+    t_client *c = obj->o_clients, *next;
+
+    while (c) {
+        // clients may detach while being notified
+        next = c->next;
+        object_method(c->obj, ps_notify, obj->o_name, s, obj, data);
+        c = next;
+    }
+    return MAX_ERR_NONE;
+}
+
+// *********************************************************
+// -(obex)--------------------------------------------------
+t_max_err object_obex_lookup(void *x, t_symbol *key, t_object **val)
+{
+    t_object *obj = (t_object *)x;
+    t_obex_entry *e;
+
+    if (key == ps_patcher) {
+        *val = obj->o_patcher;
+        return *val ? MAX_ERR_NONE : MAX_ERR_GENERIC;
+    }
+    for (e = obj->o_obex; e; e = e->next) {
+        if (e->key == key) {
+            *val = e->value;
+            return MAX_ERR_NONE;
+        }
+    }
+    *val = NULL;
+    return MAX_ERR_GENERIC;
+}
+
+t_max_err object_obex_store(void *x, t_symbol *key, t_object *val)
+{
+    t_object *obj = (t_object *)x;
+    t_obex_entry *e;
+
+    for (e = obj->o_obex; e; e = e->next) {
+        if (e->key == key) {
+            e->value = val;
+            return MAX_ERR_NONE;
+        }
+    }
+    e = (t_obex_entry *)malloc(sizeof(t_obex_entry));
+    e->key = key;
+    e->value = val;
+    e->next = obj->o_obex;
+    obj->o_obex = e;
+    return MAX_ERR_NONE;
+}
+
+// *********************************************************
+// -(patchers)----------------------------------------------
+t_object *jpatcher_get_parentpatcher(t_object *p)
+{
+    return p ? p->o_patcher : NULL;
+}
+
+static void *patcher_iterate(t_patcher *p, method fn, void *arg, long flags,
+                             long *result)
+{
+    t_object *box, *next;
+
+    for (box = p->boxes; box; box = next) {
+        next = box->o_nextbox;
+        if (box->o_messlist == patcher_class) {
+            if (flags & PI_DEEP) {
+                patcher_iterate((t_patcher *)box, fn, arg, flags, result);
+                if (result && *result)
+                    return NULL;
+            }
+            continue;
+        }
+        long r = ((t_iteratefn)fn)(arg, box);
+        if (result)
+            *result = r;
+        if (r)
+            return NULL;
+    }
+    return NULL;
+}
+
+static void *patcher_getassoc(t_patcher *p, void **assoc)
+{
+    if (assoc)
+        *assoc = NULL;
+    return NULL;
+}
+
+static void patcher_free(t_patcher *p)
+{
+    while (p->boxes)
+        object_free(p->boxes);
+}
+
+static void patcher_addbox(t_object *patcher, t_object *x)
+{
+    t_object **box = &((t_patcher *)patcher)->boxes;
+    while (*box)
+        box = &(*box)->o_nextbox;
+    *box = x;
+    x->o_patcher = patcher;
+    x->o_nextbox = NULL;
+}
+
+// *********************************************************
+// -(outlets)-----------------------------------------------
+void *outlet_new(void *x, const char *s)
+{
+    t_object *obj = (t_object *)x;
+    t_outlet *o = (t_outlet *)malloc(sizeof(t_outlet));
+
+    // outlets are created right to left
+    o->owner = obj;
+    o->next = obj->o_outlet;
+    obj->o_outlet = o;
+    return o;
+}
+
+void *listout(void *x)
+{
+    return outlet_new(x, NULL);
+}
+
+static void outlet_send(t_outlet *o, t_symbol *s, int argc, t_atom *argv)
+{
+    t_outlet *temp;
+    int index = 0;
+
+    if (!outlet_hook)
+        return;
+    for (temp = o->owner->o_outlet; temp && temp != o; temp = temp->next)
+        ++index;
+    outlet_hook(outlet_hook_ctx, o->owner, index, s, argc, argv);
+}
+
+void *outlet_bang(void *o)
+{
+    outlet_send((t_outlet *)o, ps_bang, 0, NULL);
+    return NULL;
+}
+
+void *outlet_int(void *o, t_atom_long n)
+{
+    t_atom a;
+    atom_setlong(&a, n);
+    outlet_send((t_outlet *)o, ps_int, 1, &a);
+    return NULL;
+}
+
+void *outlet_float(void *o, double f)
+{
+    t_atom a;
+    atom_setfloat(&a, f);
+    outlet_send((t_outlet *)o, ps_float, 1, &a);
+    return NULL;
+}
+
+void *outlet_list(void *o, t_symbol *s, short ac, t_atom *av)
+{
+    outlet_send((t_outlet *)o, ps_list, ac, av);
+    return NULL;
+}
+
+void *outlet_anything(void *o, t_symbol *s, short ac, t_atom *av)
+{
+    outlet_send((t_outlet *)o, s, ac, av);
+    return NULL;
+}
+
+// *********************************************************
+// -(scheduling)--------------------------------------------
+void *clock_new(void *obj, method fn)
+{
+    t_clock *c = (t_clock *)calloc(1, sizeof(t_clock));
+    c->owner = obj;
+    c->fn = fn;
+    c->settime = -1;
+    c->next = clocks;
+    clocks = c;
+    return c;
+}
+
+void clock_fdelay(void *x, double time)
+{
+    ((t_clock *)x)->settime = logical_time + (time > 0 ? time : 0);
+}
+
+void clock_delay(void *x, long n)
+{
+    clock_fdelay(x, n);
+}
+
+void clock_unset(void *x)
+{
+    ((t_clock *)x)->settime = -1;
+}
+
+void clock_free(void *x)
+{
+    t_clock **list = &clocks;
+    while (*list && *list != (t_clock *)x)
+        list = &(*list)->next;
+    if (*list)
+        *list = ((t_clock *)x)->next;
+    free(x);
+}
+
+void *defer_low(void *ob, method fn, t_symbol *sym, short argc, t_atom *argv)
+{
+    t_deferred *d = (t_deferred *)calloc(1, sizeof(t_deferred));
+    d->ob = ob;
+    d->fn = fn;
+    d->s = sym;
+    d->argc = argc;
+    if (argc) {
+        d->argv = (t_atom *)malloc(sizeof(t_atom) * argc);
+        memcpy(d->argv, argv, sizeof(t_atom) * argc);
+    }
+    *deferred_tail = d;
+    deferred_tail = &d->next;
+    return NULL;
+}
+
+void *defer(void *ob, method fn, t_symbol *sym, short argc, t_atom *argv)
+{
+    // everything runs in the main thread here
+    ((t_deferfn)fn)(ob, sym, argc, argv);
+    return NULL;
+}
+
+void critical_enter(t_critical x)
+{
+}
+
+void critical_exit(t_critical x)
+{
+}
+
+// *********************************************************
+// -(atoms)-------------------------------------------------
+t_max_err atom_setlong(t_atom *a, t_atom_long b)
+{
+    a->a_type = A_LONG;
+    a->a_w.w_long = b;
+    return MAX_ERR_NONE;
+}
+
+t_max_err atom_setfloat(t_atom *a, double b)
+{
+    a->a_type = A_FLOAT;
+    a->a_w.w_float = b;
+    return MAX_ERR_NONE;
+}
+
+t_max_err atom_setsym(t_atom *a, t_symbol *b)
+{
+    a->a_type = A_SYM;
+    a->a_w.w_sym = b;
+    return MAX_ERR_NONE;
+}
+
+t_max_err atom_setobj(t_atom *a, void *b)
+{
+    a->a_type = A_OBJ;
+    a->a_w.w_obj = (t_object *)b;
+    return MAX_ERR_NONE;
+}
+
+t_atom_long atom_getlong(const t_atom *a)
+{
+    if (a->a_type == A_LONG)
+        return a->a_w.w_long;
+    if (a->a_type == A_FLOAT)
+        return (t_atom_long)a->a_w.w_float;
+    return 0;
+}
+
+t_atom_float atom_getfloat(const t_atom *a)
+{
+    if (a->a_type == A_FLOAT)
+        return a->a_w.w_float;
+    if (a->a_type == A_LONG)
+        return (t_atom_float)a->a_w.w_long;
+    return 0;
+}
+
+t_symbol *atom_getsym(const t_atom *a)
+{
+    return a->a_type == A_SYM ? a->a_w.w_sym : ps_empty;
+}
+
+void *atom_getobj(const t_atom *a)
+{
+    return a->a_type == A_OBJ ? a->a_w.w_obj : NULL;
+}
+
+t_max_err atom_alloc(long *ac, t_atom **av, char *alloc)
+{
+    if (*ac && *av) {
+        *alloc = 0;
+        return MAX_ERR_NONE;
+    }
+    *av = (t_atom *)calloc(1, sizeof(t_atom));
+    *ac = 1;
+    *alloc = 1;
+    return MAX_ERR_NONE;
+}
+
+// *********************************************************
+// -(atomarray)---------------------------------------------
+static void atomarray_free(t_atomarray *x)
+{
+    free(x->av);
+}
+
+t_atomarray *atomarray_new(long ac, t_atom *av)
+{
+    t_atomarray *x = (t_atomarray *)object_alloc(atomarray_class);
+    x->ac = 0;
+    x->av = NULL;
+    atomarray_appendatoms(x, ac, av);
+    return x;
+}
+
+t_max_err atomarray_getatoms(t_atomarray *x, long *ac, t_atom **av)
+{
+    *ac = x->ac;
+    *av = x->av;
+    return MAX_ERR_NONE;
+}
+
+void atomarray_appendatoms(t_atomarray *x, long ac, t_atom *av)
+{
+    if (ac <= 0)
+        return;
+    x->av = (t_atom *)realloc(x->av, sizeof(t_atom) * (x->ac + ac));
+    memcpy(x->av + x->ac, av, sizeof(t_atom) * ac);
+    x->ac += ac;
+}
+
+// *********************************************************
+// -(hashtab)-----------------------------------------------
+static long hashtab_slot(t_hashtab *x, t_symbol *key)
+{
+    return (long)(((uintptr_t)key >> 4) % (uintptr_t)x->slotcount);
+}
+
+t_hashtab *hashtab_new(long slotcount)
+{
+    t_hashtab *x = (t_hashtab *)object_alloc(hashtab_class);
+    x->ob.o_patcher = NULL;
+    x->slotcount = slotcount > 0 ? slotcount : DEFAULT_SLOTS;
+    x->slots = (t_hashtab_entry **)calloc(x->slotcount, sizeof(t_hashtab_entry *));
+    return x;
+}
+
+static void hashtab_clear(t_hashtab *x, int free_values)
+{
+    long i;
+    for (i = 0; i < x->slotcount; i++) {
+        t_hashtab_entry *e = x->slots[i];
+        while (e) {
+            t_hashtab_entry *next = e->next;
+            if (free_values && e->value && !(e->flags & OBJ_FLAG_REF))
+                object_free(e->value);
+            free(e);
+            e = next;
+        }
+        x->slots[i] = NULL;
+    }
+    x->size = 0;
+}
+
+static void hashtab_free(t_hashtab *x)
+{
+    hashtab_clear(x, 1);
+    free(x->slots);
+}
+
+t_max_err hashtab_storeflags(t_hashtab *x, t_symbol *key, t_object *val, long flags)
+{
+    long slot = hashtab_slot(x, key);
+    t_hashtab_entry *e;
+
+    for (e = x->slots[slot]; e; e = e->next) {
+        if (e->key == key)
+            break;
+    }
+    if (!e) {
+        e = (t_hashtab_entry *)malloc(sizeof(t_hashtab_entry));
+        e->key = key;
+        e->next = x->slots[slot];
+        x->slots[slot] = e;
+        ++x->size;
+    }
+    e->value = val;
+    e->flags = flags;
+    object_notify(x, ps_entry_new, key);
+    return MAX_ERR_NONE;
+}
+
+t_max_err hashtab_store(t_hashtab *x, t_symbol *key, t_object *val)
+{
+    return hashtab_storeflags(x, key, val, 0);
+}
+
+t_max_err hashtab_lookup(t_hashtab *x, t_symbol *key, t_object **val)
+{
+    t_hashtab_entry *e;
+    for (e = x->slots[hashtab_slot(x, key)]; e; e = e->next) {
+        if (e->key == key) {
+            *val = e->value;
+            return MAX_ERR_NONE;
+        }
+    }
+    *val = NULL;
+    return MAX_ERR_GENERIC;
+}
+
+t_max_err hashtab_chuckkey(t_hashtab *x, t_symbol *key)
+{
+    t_hashtab_entry **e;
+
+    // clients look the entry up while handling the notification
+    object_notify(x, ps_entry_free, key);
+    for (e = &x->slots[hashtab_slot(x, key)]; *e; e = &(*e)->next) {
+        if ((*e)->key == key) {
+            t_hashtab_entry *temp = *e;
+            *e = temp->next;
+            free(temp);
+            --x->size;
+            return MAX_ERR_NONE;
+        }
+    }
+    return MAX_ERR_GENERIC;
+}
+
+t_max_err hashtab_chuck(t_hashtab *x)
+{
+    // values are left alone, unlike object_free()
+    hashtab_clear(x, 0);
+    return object_free(x);
+}
+
+t_max_err hashtab_funall(t_hashtab *x, method fun, void *arg)
+{
+    long i;
+    for (i = 0; i < x->slotcount; i++) {
+        t_hashtab_entry *e = x->slots[i], *next;
+        for (; e; e = next) {
+            next = e->next;
+            ((t_funallfn)fun)(e, arg);
+        }
+    }
+    return MAX_ERR_NONE;
+}
+
+t_max_err hashtab_methodall(t_hashtab *x, t_symbol *s, ...)
+{
+    t_object **values;
+    long i, n = 0;
+
+    // the method may remove entries, so work from a snapshot
+    if (!x->size)
+        return MAX_ERR_NONE;
+    values = (t_object **)malloc(sizeof(t_object *) * x->size);
+    for (i = 0; i < x->slotcount; i++) {
+        t_hashtab_entry *e;
+        for (e = x->slots[i]; e; e = e->next)
+            values[n++] = e->value;
+    }
+    for (i = 0; i < n; i++)
+        object_method(values[i], s);
+    free(values);
+    return MAX_ERR_NONE;
+}
+
+t_atom_long hashtab_getsize(t_hashtab *x)
+{
+    return x->size;
+}
+
+// *********************************************************
+// -(bench interface)---------------------------------------
+void maxrt_init(int verbose)
+{
+    post_verbose = verbose;
+    if (patcher_class)
+        return;
+    ps_bang = gensym("bang");
+    ps_int = gensym("int");
+    ps_float = gensym("float");
+    ps_list = gensym("list");
+    ps_anything = gensym("anything");
+    ps_notify = gensym("notify");
+    ps_free = gensym("free");
+    ps_empty = gensym("");
+    ps_patcher = gensym("#P");
+    ps_entry_new = gensym("hashtab_entry_new");
+    ps_entry_free = gensym("hashtab_entry_free");
+    ps_symbol = gensym("symbol");
+    ps_long = gensym("long");
+    ps_char = gensym("char");
+    ps_float32 = gensym("float32");
+    ps_object = gensym("object");
+    attr_class = class_new("attr", NULL, NULL, sizeof(t_attr), NULL, 0, 0);
+    patcher_class = class_new("jpatcher", NULL, (method)patcher_free,
+                              sizeof(t_patcher), NULL, 0, 0);
+    class_addmethod(patcher_class, (method)patcher_iterate, "iterate", A_CANT, 0);
+    class_addmethod(patcher_class, (method)patcher_getassoc, "getassoc", A_CANT, 0);
+    hashtab_class = class_new("hashtab", NULL, (method)hashtab_free,
+                              sizeof(t_hashtab), NULL, 0, 0);
+    atomarray_class = class_new("atomarray", NULL, (method)atomarray_free,
+                                sizeof(t_atomarray), NULL, 0, 0);
+}
+
+int maxrt_load(const char *path)
+{
+    void *lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    int (*fn)(void);
+
+    if (!lib) {
+        fprintf(stderr, "max_runtime: %s\n", dlerror());
+        return 1;
+    }
+    if (!(fn = (int (*)(void))dlsym(lib, "main"))
+        && !(fn = (int (*)(void))dlsym(lib, "ext_main"))) {
+        fprintf(stderr, "max_runtime: no main() in %s\n", path);
+        return 1;
+    }
+    fn();
+    return 0;
+}
+
+t_object *maxrt_patcher_new(t_object *parent)
+{
+    t_object *p;
+    ps_patcher->s_thing = parent;
+    p = (t_object *)object_alloc(patcher_class);
+    ps_patcher->s_thing = NULL;
+    if (parent)
+        patcher_addbox(parent, p);
+    return p;
+}
+
+void maxrt_patcher_free(t_object *p)
+{
+    object_free(p);
+}
+
+t_object *maxrt_new(t_object *patcher, const char *text)
+{
+    t_atom argv[MAX_ARGS];
+    int argc = maxrt_parse(text, argv, MAX_ARGS);
+    t_class *c;
+    t_object *x;
+
+    if (!argc || argv->a_type != A_SYM)
+        return NULL;
+    if (!(c = class_find(argv->a_w.w_sym)) || !c->c_new) {
+        fprintf(stderr, "max_runtime: %s: No such object\n", argv->a_w.w_sym->s_name);
+        return NULL;
+    }
+
+    // the box is only added to the patcher once the object has been created
+    ps_patcher->s_thing = patcher;
+    x = (t_object *)((t_gimmenew)c->c_new)(c->c_sym, argc - 1, argv + 1);
+    ps_patcher->s_thing = NULL;
+    if (x)
+        patcher_addbox(patcher, x);
+    return x;
+}
+
+void maxrt_loadbang(t_object *patcher)
+{
+    t_object *box;
+    for (box = ((t_patcher *)patcher)->boxes; box; box = box->o_nextbox) {
+        if (box->o_messlist == patcher_class)
+            maxrt_loadbang(box);
+        else if (zgetfn(box, gensym("loadbang")))
+            object_method(box, gensym("loadbang"));
+    }
+}
+
+int maxrt_parse(const char *msg, t_atom *argv, int max)
+{
+    char buf[MAX_ARGS * 8], *tok, *save = NULL, *end;
+    int argc = 0;
+
+    strncpy(buf, msg, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = 0;
+    for (tok = strtok_r(buf, " ", &save); tok && argc < max;
+         tok = strtok_r(NULL, " ", &save)) {
+        long l = strtol(tok, &end, 10);
+        if (end != tok && !*end) {
+            atom_setlong(argv + argc++, l);
+            continue;
+        }
+        double f = strtod(tok, &end);
+        if (end != tok && !*end)
+            atom_setfloat(argv + argc++, f);
+        else
+            atom_setsym(argv + argc++, gensym(tok));
+    }
+    return argc;
+}
+
+void maxrt_send(t_object *x, const char *msg)
+{
+    t_atom argv[MAX_ARGS];
+    int argc = maxrt_parse(msg, argv, MAX_ARGS);
+
+    if (!argc)
+        return;
+    if (argv->a_type == A_SYM)
+        typedmess(x, argv->a_w.w_sym, argc - 1, argv + 1);
+    else if (argc > 1)
+        typedmess(x, ps_list, argc, argv);
+    else if (argv->a_type == A_LONG)
+        typedmess(x, ps_int, 1, argv);
+    else
+        typedmess(x, ps_float, 1, argv);
+}
+
+void maxrt_set_outlet_hook(maxrt_outlet_fn fn, void *ctx)
+{
+    outlet_hook = fn;
+    outlet_hook_ctx = ctx;
+}
+
+void maxrt_advance(double ms)
+{
+    double target = logical_time + ms;
+
+    while (1) {
+        t_clock *c, *next = NULL;
+        for (c = clocks; c; c = c->next) {
+            if (c->settime >= 0 && c->settime <= target
+                && (!next || c->settime < next->settime))
+                next = c;
+        }
+        if (!next)
+            break;
+        logical_time = next->settime;
+        next->settime = -1;
+        next->fn(next->owner);
+    }
+    logical_time = target;
+
+    // low-priority queue
+    while (deferred) {
+        t_deferred *d = deferred;
+        deferred = d->next;
+        if (!deferred)
+            deferred_tail = &deferred;
+        ((t_deferfn)d->fn)(d->ob, d->s, d->argc, d->argv);
+        free(d->argv);
+        free(d);
+    }
+}
+
+double maxrt_time(void)
+{
+    return logical_time;
+}
@@ -0,0 +1,50 @@
+//
+// max_runtime.h
+// a minimal headless stand-in for the Max runtime, implementing the subset
+// of the SDK declared in bench/max/ so the mpr.* objects can be loaded and
+// driven from C
+//
+// This software was written in the Input Devices and Music Interaction
+// Laboratory at McGill University in Montreal, and is copyright those
+// found in the AUTHORS file.  It is licensed under the GNU Lesser Public
+// General License version 2.1 or later.  Please see COPYING for details.
+//
+
+#ifndef MAX_RUNTIME_H
+#define MAX_RUNTIME_H
+
+#include "ext.h"
+
+// called for every message leaving an outlet; index counts from 0 at the
+// left, int and float output use the selectors "int" and "float"
+typedef void (*maxrt_outlet_fn)(void *ctx, t_object *owner, int index,
+                                t_symbol *s, int argc, t_atom *argv);
+
+void maxrt_init(int verbose);
+
+// load an external binary and call its main() function
+int maxrt_load(const char *path);
+
+// create an empty (sub)patcher
+t_object *maxrt_patcher_new(t_object *parent);
+
+// free a patcher along with its boxes and subpatchers
+void maxrt_patcher_free(t_object *p);
+
+// create an object box from text, e.g. "mpr.in foo f 2 @min 0"
+t_object *maxrt_new(t_object *patcher, const char *text);
+
+// send loadbang to every box in a patcher and its subpatchers
+void maxrt_loadbang(t_object *patcher);
+
+// parse a space-separated message into ints, floats and symbols
+int maxrt_parse(const char *msg, t_atom *argv, int max);
+void maxrt_send(t_object *x, const char *msg);
+
+void maxrt_set_outlet_hook(maxrt_outlet_fn fn, void *ctx);
+
+// advance logical time, firing due clocks and then deferred calls
+void maxrt_advance(double ms);
+double maxrt_time(void);
+
+#endif // MAX_RUNTIME_H
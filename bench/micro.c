@@ -0,0 +1,276 @@
+//
+// micro.c
+// a small harness for timing individual binding functions in isolation
+//
+// This software was written in the Input Devices and Music Interaction
+// Laboratory at McGill University in Montreal, and is copyright those
+// found in the AUTHORS file.  It is licensed under the GNU Lesser Public
+// General License version 2.1 or later.  Please see COPYING for details.
+//
+
+#include "micro.h"
+#ifdef ALLOC_COUNT
+#include "alloc_count.h"
+#endif
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_RESULTS 256
+#define MAX_REPS 1000
+#define ALLOC_ITERS 1000
+
+typedef struct _micro_result
+{
+    char name[64];
+    int signals;
+    int length;
+    long iters;
+    int reps;
+    double min;         // all times in ns per operation
+    double median;
+    double mean;
+    double stddev;
+    double p90;
+    double baseline;    // baseline median, 0 if none
+} t_micro_result;
+
+static struct
+{
+    const char *suite;
+    const char *out;
+    const char *baseline;
+    double threshold;
+    double rep_ms;
+    int reps;
+    int warmup;
+    int verbose;
+    t_micro_result results[MAX_RESULTS];
+    int num_results;
+    int allocated;      // steady cases that allocated
+} micro;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int compare_dbl(const void *a, const void *b)
+{
+    double d = *(const double *)a - *(const double *)b;
+    return d < 0 ? -1 : d > 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-r reps] [-w warmup] [-m ms per rep] [-o results.json] "
+            "[-b baseline.json] [-t percent] [-v]\n", prog);
+}
+
+int micro_init(int argc, char **argv, const char *suite)
+{
+    int opt;
+
+    micro.suite = suite;
+    micro.reps = 15;
+    micro.warmup = 3;
+    micro.rep_ms = 20;
+    micro.threshold = 10;
+    while ((opt = getopt(argc, argv, "r:w:m:o:b:t:vh")) != -1) {
+        switch (opt) {
+            case 'r': micro.reps = atoi(optarg);        break;
+            case 'w': micro.warmup = atoi(optarg);      break;
+            case 'm': micro.rep_ms = atof(optarg);      break;
+            case 'o': micro.out = optarg;               break;
+            case 'b': micro.baseline = optarg;          break;
+            case 't': micro.threshold = atof(optarg);   break;
+            case 'v': micro.verbose = 1;                break;
+            default:  usage(argv[0]);                   return 1;
+        }
+    }
+    if (micro.reps < 1 || micro.reps > MAX_REPS || micro.warmup < 0 || micro.rep_ms <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+#ifdef ALLOC_COUNT
+    printf("%-32s %7s %6s %8s %8s %8s %8s   (per 1000 operations)\n", suite,
+           "signals", "length", "malloc", "realloc", "free", "gensym");
+#else
+    printf("%-32s %7s %6s %11s %11s %11s\n", suite, "signals", "length",
+           "median ns", "min ns", "p90 ns");
+#endif
+    return 0;
+}
+
+int micro_verbose(void)
+{
+    return micro.verbose;
+}
+
+// *********************************************************
+// -(baseline)----------------------------------------------
+// results are written one per line, so the baseline can be read back
+// without a full JSON parser
+static double baseline_median(const char *name, int signals, int length)
+{
+    char line[1024], key[128];
+    double median = 0;
+    FILE *f;
+
+    if (!micro.baseline || !(f = fopen(micro.baseline, "r")))
+        return 0;
+    snprintf(key, 128, "\"name\": \"%s\", \"signals\": %d, \"length\": %d,",
+             name, signals, length);
+    while (fgets(line, 1024, f)) {
+        char *m;
+        if (!strstr(line, key) || !(m = strstr(line, "\"median_ns\": ")))
+            continue;
+        median = atof(m + 13);
+        break;
+    }
+    fclose(f);
+    return median;
+}
+
+// *********************************************************
+// -(timing)------------------------------------------------
+static double time_rep(const t_micro_case *c, void *ctx, long iters)
+{
+    double start;
+    if (c->prepare)
+        c->prepare(ctx, iters);
+    start = now_ns();
+    c->run(ctx, iters);
+    return now_ns() - start;
+}
+
+#ifdef ALLOC_COUNT
+void micro_run(const t_micro_case *c, void *ctx)
+{
+    long iters = c->iters ? c->iters : ALLOC_ITERS;
+    double scale = 1000. / iters;
+    t_alloc_counts counts;
+    int i, allocated;
+
+    // the first calls may legitimately grow buffers
+    for (i = 0; i < (micro.warmup > 0 ? micro.warmup : 1); i++)
+        time_rep(c, ctx, iters);
+    if (c->prepare)
+        c->prepare(ctx, iters);
+    alloc_count_begin();
+    c->run(ctx, iters);
+    alloc_count_end(&counts);
+
+    allocated = counts.malloc || counts.realloc || counts.free || counts.gensym;
+    printf("%-32s %7d %6d %8.0f %8.0f %8.0f %8.0f%s\n", c->name, c->signals,
+           c->length, counts.malloc * scale, counts.realloc * scale,
+           counts.free * scale, counts.gensym * scale,
+           c->steady && allocated ? "  <- steady state path allocates" : "");
+    fflush(stdout);
+    if (c->steady && allocated)
+        ++micro.allocated;
+}
+
+int micro_finish(void)
+{
+    if (micro.allocated)
+        fprintf(stderr, "%d steady state case(s) allocated\n", micro.allocated);
+    return micro.allocated != 0;
+}
+
+#else
+
+void micro_run(const t_micro_case *c, void *ctx)
+{
+    double samples[MAX_REPS], sum = 0, var = 0;
+    t_micro_result *r;
+    long iters = c->iters;
+    int i;
+
+    if (micro.num_results >= MAX_RESULTS)
+        return;
+
+    // grow the repetition until it takes long enough to time reliably
+    if (!iters) {
+        iters = 1;
+        while (iters < (1L << 30)) {
+            double t = time_rep(c, ctx, iters);
+            if (t >= micro.rep_ms * 1e6)
+                break;
+            iters = t > 0 ? (long)(iters * fmin(micro.rep_ms * 1.2e6 / t, 100)) + 1
+                          : iters * 100;
+        }
+    }
+    for (i = 0; i < micro.warmup; i++)
+        time_rep(c, ctx, iters);
+    for (i = 0; i < micro.reps; i++) {
+        samples[i] = time_rep(c, ctx, iters) / iters;
+        sum += samples[i];
+    }
+    qsort(samples, micro.reps, sizeof(double), compare_dbl);
+
+    r = &micro.results[micro.num_results++];
+    snprintf(r->name, 64, "%s", c->name);
+    r->signals = c->signals;
+    r->length = c->length;
+    r->iters = iters;
+    r->reps = micro.reps;
+    r->min = samples[0];
+    r->median = samples[micro.reps / 2];
+    r->mean = sum / micro.reps;
+    r->p90 = samples[(int)(micro.reps * 0.9)];
+    for (i = 0; i < micro.reps; i++)
+        var += (samples[i] - r->mean) * (samples[i] - r->mean);
+    r->stddev = sqrt(var / micro.reps);
+    r->baseline = baseline_median(r->name, r->signals, r->length);
+
+    printf("%-32s %7d %6d %11.1f %11.1f %11.1f", r->name, r->signals, r->length,
+           r->median, r->min, r->p90);
+    if (r->baseline > 0)
+        printf("  %+6.1f%%", (r->median / r->baseline - 1) * 100);
+    printf("\n");
+    fflush(stdout);
+}
+
+// *********************************************************
+// -(results)-----------------------------------------------
+int micro_finish(void)
+{
+    int i, regressed = 0;
+    FILE *f = NULL;
+
+    if (micro.out && !(f = fopen(micro.out, "w")))
+        perror(micro.out);
+    if (f) {
+        fprintf(f, "{\n  \"suite\": \"%s\",\n  \"reps\": %d,\n  \"results\": [\n",
+                micro.suite, micro.reps);
+    }
+    for (i = 0; i < micro.num_results; i++) {
+        t_micro_result *r = &micro.results[i];
+        if (f) {
+            fprintf(f, "    {\"name\": \"%s\", \"signals\": %d, \"length\": %d, "
+                    "\"iters\": %ld, \"min_ns\": %.2f, \"median_ns\": %.2f, "
+                    "\"mean_ns\": %.2f, \"stddev_ns\": %.2f, \"p90_ns\": %.2f}%s\n",
+                    r->name, r->signals, r->length, r->iters, r->min, r->median,
+                    r->mean, r->stddev, r->p90, i < micro.num_results - 1 ? "," : "");
+        }
+        if (r->baseline > 0 && r->median > r->baseline * (1 + micro.threshold * 0.01)) {
+            fprintf(stderr, "regression: %s (signals %d, length %d) %.1f ns -> %.1f ns, "
+                    "more than %g%% slower\n", r->name, r->signals, r->length,
+                    r->baseline, r->median, micro.threshold);
+            regressed = 1;
+        }
+    }
+    if (f) {
+        fprintf(f, "  ]\n}\n");
+        fclose(f);
+    }
+    return regressed;
+}
+
+#endif // ALLOC_COUNT
@@ -0,0 +1,44 @@
+//
+// micro.h
+// a small harness for timing individual binding functions in isolation,
+// writing the results as JSON and checking them against a stored baseline
+//
+// This software was written in the Input Devices and Music Interaction
+// Laboratory at McGill University in Montreal, and is copyright those
+// found in the AUTHORS file.  It is licensed under the GNU Lesser Public
+// General License version 2.1 or later.  Please see COPYING for details.
+//
+
+#ifndef MICRO_H
+#define MICRO_H
+
+// performs (or prepares) iters operations of the measured path
+typedef void (*micro_fn)(void *ctx, long iters);
+
+typedef struct _micro_case
+{
+    const char *name;
+    int signals;        // parameters reported with the result
+    int length;
+    long iters;         // operations per repetition, 0 to calibrate
+    micro_fn prepare;   // optional, called untimed before each repetition
+    micro_fn run;
+    int steady;         // a value path that must not allocate once warmed up
+} t_micro_case;
+
+// parse the common options, returns nonzero on error:
+//   -r reps  -w warmup reps  -m ms per rep  -o results.json
+//   -b baseline.json  -t max regression in percent  -v
+int micro_init(int argc, char **argv, const char *suite);
+
+// time one case, printing and recording its statistics; when built with
+// -DALLOC_COUNT, count its allocations and gensym() calls instead
+void micro_run(const t_micro_case *c, void *ctx);
+
+// write the results; returns nonzero if any case regressed, or in
+// allocation counting builds if any steady case allocated
+int micro_finish(void);
+
+int micro_verbose(void);
+
+#endif // MICRO_H
@@ -0,0 +1,117 @@
+//
+// micro_mapper_pd.c
+// microbenchmarks for the value paths of the puredata mapper external; the
+// source is included directly so that its static functions can be timed
+//
+// This software was written in the Input Devices and Music Interaction
+// Laboratory at McGill University in Montreal, and is copyright those
+// found in the AUTHORS file.  It is licensed under the GNU Lesser Public
+// General License version 2.1 or later.  Please see COPYING for details.
+//
+
+#include "pd_runtime.h"
+#include "micro.h"
+#include "../mapper/mapper.c"
+
+typedef struct _micro_ctx
+{
+    t_mapper *x;
+    int num_sigs;
+    int len;
+    t_symbol **names;
+    mpr_sig *sigs;
+    t_atom atoms[MAX_LIST];
+    float values[MAX_LIST];
+} t_micro_ctx;
+
+// *********************************************************
+// -(measured paths)----------------------------------------
+static void run_anything(void *ctx, long iters)
+{
+    t_micro_ctx *c = (t_micro_ctx *)ctx;
+    long i;
+    for (i = 0; i < iters; i++)
+        mapperobj_anything(c->x, c->names[i % c->num_sigs], c->len, c->atoms);
+}
+
+static void run_sig_handler(void *ctx, long iters)
+{
+    t_micro_ctx *c = (t_micro_ctx *)ctx;
+    long i;
+    for (i = 0; i < iters; i++)
+        mapperobj_sig_handler(c->sigs[i % c->num_sigs], MPR_SIG_UPDATE, 0, c->len,
+                              MPR_FLT, c->values, MPR_NOW);
+}
+
+// *********************************************************
+// -(setup)-------------------------------------------------
+static t_mapper *micro_mapper_new(t_micro_ctx *c, const char *dir)
+{
+    char msg[256];
+    t_atom args[2];
+    int i;
+
+    SETSYMBOL(args, gensym("@alias"));
+    SETSYMBOL(args + 1, gensym("micro"));
+    c->x = (t_mapper *)pdrt_new("mapper", 2, args);
+    if (!c->x)
+        return NULL;
+    for (i = 0; i < c->num_sigs; i++) {
+        snprintf(msg, 256, "add %s sig/%d @type f @length %d", dir, i, c->len);
+        pdrt_send((t_pd *)c->x, msg);
+        snprintf(msg, 256, "sig/%d", i);
+        c->names[i] = gensym(msg);
+        c->sigs[i] = mapperobj_names_find(c->x, msg);
+    }
+
+    // values are only accepted once the device has joined the network
+    for (i = 0; i < 1000 && !c->x->ready; i++) {
+        pdrt_advance(10);
+        usleep(10000);
+    }
+    return c->x->ready ? c->x : NULL;
+}
+
+int main(int argc, char **argv)
+{
+    int sig_counts[] = {1, 16, 256}, lengths[] = {1, 16};
+    int i, j, k;
+    t_micro_ctx c;
+
+    if (micro_init(argc, argv, "mapper (pd)"))
+        return 1;
+    pdrt_init(micro_verbose());
+    mapper_setup();
+
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 2; j++) {
+            memset(&c, 0, sizeof(c));
+            c.num_sigs = sig_counts[i];
+            c.len = lengths[j];
+            c.names = (t_symbol **)calloc(c.num_sigs, sizeof(t_symbol *));
+            c.sigs = (mpr_sig *)calloc(c.num_sigs, sizeof(mpr_sig));
+            for (k = 0; k < c.len; k++) {
+                SETFLOAT(c.atoms + k, k);
+                c.values[k] = k;
+            }
+
+            t_micro_case anything = {"mapperobj_anything", c.num_sigs, c.len, 0,
+                                     NULL, run_anything, 1};
+            if (!micro_mapper_new(&c, "output"))
+                return 1;
+            micro_run(&anything, &c);
+            pdrt_free((t_pd *)c.x);
+
+            t_micro_case handler = {"mapperobj_sig_handler", c.num_sigs, c.len, 0,
+                                    NULL, run_sig_handler, 1};
+            if (!micro_mapper_new(&c, "input"))
+                return 1;
+            micro_run(&handler, &c);
+            pdrt_free((t_pd *)c.x);
+
+            free(c.names);
+            free(c.sigs);
+        }
+    }
+    return micro_finish();
+}
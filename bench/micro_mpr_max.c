@@ -0,0 +1,243 @@
+//
+// micro_mpr_max.c
+// microbenchmarks for the value and signal management paths of the Max
+// objects; mpr.device is included directly so that its static functions can
+// be timed, mpr.in and mpr.out are loaded as externals and timed through
+// their methods
+//
+// This software was written in the Input Devices and Music Interaction
+// Laboratory at McGill University in Montreal, and is copyright those
+// found in the AUTHORS file.  It is licensed under the GNU Lesser Public
+// General License version 2.1 or later.  Please see COPYING for details.
+//
+
+#include "max_runtime.h"
+#include "micro.h"
+#ifdef ALLOC_COUNT
+#include "alloc_count.h"
+#endif
+
+#define main mpr_device_main
+#include "../mpr_device/mpr.device.c"
+#undef main
+
+#define POOL_SIZE 64
+#define OUT_BLOCK 4             // samples per list in the block cases
+
+typedef void (*t_listfn)(t_object *x, t_symbol *s, int argc, t_atom *argv);
+
+typedef struct _micro_ctx
+{
+    t_object *patcher;
+    t_mpr_device *device;
+    int num_sigs;
+    int len;
+    t_object **ins;
+    t_object **outs;
+    mpr_sig *sigs;
+    t_listfn list;
+    t_listfn out_list;
+    int recording;
+    t_object *pool[POOL_SIZE];  // objects outside the device's patcher
+    int pool_added;
+    t_atom atoms[MAX_LIST];
+    float values[MAX_LIST];
+} t_micro_ctx;
+
+static t_symbol *ps_list, *ps_sig_ptr, *ps_record;
+
+// *********************************************************
+// -(measured paths)----------------------------------------
+static void run_sig_handler(void *ctx, long iters)
+{
+    t_micro_ctx *c = (t_micro_ctx *)ctx;
+    long i;
+    for (i = 0; i < iters; i++)
+        mpr_device_sig_handler(c->sigs[i % c->num_sigs], MPR_SIG_UPDATE, 0, c->len,
+                               MPR_FLT, c->values, MPR_NOW);
+}
+
+static void run_in_list(void *ctx, long iters)
+{
+    t_micro_ctx *c = (t_micro_ctx *)ctx;
+    long i;
+    for (i = 0; i < iters; i++)
+        c->list(c->ins[i % c->num_sigs], ps_list, c->len, c->atoms);
+}
+
+static void run_out_list(void *ctx, long iters)
+{
+    t_micro_ctx *c = (t_micro_ctx *)ctx;
+    long i;
+    for (i = 0; i < iters; i++)
+        c->out_list(c->outs[i % c->num_sigs], ps_list, c->len, c->atoms);
+}
+
+// a list of several samples is sent as a block of timetagged updates
+static void run_out_block(void *ctx, long iters)
+{
+    t_micro_ctx *c = (t_micro_ctx *)ctx;
+    long i;
+    for (i = 0; i < iters; i++)
+        c->out_list(c->outs[i % c->num_sigs], ps_list, c->len * OUT_BLOCK, c->atoms);
+}
+
+// while recording, mpr.out also captures each sample it sends
+static void record_start(void *ctx, long iters)
+{
+    t_micro_ctx *c = (t_micro_ctx *)ctx;
+    char path[64];
+    t_atom a;
+
+    if (c->recording)
+        return;
+    snprintf(path, 64, "/tmp/micro_mpr_max.%d.cap", (int)getpid());
+    atom_setsym(&a, gensym(path));
+    mpr_device_record(c->device, ps_record, 1, &a);
+    c->recording = 1;
+}
+
+static void record_stop(t_micro_ctx *c)
+{
+    char path[64];
+
+    if (!c->recording)
+        return;
+    mpr_device_record_stop(c->device);
+    snprintf(path, 64, "/tmp/micro_mpr_max.%d.cap", (int)getpid());
+    unlink(path);
+    c->recording = 0;
+}
+
+// setting the signal pointer re-parses the properties given at creation
+static void run_parse_properties(void *ctx, long iters)
+{
+    t_micro_ctx *c = (t_micro_ctx *)ctx;
+    t_atom a;
+    long i;
+    for (i = 0; i < iters; i++) {
+        int idx = i % c->num_sigs;
+        atom_setobj(&a, c->sigs[idx]);
+        object_attr_setvalueof(c->ins[idx], ps_sig_ptr, 1, &a);
+    }
+}
+
+static void pool_add(void *ctx, long iters)
+{
+    t_micro_ctx *c = (t_micro_ctx *)ctx;
+    for (; c->pool_added < iters; c->pool_added++)
+        mpr_device_add_signal(c->device, c->pool[c->pool_added]);
+}
+
+static void pool_remove(void *ctx, long iters)
+{
+    t_micro_ctx *c = (t_micro_ctx *)ctx;
+    while (c->pool_added > 0)
+        mpr_device_remove_signal(c->device, c->pool[--c->pool_added]);
+}
+
+// *********************************************************
+// -(setup)-------------------------------------------------
+static int micro_patcher_new(t_micro_ctx *c, t_object *pool_patcher)
+{
+    char msg[256];
+    int i;
+
+    c->patcher = maxrt_patcher_new(NULL);
+    c->device = (t_mpr_device *)maxrt_new(c->patcher, "mpr.device micro");
+    if (!c->device)
+        return 1;
+    for (i = 0; i < c->num_sigs; i++) {
+        snprintf(msg, 256, "mpr.in sig/%d f %d @min 0 @max 1 @unit m", i, c->len);
+        if (!(c->ins[i] = maxrt_new(c->patcher, msg)))
+            return 1;
+        snprintf(msg, 256, "sig/%d", i);
+        mpr_list sigs = mpr_dev_get_sigs(c->device->device, MPR_DIR_IN);
+        sigs = mpr_list_filter(sigs, MPR_PROP_NAME, NULL, 1, MPR_STR, msg, MPR_OP_EQ);
+        if (!sigs)
+            return 1;
+        c->sigs[i] = (mpr_sig)*sigs;
+        snprintf(msg, 256, "mpr.out out/%d f %d", i, c->len);
+        if (!(c->outs[i] = maxrt_new(c->patcher, msg)))
+            return 1;
+    }
+    for (i = 0; i < POOL_SIZE; i++) {
+        snprintf(msg, 256, "mpr.in extra/%d f %d", i, c->len);
+        if (!(c->pool[i] = maxrt_new(pool_patcher, msg)))
+            return 1;
+    }
+    c->list = (t_listfn)(void (*)(void))zgetfn(c->ins[0], ps_list);
+    c->out_list = (t_listfn)(void (*)(void))zgetfn(c->outs[0], ps_list);
+#ifdef ALLOC_COUNT
+    alloc_count_module((const void *)c->list);
+    alloc_count_module((const void *)c->out_list);
+#endif
+    return 0;
+}
+
+static void micro_patcher_free(t_micro_ctx *c)
+{
+    record_stop(c);
+    pool_remove(c, 0);
+    maxrt_patcher_free(c->patcher);
+}
+
+int main(int argc, char **argv)
+{
+    int sig_counts[] = {1, 16, 256}, lengths[] = {1, 16};
+    int i, j, k;
+    t_micro_ctx c;
+
+    if (micro_init(argc, argv, "mpr.device/mpr.in/mpr.out (max)"))
+        return 1;
+    maxrt_init(micro_verbose());
+    mpr_device_main();
+    if (maxrt_load("./mpr.in.so") || maxrt_load("./mpr.out.so"))
+        return 1;
+    ps_list = gensym("list");
+    ps_sig_ptr = gensym("sig_ptr");
+    ps_record = gensym("record");
+
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 2; j++) {
+            t_object *pool_patcher = maxrt_patcher_new(NULL);
+
+            memset(&c, 0, sizeof(c));
+            c.num_sigs = sig_counts[i];
+            c.len = lengths[j];
+            c.ins = (t_object **)calloc(c.num_sigs, sizeof(t_object *));
+            c.outs = (t_object **)calloc(c.num_sigs, sizeof(t_object *));
+            c.sigs = (mpr_sig *)calloc(c.num_sigs, sizeof(mpr_sig));
+            for (k = 0; k < c.len; k++)
+                c.values[k] = k;
+            for (k = 0; k < c.len * OUT_BLOCK; k++)
+                atom_setfloat(c.atoms + k, k % c.len);
+            if (micro_patcher_new(&c, pool_patcher))
+                return 1;
+
+            t_micro_case cases[] = {
+                {"mpr_device_sig_handler", c.num_sigs, c.len, 0, NULL, run_sig_handler, 1},
+                {"mpr_in_list", c.num_sigs, c.len, 0, NULL, run_in_list, 1},
+                {"mpr_out_list", c.num_sigs, c.len, 0, NULL, run_out_list, 1},
+                {"mpr_out_list block", c.num_sigs, c.len, 0, NULL, run_out_block, 1},
+                {"mpr_out_list block recording", c.num_sigs, c.len, 0, record_start,
+                 run_out_block, 1},
+                {"parse_extra_properties", c.num_sigs, c.len, 0, NULL,
+                 run_parse_properties},
+                {"mpr_device_add_signal", c.num_sigs, c.len, POOL_SIZE, pool_remove,
+                 pool_add},
+                {"mpr_device_remove_signal", c.num_sigs, c.len, POOL_SIZE, pool_add,
+                 pool_remove},
+            };
+            for (k = 0; k < (int)(sizeof(cases) / sizeof(cases[0])); k++)
+                micro_run(&cases[k], &c);
+
+            micro_patcher_free(&c);
+            maxrt_patcher_free(pool_patcher);
+            free(c.ins);
+            free(c.outs);
+            free(c.sigs);
+        }
+    }
+    return micro_finish();
+}
@@ -0,0 +1,372 @@
+//
+// pd_runtime.c
+// a minimal headless stand-in for the puredata runtime
+//
+// This software was written in the Input Devices and Music Interaction
+// Laboratory at McGill University in Montreal, and is copyright those
+// found in the AUTHORS file.  It is licensed under the GNU Lesser Public
+// General License version 2.1 or later.  Please see COPYING for details.
+//
+
+#include "pd_runtime.h"
+#ifdef ALLOC_COUNT
+#include "alloc_count.h"
+#endif
+#include <dlfcn.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SYMTAB_SIZE 1024
+#define MAX_CLASSES 64
+#define MAX_ARGS 256
+
+typedef void (*t_gimmefn)(t_pd *x, t_symbol *s, int argc, t_atom *argv);
+typedef void *(*t_gimmenew)(t_symbol *s, int argc, t_atom *argv);
+typedef void (*t_freefn)(t_pd *x);
+typedef void (*t_clockfn)(void *owner);
+
+// *********************************************************
+// -(runtime structures)------------------------------------
+typedef struct _methodentry
+{
+    t_symbol *sel;
+    t_method fn;
+    t_atomtype type;
+} t_methodentry;
+
+struct _class
+{
+    t_symbol *name;
+    t_newmethod newmethod;
+    t_method freemethod;
+    size_t size;
+    t_methodentry *methods;
+    int num_methods;
+    t_method anything;
+};
+
+struct _outlet
+{
+    t_object *owner;
+    int index;
+    struct _outlet *next;
+};
+
+struct _clock
+{
+    void *owner;
+    t_method fn;
+    double settime;     // < 0 when unset
+    struct _clock *next;
+};
+
+static t_symbol *symtab[SYMTAB_SIZE];
+static t_class *classes[MAX_CLASSES];
+static int num_classes = 0;
+static t_clock *clocks = NULL;
+static double logical_time = 0;
+static int post_verbose = 0;
+static pdrt_outlet_fn outlet_hook = NULL;
+static t_symbol *ps_list;
+static void *outlet_hook_ctx = NULL;
+
+// *********************************************************
+// -(symbols)-----------------------------------------------
+t_symbol *gensym(const char *s)
+{
+    unsigned int hash = 5381;
+    const char *c;
+    t_symbol *sym;
+
+#ifdef ALLOC_COUNT
+    alloc_count_gensym();
+#endif
+    for (c = s; *c; c++)
+        hash = hash * 33 + (unsigned char)*c;
+    hash &= (SYMTAB_SIZE - 1);
+    for (sym = symtab[hash]; sym; sym = sym->s_next) {
+        if (strcmp(sym->s_name, s) == 0)
+            return sym;
+    }
+    sym = (t_symbol *)calloc(1, sizeof(t_symbol));
+    sym->s_name = strdup(s);
+    sym->s_next = symtab[hash];
+    symtab[hash] = sym;
+    return sym;
+}
+
+t_float atom_getfloat(t_atom *a)
+{
+    return a->a_type == A_FLOAT ? a->a_w.w_float : 0;
+}
+
+// *********************************************************
+// -(printing)----------------------------------------------
+void post(const char *fmt, ...)
+{
+    va_list args;
+    if (!post_verbose)
+        return;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
+
+// *********************************************************
+// -(canvas)------------------------------------------------
+// objects are created outside of any patch, so relative to the working
+// directory
+t_symbol *canvas_getcurrentdir(void)
+{
+    return gensym(".");
+}
+
+// *********************************************************
+// -(classes)-----------------------------------------------
+t_class *class_new(t_symbol *name, t_newmethod newmethod, t_method freemethod,
+                   size_t size, int flags, t_atomtype arg1, ...)
+{
+    t_class *c;
+    if (num_classes >= MAX_CLASSES)
+        return NULL;
+    c = (t_class *)calloc(1, sizeof(t_class));
+    c->name = name;
+    c->newmethod = newmethod;
+    c->freemethod = freemethod;
+    c->size = size;
+    classes[num_classes++] = c;
+    return c;
+}
+
+void class_addmethod(t_class *c, t_method fn, t_symbol *sel, t_atomtype arg1, ...)
+{
+    c->methods = (t_methodentry *)realloc(c->methods, sizeof(t_methodentry)
+                                          * (c->num_methods + 1));
+    c->methods[c->num_methods].sel = sel;
+    c->methods[c->num_methods].fn = fn;
+    c->methods[c->num_methods].type = arg1;
+    ++c->num_methods;
+}
+
+#undef class_addanything
+void class_addanything(t_class *c, t_method fn)
+{
+    c->anything = fn;
+}
+
+// *********************************************************
+// -(objects and messages)----------------------------------
+t_pd *pd_new(t_class *cls)
+{
+    t_pd *x = (t_pd *)calloc(1, cls->size);
+    *x = cls;
+    return x;
+}
+
+void pd_typedmess(t_pd *x, t_symbol *s, int argc, t_atom *argv)
+{
+    t_class *c = *x;
+    int i;
+
+    for (i = 0; i < c->num_methods; i++) {
+        t_methodentry *m = &c->methods[i];
+        if (m->sel != s)
+            continue;
+        switch (m->type) {
+            case A_GIMME:
+                ((t_gimmefn)m->fn)(x, s, argc, argv);
+                return;
+            case A_NULL:
+                ((void (*)(t_pd *))m->fn)(x);
+                return;
+            case A_FLOAT:
+            case A_DEFFLOAT:
+                ((void (*)(t_pd *, t_float))m->fn)(x, argc ? atom_getfloat(argv) : 0);
+                return;
+            default:
+                post("pd_runtime: unsupported argument type for '%s'", s->s_name);
+                return;
+        }
+    }
+    if (c->anything)
+        ((t_gimmefn)c->anything)(x, s, argc, argv);
+    else
+        post("%s: no method for '%s'", c->name->s_name, s->s_name);
+}
+
+void pd_list(t_pd *x, t_symbol *s, int argc, t_atom *argv)
+{
+    pd_typedmess(x, ps_list, argc, argv);
+}
+
+t_outlet *outlet_new(t_object *owner, t_symbol *s)
+{
+    t_outlet *o = (t_outlet *)calloc(1, sizeof(t_outlet)), **list;
+    int index = 0;
+
+    o->owner = owner;
+    for (list = &owner->te_outlet; *list; list = &(*list)->next)
+        ++index;
+    o->index = index;
+    *list = o;
+    return o;
+}
+
+void outlet_anything(t_outlet *x, t_symbol *s, int argc, t_atom *argv)
+{
+    if (outlet_hook)
+        outlet_hook(outlet_hook_ctx, x->owner, x->index, s, argc, argv);
+}
+
+// *********************************************************
+// -(clocks)------------------------------------------------
+t_clock *clock_new(void *owner, t_method fn)
+{
+    t_clock *c = (t_clock *)calloc(1, sizeof(t_clock));
+    c->owner = owner;
+    c->fn = fn;
+    c->settime = -1;
+    c->next = clocks;
+    clocks = c;
+    return c;
+}
+
+void clock_delay(t_clock *x, double delaytime)
+{
+    x->settime = logical_time + (delaytime > 0 ? delaytime : 0);
+}
+
+void clock_unset(t_clock *x)
+{
+    x->settime = -1;
+}
+
+void clock_free(t_clock *x)
+{
+    t_clock **list = &clocks;
+    while (*list && *list != x)
+        list = &(*list)->next;
+    if (*list)
+        *list = x->next;
+    free(x);
+}
+
+// *********************************************************
+// -(bench interface)---------------------------------------
+void pdrt_init(int verbose)
+{
+    post_verbose = verbose;
+    ps_list = gensym("list");
+}
+
+int pdrt_load(const char *path, const char *name)
+{
+    char setup[256];
+    void *lib = dlopen(path, RTLD_NOW | RTLD_GLOBAL);
+    void (*fn)(void);
+
+    if (!lib) {
+        fprintf(stderr, "pd_runtime: %s\n", dlerror());
+        return 1;
+    }
+    snprintf(setup, 256, "%s_setup", name);
+    if (!(fn = (void (*)(void))dlsym(lib, setup))) {
+        fprintf(stderr, "pd_runtime: no %s() in %s\n", setup, path);
+        return 1;
+    }
+    fn();
+    return 0;
+}
+
+t_pd *pdrt_new(const char *name, int argc, t_atom *argv)
+{
+    t_symbol *s = gensym(name);
+    int i;
+
+    for (i = 0; i < num_classes; i++) {
+        if (classes[i]->name == s)
+            return (t_pd *)((t_gimmenew)(void (*)(void))classes[i]->newmethod)(s, argc, argv);
+    }
+    fprintf(stderr, "pd_runtime: %s ... couldn't create\n", name);
+    return NULL;
+}
+
+void pdrt_free(t_pd *x)
+{
+    t_class *c = *x;
+    t_outlet *o = ((t_object *)x)->te_outlet;
+
+    if (c->freemethod)
+        ((t_freefn)c->freemethod)(x);
+    while (o) {
+        t_outlet *next = o->next;
+        free(o);
+        o = next;
+    }
+    free(x);
+}
+
+int pdrt_parse(const char *msg, t_atom *argv, int max)
+{
+    char buf[MAX_ARGS * 8], *tok, *save = NULL, *end;
+    int argc = 0;
+
+    strncpy(buf, msg, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = 0;
+    for (tok = strtok_r(buf, " ", &save); tok && argc < max;
+         tok = strtok_r(NULL, " ", &save)) {
+        double f = strtod(tok, &end);
+        if (end != tok && !*end)
+            SETFLOAT(argv + argc, f);
+        else
+            SETSYMBOL(argv + argc, gensym(tok));
+        ++argc;
+    }
+    return argc;
+}
+
+void pdrt_send(t_pd *x, const char *msg)
+{
+    t_atom argv[MAX_ARGS];
+    int argc = pdrt_parse(msg, argv, MAX_ARGS);
+    if (!argc)
+        return;
+    if (argv->a_type == A_SYMBOL)
+        pd_typedmess(x, argv->a_w.w_symbol, argc - 1, argv + 1);
+    else
+        pd_list(x, gensym("list"), argc, argv);
+}
+
+void pdrt_set_outlet_hook(pdrt_outlet_fn fn, void *ctx)
+{
+    outlet_hook = fn;
+    outlet_hook_ctx = ctx;
+}
+
+void pdrt_advance(double ms)
+{
+    double target = logical_time + ms;
+
+    while (1) {
+        t_clock *c, *next = NULL;
+        for (c = clocks; c; c = c->next) {
+            if (c->settime >= 0 && c->settime <= target
+                && (!next || c->settime < next->settime))
+                next = c;
+        }
+        if (!next)
+            break;
+        logical_time = next->settime;
+        next->settime = -1;
+        ((t_clockfn)next->fn)(next->owner);
+    }
+    logical_time = target;
+}
+
+double pdrt_time(void)
+{
+    return logical_time;
+}
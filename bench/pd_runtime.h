@@ -0,0 +1,41 @@
+//
+// pd_runtime.h
+// a minimal headless stand-in for the puredata runtime, implementing just
+// enough of m_pd.h to load and drive externals from a C program
+//
+// This software was written in the Input Devices and Music Interaction
+// Laboratory at McGill University in Montreal, and is copyright those
+// found in the AUTHORS file.  It is licensed under the GNU Lesser Public
+// General License version 2.1 or later.  Please see COPYING for details.
+//
+
+#ifndef PD_RUNTIME_H
+#define PD_RUNTIME_H
+
+#include "m_pd.h"
+
+// called for every message leaving an outlet; index counts from 0 in
+// order of creation
+typedef void (*pdrt_outlet_fn)(void *ctx, t_object *owner, int index,
+                               t_symbol *s, int argc, t_atom *argv);
+
+void pdrt_init(int verbose);
+
+// load an external binary and call its <name>_setup() function
+int pdrt_load(const char *path, const char *name);
+
+// instantiate a loaded class, as if typed into an object box
+t_pd *pdrt_new(const char *name, int argc, t_atom *argv);
+void pdrt_free(t_pd *x);
+
+// parse a space-separated message, floats and symbols only
+int pdrt_parse(const char *msg, t_atom *argv, int max);
+void pdrt_send(t_pd *x, const char *msg);
+
+void pdrt_set_outlet_hook(pdrt_outlet_fn fn, void *ctx);
+
+// advance logical time, firing any clocks that come due
+void pdrt_advance(double ms);
+double pdrt_time(void);
+
+#endif // PD_RUNTIME_H
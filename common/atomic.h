@@ -0,0 +1,53 @@
+//
+// atomic.h
+// replacing a file as a whole, so that a reader or a crash never leaves
+// behind a partly written one
+//
+// The contents are written to <path>.tmp, which is then renamed over the
+// file. Used for the session, identity and definition image files.
+//
+// This software was written in the Input Devices and Music Interaction
+// Laboratory at McGill University in Montreal, and is copyright those
+// found in the AUTHORS file.  It is licensed under the GNU Lesser Public
+// General License version 2.1 or later.  Please see COPYING for details.
+//
+
+#ifndef MPR_BINDINGS_ATOMIC_H
+#define MPR_BINDINGS_ATOMIC_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// write len bytes of buf to path through a temporary file, returning 0 on
+// failure, in which case the previous file is left in place
+static int atomic_write(const char *path, const void *buf, size_t len)
+{
+    size_t size = strlen(path) + 5;
+    char *tmp = (char *)malloc(size);
+    FILE *f;
+    int ok;
+
+    if (!tmp)
+        return 0;
+    snprintf(tmp, size, "%s.tmp", path);
+    if (!(f = fopen(tmp, "wb"))) {
+        free(tmp);
+        return 0;
+    }
+    ok = fwrite(buf, 1, len, f) == len;
+    ok = !fclose(f) && ok;
+#ifdef WIN32
+    // rename() does not replace an existing file here
+    if (ok)
+        remove(path);
+#endif
+    if (!ok || rename(tmp, path)) {
+        remove(tmp);
+        ok = 0;
+    }
+    free(tmp);
+    return ok;
+}
+
+#endif // MPR_BINDINGS_ATOMIC_H
@@ -0,0 +1,157 @@
+//
+// block.h
+// lists of several samples sent by mpr.in and mpr.out as one block of
+// individually timetagged updates
+//
+// A list of k times the signal's length values is sent as k samples. Each
+// sample is given its own timetag: either the offsets sent in the preceding
+// 'timetags' message, or evenly spaced samples ending now. The spacing is
+// taken from the signal's rate if declared, otherwise the time since the
+// previous block is divided between the samples. All samples are flushed to
+// the network together by mpr_dev_update_maps().
+//
+// The @block setting, the number of received samples mpr.device gathers
+// into one list, is kept here as well so that it can be given again to a
+// re-created signal.
+//
+// For the Max objects only: include after ext.h.
+//
+// This software was written in the Input Devices and Music Interaction
+// Laboratory at McGill University in Montreal, and is copyright those
+// found in the AUTHORS file.  It is licensed under the GNU Lesser Public
+// General License version 2.1 or later.  Please see COPYING for details.
+//
+
+#ifndef MPR_BINDINGS_BLOCK_H
+#define MPR_BINDINGS_BLOCK_H
+
+#include <mapper/mapper.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct _block
+{
+    double sample_period;           // from the declared rate, 0 if none
+    mpr_time last;                  // when the previous block was sent
+    int num_timetags;               // offsets given for the next block
+    int timetags_size;              // offsets allocated
+    double *timetags;               // in seconds
+    long gather;                    // the @block setting, 0 if unset
+    void *payload;                  // values being sent, grown on demand
+    int payload_size;
+} t_block;
+
+// called for each sample sent, e.g. to record it
+typedef void (*block_sent_handler)(void *context, mpr_sig sig, mpr_id inst, int len,
+                                   mpr_type type, const void *val, mpr_time time);
+
+static void block_init(t_block *b)
+{
+    memset(b, 0, sizeof(t_block));
+}
+
+static void block_free(t_block *b)
+{
+    if (b->timetags)
+        free(b->timetags);
+    if (b->payload)
+        free(b->payload);
+    block_init(b);
+}
+
+// offsets in milliseconds for the samples of the next block, relative to
+// its arrival; returns 0 if they were rejected
+static int block_set_timetags(t_block *b, t_object *ob, long argc, t_atom *argv)
+{
+    int i;
+
+    b->num_timetags = 0;
+    if (!argc)
+        return 1;
+    if (argc > b->timetags_size) {
+        double *timetags = (double *)realloc(b->timetags, argc * sizeof(double));
+        if (!timetags) {
+            object_post(ob, "Out of memory for timetags!");
+            return 0;
+        }
+        b->timetags = timetags;
+        b->timetags_size = (int)argc;
+    }
+    for (i = 0; i < argc; i++) {
+        if ((argv+i)->a_type == A_FLOAT)
+            b->timetags[i] = atom_getfloat(argv+i) * 0.001;
+        else if ((argv+i)->a_type == A_LONG)
+            b->timetags[i] = atom_getlong(argv+i) * 0.001;
+        else {
+            object_post(ob, "Illegal data type in timetags!");
+            return 0;
+        }
+    }
+    b->num_timetags = (int)argc;
+    return 1;
+}
+
+// the values of a list as int32 ('i') or float ('f'), or 0 if the list was
+// rejected; the buffer only grows, so lists of a steady length do not allocate
+static void *block_payload(t_block *b, t_object *ob, char type, long argc, t_atom *argv)
+{
+    int i;
+
+    if (argc > b->payload_size) {
+        // int32 and float are the same size
+        void *payload = realloc(b->payload, argc * sizeof(float));
+        if (!payload)
+            return 0;
+        b->payload = payload;
+        b->payload_size = (int)argc;
+    }
+    for (i = 0; i < argc; i++) {
+        double d;
+        if ((argv+i)->a_type == A_FLOAT)
+            d = atom_getfloat(argv+i);
+        else if ((argv+i)->a_type == A_LONG)
+            d = (double)atom_getlong(argv+i);
+        else {
+            object_post(ob, "Illegal data type in list!");
+            return 0;
+        }
+        if ('i' == type)
+            ((int *)b->payload)[i] = (int)d;
+        else
+            ((float *)b->payload)[i] = (float)d;
+    }
+    return b->payload;
+}
+
+// send num_samps samples of len values each; call with the critical region held
+static void block_send(t_block *b, mpr_sig sig, mpr_id inst, int len, int num_samps,
+                       mpr_type type, const void *value, block_sent_handler sent,
+                       void *context)
+{
+    int i, size = (MPR_INT32 == type) ? sizeof(int) : sizeof(float);
+    mpr_dev dev = mpr_sig_get_dev(sig);
+    mpr_time now, time;
+    double interval = b->sample_period;
+
+    mpr_time_set(&now, MPR_NOW);
+    if (interval <= 0 && b->last.sec)
+        interval = mpr_time_get_diff(now, b->last) / num_samps;
+
+    for (i = 0; i < num_samps; i++) {
+        const char *sample = (const char *)value + i * len * size;
+        mpr_time_set(&time, now);
+        if (b->num_timetags == num_samps)
+            mpr_time_add_dbl(&time, b->timetags[i]);
+        else
+            mpr_time_add_dbl(&time, (i - num_samps + 1) * interval);
+        mpr_dev_set_time(dev, time);
+        mpr_sig_set_value(sig, inst, len, type, sample);
+        if (sent)
+            sent(context, sig, inst, len, type, sample, time);
+    }
+    mpr_dev_update_maps(dev);
+    mpr_time_set(&b->last, now);
+    b->num_timetags = 0;
+}
+
+#endif // MPR_BINDINGS_BLOCK_H
@@ -0,0 +1,599 @@
+//
+// capture.h
+// timetagged binary capture of the signal traffic of a device, written
+// through a memory-mapped file by a background thread
+//
+// Updates are appended by the sending or receiving thread into a lock-free
+// ring; a flusher thread copies them into a preallocated, memory-mapped
+// log, growing it in CAPTURE_FILE_CHUNK steps. Recording never blocks the
+// caller: if the ring is full the update is counted as dropped.
+//
+// A log is a t_capture_header followed by records of 8-byte aligned size.
+// Each signal is described once by a CAPTURE_SIG record (its name follows
+// the record) before any CAPTURE_UPDATE or CAPTURE_RELEASE referring to
+// its id. Update values follow the record in the signal's native type.
+// All fields are in host byte order.
+//
+// A log is played back by mapping it read-only and handing each record,
+// in place, to a callback when its timetag falls due.
+//
+// This software was written in the Input Devices and Music Interaction
+// Laboratory at McGill University in Montreal, and is copyright those
+// found in the AUTHORS file.  It is licensed under the GNU Lesser Public
+// General License version 2.1 or later.  Please see COPYING for details.
+//
+
+#ifndef MPR_BINDINGS_CAPTURE_H
+#define MPR_BINDINGS_CAPTURE_H
+
+#include <mapper/mapper.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef WIN32
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <pthread.h>
+  #include <sys/mman.h>
+  #include <unistd.h>
+#endif
+
+#define CAPTURE_MAGIC "MPRCAP1"
+#define CAPTURE_VERSION 1
+#define CAPTURE_RING_SIZE (1 << 22)         // must be a power of two
+#define CAPTURE_FILE_CHUNK (64 << 20)
+#define CAPTURE_PAD 0xFFFFFFFF              // rest of the ring is unused
+#define CAPTURE_PLAY_BATCH 4096             // records per call when not timed
+
+// record kinds
+#define CAPTURE_SIG 'S'
+#define CAPTURE_UPDATE 'U'
+#define CAPTURE_RELEASE 'R'
+
+typedef struct _capture_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t size;                          // of this header
+    uint32_t sec;                           // when recording started
+    uint32_t frac;
+} t_capture_header;
+
+typedef struct _capture_record
+{
+    uint32_t size;                          // whole record, written last
+    uint8_t kind;
+    uint8_t dir;                            // MPR_DIR_IN received, MPR_DIR_OUT sent
+    char type;                              // MPR_INT32, MPR_FLT or MPR_DBL
+    uint8_t reserved;
+    uint64_t sig;                           // libmapper signal id
+    uint64_t inst;                          // instance, or instance count for CAPTURE_SIG
+    uint32_t sec;                           // timetag
+    uint32_t frac;
+    uint32_t len;                           // vector length
+    uint32_t count;                         // value or name bytes following
+} t_capture_record;
+
+typedef struct _capture
+{
+    char *ring;
+    volatile uint64_t head;                 // reserved by recording threads
+    volatile uint64_t tail;                 // consumed by the flusher
+    volatile uint32_t dropped;
+    volatile int running;
+    char *map;
+    uint64_t mapped;
+    uint64_t written;
+    uint32_t records;
+#ifdef WIN32
+    HANDLE file;
+    HANDLE mapping;
+    HANDLE thread;
+#else
+    int fd;
+    pthread_t thread;
+#endif
+} t_capture;
+
+typedef struct _capture_log
+{
+    const char *data;
+    uint64_t size;
+#ifdef WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+} t_capture_log;
+
+// resolves a signal described in a log to a local target, returning 0 to
+// skip its updates; dir is set to the local signal's direction
+typedef void *(*capture_sig_fn)(void *ctx, const t_capture_record *r,
+                                const char *name, int *dir);
+typedef void (*capture_update_fn)(void *ctx, void *target, int dir,
+                                  const t_capture_record *r);
+
+typedef struct _capture_target
+{
+    uint64_t sig;
+    void *target;
+    int dir;
+} t_capture_target;
+
+typedef struct _capture_player
+{
+    t_capture_log log;
+    const t_capture_record *next;
+    double speed;                           // 0 to play as fast as possible
+    mpr_time start;                         // when playback started
+    mpr_time first;                         // timetag of the first update
+    int started;
+    t_capture_target *targets;              // sorted by signal id
+    int num_targets;
+    uint32_t played;
+    uint32_t skipped;
+} t_capture_player;
+
+// *********************************************************
+// -(atomics)-----------------------------------------------
+#ifdef WIN32
+  #define capture_load(p) (MemoryBarrier(), *(p))
+  #define capture_store(p, v) { MemoryBarrier(); *(p) = (v); }
+  #define capture_cas(p, old, new) \
+      ((uint64_t)InterlockedCompareExchange64((volatile LONG64 *)(p), (new), (old)) == (old))
+  #define capture_inc(p) InterlockedIncrement((volatile LONG *)(p))
+#else
+  #define capture_load(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+  #define capture_store(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+  #define capture_cas(p, old, new) \
+      __atomic_compare_exchange_n(p, &(old), new, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)
+  #define capture_inc(p) __atomic_add_fetch(p, 1, __ATOMIC_RELAXED)
+#endif
+
+// *********************************************************
+// -(mapped file)-------------------------------------------
+static int capture_map(t_capture *c, uint64_t size)
+{
+#ifdef WIN32
+    if (c->map) {
+        UnmapViewOfFile(c->map);
+        CloseHandle(c->mapping);
+    }
+    c->map = 0;
+    c->mapping = CreateFileMapping(c->file, NULL, PAGE_READWRITE,
+                                   (DWORD)(size >> 32), (DWORD)size, NULL);
+    if (!c->mapping)
+        return 1;
+    c->map = MapViewOfFile(c->mapping, FILE_MAP_WRITE, 0, 0, (SIZE_T)size);
+#else
+    if (c->map)
+        munmap(c->map, c->mapped);
+    c->map = 0;
+    if (ftruncate(c->fd, size))
+        return 1;
+    c->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, 0);
+    if (MAP_FAILED == c->map)
+        c->map = 0;
+#endif
+    if (!c->map)
+        return 1;
+    c->mapped = size;
+    return 0;
+}
+
+static void capture_unmap(t_capture *c)
+{
+    // trim the preallocated space left after the last record
+#ifdef WIN32
+    LARGE_INTEGER size;
+    if (c->map) {
+        UnmapViewOfFile(c->map);
+        CloseHandle(c->mapping);
+    }
+    size.QuadPart = c->written;
+    SetFilePointerEx(c->file, size, NULL, FILE_BEGIN);
+    SetEndOfFile(c->file);
+    CloseHandle(c->file);
+#else
+    if (c->map)
+        munmap(c->map, c->mapped);
+    if (ftruncate(c->fd, c->written)) {}
+    close(c->fd);
+#endif
+    c->map = 0;
+}
+
+// *********************************************************
+// -(flusher)-----------------------------------------------
+// copy the committed records from the ring to the file, returning the
+// number of bytes consumed
+static uint64_t capture_drain(t_capture *c)
+{
+    uint64_t tail = c->tail, start = tail;
+    while (1) {
+        uint32_t off = tail & (CAPTURE_RING_SIZE - 1), size;
+        size = capture_load((volatile uint32_t *)(c->ring + off));
+        if (!size)
+            break;
+        if (CAPTURE_PAD == size)
+            size = CAPTURE_RING_SIZE - off;
+        else {
+            if (c->written + size > c->mapped
+                && capture_map(c, c->mapped + CAPTURE_FILE_CHUNK))
+                break;
+            memcpy(c->map + c->written, c->ring + off, size);
+            c->written += size;
+            ++c->records;
+        }
+        // free slots must read as uncommitted when they are reused
+        memset(c->ring + off, 0, size);
+        tail += size;
+    }
+    if (tail != start)
+        capture_store(&c->tail, tail);
+    return tail - start;
+}
+
+#ifdef WIN32
+static DWORD WINAPI capture_thread(LPVOID arg)
+#else
+static void *capture_thread(void *arg)
+#endif
+{
+    t_capture *c = (t_capture *)arg;
+    while (capture_load(&c->running)) {
+        if (!capture_drain(c)) {
+#ifdef WIN32
+            Sleep(1);
+#else
+            usleep(1000);
+#endif
+        }
+    }
+    capture_drain(c);
+    return 0;
+}
+
+// *********************************************************
+// -(recording)---------------------------------------------
+// claim size bytes of the ring, or return 0 if it is full
+static t_capture_record *capture_reserve(t_capture *c, uint32_t size)
+{
+    uint64_t head, pos, end;
+    uint32_t off;
+
+    do {
+        head = capture_load(&c->head);
+        off = head & (CAPTURE_RING_SIZE - 1);
+        // records do not wrap, the end of the ring is skipped instead
+        pos = off + size > CAPTURE_RING_SIZE ? head + CAPTURE_RING_SIZE - off : head;
+        end = pos + size;
+        if (end - capture_load(&c->tail) > CAPTURE_RING_SIZE) {
+            capture_inc(&c->dropped);
+            return 0;
+        }
+    } while (!capture_cas(&c->head, head, end));
+
+    if (pos != head)
+        capture_store((volatile uint32_t *)(c->ring + off), CAPTURE_PAD);
+    return (t_capture_record *)(c->ring + (pos & (CAPTURE_RING_SIZE - 1)));
+}
+
+static void capture_commit(t_capture_record *r, uint32_t size)
+{
+    capture_store(&r->size, size);
+}
+
+static int capture_type_size(mpr_type type)
+{
+    return (MPR_DBL == type || MPR_INT64 == type) ? 8 : 4;
+}
+
+// describe a signal, must precede its first update
+static void capture_sig(t_capture *c, mpr_sig sig)
+{
+    const char *name = mpr_obj_get_prop_as_str(sig, MPR_PROP_NAME, NULL);
+    uint32_t count = strlen(name) + 1;
+    uint32_t size = (sizeof(t_capture_record) + count + 7) & ~7;
+    t_capture_record *r;
+    mpr_time now;
+
+    if (!(r = capture_reserve(c, size)))
+        return;
+    mpr_time_set(&now, MPR_NOW);
+    r->kind = CAPTURE_SIG;
+    r->dir = mpr_obj_get_prop_as_int32(sig, MPR_PROP_DIR, NULL);
+    r->type = mpr_obj_get_prop_as_int32(sig, MPR_PROP_TYPE, NULL);
+    r->sig = mpr_obj_get_prop_as_int64(sig, MPR_PROP_ID, NULL);
+    r->inst = mpr_obj_get_prop_as_int32(sig, MPR_PROP_NUM_INST, NULL);
+    r->sec = now.sec;
+    r->frac = now.frac;
+    r->len = mpr_obj_get_prop_as_int32(sig, MPR_PROP_LEN, NULL);
+    r->count = count;
+    memcpy(r + 1, name, count);
+    capture_commit(r, size);
+}
+
+// record one update, or a release if val is 0; pass MPR_NOW as the time
+// of values being sent
+static void capture_update(t_capture *c, mpr_dir dir, mpr_sig sig, mpr_id inst,
+                           int len, mpr_type type, const void *val, mpr_time time)
+{
+    uint32_t count = val ? len * capture_type_size(type) : 0;
+    uint32_t size = (sizeof(t_capture_record) + count + 7) & ~7;
+    t_capture_record *r;
+
+    if (size > CAPTURE_RING_SIZE / 4 || !(r = capture_reserve(c, size)))
+        return;
+    mpr_time_set(&time, time);
+    r->kind = val ? CAPTURE_UPDATE : CAPTURE_RELEASE;
+    r->dir = dir;
+    r->type = type;
+    r->sig = mpr_obj_get_prop_as_int64(sig, MPR_PROP_ID, NULL);
+    r->inst = inst;
+    r->sec = time.sec;
+    r->frac = time.frac;
+    r->len = len;
+    r->count = count;
+    if (count)
+        memcpy(r + 1, val, count);
+    capture_commit(r, size);
+}
+
+// *********************************************************
+// -(open and close)----------------------------------------
+// create the log and start the flusher, returns 0 on failure
+static t_capture *capture_open(const char *path)
+{
+    t_capture *c = (t_capture *)calloc(1, sizeof(t_capture));
+    t_capture_header *h;
+    mpr_time now;
+
+    if (!c || !(c->ring = (char *)calloc(1, CAPTURE_RING_SIZE))) {
+        free(c);
+        return 0;
+    }
+#ifdef WIN32
+    c->file = CreateFile(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                         CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (INVALID_HANDLE_VALUE == c->file)
+        goto error;
+#else
+    if ((c->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+        goto error;
+#endif
+    if (capture_map(c, CAPTURE_FILE_CHUNK)) {
+        capture_unmap(c);
+        goto error;
+    }
+
+    h = (t_capture_header *)c->map;
+    memcpy(h->magic, CAPTURE_MAGIC, sizeof(h->magic));
+    h->version = CAPTURE_VERSION;
+    h->size = sizeof(t_capture_header);
+    mpr_time_set(&now, MPR_NOW);
+    h->sec = now.sec;
+    h->frac = now.frac;
+    c->written = sizeof(t_capture_header);
+
+    c->running = 1;
+#ifdef WIN32
+    if (!(c->thread = CreateThread(NULL, 0, capture_thread, c, 0, NULL))) {
+#else
+    if (pthread_create(&c->thread, NULL, capture_thread, c)) {
+#endif
+        capture_unmap(c);
+        goto error;
+    }
+    return c;
+
+error:
+    free(c->ring);
+    free(c);
+    return 0;
+}
+
+// flush and close the log; returns the number of records written and
+// optionally the number dropped because the ring was full
+static uint32_t capture_close(t_capture *c, uint32_t *dropped)
+{
+    uint32_t records;
+    capture_store(&c->running, 0);
+#ifdef WIN32
+    WaitForSingleObject(c->thread, INFINITE);
+    CloseHandle(c->thread);
+#else
+    pthread_join(c->thread, NULL);
+#endif
+    capture_unmap(c);
+    records = c->records;
+    if (dropped)
+        *dropped = c->dropped;
+    free(c->ring);
+    free(c);
+    return records;
+}
+
+// *********************************************************
+// -(reading)-----------------------------------------------
+static void capture_log_close(t_capture_log *log)
+{
+#ifdef WIN32
+    if (log->data)
+        UnmapViewOfFile(log->data);
+    if (log->mapping)
+        CloseHandle(log->mapping);
+    if (log->file && INVALID_HANDLE_VALUE != log->file)
+        CloseHandle(log->file);
+#else
+    if (log->data)
+        munmap((void *)log->data, log->size);
+    if (log->fd > 0)
+        close(log->fd);
+#endif
+    memset(log, 0, sizeof(t_capture_log));
+}
+
+// map a log for reading, returns 0 if it cannot be read or is not a log
+static const t_capture_header *capture_log_open(t_capture_log *log, const char *path)
+{
+    const t_capture_header *h;
+    memset(log, 0, sizeof(t_capture_log));
+#ifdef WIN32
+    LARGE_INTEGER size;
+    log->file = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, NULL);
+    if (INVALID_HANDLE_VALUE == log->file || !GetFileSizeEx(log->file, &size))
+        goto error;
+    log->size = size.QuadPart;
+    if (log->size < sizeof(t_capture_header)
+        || !(log->mapping = CreateFileMapping(log->file, NULL, PAGE_READONLY, 0, 0, NULL))
+        || !(log->data = MapViewOfFile(log->mapping, FILE_MAP_READ, 0, 0, 0)))
+        goto error;
+#else
+    off_t size;
+    void *data;
+    if ((log->fd = open(path, O_RDONLY)) < 0 || (size = lseek(log->fd, 0, SEEK_END)) < 0)
+        goto error;
+    log->size = size;
+    if (log->size < sizeof(t_capture_header))
+        goto error;
+    data = mmap(NULL, log->size, PROT_READ, MAP_PRIVATE, log->fd, 0);
+    if (MAP_FAILED == data)
+        goto error;
+    log->data = data;
+    madvise(data, log->size, MADV_SEQUENTIAL);
+#endif
+    h = (const t_capture_header *)log->data;
+    if (memcmp(h->magic, CAPTURE_MAGIC, sizeof(h->magic)) || h->version != CAPTURE_VERSION
+        || h->size < sizeof(t_capture_header) || h->size > log->size)
+        goto error;
+    return h;
+
+error:
+    capture_log_close(log);
+    return 0;
+}
+
+// the record following r, or the first if r is 0; returns 0 at the end
+// of the log or if the next record is truncated
+static const t_capture_record *capture_log_next(const t_capture_log *log,
+                                                const t_capture_record *r)
+{
+    uint64_t off = r ? (const char *)r - log->data + r->size
+                     : ((const t_capture_header *)log->data)->size;
+    if (off + sizeof(t_capture_record) > log->size)
+        return 0;
+    r = (const t_capture_record *)(log->data + off);
+    if (r->size < sizeof(t_capture_record) || off + r->size > log->size
+        || sizeof(t_capture_record) + r->count > r->size)
+        return 0;
+    return r;
+}
+
+// *********************************************************
+// -(playback)----------------------------------------------
+static t_capture_target *capture_target_find(t_capture_player *p, uint64_t sig)
+{
+    int lo = 0, hi = p->num_targets - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (p->targets[mid].sig == sig)
+            return &p->targets[mid];
+        if (p->targets[mid].sig < sig)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return 0;
+}
+
+static void capture_target_add(t_capture_player *p, uint64_t sig, void *target, int dir)
+{
+    t_capture_target *t = capture_target_find(p, sig);
+    int i;
+    if (!t) {
+        t = (t_capture_target *)realloc(p->targets, (p->num_targets + 1) * sizeof(t_capture_target));
+        if (!t)
+            return;
+        p->targets = t;
+        for (i = p->num_targets; i > 0 && p->targets[i - 1].sig > sig; i--)
+            p->targets[i] = p->targets[i - 1];
+        t = &p->targets[i];
+        ++p->num_targets;
+    }
+    t->sig = sig;
+    t->target = target;
+    t->dir = dir;
+}
+
+// returns 0 if the file is not a readable log
+static t_capture_player *capture_player_open(const char *path, double speed)
+{
+    t_capture_player *p = (t_capture_player *)calloc(1, sizeof(t_capture_player));
+    if (!p)
+        return 0;
+    if (!capture_log_open(&p->log, path)) {
+        free(p);
+        return 0;
+    }
+    p->speed = speed > 0 ? speed : 0;
+    p->next = capture_log_next(&p->log, 0);
+    return p;
+}
+
+static void capture_player_close(t_capture_player *p)
+{
+    capture_log_close(&p->log);
+    free(p->targets);
+    free(p);
+}
+
+// hand every record that is due to the callbacks; returns the seconds
+// until the next record is due, or a negative number when playback is
+// complete
+static double capture_play(t_capture_player *p, capture_sig_fn sig_fn,
+                           capture_update_fn update_fn, void *ctx)
+{
+    const t_capture_record *r;
+    t_capture_target *t;
+    mpr_time now;
+    int batch = 0;
+
+    mpr_time_set(&now, MPR_NOW);
+    while ((r = p->next)) {
+        if (CAPTURE_SIG == r->kind) {
+            int dir = 0;
+            void *target = sig_fn(ctx, r, (const char *)(r + 1), &dir);
+            capture_target_add(p, r->sig, target, dir);
+        }
+        else if (CAPTURE_UPDATE == r->kind || CAPTURE_RELEASE == r->kind) {
+            mpr_time time = {r->sec, r->frac};
+            if (!p->started) {
+                p->start = now;
+                p->first = time;
+                p->started = 1;
+            }
+            else if (p->speed > 0) {
+                double due = mpr_time_get_diff(time, p->first) / p->speed
+                             - mpr_time_get_diff(now, p->start);
+                if (due > 0)
+                    return due;
+            }
+            else if (++batch > CAPTURE_PLAY_BATCH)
+                return 0;
+            if ((t = capture_target_find(p, r->sig)) && t->target) {
+                update_fn(ctx, t->target, t->dir, r);
+                ++p->played;
+            }
+            else
+                ++p->skipped;
+        }
+        p->next = capture_log_next(&p->log, r);
+    }
+    return -1;
+}
+
+#endif // MPR_BINDINGS_CAPTURE_H
@@ -0,0 +1,1089 @@
+//
+// definition.h
+// single-pass reader for JSON device definitions, shared by the Max and
+// puredata builds
+//
+// A definition has the form of mapper/sample_device_definition.json:
+//
+//   {"device": {"name": "tester",
+//               "inputs": [{"name": "in1", "type": "f", "length": 1,
+//                           "units": "na", "minimum": 0, "maximum": 1}, ...],
+//               "outputs": [...]}}
+//
+// The file is read into one buffer and tokenized in place, so no tree is
+// built: definition_next() advances to the device name or to the next
+// complete signal and returns it, with strings pointing into the buffer
+// until definition_close(). Unknown keys holding a string or number are
+// passed on as extra properties; anything else is skipped. The device name
+// is only known before the device is created if it precedes the signals.
+//
+// Once a definition has been read to the end, it is also compiled into a
+// binary image next to it (<file>.mprc): a header, a flat table of signals
+// and their extra properties, and a table of interned strings. On later
+// loads the image is memory-mapped instead of parsing the JSON if the hash
+// of the JSON recorded in it still matches, and definition_next() returns
+// the same events from it. The image is in host byte order.
+//
+// definition_write() does the opposite, saving the signals of a running
+// device in the same format.
+//
+// This software was written in the Input Devices and Music Interaction
+// Laboratory at McGill University in Montreal, and is copyright those
+// found in the AUTHORS file.  It is licensed under the GNU Lesser Public
+// General License version 2.1 or later.  Please see COPYING for details.
+//
+
+#ifndef MPR_BINDINGS_DEFINITION_H
+#define MPR_BINDINGS_DEFINITION_H
+
+#include <mapper/mapper.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef WIN32
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+#include "atomic.h"
+
+#define DEFINITION_MAX_PROPS 32
+#define DEFINITION_CACHE_MAGIC "MPRDEF1"
+#define DEFINITION_CACHE_VERSION 1
+#define DEFINITION_CACHE_EXT ".mprc"
+#define DEFINITION_NONE 0xFFFFFFFF      // no string
+
+// events returned by definition_next()
+#define DEFINITION_END 0
+#define DEFINITION_NAME 1
+#define DEFINITION_SIG 2
+#define DEFINITION_ERROR -1
+
+typedef struct _definition_prop
+{
+    const char *key;
+    char type;                  // MPR_STR, MPR_INT32 or MPR_DBL
+    const char *str;
+    double num;
+} t_definition_prop;
+
+typedef struct _definition_sig
+{
+    mpr_dir dir;
+    const char *name;
+    char type;                  // MPR_INT32, MPR_FLT or MPR_DBL, 0 if unknown
+    const char *type_str;
+    int length;
+    const char *units;
+    int instances;              // 0 if not declared
+    int steal;                  // MPR_STEAL_NONE, _OLDEST or _NEWEST
+    char min_type;              // MPR_INT32 or MPR_DBL, 0 if not declared
+    char max_type;
+    double min;
+    double max;
+    int num_props;
+    t_definition_prop props[DEFINITION_MAX_PROPS];
+} t_definition_sig;
+
+typedef struct _definition_cache_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t size;              // of the whole image
+    uint64_t hash;              // of the JSON it was compiled from
+    uint32_t num_sigs;
+    uint32_t num_props;
+    uint32_t strings_size;      // the string table ends the image
+    uint32_t name;              // device name, or DEFINITION_NONE
+    uint32_t name_pos;          // number of signals preceding it
+    uint32_t reserved;
+} t_definition_cache_header;
+
+// strings are offsets into the string table
+typedef struct _definition_cache_sig
+{
+    uint32_t name;
+    uint32_t type_str;
+    uint32_t units;
+    uint32_t first_prop;
+    uint32_t num_props;
+    int32_t length;
+    int32_t instances;
+    int32_t steal;
+    uint8_t dir;
+    uint8_t type;
+    uint8_t min_type;
+    uint8_t max_type;
+    uint32_t reserved;
+    double min;
+    double max;
+} t_definition_cache_sig;
+
+typedef struct _definition_cache_prop
+{
+    uint32_t key;
+    uint32_t str;
+    uint8_t type;
+    uint8_t reserved[7];
+    double num;
+} t_definition_cache_prop;
+
+// an image being compiled while the JSON is read
+typedef struct _definition_cache
+{
+    char *path;
+    uint64_t hash;
+    t_definition_cache_header header;
+    t_definition_cache_sig *sigs;
+    uint32_t max_sigs;
+    t_definition_cache_prop *props;
+    uint32_t max_props;
+    char *strings;
+    uint32_t max_strings;
+    uint32_t *interned;         // open addressing, string offset + 1
+    uint32_t num_interned;
+    uint32_t max_interned;      // a power of two
+} t_definition_cache;
+
+typedef struct _definition
+{
+    char *text;                 // JSON, unless an image is used
+    char *pos;
+    int state;
+    int event;                  // last event returned
+    int first;                  // the next key or element is the first
+    mpr_dir dir;                // of the signal array being read
+    const char *name;           // device name once read
+    const char *error;
+    t_definition_sig sig;
+    t_definition_cache *cache;  // image being compiled, if any
+    const char *image;          // image being read, if any
+    uint64_t image_size;
+    uint32_t image_next;        // next signal of the image
+#ifdef WIN32
+    HANDLE image_file;
+    HANDLE image_mapping;
+#endif
+} t_definition;
+
+// reader states
+#define DEFINITION_TOP 0
+#define DEFINITION_DEVICE 1
+#define DEFINITION_ARRAY 2
+#define DEFINITION_DONE 3
+
+// *********************************************************
+// -(tokens)------------------------------------------------
+static void definition_ws(t_definition *d)
+{
+    while (*d->pos == ' ' || *d->pos == '\t' || *d->pos == '\n' || *d->pos == '\r')
+        ++d->pos;
+}
+
+static int definition_fail(t_definition *d, const char *error)
+{
+    d->error = error;
+    d->state = DEFINITION_DONE;
+    return d->event = DEFINITION_ERROR;
+}
+
+// skip whitespace and consume c if it is next
+static int definition_accept(t_definition *d, char c)
+{
+    definition_ws(d);
+    if (*d->pos != c)
+        return 0;
+    ++d->pos;
+    return 1;
+}
+
+static int definition_hex(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// unescape a string in place and terminate it, returning 0 if malformed;
+// the result is never longer than its quoted form
+static char *definition_string(t_definition *d)
+{
+    char *out, *start;
+
+    if (!definition_accept(d, '"'))
+        return 0;
+    out = start = d->pos;
+    while (*d->pos != '"') {
+        char c = *d->pos++;
+        if (!c)
+            return 0;
+        if (c != '\\') {
+            *out++ = c;
+            continue;
+        }
+        switch (c = *d->pos++) {
+            case 'b': *out++ = '\b';    break;
+            case 'f': *out++ = '\f';    break;
+            case 'n': *out++ = '\n';    break;
+            case 'r': *out++ = '\r';    break;
+            case 't': *out++ = '\t';    break;
+            case 'u': {
+                unsigned int u = 0;
+                int i, h;
+                for (i = 0; i < 4; i++) {
+                    if ((h = definition_hex(d->pos[i])) < 0)
+                        return 0;
+                    u = (u << 4) | h;
+                }
+                d->pos += 4;
+                // code points above the BMP are left as their surrogates
+                if (u < 0x80)
+                    *out++ = (char)u;
+                else if (u < 0x800) {
+                    *out++ = (char)(0xC0 | (u >> 6));
+                    *out++ = (char)(0x80 | (u & 0x3F));
+                }
+                else {
+                    *out++ = (char)(0xE0 | (u >> 12));
+                    *out++ = (char)(0x80 | ((u >> 6) & 0x3F));
+                    *out++ = (char)(0x80 | (u & 0x3F));
+                }
+                break;
+            }
+            case 0:
+                return 0;
+            default:
+                *out++ = c;
+                break;
+        }
+    }
+    ++d->pos;
+    *out = 0;
+    return start;
+}
+
+// returns MPR_INT32 or MPR_DBL, or 0 if no number is next
+static char definition_number(t_definition *d, double *num)
+{
+    char *end, *c;
+    int integer = 1;
+
+    definition_ws(d);
+    if (*d->pos != '-' && (*d->pos < '0' || *d->pos > '9'))
+        return 0;
+    *num = strtod(d->pos, &end);
+    if (end == d->pos)
+        return 0;
+    for (c = d->pos; c < end; c++) {
+        if (*c == '.' || *c == 'e' || *c == 'E')
+            integer = 0;
+    }
+    d->pos = end;
+    return integer ? MPR_INT32 : MPR_DBL;
+}
+
+// skip any value, returning 0 if malformed
+static int definition_skip(t_definition *d)
+{
+    int depth = 0;
+    double num;
+
+    do {
+        definition_ws(d);
+        switch (*d->pos) {
+            case '"':
+                if (!definition_string(d))
+                    return 0;
+                break;
+            case '{':
+            case '[':
+                ++depth;
+                ++d->pos;
+                continue;
+            case '}':
+            case ']':
+                if (--depth < 0)
+                    return 0;
+                ++d->pos;
+                break;
+            case ',':
+            case ':':
+                if (!depth)
+                    return 0;
+                ++d->pos;
+                continue;
+            case 't':
+            case 'n':
+                if (strncmp(d->pos, "true", 4) && strncmp(d->pos, "null", 4))
+                    return 0;
+                d->pos += 4;
+                break;
+            case 'f':
+                if (strncmp(d->pos, "false", 5))
+                    return 0;
+                d->pos += 5;
+                break;
+            default:
+                if (!definition_number(d, &num))
+                    return 0;
+                break;
+        }
+    } while (depth);
+    return 1;
+}
+
+// read '"key":', returning the key or 0 at the end of the object
+static char *definition_key(t_definition *d, int first, int *ok)
+{
+    char *key;
+
+    *ok = 1;
+    if (definition_accept(d, '}'))
+        return 0;
+    if ((!first && !definition_accept(d, ',')) || !(key = definition_string(d))
+        || !definition_accept(d, ':')) {
+        *ok = 0;
+        return 0;
+    }
+    return key;
+}
+
+// *********************************************************
+// -(signals)-----------------------------------------------
+static char definition_type(const char *type)
+{
+    if (!strcmp(type, "i") || !strcmp(type, "int"))
+        return MPR_INT32;
+    if (!strcmp(type, "f") || !strcmp(type, "float"))
+        return MPR_FLT;
+    if (!strcmp(type, "d") || !strcmp(type, "double"))
+        return MPR_DBL;
+    return 0;
+}
+
+static int definition_read_sig(t_definition *d)
+{
+    t_definition_sig *s = &d->sig;
+    int first = 1, ok;
+    char *key, *str, type;
+    double num;
+
+    memset(s, 0, sizeof(t_definition_sig));
+    s->dir = d->dir;
+    s->length = 1;
+    s->steal = MPR_STEAL_NONE;
+    if (!definition_accept(d, '{'))
+        return 0;
+    while ((key = definition_key(d, first, &ok))) {
+        first = 0;
+        definition_ws(d);
+        if ('"' == *d->pos) {
+            if (!(str = definition_string(d)))
+                return 0;
+            if (!strcmp(key, "name"))
+                s->name = str;
+            else if (!strcmp(key, "type")) {
+                s->type_str = str;
+                s->type = definition_type(str);
+            }
+            else if (!strcmp(key, "units"))
+                s->units = str;
+            else if (!strcmp(key, "stealing") || !strcmp(key, "steal")) {
+                if (!strcmp(str, "oldest"))
+                    s->steal = MPR_STEAL_OLDEST;
+                else if (!strcmp(str, "newest"))
+                    s->steal = MPR_STEAL_NEWEST;
+            }
+            else if (s->num_props < DEFINITION_MAX_PROPS) {
+                t_definition_prop *p = &s->props[s->num_props++];
+                p->key = key;
+                p->type = MPR_STR;
+                p->str = str;
+            }
+        }
+        else if ((type = definition_number(d, &num))) {
+            if (!strcmp(key, "length"))
+                s->length = (int)num;
+            else if (!strcmp(key, "instances"))
+                s->instances = (int)num;
+            else if (!strcmp(key, "minimum") || !strcmp(key, "min")) {
+                s->min_type = type;
+                s->min = num;
+            }
+            else if (!strcmp(key, "maximum") || !strcmp(key, "max")) {
+                s->max_type = type;
+                s->max = num;
+            }
+            else if (s->num_props < DEFINITION_MAX_PROPS) {
+                t_definition_prop *p = &s->props[s->num_props++];
+                p->key = key;
+                p->type = type;
+                p->num = num;
+            }
+        }
+        else if (!definition_skip(d))
+            return 0;
+    }
+    return ok;
+}
+
+// *********************************************************
+// -(parsing)-----------------------------------------------
+// advance to the next device name or signal; at the end of the device
+// object the rest of the file is ignored
+static int definition_parse(t_definition *d)
+{
+    char *key;
+    int first, ok;
+
+    while (1) {
+        switch (d->state) {
+            case DEFINITION_TOP:
+                if (!definition_accept(d, '{'))
+                    return definition_fail(d, "expected an object");
+                for (first = 1; (key = definition_key(d, first, &ok)); first = 0) {
+                    if (!strcmp(key, "device"))
+                        break;
+                    if (!definition_skip(d))
+                        return definition_fail(d, "malformed value");
+                }
+                if (!ok)
+                    return definition_fail(d, "malformed object");
+                if (!key || !definition_accept(d, '{'))
+                    return definition_fail(d, "no device object");
+                d->state = DEFINITION_DEVICE;
+                d->first = 1;
+                break;
+            case DEFINITION_DEVICE:
+                first = d->first;
+                d->first = 0;
+                if (!(key = definition_key(d, first, &ok))) {
+                    if (!ok)
+                        return definition_fail(d, "malformed device object");
+                    d->state = DEFINITION_DONE;
+                    break;
+                }
+                if (!strcmp(key, "name")) {
+                    definition_ws(d);
+                    if ('"' == *d->pos) {
+                        if (!(d->name = definition_string(d)))
+                            return definition_fail(d, "malformed device name");
+                        return d->event = DEFINITION_NAME;
+                    }
+                }
+                else if (!strcmp(key, "inputs") || !strcmp(key, "outputs")) {
+                    d->dir = 'i' == *key ? MPR_DIR_IN : MPR_DIR_OUT;
+                    if (definition_accept(d, '[')) {
+                        d->state = DEFINITION_ARRAY;
+                        d->first = 1;
+                        break;
+                    }
+                }
+                if (!definition_skip(d))
+                    return definition_fail(d, "malformed value");
+                break;
+            case DEFINITION_ARRAY:
+                first = d->first;
+                d->first = 0;
+                if (definition_accept(d, ']')) {
+                    d->state = DEFINITION_DEVICE;
+                    break;
+                }
+                if ((!first && !definition_accept(d, ',')) || !definition_read_sig(d))
+                    return definition_fail(d, "malformed signal");
+                return d->event = DEFINITION_SIG;
+            default:
+                return d->event = d->error ? DEFINITION_ERROR : DEFINITION_END;
+        }
+    }
+}
+
+// *********************************************************
+// -(compiling)---------------------------------------------
+// FNV-1a, folding in eight bytes at a time
+static uint64_t definition_hash(const char *data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL, word;
+    size_t i;
+    for (i = 0; i + 8 <= size; i += 8) {
+        memcpy(&word, data + i, 8);
+        hash ^= word;
+        hash *= 1099511628211ULL;
+    }
+    for (; i < size; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// grow an array so that it holds at least n elements
+static int definition_reserve(void **array, uint32_t *max, uint32_t n, size_t size)
+{
+    uint32_t m = *max ? *max : 64;
+    void *grown;
+    if (n <= *max)
+        return 1;
+    while (m < n)
+        m *= 2;
+    if (!(grown = realloc(*array, m * size)))
+        return 0;
+    *array = grown;
+    *max = m;
+    return 1;
+}
+
+static void definition_cache_free(t_definition_cache *c)
+{
+    free(c->path);
+    free(c->sigs);
+    free(c->props);
+    free(c->strings);
+    free(c->interned);
+    free(c);
+}
+
+// add a string to the string table once, returning its offset
+static uint32_t definition_intern(t_definition_cache *c, const char *str)
+{
+    t_definition_cache_header *h = &c->header;
+    uint32_t len, hash, i, offset;
+
+    if (!str)
+        return DEFINITION_NONE;
+    len = (uint32_t)strlen(str);
+    hash = (uint32_t)definition_hash(str, len);
+    if (c->num_interned * 2 >= c->max_interned) {
+        // rehash into a table twice the size
+        uint32_t max = c->max_interned ? c->max_interned * 2 : 256, j;
+        uint32_t *interned = (uint32_t *)calloc(max, sizeof(uint32_t));
+        if (!interned)
+            return DEFINITION_NONE;
+        for (j = 0; j < c->max_interned; j++) {
+            const char *s;
+            if (!c->interned[j])
+                continue;
+            s = c->strings + c->interned[j] - 1;
+            i = (uint32_t)definition_hash(s, strlen(s)) & (max - 1);
+            while (interned[i])
+                i = (i + 1) & (max - 1);
+            interned[i] = c->interned[j];
+        }
+        free(c->interned);
+        c->interned = interned;
+        c->max_interned = max;
+    }
+    for (i = hash & (c->max_interned - 1); c->interned[i]; i = (i + 1) & (c->max_interned - 1)) {
+        if (!strcmp(c->strings + c->interned[i] - 1, str))
+            return c->interned[i] - 1;
+    }
+    if (!definition_reserve((void **)&c->strings, &c->max_strings,
+                            h->strings_size + len + 1, 1))
+        return DEFINITION_NONE;
+    offset = h->strings_size;
+    memcpy(c->strings + offset, str, len + 1);
+    h->strings_size += len + 1;
+    c->interned[i] = offset + 1;
+    ++c->num_interned;
+    return offset;
+}
+
+// append the signal just read to the image
+static int definition_cache_sig(t_definition_cache *c, t_definition_sig *sig)
+{
+    t_definition_cache_header *h = &c->header;
+    t_definition_cache_sig *s;
+    int i;
+
+    if (!definition_reserve((void **)&c->sigs, &c->max_sigs, h->num_sigs + 1,
+                            sizeof(t_definition_cache_sig))
+        || !definition_reserve((void **)&c->props, &c->max_props,
+                               h->num_props + sig->num_props,
+                               sizeof(t_definition_cache_prop)))
+        return 0;
+    s = &c->sigs[h->num_sigs++];
+    memset(s, 0, sizeof(*s));
+    s->name = definition_intern(c, sig->name);
+    s->type_str = definition_intern(c, sig->type_str);
+    s->units = definition_intern(c, sig->units);
+    s->first_prop = h->num_props;
+    s->num_props = sig->num_props;
+    s->length = sig->length;
+    s->instances = sig->instances;
+    s->steal = sig->steal;
+    s->dir = (uint8_t)sig->dir;
+    s->type = (uint8_t)sig->type;
+    s->min_type = (uint8_t)sig->min_type;
+    s->max_type = (uint8_t)sig->max_type;
+    s->min = sig->min;
+    s->max = sig->max;
+    for (i = 0; i < sig->num_props; i++) {
+        t_definition_cache_prop *p = &c->props[h->num_props++];
+        memset(p, 0, sizeof(*p));
+        p->key = definition_intern(c, sig->props[i].key);
+        p->str = definition_intern(c, sig->props[i].str);
+        p->type = (uint8_t)sig->props[i].type;
+        p->num = sig->props[i].num;
+    }
+    return 1;
+}
+
+// write the image next to the definition, through a temporary file so that
+// a reader never maps a partial one; failing to write it is not an error
+static void definition_cache_write(t_definition_cache *c)
+{
+    t_definition_cache_header *h = &c->header;
+    size_t sigs = h->num_sigs * sizeof(t_definition_cache_sig);
+    size_t props = h->num_props * sizeof(t_definition_cache_prop);
+    char *image, *p;
+
+    memcpy(h->magic, DEFINITION_CACHE_MAGIC, 8);
+    h->version = DEFINITION_CACHE_VERSION;
+    h->hash = c->hash;
+    h->size = (uint32_t)(sizeof(*h) + sigs + props + h->strings_size);
+    if (!(image = p = (char *)malloc(h->size)))
+        return;
+    memcpy(p, h, sizeof(*h));
+    p += sizeof(*h);
+    if (sigs)
+        memcpy(p, c->sigs, sigs);
+    p += sigs;
+    if (props)
+        memcpy(p, c->props, props);
+    p += props;
+    if (h->strings_size)
+        memcpy(p, c->strings, h->strings_size);
+    atomic_write(c->path, image, h->size);
+    free(image);
+}
+
+// *********************************************************
+// -(image)-------------------------------------------------
+static void definition_image_unmap(t_definition *d)
+{
+    if (!d->image)
+        return;
+#ifdef WIN32
+    UnmapViewOfFile(d->image);
+    CloseHandle(d->image_mapping);
+    CloseHandle(d->image_file);
+#else
+    munmap((void *)d->image, d->image_size);
+#endif
+    d->image = 0;
+}
+
+static int definition_image_str_ok(const t_definition_cache_header *h, uint32_t offset)
+{
+    return DEFINITION_NONE == offset || offset < h->strings_size;
+}
+
+// check that every offset in a mapped image stays inside it
+static int definition_image_check(const char *image, uint64_t size, uint64_t hash)
+{
+    const t_definition_cache_header *h = (const t_definition_cache_header *)image;
+    const t_definition_cache_sig *sigs;
+    const t_definition_cache_prop *props;
+    uint64_t expected;
+    uint32_t i;
+
+    if (size < sizeof(*h) || memcmp(h->magic, DEFINITION_CACHE_MAGIC, 8)
+        || h->version != DEFINITION_CACHE_VERSION || h->size != size || h->hash != hash)
+        return 0;
+    expected = sizeof(*h) + (uint64_t)h->num_sigs * sizeof(t_definition_cache_sig)
+               + (uint64_t)h->num_props * sizeof(t_definition_cache_prop) + h->strings_size;
+    if (expected != size || (h->strings_size && image[size - 1])
+        || !definition_image_str_ok(h, h->name) || h->name_pos > h->num_sigs)
+        return 0;
+    sigs = (const t_definition_cache_sig *)(image + sizeof(*h));
+    props = (const t_definition_cache_prop *)(sigs + h->num_sigs);
+    for (i = 0; i < h->num_sigs; i++) {
+        const t_definition_cache_sig *s = &sigs[i];
+        if (DEFINITION_NONE == s->name || !definition_image_str_ok(h, s->type_str)
+            || !definition_image_str_ok(h, s->units) || s->name >= h->strings_size
+            || s->num_props > DEFINITION_MAX_PROPS || s->first_prop > h->num_props
+            || s->num_props > h->num_props - s->first_prop)
+            return 0;
+    }
+    for (i = 0; i < h->num_props; i++) {
+        if (props[i].key >= h->strings_size || !definition_image_str_ok(h, props[i].str))
+            return 0;
+    }
+    return 1;
+}
+
+// map an image compiled from a definition with the given hash, returning 0
+// if there is none or it is stale
+static int definition_image_open(t_definition *d, const char *path, uint64_t hash)
+{
+#ifdef WIN32
+    LARGE_INTEGER size;
+    d->image_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (INVALID_HANDLE_VALUE == d->image_file)
+        return 0;
+    if (!GetFileSizeEx(d->image_file, &size) || !size.QuadPart
+        || !(d->image_mapping = CreateFileMappingA(d->image_file, NULL, PAGE_READONLY,
+                                                   0, 0, NULL))) {
+        CloseHandle(d->image_file);
+        return 0;
+    }
+    if (!(d->image = (const char *)MapViewOfFile(d->image_mapping, FILE_MAP_READ, 0, 0, 0))) {
+        CloseHandle(d->image_mapping);
+        CloseHandle(d->image_file);
+        return 0;
+    }
+    d->image_size = size.QuadPart;
+#else
+    struct stat st;
+    void *image;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    if (fstat(fd, &st) || !st.st_size
+        || MAP_FAILED == (image = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0))) {
+        close(fd);
+        return 0;
+    }
+    // the mapping stays valid once the descriptor is closed
+    close(fd);
+    d->image = (const char *)image;
+    d->image_size = st.st_size;
+#endif
+    if (!definition_image_check(d->image, d->image_size, hash)) {
+        definition_image_unmap(d);
+        return 0;
+    }
+    return 1;
+}
+
+static const char *definition_image_str(t_definition *d, uint32_t offset)
+{
+    const t_definition_cache_header *h = (const t_definition_cache_header *)d->image;
+    if (DEFINITION_NONE == offset)
+        return 0;
+    return d->image + h->size - h->strings_size + offset;
+}
+
+static int definition_image_next(t_definition *d)
+{
+    const t_definition_cache_header *h = (const t_definition_cache_header *)d->image;
+    const t_definition_cache_sig *s = (const t_definition_cache_sig *)(d->image + sizeof(*h));
+    const t_definition_cache_prop *p = (const t_definition_cache_prop *)(s + h->num_sigs);
+    t_definition_sig *sig = &d->sig;
+    uint32_t i;
+
+    if (DEFINITION_DONE == d->state)
+        return d->event = DEFINITION_END;
+    if (!d->name && DEFINITION_NONE != h->name && d->image_next == h->name_pos) {
+        d->name = definition_image_str(d, h->name);
+        return d->event = DEFINITION_NAME;
+    }
+    if (d->image_next >= h->num_sigs) {
+        d->state = DEFINITION_DONE;
+        return d->event = DEFINITION_END;
+    }
+    s += d->image_next++;
+    sig->dir = (mpr_dir)s->dir;
+    sig->name = definition_image_str(d, s->name);
+    sig->type = (char)s->type;
+    sig->type_str = definition_image_str(d, s->type_str);
+    sig->length = s->length;
+    sig->units = definition_image_str(d, s->units);
+    sig->instances = s->instances;
+    sig->steal = s->steal;
+    sig->min_type = (char)s->min_type;
+    sig->max_type = (char)s->max_type;
+    sig->min = s->min;
+    sig->max = s->max;
+    sig->num_props = s->num_props;
+    for (i = 0; i < s->num_props; i++) {
+        const t_definition_cache_prop *from = &p[s->first_prop + i];
+        sig->props[i].key = definition_image_str(d, from->key);
+        sig->props[i].type = (char)from->type;
+        sig->props[i].str = definition_image_str(d, from->str);
+        sig->props[i].num = from->num;
+    }
+    return d->event = DEFINITION_SIG;
+}
+
+// *********************************************************
+// -(reading)-----------------------------------------------
+// advance to the next device name or signal, from the image if one was
+// mapped; a definition parsed without error is compiled as it is read
+static int definition_next(t_definition *d)
+{
+    t_definition_cache *c = d->cache;
+
+    if (d->image)
+        return definition_image_next(d);
+    definition_parse(d);
+    if (!c)
+        return d->event;
+    switch (d->event) {
+        case DEFINITION_NAME:
+            c->header.name = definition_intern(c, d->name);
+            c->header.name_pos = c->header.num_sigs;
+            break;
+        case DEFINITION_SIG:
+            if (definition_cache_sig(c, &d->sig))
+                break;
+            // out of memory: give up on the image
+            // fall through
+        case DEFINITION_ERROR:
+            definition_cache_free(c);
+            d->cache = 0;
+            break;
+        default:
+            definition_cache_write(c);
+            definition_cache_free(c);
+            d->cache = 0;
+            break;
+    }
+    return d->event;
+}
+
+// read a definition into memory, returning 0 if it cannot be read; if an
+// up-to-date image of it exists, that is mapped instead of parsing it
+static t_definition *definition_open(const char *path)
+{
+    t_definition *d;
+    FILE *f = fopen(path, "rb");
+    long size;
+    uint64_t hash;
+    char *image_path;
+    size_t len = strlen(path) + sizeof(DEFINITION_CACHE_EXT);
+
+    if (!f)
+        return 0;
+    if (fseek(f, 0, SEEK_END) || (size = ftell(f)) < 0 || fseek(f, 0, SEEK_SET)
+        || !(d = (t_definition *)calloc(1, sizeof(t_definition)))) {
+        fclose(f);
+        return 0;
+    }
+    if (!(d->text = (char *)malloc(size + 1)) || fread(d->text, 1, size, f) != (size_t)size) {
+        fclose(f);
+        free(d->text);
+        free(d);
+        return 0;
+    }
+    fclose(f);
+    d->text[size] = 0;
+    d->pos = d->text;
+    // skip a UTF-8 byte order mark
+    if (!strncmp(d->pos, "\xEF\xBB\xBF", 3))
+        d->pos += 3;
+
+    hash = definition_hash(d->text, size);
+    if (!(image_path = (char *)malloc(len)))
+        return d;
+    snprintf(image_path, len, "%s%s", path, DEFINITION_CACHE_EXT);
+    if (definition_image_open(d, image_path, hash)) {
+        free(image_path);
+        free(d->text);
+        d->text = d->pos = 0;
+        return d;
+    }
+    if (!(d->cache = (t_definition_cache *)calloc(1, sizeof(t_definition_cache)))) {
+        free(image_path);
+        return d;
+    }
+    d->cache->path = image_path;
+    d->cache->hash = hash;
+    d->cache->header.name = DEFINITION_NONE;
+    return d;
+}
+
+// line number of the current position, for error messages
+static int definition_line(t_definition *d)
+{
+    const char *c;
+    int line = 1;
+    if (!d->text)
+        return 0;
+    for (c = d->text; c < d->pos; c++)
+        line += '\n' == *c;
+    return line;
+}
+
+static void definition_close(t_definition *d)
+{
+    if (d->cache)
+        definition_cache_free(d->cache);
+    definition_image_unmap(d);
+    free(d->text);
+    free(d);
+}
+
+// *********************************************************
+// -(writing)-----------------------------------------------
+static void definition_write_string(FILE *f, const char *str)
+{
+    fputc('"', f);
+    for (; *str; str++) {
+        unsigned char c = (unsigned char)*str;
+        if ('"' == c || '\\' == c)
+            fprintf(f, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(f, "\\u%04x", c);
+        else
+            fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+// format one element of a value as a JSON number, with a decimal point
+// for reals so that they are read back as such; returns 0 if the type or
+// value has no JSON number
+static int definition_format_number(char *buf, int size, mpr_type type,
+                                    const void *val, int idx)
+{
+    double num;
+
+    if (MPR_INT32 == type) {
+        snprintf(buf, size, "%d", ((const int *)val)[idx]);
+        return 1;
+    }
+    if (MPR_FLT == type)
+        num = ((const float *)val)[idx];
+    else if (MPR_DBL == type)
+        num = ((const double *)val)[idx];
+    else
+        return 0;
+    // infinity or NaN
+    if (num - num != 0)
+        return 0;
+    snprintf(buf, size, MPR_FLT == type ? "%.9g" : "%.17g", num);
+    if (strspn(buf, "-0123456789") == strlen(buf))
+        strncat(buf, ".0", size - strlen(buf) - 1);
+    return 1;
+}
+
+// a minimum or maximum is declared as one number, so a vector range is only
+// written if all of its elements are equal
+static void definition_write_range(FILE *f, mpr_sig sig, mpr_prop prop, const char *key)
+{
+    char buf[32], other[32];
+    const void *val = NULL;
+    mpr_type type = 0;
+    int len = 0, pub, i;
+
+    mpr_obj_get_prop_by_idx(sig, prop, NULL, &len, &type, &val, &pub);
+    if (len < 1 || !val || !definition_format_number(buf, 32, type, val, 0))
+        return;
+    for (i = 1; i < len; i++) {
+        definition_format_number(other, 32, type, val, i);
+        if (strcmp(buf, other))
+            return;
+    }
+    fprintf(f, ",\n                \"%s\" : %s", key, buf);
+}
+
+// keys with a meaning of their own in a definition
+static int definition_reserved(const char *key)
+{
+    static const char *reserved[] = {"name", "type", "length", "units", "instances",
+        "minimum", "min", "maximum", "max", "stealing", "steal", 0};
+    int i;
+    for (i = 0; reserved[i]; i++) {
+        if (!strcmp(key, reserved[i]))
+            return 1;
+    }
+    return 0;
+}
+
+static void definition_write_sig(FILE *f, mpr_sig sig, int first)
+{
+    const char *units = mpr_obj_get_prop_as_str(sig, MPR_PROP_UNIT, NULL);
+    int i, num_props, steal;
+
+    fprintf(f, "%s\n            {\n                \"name\" : ", first ? "" : ",");
+    definition_write_string(f, mpr_obj_get_prop_as_str(sig, MPR_PROP_NAME, NULL));
+    fprintf(f, ",\n                \"type\" : \"%c\"",
+            (char)mpr_obj_get_prop_as_int32(sig, MPR_PROP_TYPE, NULL));
+    fprintf(f, ",\n                \"length\" : %d",
+            mpr_obj_get_prop_as_int32(sig, MPR_PROP_LEN, NULL));
+    if (units) {
+        fprintf(f, ",\n                \"units\" : ");
+        definition_write_string(f, units);
+    }
+    definition_write_range(f, sig, MPR_PROP_MIN, "minimum");
+    definition_write_range(f, sig, MPR_PROP_MAX, "maximum");
+    if (mpr_obj_get_prop_as_int32(sig, MPR_PROP_USE_INST, NULL))
+        fprintf(f, ",\n                \"instances\" : %d",
+                mpr_sig_get_num_inst(sig, MPR_STATUS_ALL));
+    steal = mpr_obj_get_prop_as_int32(sig, MPR_PROP_STEAL_MODE, NULL);
+    if (MPR_STEAL_OLDEST == steal || MPR_STEAL_NEWEST == steal)
+        fprintf(f, ",\n                \"stealing\" : \"%s\"",
+                MPR_STEAL_OLDEST == steal ? "oldest" : "newest");
+
+    // other properties holding a string or a number
+    num_props = mpr_obj_get_num_props(sig, 0);
+    for (i = 0; i < num_props; i++) {
+        const char *key = NULL;
+        const void *val = NULL;
+        mpr_type type = 0;
+        int len = 0, pub;
+        char buf[32];
+
+        if (MPR_PROP_EXTRA != mpr_obj_get_prop_by_idx(sig, i, &key, &len, &type, &val, &pub)
+            || !key || 1 != len || !val || definition_reserved(key))
+            continue;
+        if (MPR_STR == type) {
+            fprintf(f, ",\n                ");
+            definition_write_string(f, key);
+            fprintf(f, " : ");
+            definition_write_string(f, (const char *)val);
+        }
+        else if (definition_format_number(buf, 32, type, val, 0)) {
+            fprintf(f, ",\n                ");
+            definition_write_string(f, key);
+            fprintf(f, " : %s", buf);
+        }
+    }
+    fprintf(f, "\n            }");
+}
+
+// write the signals of a device as a definition in the format read above,
+// returning the number of signals written or -1 if the file cannot be written
+static int definition_write(const char *path, mpr_dev dev, const char *name)
+{
+    FILE *f = fopen(path, "w");
+    int count = 0, dir, err;
+
+    if (!f)
+        return -1;
+    fprintf(f, "{\n    \"device\" : {\n        \"fileversion\" : \"dot-1\"");
+    if (name) {
+        fprintf(f, ",\n        \"name\" : ");
+        definition_write_string(f, name);
+    }
+    for (dir = 0; dir < 2; dir++) {
+        mpr_list sigs = mpr_dev_get_sigs(dev, dir ? MPR_DIR_OUT : MPR_DIR_IN);
+        int first = 1;
+        fprintf(f, ",\n        \"%s\" : [", dir ? "outputs" : "inputs");
+        while (sigs) {
+            definition_write_sig(f, *sigs, first);
+            first = 0;
+            ++count;
+            sigs = mpr_list_get_next(sigs);
+        }
+        fprintf(f, first ? "]" : "\n        ]");
+    }
+    fprintf(f, "\n    }\n}\n");
+    err = ferror(f);
+    if (fclose(f) || err)
+        return -1;
+    return count;
+}
+
+#endif // MPR_BINDINGS_DEFINITION_H
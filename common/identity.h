@@ -0,0 +1,118 @@
+//
+// identity.h
+// persistent device identity: the name, ordinal and port a device claimed
+// on the mapping network, saved so that it can ask for the same ones when
+// the patch is next opened
+//
+// The file holds one "key value" pair per line:
+//
+//   name tester.2
+//   ordinal 2
+//   port 9002
+//
+// Before the device registers, identity_hint() sets the stored ordinal and
+// port on it, unpublished, in the hope that libmapper starts probing from
+// them instead of stepping up from 1 past every device sharing the name.
+// This is a hint only: libmapper's public API offers no way to request an
+// ordinal or port, and whether it reads these properties before it
+// registers depends on its version. Either way the name is probed on the
+// bus, so the device may end up with a different one, which
+// identity_update() then reports; the file stays correct regardless.
+//
+// This software was written in the Input Devices and Music Interaction
+// Laboratory at McGill University in Montreal, and is copyright those
+// found in the AUTHORS file.  It is licensed under the GNU Lesser Public
+// General License version 2.1 or later.  Please see COPYING for details.
+//
+
+#ifndef MPR_BINDINGS_IDENTITY_H
+#define MPR_BINDINGS_IDENTITY_H
+
+#include <mapper/mapper.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "atomic.h"
+
+#define IDENTITY_MAX_NAME 256
+
+typedef struct _identity
+{
+    char name[IDENTITY_MAX_NAME];   // full name, <prefix>.<ordinal>
+    int ordinal;                    // 0 if unknown
+    int port;
+} t_identity;
+
+// read a stored identity, returning 0 if there is none
+static int identity_read(const char *path, t_identity *id)
+{
+    char line[IDENTITY_MAX_NAME + 32], key[16], value[IDENTITY_MAX_NAME];
+    FILE *f;
+
+    memset(id, 0, sizeof(t_identity));
+    if (!(f = fopen(path, "r")))
+        return 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%15s %255s", key, value) != 2)
+            continue;
+        if (!strcmp(key, "name"))
+            snprintf(id->name, IDENTITY_MAX_NAME, "%s", value);
+        else if (!strcmp(key, "ordinal"))
+            id->ordinal = atoi(value);
+        else if (!strcmp(key, "port"))
+            id->port = atoi(value);
+    }
+    fclose(f);
+    return id->name[0] != 0;
+}
+
+// the name without its ordinal, which is what a device is created with
+static const char *identity_prefix(const t_identity *id, char *prefix, int size)
+{
+    char *dot;
+
+    snprintf(prefix, size, "%s", id->name);
+    if ((dot = strrchr(prefix, '.')) && dot[1]
+        && strspn(dot + 1, "0123456789") == strlen(dot + 1))
+        *dot = 0;
+    return prefix;
+}
+
+// suggest the stored ordinal and port to a device that has not registered
+// yet; libmapper is free to ignore them
+static void identity_hint(mpr_dev dev, const t_identity *id)
+{
+    if (id->ordinal > 0)
+        mpr_obj_set_prop(dev, MPR_PROP_ORDINAL, NULL, 1, MPR_INT32, &id->ordinal, 0);
+    if (id->port > 0)
+        mpr_obj_set_prop(dev, MPR_PROP_PORT, NULL, 1, MPR_INT32, &id->port, 0);
+}
+
+// record the identity of a ready device, returning 1 if it differs from
+// the one stored before
+static int identity_update(t_identity *id, mpr_dev dev)
+{
+    const char *name = mpr_obj_get_prop_as_str(dev, MPR_PROP_NAME, NULL);
+    t_identity now;
+
+    memset(&now, 0, sizeof(t_identity));
+    snprintf(now.name, IDENTITY_MAX_NAME, "%s", name ? name : "");
+    now.ordinal = mpr_obj_get_prop_as_int32(dev, MPR_PROP_ORDINAL, NULL);
+    now.port = mpr_obj_get_prop_as_int32(dev, MPR_PROP_PORT, NULL);
+    if (!strcmp(now.name, id->name) && now.ordinal == id->ordinal && now.port == id->port)
+        return 0;
+    *id = now;
+    return 1;
+}
+
+// save an identity through a temporary file, returning 0 on failure
+static int identity_write(const char *path, const t_identity *id)
+{
+    char text[IDENTITY_MAX_NAME + 64];
+    int len = snprintf(text, sizeof(text), "name %s\nordinal %d\nport %d\n",
+                       id->name, id->ordinal, id->port);
+    return atomic_write(path, text, len);
+}
+
+#endif // MPR_BINDINGS_IDENTITY_H
@@ -0,0 +1,72 @@
+//
+// latency.h
+// log-bucketed histograms of the latency of received values, from which
+// the mapper and mpr.device objects report percentiles
+//
+// Buckets are a quarter octave wide from 1us to about 17s, so a reported
+// percentile is the upper edge of its bucket and within 12.5% of the true
+// value; it is capped at the largest latency seen. Adding a value costs a
+// frexp() and an increment, so histograms can stay on under load.
+//
+// This software was written in the Input Devices and Music Interaction
+// Laboratory at McGill University in Montreal, and is copyright those
+// found in the AUTHORS file.  It is licensed under the GNU Lesser Public
+// General License version 2.1 or later.  Please see COPYING for details.
+//
+
+#ifndef MPR_BINDINGS_LATENCY_H
+#define MPR_BINDINGS_LATENCY_H
+
+#include <math.h>
+
+#define LATENCY_BUCKETS 100
+
+typedef struct _latency
+{
+    unsigned int counts[LATENCY_BUCKETS];
+    unsigned int total;
+    double max;                     // seconds
+} t_latency;
+
+static int latency_bucket(double latency)
+{
+    int exp;
+    double frac;
+    if (latency < 1e-6)
+        return 0;
+    frac = frexp(latency * 1e6, &exp);
+    exp = 1 + (exp - 1) * 4 + (int)((frac - 0.5) * 8);
+    return exp < LATENCY_BUCKETS ? exp : LATENCY_BUCKETS - 1;
+}
+
+static double latency_bucket_max(int bucket)
+{
+    if (bucket < 1)
+        return 1e-6;
+    --bucket;
+    return ldexp(0.5 + (bucket % 4 + 1) * 0.125, bucket / 4 + 1) * 1e-6;
+}
+
+// latency in seconds
+static void latency_add(t_latency *l, double latency)
+{
+    // negative timetag latencies come from unsynchronised clocks
+    ++l->counts[latency_bucket(latency)];
+    ++l->total;
+    if (latency > l->max)
+        l->max = latency;
+}
+
+// p between 0 and 1, in seconds
+static double latency_percentile(t_latency *l, double p)
+{
+    unsigned int i, count = 0, rank = (unsigned int)ceil(l->total * p);
+    for (i = 0; i < LATENCY_BUCKETS; i++) {
+        count += l->counts[i];
+        if (count >= rank)
+            break;
+    }
+    return fmin(latency_bucket_max(i), l->max);
+}
+
+#endif // MPR_BINDINGS_LATENCY_H
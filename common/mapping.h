@@ -0,0 +1,545 @@
+//
+// mapping.h
+// bulk creation of maps listed in a JSON mapping file, in the layout saved
+// by libmapper's session tools:
+//
+//   {"fileversion": "2.4",
+//    "mapping": {"maps": [{"sources": ["tester.1/out/1"],
+//                          "destinations": ["synth.1/in/1"],
+//                          "expression": "y=x*0.5",
+//                          "muted": false, "process_loc": "src",
+//                          "protocol": "udp", "use_inst": false}, ...]}}
+//
+// "source" and "destination" may also be given as single strings, and the
+// array as "connections". Signal names may leave out the ordinal of their
+// device ("synth/in/1"), in which case the first device of that name the
+// graph knows is used.
+//
+// The file is tokenized in place with the reader of definition.h and all
+// of its maps are read before any is created. Signal names are then
+// resolved through a hash index of every signal known to the graph, built
+// once, and the maps are created and pushed in a single pass, so that
+// libmapper announces them together on the next poll.
+//
+// A graph only knows the devices it has heard from, so a map whose signals
+// are not found yet is kept waiting rather than failed: the graph is
+// subscribed to every device, and the waiting maps are tried again as
+// devices and signals appear, and every MAPPING_RETRY seconds, until they
+// are created or MAPPING_TIMEOUT seconds have passed.
+//
+// This software was written in the Input Devices and Music Interaction
+// Laboratory at McGill University in Montreal, and is copyright those
+// found in the AUTHORS file.  It is licensed under the GNU Lesser Public
+// General License version 2.1 or later.  Please see COPYING for details.
+//
+
+#ifndef MPR_BINDINGS_MAPPING_H
+#define MPR_BINDINGS_MAPPING_H
+
+#include "definition.h"
+
+#define MAPPING_MAX_SRC 8               // sources of a convergent map
+#define MAPPING_MAX_NAME 256
+#define MAPPING_UNSET -1
+#define MAPPING_MISSING -1              // a signal of the map is not known yet
+#define MAPPING_RETRY 1.0               // seconds between attempts at waiting maps
+#define MAPPING_TIMEOUT 30.0            // seconds before waiting maps fail
+
+typedef struct _mapping_map
+{
+    const char *src[MAPPING_MAX_SRC];   // strings point into the file's buffer
+    int num_src;
+    const char *dst;
+    const char *expr;
+    int process_loc;                    // MAPPING_UNSET if not given
+    int protocol;
+    int muted;
+    int use_inst;
+    char *pos;                          // in the file, for reporting failures
+} t_mapping_map;
+
+typedef struct _mapping_entry
+{
+    char *name;                         // <device>/<signal>, 0 if the slot is free
+    uint64_t hash;
+    mpr_sig sig;
+} t_mapping_entry;
+
+typedef struct _mapping_index
+{
+    t_mapping_entry *entries;
+    uint32_t size;                      // a power of two
+    uint32_t count;
+} t_mapping_index;
+
+typedef struct _mapping_result
+{
+    int created;
+    int failed;
+    const char *error;                  // set if the file could not be read
+    int line;                           // of the error or of the first failed map
+    char failure[MAPPING_MAX_NAME + 16];    // why the first failed map failed
+} t_mapping_result;
+
+typedef struct _mapping_load
+{
+    mpr_graph graph;
+    char *path;
+    t_definition *d;
+    t_mapping_map *maps;                // those waiting for their signals
+    int num_pending;
+    int subscribed;
+    int found;                          // devices or signals appeared since the last attempt
+    mpr_time started;
+    mpr_time attempted;
+} t_mapping_load;
+
+// *********************************************************
+// -(signal index)------------------------------------------
+static int mapping_index_add(t_mapping_index *idx, const char *name, size_t len, mpr_sig sig)
+{
+    uint64_t hash = definition_hash(name, len);
+    uint32_t i = (uint32_t)hash & (idx->size - 1);
+
+    while (idx->entries[i].name) {
+        // the first device of a name keeps its signals
+        if (idx->entries[i].hash == hash && !strncmp(idx->entries[i].name, name, len)
+            && !idx->entries[i].name[len])
+            return 1;
+        i = (i + 1) & (idx->size - 1);
+    }
+    if (!(idx->entries[i].name = (char *)malloc(len + 1)))
+        return 0;
+    memcpy(idx->entries[i].name, name, len);
+    idx->entries[i].name[len] = 0;
+    idx->entries[i].hash = hash;
+    idx->entries[i].sig = sig;
+    ++idx->count;
+    return 1;
+}
+
+static mpr_sig mapping_index_find(const t_mapping_index *idx, const char *name)
+{
+    size_t len = strlen(name);
+    uint64_t hash = definition_hash(name, len);
+    uint32_t i = (uint32_t)hash & (idx->size - 1);
+
+    while (idx->entries[i].name) {
+        if (idx->entries[i].hash == hash && !strcmp(idx->entries[i].name, name))
+            return idx->entries[i].sig;
+        i = (i + 1) & (idx->size - 1);
+    }
+    return 0;
+}
+
+static void mapping_index_free(t_mapping_index *idx)
+{
+    uint32_t i;
+    if (!idx->entries)
+        return;
+    for (i = 0; i < idx->size; i++)
+        free(idx->entries[i].name);
+    free(idx->entries);
+}
+
+// index every signal the graph knows by its full name, and by its name
+// without the device's ordinal
+static int mapping_index_build(t_mapping_index *idx, mpr_graph graph)
+{
+    mpr_list devs = mpr_graph_get_list(graph, MPR_DEV), sigs;
+    uint32_t num_sigs = 0;
+    char name[MAPPING_MAX_NAME];
+    int ok = 1;
+
+    memset(idx, 0, sizeof(t_mapping_index));
+    while (devs) {
+        sigs = mpr_dev_get_sigs(*devs, MPR_DIR_ANY);
+        num_sigs += mpr_list_get_size(sigs);
+        mpr_list_free(sigs);
+        devs = mpr_list_get_next(devs);
+    }
+    // two names per signal, at most half full
+    for (idx->size = 64; idx->size < num_sigs * 4; idx->size <<= 1) {}
+    if (!(idx->entries = (t_mapping_entry *)calloc(idx->size, sizeof(t_mapping_entry)))) {
+        idx->size = 0;
+        return 0;
+    }
+    devs = mpr_graph_get_list(graph, MPR_DEV);
+    while (devs) {
+        const char *dev_name = mpr_obj_get_prop_as_str(*devs, MPR_PROP_NAME, NULL);
+        const char *dot = dev_name ? strrchr(dev_name, '.') : 0;
+        size_t prefix = dot ? (size_t)(dot - dev_name) : 0;
+
+        sigs = dev_name ? mpr_dev_get_sigs(*devs, MPR_DIR_ANY) : 0;
+        while (sigs) {
+            const char *sig_name = mpr_obj_get_prop_as_str(*sigs, MPR_PROP_NAME, NULL);
+            int len = snprintf(name, MAPPING_MAX_NAME, "%s/%s", dev_name, sig_name ? sig_name : "");
+
+            if (len < MAPPING_MAX_NAME) {
+                ok &= mapping_index_add(idx, name, len, *sigs);
+                if (prefix) {
+                    len = snprintf(name, MAPPING_MAX_NAME, "%.*s/%s", (int)prefix, dev_name,
+                                   sig_name ? sig_name : "");
+                    ok &= mapping_index_add(idx, name, len, *sigs);
+                }
+            }
+            sigs = mpr_list_get_next(sigs);
+        }
+        devs = mpr_list_get_next(devs);
+    }
+    return ok;
+}
+
+// *********************************************************
+// -(parsing)-----------------------------------------------
+static int mapping_loc(const char *str)
+{
+    if (!strcmp(str, "src") || !strcmp(str, "source"))
+        return MPR_LOC_SRC;
+    if (!strcmp(str, "dst") || !strcmp(str, "destination"))
+        return MPR_LOC_DST;
+    return MAPPING_UNSET;
+}
+
+static int mapping_proto(const char *str)
+{
+    if (!strcmp(str, "udp") || !strcmp(str, "UDP"))
+        return MPR_PROTO_UDP;
+    if (!strcmp(str, "tcp") || !strcmp(str, "TCP"))
+        return MPR_PROTO_TCP;
+    return MAPPING_UNSET;
+}
+
+// read true, false or a number as a flag, returning 0 if none is next
+static int mapping_bool(t_definition *d, int *flag)
+{
+    double num;
+
+    definition_ws(d);
+    if (!strncmp(d->pos, "true", 4)) {
+        d->pos += 4;
+        *flag = 1;
+    }
+    else if (!strncmp(d->pos, "false", 5)) {
+        d->pos += 5;
+        *flag = 0;
+    }
+    else if (definition_number(d, &num))
+        *flag = num != 0;
+    else
+        return 0;
+    return 1;
+}
+
+// read a signal name or an array of them
+static int mapping_names(t_definition *d, const char **names, int *count, int max)
+{
+    int first = 1;
+    char *str;
+
+    definition_ws(d);
+    if ('"' == *d->pos) {
+        if (!(str = definition_string(d)))
+            return 0;
+        if (*count < max)
+            names[(*count)++] = str;
+        return 1;
+    }
+    if (!definition_accept(d, '['))
+        return 0;
+    while (!definition_accept(d, ']')) {
+        if ((!first && !definition_accept(d, ',')) || !(str = definition_string(d)))
+            return 0;
+        first = 0;
+        if (*count < max)
+            names[(*count)++] = str;
+    }
+    return 1;
+}
+
+static int mapping_read_map(t_definition *d, t_mapping_map *m)
+{
+    int first = 1, ok, num_dst = 0;
+    char *key, *str;
+
+    memset(m, 0, sizeof(t_mapping_map));
+    m->process_loc = m->protocol = m->muted = m->use_inst = MAPPING_UNSET;
+    m->pos = d->pos;
+    if (!definition_accept(d, '{'))
+        return 0;
+    while ((key = definition_key(d, first, &ok))) {
+        first = 0;
+        definition_ws(d);
+        if (!strcmp(key, "sources") || !strcmp(key, "source")) {
+            if (!mapping_names(d, m->src, &m->num_src, MAPPING_MAX_SRC))
+                return 0;
+        }
+        else if (!strcmp(key, "destinations") || !strcmp(key, "destination")) {
+            if (!mapping_names(d, &m->dst, &num_dst, 1))
+                return 0;
+        }
+        else if (!strcmp(key, "muted")) {
+            if (!mapping_bool(d, &m->muted))
+                return 0;
+        }
+        else if (!strcmp(key, "use_inst") || !strcmp(key, "use_instances")) {
+            if (!mapping_bool(d, &m->use_inst))
+                return 0;
+        }
+        else if ('"' == *d->pos) {
+            if (!(str = definition_string(d)))
+                return 0;
+            if (!strcmp(key, "expression") || !strcmp(key, "expr"))
+                m->expr = str;
+            else if (!strcmp(key, "process_loc") || !strcmp(key, "process"))
+                m->process_loc = mapping_loc(str);
+            else if (!strcmp(key, "protocol"))
+                m->protocol = mapping_proto(str);
+        }
+        else if (!definition_skip(d))
+            return 0;
+    }
+    return ok;
+}
+
+// read every map of the file, returning how many or -1 if malformed
+static int mapping_parse(t_definition *d, t_mapping_map **maps)
+{
+    uint32_t max = 0;
+    int count = 0, first, ok;
+    char *key;
+
+    *maps = 0;
+    if (!definition_accept(d, '{'))
+        return definition_fail(d, "expected an object");
+    for (first = 1; (key = definition_key(d, first, &ok)); first = 0) {
+        if (!strcmp(key, "mapping"))
+            break;
+        if (!definition_skip(d))
+            return definition_fail(d, "malformed value");
+    }
+    if (!ok)
+        return definition_fail(d, "malformed object");
+    if (!key || !definition_accept(d, '{'))
+        return definition_fail(d, "no mapping object");
+    for (first = 1; (key = definition_key(d, first, &ok)); first = 0) {
+        if ((strcmp(key, "maps") && strcmp(key, "connections")) || !definition_accept(d, '[')) {
+            if (!definition_skip(d))
+                return definition_fail(d, "malformed value");
+            continue;
+        }
+        while (!definition_accept(d, ']')) {
+            if (count && !definition_accept(d, ','))
+                return definition_fail(d, "malformed map");
+            if (!definition_reserve((void **)maps, &max, count + 1, sizeof(t_mapping_map)))
+                return definition_fail(d, "out of memory");
+            if (!mapping_read_map(d, &(*maps)[count]))
+                return definition_fail(d, "malformed map");
+            ++count;
+        }
+    }
+    if (!ok)
+        return definition_fail(d, "malformed mapping object");
+    return count;
+}
+
+// *********************************************************
+// -(creating)----------------------------------------------
+static void mapping_set_int(mpr_map map, mpr_prop prop, mpr_type type, int value)
+{
+    if (value != MAPPING_UNSET)
+        mpr_obj_set_prop(map, prop, NULL, 1, type, &value, 1);
+}
+
+// create a map, or return 0 or MAPPING_MISSING and say why not
+static int mapping_create(const t_mapping_index *idx, const t_mapping_map *m,
+                          char *why, int size)
+{
+    mpr_sig src[MAPPING_MAX_SRC], dst;
+    mpr_map map;
+    int i;
+
+    if (!m->dst || !m->num_src) {
+        snprintf(why, size, "no %s", m->dst ? "source" : "destination");
+        return 0;
+    }
+    if (!(dst = mapping_index_find(idx, m->dst))) {
+        snprintf(why, size, "%s not found", m->dst);
+        return MAPPING_MISSING;
+    }
+    for (i = 0; i < m->num_src; i++) {
+        if (!(src[i] = mapping_index_find(idx, m->src[i]))) {
+            snprintf(why, size, "%s not found", m->src[i]);
+            return MAPPING_MISSING;
+        }
+    }
+    if (!(map = mpr_map_new(m->num_src, src, 1, &dst))) {
+        snprintf(why, size, "map refused by libmapper");
+        return 0;
+    }
+    if (m->expr)
+        mpr_obj_set_prop(map, MPR_PROP_EXPR, NULL, 1, MPR_STR, m->expr, 1);
+    mapping_set_int(map, MPR_PROP_PROCESS_LOC, MPR_INT32, m->process_loc);
+    mapping_set_int(map, MPR_PROP_PROTOCOL, MPR_INT32, m->protocol);
+    mapping_set_int(map, MPR_PROP_MUTED, MPR_BOOL, m->muted);
+    mapping_set_int(map, MPR_PROP_USE_INST, MPR_BOOL, m->use_inst);
+    mpr_obj_push(map);
+    return 1;
+}
+
+// read a mapping file into memory, returning 0 if it cannot be read
+static t_definition *mapping_open(const char *path)
+{
+    t_definition *d;
+    FILE *f = fopen(path, "rb");
+    long size;
+
+    if (!f)
+        return 0;
+    if (fseek(f, 0, SEEK_END) || (size = ftell(f)) < 0 || fseek(f, 0, SEEK_SET)
+        || !(d = (t_definition *)calloc(1, sizeof(t_definition)))) {
+        fclose(f);
+        return 0;
+    }
+    if (!(d->text = (char *)malloc(size + 1)) || fread(d->text, 1, size, f) != (size_t)size) {
+        fclose(f);
+        free(d->text);
+        free(d);
+        return 0;
+    }
+    fclose(f);
+    d->text[size] = 0;
+    d->pos = d->text;
+    // skip a UTF-8 byte order mark
+    if (!strncmp(d->pos, "\xEF\xBB\xBF", 3))
+        d->pos += 3;
+    return d;
+}
+
+// read the maps listed in a file, returning how many or -1 on error; they
+// are created separately, so that only that needs to hold a lock
+static int mapping_read(const char *path, t_mapping_map **maps, t_definition **d,
+                        t_mapping_result *r)
+{
+    int count;
+
+    memset(r, 0, sizeof(t_mapping_result));
+    if (!(*d = mapping_open(path))) {
+        r->error = "could not read file";
+        return -1;
+    }
+    if ((count = mapping_parse(*d, maps)) < 0) {
+        r->error = (*d)->error;
+        r->line = definition_line(*d);
+    }
+    return count;
+}
+
+static void mapping_fail(t_definition *d, const t_mapping_map *m, const char *why,
+                         t_mapping_result *r)
+{
+    if (!r->failed++) {
+        d->pos = m->pos;
+        r->line = definition_line(d);
+        snprintf(r->failure, sizeof(r->failure), "%s", why);
+    }
+}
+
+// create every map whose signals are known to the graph, in one pass; if
+// wait is set the maps still missing a signal are moved to the front, and
+// their number is returned, otherwise they fail
+static int mapping_create_all(mpr_graph graph, t_definition *d, t_mapping_map *maps,
+                              int count, int wait, t_mapping_result *r)
+{
+    t_mapping_index idx;
+    char why[sizeof(r->failure)];
+    int i, ret, missing = 0;
+
+    if (!count)
+        return 0;
+    if (!mapping_index_build(&idx, graph)) {
+        r->error = "out of memory";
+        mapping_index_free(&idx);
+        return 0;
+    }
+    for (i = 0; i < count; i++) {
+        if ((ret = mapping_create(&idx, &maps[i], why, sizeof(why))) > 0)
+            ++r->created;
+        else if (MAPPING_MISSING == ret && wait)
+            maps[missing++] = maps[i];
+        else
+            mapping_fail(d, &maps[i], why, r);
+    }
+    mapping_index_free(&idx);
+    return missing;
+}
+
+static void mapping_close(t_definition *d, t_mapping_map *maps)
+{
+    free(maps);
+    if (d) {
+        free(d->text);
+        free(d);
+    }
+}
+
+// *********************************************************
+// -(waiting maps)------------------------------------------
+static void mapping_handler(mpr_graph g, mpr_obj obj, mpr_graph_evt evt, const void *data)
+{
+    if (MPR_OBJ_NEW == evt)
+        ((t_mapping_load *)data)->found = 1;
+}
+
+// keep the maps left waiting by mapping_create_all(), taking over the file
+// they were read from; returns 0 if there is no memory for it
+static t_mapping_load *mapping_load_new(mpr_graph graph, const char *path, t_definition *d,
+                                        t_mapping_map *maps, int num_pending, mpr_time now)
+{
+    t_mapping_load *l = (t_mapping_load *)calloc(1, sizeof(t_mapping_load));
+
+    if (!l || !(l->path = strdup(path))) {
+        free(l);
+        return 0;
+    }
+    l->graph = graph;
+    l->d = d;
+    l->maps = maps;
+    l->num_pending = num_pending;
+    l->started = l->attempted = now;
+    // peers are only known to the graph once it subscribes to them
+    mpr_graph_subscribe(graph, NULL, MPR_DEV | MPR_SIG, -1);
+    l->subscribed = 1;
+    mpr_graph_add_cb(graph, mapping_handler, MPR_DEV | MPR_SIG, l);
+    return l;
+}
+
+// try the waiting maps again if devices or signals have appeared, failing
+// those still waiting once MAPPING_TIMEOUT has passed; returns 1 if anything
+// changed, with the maps created and failed in r, and num_pending 0 once
+// the load is done
+static int mapping_load_poll(t_mapping_load *l, mpr_time now, t_mapping_result *r)
+{
+    int wait = mpr_time_get_diff(now, l->started) < MAPPING_TIMEOUT;
+
+    memset(r, 0, sizeof(t_mapping_result));
+    if (wait && !l->found && mpr_time_get_diff(now, l->attempted) < MAPPING_RETRY)
+        return 0;
+    l->found = 0;
+    l->attempted = now;
+    l->num_pending = mapping_create_all(l->graph, l->d, l->maps, l->num_pending, wait, r);
+    return r->created || r->failed || r->error;
+}
+
+// unless keep_subscribed is set, the graph stops following other devices
+static void mapping_load_free(t_mapping_load *l, int keep_subscribed)
+{
+    mpr_graph_remove_cb(l->graph, mapping_handler, l);
+    if (l->subscribed && !keep_subscribed)
+        mpr_graph_unsubscribe(l->graph, NULL);
+    mapping_close(l->d, l->maps);
+    free(l->path);
+    free(l);
+}
+
+#endif // MPR_BINDINGS_MAPPING_H
@@ -0,0 +1,242 @@
+//
+// qos.h
+// priority-ordered delivery of received signal values under a per-poll
+// budget, so that control signals are not held up behind bulk data
+//
+// Each signal is in one of three classes:
+//
+//   high    always output as soon as it is received
+//   normal  output as it arrives while the budget lasts, then held back
+//   low     held back and output after high and normal values
+//
+// A held-back signal keeps only its newest value; overwriting one that was
+// never output counts as shed. At the end of each poll the held-back
+// values are output in class order, oldest first within a class, until
+// the budget is spent, and every value still waiting counts as deferred
+// for that poll. High values count against the budget but are never held
+// back themselves; a signal made high while a value of it is held has that
+// value output at once. A budget of 0 turns the stage off: every value is
+// output in arrival order, as before.
+//
+// A held value keeps the time it was taken off the network as well as its
+// timetag, so that its network latency includes the time it was held.
+//
+// Only the newest value of a signal is kept, so the caller should pass
+// values of instanced signals and sample blocks straight through.
+//
+// This software was written in the Input Devices and Music Interaction
+// Laboratory at McGill University in Montreal, and is copyright those
+// found in the AUTHORS file.  It is licensed under the GNU Lesser Public
+// General License version 2.1 or later.  Please see COPYING for details.
+//
+
+#ifndef MPR_BINDINGS_QOS_H
+#define MPR_BINDINGS_QOS_H
+
+#include <mapper/mapper.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define QOS_HIGH 0
+#define QOS_NORMAL 1
+#define QOS_LOW 2
+#define QOS_CLASSES 3
+
+// delivery state of one signal, kept with its per-signal data
+typedef struct _qos_slot
+{
+    int priority;
+    int pending;                    // a value is waiting to be output
+    void *owner;                    // the caller's per-signal data
+    mpr_id inst;
+    int len;
+    mpr_type type;
+    mpr_time time;
+    mpr_time recv_time;             // when it was taken off the network
+    void *value;                    // allocated the first time a value is held
+    int size;                       // bytes allocated
+    unsigned long shed;             // held values overwritten before output
+    unsigned long deferred;         // polls a held value waited past the budget
+    struct _qos_slot *next;
+} t_qos_slot;
+
+typedef struct _qos
+{
+    int budget;                     // values output per poll, 0 for no limit
+    int spent;
+    t_qos_slot *head[QOS_CLASSES];  // held values by class, oldest first
+    t_qos_slot *tail[QOS_CLASSES];
+    unsigned long shed;             // totals over all signals
+    unsigned long deferred;
+} t_qos;
+
+// class of a priority name, or -1 if it is not one
+static int qos_parse(const char *name)
+{
+    if (!strcmp(name, "high"))
+        return QOS_HIGH;
+    if (!strcmp(name, "normal"))
+        return QOS_NORMAL;
+    if (!strcmp(name, "low"))
+        return QOS_LOW;
+    return -1;
+}
+
+static const char *qos_name(int priority)
+{
+    static const char *names[] = {"high", "normal", "low"};
+    return priority >= 0 && priority < QOS_CLASSES ? names[priority] : "normal";
+}
+
+static void qos_slot_init(t_qos_slot *s, void *owner)
+{
+    memset(s, 0, sizeof(t_qos_slot));
+    s->priority = QOS_NORMAL;
+    s->owner = owner;
+}
+
+// take a held value out of its queue without outputting it
+static void qos_remove(t_qos *q, t_qos_slot *s)
+{
+    t_qos_slot **p, *prev = 0;
+
+    if (!s->pending)
+        return;
+    for (p = &q->head[s->priority]; *p; prev = *p, p = &(*p)->next) {
+        if (*p == s) {
+            *p = s->next;
+            if (q->tail[s->priority] == s)
+                q->tail[s->priority] = prev;
+            break;
+        }
+    }
+    s->next = 0;
+    s->pending = 0;
+}
+
+static void qos_slot_free(t_qos *q, t_qos_slot *s)
+{
+    qos_remove(q, s);
+    if (s->value)
+        free(s->value);
+    s->value = 0;
+    s->size = 0;
+}
+
+// a held value keeps its place in line when the signal changes class;
+// returns 1 if the signal became high priority with a value held, which
+// the caller should then output from the slot
+static int qos_set_priority(t_qos *q, t_qos_slot *s, int priority)
+{
+    int pending = s->pending;
+
+    if (priority == s->priority)
+        return 0;
+    qos_remove(q, s);
+    s->priority = priority;
+    if (!pending)
+        return 0;
+    if (QOS_HIGH == priority) {
+        ++q->spent;
+        return 1;
+    }
+    s->pending = 1;
+    if (q->tail[priority])
+        q->tail[priority]->next = s;
+    else
+        q->head[priority] = s;
+    q->tail[priority] = s;
+    return 0;
+}
+
+// keep the newest value of a signal until it can be output
+static int qos_hold(t_qos *q, t_qos_slot *s, mpr_id inst, int len,
+                    mpr_type type, const void *val, mpr_time time, mpr_time recv_time)
+{
+    int size = len * (MPR_DBL == type || MPR_INT64 == type ? 8 : 4);
+
+    if (size > s->size) {
+        void *value = realloc(s->value, size);
+        if (!value)
+            return 0;
+        s->value = value;
+        s->size = size;
+    }
+    if (s->pending) {
+        ++s->shed;
+        ++q->shed;
+    }
+    else {
+        s->pending = 1;
+        s->next = 0;
+        if (q->tail[s->priority])
+            q->tail[s->priority]->next = s;
+        else
+            q->head[s->priority] = s;
+        q->tail[s->priority] = s;
+    }
+    memcpy(s->value, val, size);
+    s->inst = inst;
+    s->len = len;
+    s->type = type;
+    s->time = time;
+    s->recv_time = recv_time;
+    return 1;
+}
+
+// returns 1 if a received value should be output now, or 0 if it was held
+static int qos_admit(t_qos *q, t_qos_slot *s, mpr_id inst, int len,
+                     mpr_type type, const void *val, mpr_time time, mpr_time recv_time)
+{
+    if (!q->budget)
+        return 1;
+    if (QOS_HIGH == s->priority
+        || (QOS_NORMAL == s->priority && !q->head[QOS_NORMAL] && q->spent < q->budget)) {
+        ++q->spent;
+        return 1;
+    }
+    // if it cannot be held it is better late than lost
+    if (!qos_hold(q, s, inst, len, type, val, time, recv_time)) {
+        ++q->spent;
+        return 1;
+    }
+    return 0;
+}
+
+// the next held value to output within the budget, if any
+static t_qos_slot *qos_next(t_qos *q)
+{
+    t_qos_slot *s;
+    int i;
+
+    if (q->budget && q->spent >= q->budget)
+        return 0;
+    for (i = QOS_NORMAL; i < QOS_CLASSES; i++) {
+        if ((s = q->head[i])) {
+            if (!(q->head[i] = s->next))
+                q->tail[i] = 0;
+            s->next = 0;
+            s->pending = 0;
+            ++q->spent;
+            return s;
+        }
+    }
+    return 0;
+}
+
+// end a poll: count what is still waiting and start a new budget
+static void qos_tick(t_qos *q)
+{
+    t_qos_slot *s;
+    int i;
+
+    for (i = QOS_NORMAL; i < QOS_CLASSES; i++) {
+        for (s = q->head[i]; s; s = s->next) {
+            ++s->deferred;
+            ++q->deferred;
+        }
+    }
+    q->spent = 0;
+}
+
+#endif // MPR_BINDINGS_QOS_H
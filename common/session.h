@@ -0,0 +1,482 @@
+//
+// session.h
+// local cache of the maps attached to a device's signals, saved as they
+// change so that they can be recreated when the device comes back after
+// its host was restarted or crashed
+//
+// The file holds one "key value" pair per line, each map starting with a
+// "map" line; values run to the end of the line:
+//
+//   device tester.1
+//   map
+//   source tester.1/out/1
+//   destination synth.1/in/1
+//   expression y=x*0.5+2
+//   process 2
+//   protocol 1
+//   muted 0
+//   instances 0
+//
+// Signals of the device itself are looked up by name alone when restoring,
+// so the maps survive the device coming back under another ordinal. Maps
+// whose peers are not on the network yet stay pending: the graph is then
+// subscribed to every device and they are recreated as soon as all their
+// signals are known. A recreated map stays pending until the graph reports
+// it established, and is recreated again if its peers drop it before then;
+// pending maps are kept in the file in place of their unconfirmed copies.
+//
+// This software was written in the Input Devices and Music Interaction
+// Laboratory at McGill University in Montreal, and is copyright those
+// found in the AUTHORS file.  It is licensed under the GNU Lesser Public
+// General License version 2.1 or later.  Please see COPYING for details.
+//
+
+#ifndef MPR_BINDINGS_SESSION_H
+#define MPR_BINDINGS_SESSION_H
+
+#include <mapper/mapper.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "atomic.h"
+
+#define SESSION_MAX_SRC 8               // sources of a convergent map
+#define SESSION_MAX_NAME 256
+#define SESSION_MAX_EXPR 1024
+#define SESSION_SETTLE 0.5              // seconds without changes before saving
+#define SESSION_RETRY 1.0               // seconds between attempts at pending maps
+#define SESSION_UNSET -1
+
+typedef struct _session_map
+{
+    char src[SESSION_MAX_SRC][SESSION_MAX_NAME];
+    int num_src;
+    char dst[SESSION_MAX_NAME];
+    char expr[SESSION_MAX_EXPR];
+    int process_loc;                    // SESSION_UNSET if not recorded
+    int protocol;
+    int muted;
+    int use_inst;
+    mpr_map map;                        // recreated, not yet established
+    struct _session_map *next;
+} t_session_map;
+
+typedef struct _session
+{
+    mpr_dev dev;
+    mpr_graph graph;
+    char device[SESSION_MAX_NAME];      // name of the device when the file was saved
+    t_session_map *pending;             // maps waiting to be recreated
+    int num_pending;
+    int subscribed;
+    int found;                          // devices or signals appeared since the last attempt
+    int dirty;                          // maps changed since the last save
+    mpr_time changed;
+    mpr_time attempted;
+} t_session;
+
+// *********************************************************
+// -(reading)-----------------------------------------------
+static t_session_map *session_map_new(void)
+{
+    t_session_map *m = (t_session_map *)calloc(1, sizeof(t_session_map));
+    if (m)
+        m->process_loc = m->protocol = m->muted = m->use_inst = SESSION_UNSET;
+    return m;
+}
+
+static void session_map_append(t_session *s, t_session_map *m, t_session_map **last)
+{
+    if (*last)
+        (*last)->next = m;
+    else
+        s->pending = m;
+    *last = m;
+    ++s->num_pending;
+}
+
+// read the maps stored in a file; a missing file is an empty session
+static void session_read(t_session *s, const char *path)
+{
+    char line[SESSION_MAX_EXPR + 32], *value;
+    t_session_map *m = 0, *last = 0;
+    FILE *f;
+
+    if (!(f = fopen(path, "r")))
+        return;
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = 0;
+        if ((value = strchr(line, ' ')))
+            *value++ = 0;
+        else
+            value = line + strlen(line);
+        if (!strcmp(line, "device"))
+            snprintf(s->device, SESSION_MAX_NAME, "%s", value);
+        else if (!strcmp(line, "map")) {
+            if (m && (!m->num_src || !m->dst[0]))
+                free(m);
+            else if (m)
+                session_map_append(s, m, &last);
+            if (!(m = session_map_new()))
+                break;
+        }
+        else if (!m)
+            continue;
+        else if (!strcmp(line, "source") && m->num_src < SESSION_MAX_SRC)
+            snprintf(m->src[m->num_src++], SESSION_MAX_NAME, "%s", value);
+        else if (!strcmp(line, "destination"))
+            snprintf(m->dst, SESSION_MAX_NAME, "%s", value);
+        else if (!strcmp(line, "expression"))
+            snprintf(m->expr, SESSION_MAX_EXPR, "%s", value);
+        else if (!strcmp(line, "process"))
+            m->process_loc = atoi(value);
+        else if (!strcmp(line, "protocol"))
+            m->protocol = atoi(value);
+        else if (!strcmp(line, "muted"))
+            m->muted = atoi(value);
+        else if (!strcmp(line, "instances"))
+            m->use_inst = atoi(value);
+    }
+    if (m && (!m->num_src || !m->dst[0]))
+        free(m);
+    else if (m)
+        session_map_append(s, m, &last);
+    fclose(f);
+}
+
+// *********************************************************
+// -(restoring)---------------------------------------------
+static mpr_sig session_find_dev_sig(mpr_dev dev, const char *name)
+{
+    mpr_list sigs = mpr_dev_get_sigs(dev, MPR_DIR_ANY);
+    while (sigs) {
+        const char *sig_name = mpr_obj_get_prop_as_str(*sigs, MPR_PROP_NAME, NULL);
+        if (sig_name && !strcmp(sig_name, name)) {
+            mpr_sig sig = *sigs;
+            mpr_list_free(sigs);
+            return sig;
+        }
+        sigs = mpr_list_get_next(sigs);
+    }
+    return 0;
+}
+
+// look up a signal by its full name, <device>/<signal>
+static mpr_sig session_find_sig(t_session *s, const char *full)
+{
+    const char *slash = strchr(full, '/');
+    size_t len;
+    mpr_list devs;
+
+    if (!slash || slash == full)
+        return 0;
+    len = slash - full;
+    // this device may have come back under another ordinal
+    if (strlen(s->device) == len && !strncmp(full, s->device, len))
+        return session_find_dev_sig(s->dev, slash + 1);
+    devs = mpr_graph_get_list(s->graph, MPR_DEV);
+    while (devs) {
+        const char *dev_name = mpr_obj_get_prop_as_str(*devs, MPR_PROP_NAME, NULL);
+        if (dev_name && strlen(dev_name) == len && !strncmp(dev_name, full, len)) {
+            mpr_dev dev = *devs;
+            mpr_list_free(devs);
+            return session_find_dev_sig(dev, slash + 1);
+        }
+        devs = mpr_list_get_next(devs);
+    }
+    return 0;
+}
+
+static void session_set_int(mpr_map map, mpr_prop prop, mpr_type type, int value)
+{
+    if (value != SESSION_UNSET)
+        mpr_obj_set_prop(map, prop, NULL, 1, type, &value, 1);
+}
+
+// recreate a stored map if all of its signals are known, returning 0 if not
+static int session_create(t_session *s, t_session_map *m)
+{
+    mpr_sig src[SESSION_MAX_SRC], dst;
+    mpr_map map;
+    int i;
+
+    if (!(dst = session_find_sig(s, m->dst)))
+        return 0;
+    for (i = 0; i < m->num_src; i++) {
+        if (!(src[i] = session_find_sig(s, m->src[i])))
+            return 0;
+    }
+    if (!(map = mpr_map_new(m->num_src, src, 1, &dst)))
+        return 0;
+    if (m->expr[0])
+        mpr_obj_set_prop(map, MPR_PROP_EXPR, NULL, 1, MPR_STR, m->expr, 1);
+    session_set_int(map, MPR_PROP_PROCESS_LOC, MPR_INT32, m->process_loc);
+    session_set_int(map, MPR_PROP_PROTOCOL, MPR_INT32, m->protocol);
+    session_set_int(map, MPR_PROP_MUTED, MPR_BOOL, m->muted);
+    session_set_int(map, MPR_PROP_USE_INST, MPR_BOOL, m->use_inst);
+    mpr_obj_push(map);
+    m->map = map;
+    return 1;
+}
+
+// peers are only known to the graph once it subscribes to them
+static void session_subscribe(t_session *s)
+{
+    if (s->num_pending && !s->subscribed) {
+        mpr_graph_subscribe(s->graph, NULL, MPR_DEV | MPR_SIG, -1);
+        s->subscribed = 1;
+    }
+    else if (!s->num_pending && s->subscribed) {
+        mpr_graph_unsubscribe(s->graph, NULL);
+        s->subscribed = 0;
+    }
+}
+
+static void session_done(t_session *s, t_session_map **m)
+{
+    t_session_map *done = *m;
+
+    *m = done->next;
+    free(done);
+    --s->num_pending;
+}
+
+// recreate every pending map whose signals are known, in one pass,
+// returning how many were created
+static int session_restore(t_session *s, mpr_time now)
+{
+    t_session_map **m = &s->pending;
+    int created = 0;
+
+    s->found = 0;
+    s->attempted = now;
+    while (*m) {
+        if (!(*m)->map && session_create(s, *m))
+            ++created;
+        // libmapper hands back a map that is already established
+        if ((*m)->map && mpr_map_get_is_ready((*m)->map))
+            session_done(s, m);
+        else
+            m = &(*m)->next;
+    }
+    session_subscribe(s);
+    return created;
+}
+
+// a recreated map is done with once it is established, and is tried again
+// if it is dropped before that
+static void session_confirm(t_session *s, mpr_map map, mpr_graph_evt evt)
+{
+    t_session_map **m;
+
+    for (m = &s->pending; *m; m = &(*m)->next) {
+        if ((*m)->map != map)
+            continue;
+        if (MPR_OBJ_REM == evt)
+            (*m)->map = 0;
+        else if (mpr_map_get_is_ready(map))
+            session_done(s, m);
+        return;
+    }
+}
+
+// *********************************************************
+// -(recording)---------------------------------------------
+static void session_handler(mpr_graph g, mpr_obj obj, mpr_graph_evt evt, const void *data)
+{
+    t_session *s = (t_session *)data;
+
+    if (mpr_obj_get_type(obj) & MPR_MAP) {
+        if (!mpr_obj_get_prop_as_int32(obj, MPR_PROP_IS_LOCAL, NULL))
+            return;
+        if (s->num_pending)
+            session_confirm(s, (mpr_map)obj, evt);
+        s->dirty = 1;
+        mpr_time_set(&s->changed, MPR_NOW);
+    }
+    else if (evt == MPR_OBJ_NEW && s->num_pending)
+        s->found = 1;
+}
+
+typedef struct _session_buf
+{
+    char *text;
+    size_t len;
+    size_t size;
+} t_session_buf;
+
+static void session_printf(t_session_buf *b, const char *key, const char *value)
+{
+    size_t need = strlen(key) + strlen(value) + 3;
+    char *c;
+
+    if (!b->text)
+        return;
+    if (b->len + need > b->size) {
+        char *text = (char *)realloc(b->text, (b->size + need) * 2);
+        if (!text) {
+            free(b->text);
+            b->text = 0;
+            return;
+        }
+        b->text = text;
+        b->size = (b->size + need) * 2;
+    }
+    c = b->text + b->len;
+    b->len += snprintf(c, b->size - b->len, "%s%s%s\n", key, *value ? " " : "", value);
+    // an expression spanning lines would end the record early
+    for (; *c; c++) {
+        if (*c == '\n' && c[1])
+            *c = ' ';
+    }
+}
+
+static void session_print_int(t_session_buf *b, const char *key, int value)
+{
+    char str[16];
+    if (value == SESSION_UNSET)
+        return;
+    snprintf(str, 16, "%d", value);
+    session_printf(b, key, str);
+}
+
+static void session_print_sig(t_session_buf *b, const char *key, mpr_sig sig)
+{
+    const char *dev_name = mpr_obj_get_prop_as_str(mpr_sig_get_dev(sig), MPR_PROP_NAME, NULL);
+    const char *sig_name = mpr_obj_get_prop_as_str(sig, MPR_PROP_NAME, NULL);
+    char full[SESSION_MAX_NAME];
+
+    snprintf(full, SESSION_MAX_NAME, "%s/%s", dev_name ? dev_name : "", sig_name ? sig_name : "");
+    session_printf(b, key, full);
+}
+
+static void session_print_map(t_session_buf *b, const t_session_map *m)
+{
+    int i;
+
+    session_printf(b, "map", "");
+    for (i = 0; i < m->num_src; i++)
+        session_printf(b, "source", m->src[i]);
+    session_printf(b, "destination", m->dst);
+    if (m->expr[0])
+        session_printf(b, "expression", m->expr);
+    session_print_int(b, "process", m->process_loc);
+    session_print_int(b, "protocol", m->protocol);
+    session_print_int(b, "muted", m->muted);
+    session_print_int(b, "instances", m->use_inst);
+}
+
+// describe the established maps of the device and those still pending as
+// the text of a session file, which the caller frees; 0 on failure
+static char *session_format(t_session *s, int *count)
+{
+    t_session_buf b;
+    const char *name = mpr_obj_get_prop_as_str(s->dev, MPR_PROP_NAME, NULL);
+    mpr_list maps = mpr_dev_get_maps(s->dev, MPR_DIR_ANY);
+    t_session_map *m;
+    int value;
+
+    b.size = 1024;
+    b.len = 0;
+    if (!(b.text = (char *)malloc(b.size))) {
+        mpr_list_free(maps);
+        return 0;
+    }
+    *b.text = 0;
+    *count = 0;
+    session_printf(&b, "device", name ? name : "");
+    while (maps) {
+        mpr_list sigs;
+        const char *expr;
+
+        // saved once established, or as pending if the session recreated it
+        if (!mpr_map_get_is_ready(*maps)) {
+            maps = mpr_list_get_next(maps);
+            continue;
+        }
+        sigs = mpr_map_get_sigs(*maps, MPR_LOC_SRC);
+        expr = mpr_obj_get_prop_as_str(*maps, MPR_PROP_EXPR, NULL);
+        session_printf(&b, "map", "");
+        while (sigs) {
+            session_print_sig(&b, "source", *sigs);
+            sigs = mpr_list_get_next(sigs);
+        }
+        if ((sigs = mpr_map_get_sigs(*maps, MPR_LOC_DST))) {
+            session_print_sig(&b, "destination", *sigs);
+            mpr_list_free(sigs);
+        }
+        if (expr)
+            session_printf(&b, "expression", expr);
+        // 0 leaves the choice to libmapper
+        if ((value = mpr_obj_get_prop_as_int32(*maps, MPR_PROP_PROCESS_LOC, NULL)))
+            session_print_int(&b, "process", value);
+        if ((value = mpr_obj_get_prop_as_int32(*maps, MPR_PROP_PROTOCOL, NULL)))
+            session_print_int(&b, "protocol", value);
+        session_print_int(&b, "muted", mpr_obj_get_prop_as_int32(*maps, MPR_PROP_MUTED, NULL));
+        session_print_int(&b, "instances",
+                          mpr_obj_get_prop_as_int32(*maps, MPR_PROP_USE_INST, NULL));
+        ++*count;
+        maps = mpr_list_get_next(maps);
+    }
+    for (m = s->pending; m; m = m->next) {
+        session_print_map(&b, m);
+        ++*count;
+    }
+    return b.text;
+}
+
+// save the text of a session through a temporary file, returning 0 on failure
+static int session_write(const char *path, const char *text)
+{
+    return atomic_write(path, text, strlen(text));
+}
+
+// *********************************************************
+// -(session)-----------------------------------------------
+// read the maps stored for a device and start recording its maps; nothing
+// is restored until session_restore() is called once the device is ready
+static t_session *session_new(const char *path, mpr_dev dev)
+{
+    t_session *s = (t_session *)calloc(1, sizeof(t_session));
+
+    if (!s)
+        return 0;
+    s->dev = dev;
+    s->graph = mpr_obj_get_graph(dev);
+    session_read(s, path);
+    mpr_graph_add_cb(s->graph, session_handler, MPR_DEV | MPR_SIG | MPR_MAP, s);
+    return s;
+}
+
+// check a ready device's session, recreating pending maps if devices or
+// signals have appeared; returns 1 once changes have settled and are due
+// to be saved
+static int session_poll(t_session *s, mpr_time now, int *created)
+{
+    *created = 0;
+    if (s->num_pending && (s->found || mpr_time_get_diff(now, s->attempted) >= SESSION_RETRY))
+        *created = session_restore(s, now);
+    else
+        session_subscribe(s);
+    if (!s->dirty || mpr_time_get_diff(now, s->changed) < SESSION_SETTLE)
+        return 0;
+    s->dirty = 0;
+    return 1;
+}
+
+static void session_free(t_session *s)
+{
+    t_session_map *m;
+
+    mpr_graph_remove_cb(s->graph, session_handler, s);
+    if (s->subscribed)
+        mpr_graph_unsubscribe(s->graph, NULL);
+    while ((m = s->pending)) {
+        s->pending = m->next;
+        free(m);
+    }
+    free(s);
+}
+
+#endif // MPR_BINDINGS_SESSION_H
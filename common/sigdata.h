@@ -0,0 +1,117 @@
+//
+// sigdata.h
+// the header shared by every struct the Max objects store as a signal's
+// MPR_PROP_DATA, so that one object can tell its own signals from those
+// another object created on the same device
+//
+// mpr.device keeps a t_mpr_ptrs for the signals of mpr.in, mpr.out and
+// mpr.poly objects, and mpr.bundle a t_bundle_sig for each of its own. A
+// name clash between the two would otherwise have one of them treat the
+// other's data as its own.
+//
+// The instance data of mpr.in and mpr.out, the objects attached to each
+// instance of an instanced signal, is defined here too, since mpr.device
+// reads it when it outputs instance updates and releases. It needs the Max
+// headers, so include this file after ext.h.
+//
+// This software was written in the Input Devices and Music Interaction
+// Laboratory at McGill University in Montreal, and is copyright those
+// found in the AUTHORS file.  It is licensed under the GNU Lesser Public
+// General License version 2.1 or later.  Please see COPYING for details.
+//
+
+#ifndef MPR_BINDINGS_SIGDATA_H
+#define MPR_BINDINGS_SIGDATA_H
+
+#include <mapper/mapper.h>
+#include <stdlib.h>
+
+#define SIGDATA_DEVICE 0x6d707264       // t_mpr_ptrs of mpr.device
+#define SIGDATA_BUNDLE 0x6d707262       // t_bundle_sig of mpr.bundle
+
+// first member of each per-signal struct
+typedef struct _sigdata
+{
+    int kind;
+} t_sigdata;
+
+// instance data of mpr.in and mpr.out
+typedef struct _sigdata_inst
+{
+    t_sigdata head;                 // SIGDATA_DEVICE
+    int num_objs;
+    t_object **objs;
+} t_sigdata_inst;
+
+// the kind of data stored on a signal, or 0 if there is none
+static int sigdata_kind(mpr_sig sig)
+{
+    const t_sigdata *data = (const t_sigdata *)mpr_obj_get_prop_as_ptr(sig, MPR_PROP_DATA, NULL);
+    return data ? data->kind : 0;
+}
+
+// a signal of the device with the given name, if any
+static mpr_sig sigdata_find(mpr_dev dev, const char *name)
+{
+    mpr_sig sig = 0;
+    mpr_list list = mpr_dev_get_sigs(dev, MPR_DIR_ANY);
+    list = mpr_list_filter(list, MPR_PROP_NAME, NULL, 1, MPR_STR, name, MPR_OP_EQ);
+    if (list) {
+        sig = *list;
+        mpr_list_free(list);
+    }
+    return sig;
+}
+
+// attach an object to an instance, reserving the instance for the first one;
+// returns 0 if out of memory
+static int sigdata_inst_attach(mpr_sig sig, mpr_id *inst, t_object *obj)
+{
+    t_sigdata_inst *ptrs = (t_sigdata_inst *)mpr_sig_get_inst_data(sig, *inst);
+    t_object **objs;
+
+    if (!ptrs) {
+        if (!(ptrs = (t_sigdata_inst *)malloc(sizeof(t_sigdata_inst))))
+            return 0;
+        if (!(ptrs->objs = (t_object **)malloc(sizeof(t_object *)))) {
+            free(ptrs);
+            return 0;
+        }
+        ptrs->head.kind = SIGDATA_DEVICE;
+        ptrs->num_objs = 1;
+        ptrs->objs[0] = obj;
+        mpr_sig_reserve_inst(sig, 1, inst, (void **)&ptrs);
+        return 1;
+    }
+    objs = (t_object **)realloc(ptrs->objs, (ptrs->num_objs + 1) * sizeof(t_object *));
+    if (!objs)
+        return 0;
+    ptrs->objs = objs;
+    ptrs->objs[ptrs->num_objs++] = obj;
+    return 1;
+}
+
+// detach an object from an instance, freeing the data with the last one
+static void sigdata_inst_detach(mpr_sig sig, mpr_id inst, t_object *obj)
+{
+    t_sigdata_inst *ptrs = (t_sigdata_inst *)mpr_sig_get_inst_data(sig, inst);
+    int i, found = 0;
+
+    if (!ptrs)
+        return;
+    for (i = 0; i < ptrs->num_objs; i++) {
+        if (found)
+            ptrs->objs[i-1] = ptrs->objs[i];
+        else if (ptrs->objs[i] == obj)
+            found = 1;
+    }
+    if (!found)
+        return;
+    if (--ptrs->num_objs <= 0) {
+        free(ptrs->objs);
+        free(ptrs);
+        mpr_sig_set_inst_data(sig, inst, NULL);
+    }
+}
+
+#endif // MPR_BINDINGS_SIGDATA_H
@@ -0,0 +1,147 @@
+//
+// stats.h
+// poll loop counters of the mapper and mpr.device objects and the layout
+// of their 'stats' reports
+//
+// A report is one 'stats device ...' message followed by one 'stats signal
+// <name> <in|out> ...' message per signal, each made of key/value pairs.
+// Rates are averaged since the previous report. The binding fills in the
+// per-signal counters it keeps after the common ones written here. The
+// 'latency' report of a signal's histogram is laid out here as well.
+//
+// The atoms are written for Max when MAXMSP is defined and for Pd
+// otherwise, so include this file after the host's headers.
+//
+// This software was written in the Input Devices and Music Interaction
+// Laboratory at McGill University in Montreal, and is copyright those
+// found in the AUTHORS file.  It is licensed under the GNU Lesser Public
+// General License version 2.1 or later.  Please see COPYING for details.
+//
+
+#ifndef MPR_BINDINGS_STATS_H
+#define MPR_BINDINGS_STATS_H
+
+#include <mapper/mapper.h>
+#include <string.h>
+
+#include "latency.h"
+#include "qos.h"
+
+typedef struct _stats
+{
+    unsigned long polls;            // incremented on every poll
+    unsigned long messages;         // messages handled by libmapper
+    unsigned long backlog;          // polls that stopped with messages pending
+    double poll_time;               // total and longest time spent polling
+    double poll_max;
+    double interval;                // seconds between periodic reports, 0 for none
+    mpr_time time;                  // time of the previous report or reset
+    unsigned long last_polls;       // polls at the previous report or reset
+} t_stats;
+
+// clear the counters, keeping the report interval
+static void stats_reset(t_stats *s)
+{
+    double interval = s->interval;
+    memset(s, 0, sizeof(t_stats));
+    s->interval = interval;
+    mpr_time_set(&s->time, MPR_NOW);
+}
+
+// count a poll that ran from start to end; returns 1 if a periodic report
+// is due
+static int stats_poll(t_stats *s, mpr_time start, mpr_time end, int backlog)
+{
+    double elapsed = mpr_time_get_diff(end, start);
+
+    if (backlog)
+        ++s->backlog;
+    ++s->polls;
+    s->poll_time += elapsed;
+    if (elapsed > s->poll_max)
+        s->poll_max = elapsed;
+    return s->interval > 0 && mpr_time_get_diff(end, s->time) >= s->interval;
+}
+
+static void stats_key(t_atom *a, const char *key)
+{
+#ifdef MAXMSP
+    atom_setsym(a, gensym((char *)key));
+#else
+    SETSYMBOL(a, gensym(key));
+#endif
+}
+
+static t_atom *stats_count(t_atom *a, const char *key, unsigned long count)
+{
+    stats_key(a, key);
+#ifdef MAXMSP
+    atom_setlong(a + 1, count);
+#else
+    SETFLOAT(a + 1, (t_float)count);
+#endif
+    return a + 2;
+}
+
+static t_atom *stats_value(t_atom *a, const char *key, double value)
+{
+    stats_key(a, key);
+#ifdef MAXMSP
+    atom_setfloat(a + 1, value);
+#else
+    SETFLOAT(a + 1, (t_float)value);
+#endif
+    return a + 2;
+}
+
+// the body of the 'stats device' message, for the period since the
+// previous report
+static t_atom *stats_device(t_atom *a, t_stats *s, t_qos *q, double period)
+{
+    stats_key(a++, "device");
+    a = stats_value(a, "period", period);
+    a = stats_count(a, "polls", s->polls);
+    a = stats_count(a, "messages", s->messages);
+    a = stats_count(a, "backlog", s->backlog);
+    a = stats_value(a, "poll_ms", s->polls ? s->poll_time * 1000 / s->polls : 0);
+    a = stats_value(a, "poll_max_ms", s->poll_max * 1000);
+    a = stats_value(a, "poll_rate", period > 0 ? (s->polls - s->last_polls) / period : 0);
+    a = stats_count(a, "budget", q->budget);
+    a = stats_count(a, "shed", q->shed);
+    a = stats_count(a, "deferred", q->deferred);
+    return a;
+}
+
+// the start of a 'stats signal' message, up to and including the update rate
+static t_atom *stats_signal(t_atom *a, const char *name, int out, unsigned long updates,
+                            unsigned long last_updates, double period)
+{
+    stats_key(a++, "signal");
+    stats_key(a++, name);
+    stats_key(a++, out ? "out" : "in");
+    a = stats_count(a, "updates", updates);
+    a = stats_value(a, "rate", period > 0 ? (updates - last_updates) / period : 0);
+    return a;
+}
+
+// the count and percentiles of a latency histogram in milliseconds, which
+// is then cleared
+static t_atom *stats_latency(t_atom *a, t_latency *l)
+{
+    a = stats_count(a, "count", l->total);
+    a = stats_value(a, "p50", latency_percentile(l, 0.5) * 1000);
+    a = stats_value(a, "p90", latency_percentile(l, 0.9) * 1000);
+    a = stats_value(a, "p99", latency_percentile(l, 0.99) * 1000);
+    a = stats_value(a, "max", l->max * 1000);
+    memset(l, 0, sizeof(t_latency));
+    return a;
+}
+
+// start the next period after a report made at 'now'
+static void stats_reported(t_stats *s, mpr_time now)
+{
+    s->time = now;
+    s->last_polls = s->polls;
+}
+
+#endif // MPR_BINDINGS_STATS_H
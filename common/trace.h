@@ -0,0 +1,157 @@
+//
+// trace.h
+// compile-time optional tracing of the bindings' poll, handler and outlet
+// spans, written out as Chrome trace-event JSON (chrome://tracing, Perfetto)
+//
+// Build with -DMPR_TRACE to enable. Otherwise TRACE_BEGIN and TRACE_END
+// expand to nothing and no code or data is added.
+//
+// Events go into a fixed ring of MPR_TRACE_EVENTS entries (default 65536)
+// that is claimed with an atomic increment, so any thread may record
+// without locking; once full, the oldest events are overwritten. Each
+// external including this header has its own ring.
+//
+// This software was written in the Input Devices and Music Interaction
+// Laboratory at McGill University in Montreal, and is copyright those
+// found in the AUTHORS file.  It is licensed under the GNU Lesser Public
+// General License version 2.1 or later.  Please see COPYING for details.
+//
+
+#ifndef MPR_BINDINGS_TRACE_H
+#define MPR_BINDINGS_TRACE_H
+
+#ifdef MPR_TRACE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef WIN32
+  #include <windows.h>
+#else
+  #include <time.h>
+  #include <pthread.h>
+  #include <unistd.h>
+  #ifdef __linux__
+    #include <sys/syscall.h>
+  #endif
+#endif
+
+#ifndef MPR_TRACE_EVENTS
+#define MPR_TRACE_EVENTS 65536          // must be a power of two
+#endif
+
+// names must be string literals, only the pointer is stored
+#define TRACE_BEGIN(name) trace_event(name, 'B')
+#define TRACE_END(name) trace_event(name, 'E')
+
+typedef struct _trace_event
+{
+    const char *name;
+    uint64_t time;                      // ns from an arbitrary origin
+    uint32_t tid;
+    char phase;                         // 'B'egin or 'E'nd
+    volatile uint32_t seq;              // index + 1 once the event is complete
+} t_trace_event;
+
+static t_trace_event trace_events[MPR_TRACE_EVENTS];
+static volatile uint32_t trace_next = 0;
+
+static uint64_t trace_now(void)
+{
+#ifdef WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (!freq.QuadPart)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (uint64_t)(now.QuadPart * (1e9 / freq.QuadPart));
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static uint32_t trace_tid(void)
+{
+#if defined(WIN32)
+    return (uint32_t)GetCurrentThreadId();
+#elif defined(__APPLE__)
+    uint64_t tid;
+    pthread_threadid_np(NULL, &tid);
+    return (uint32_t)tid;
+#elif defined(__linux__)
+    return (uint32_t)syscall(SYS_gettid);
+#else
+    return (uint32_t)(uintptr_t)pthread_self();
+#endif
+}
+
+static void trace_event(const char *name, char phase)
+{
+#ifdef WIN32
+    uint32_t seq = (uint32_t)InterlockedIncrement((volatile LONG *)&trace_next);
+#else
+    uint32_t seq = __atomic_add_fetch(&trace_next, 1, __ATOMIC_RELAXED);
+#endif
+    t_trace_event *e = &trace_events[(seq - 1) & (MPR_TRACE_EVENTS - 1)];
+    e->seq = 0;
+    e->name = name;
+    e->time = trace_now();
+    e->tid = trace_tid();
+    e->phase = phase;
+#ifdef WIN32
+    MemoryBarrier();
+    e->seq = seq;
+#else
+    __atomic_store_n(&e->seq, seq, __ATOMIC_RELEASE);
+#endif
+}
+
+static void trace_clear(void)
+{
+    memset(trace_events, 0, sizeof(trace_events));
+    trace_next = 0;
+}
+
+// write the buffered events in trace-event JSON, labelling the process
+// with the given name; returns the number of events written or -1 if the
+// file cannot be opened. Events still being recorded are skipped.
+static int trace_write(const char *path, const char *process)
+{
+    uint32_t last = trace_next, first, seq;
+    int count = 0;
+#ifdef WIN32
+    int pid = (int)GetCurrentProcessId();
+#else
+    int pid = (int)getpid();
+#endif
+    FILE *f = fopen(path, "w");
+
+    if (!f)
+        return -1;
+    first = last > MPR_TRACE_EVENTS ? last - MPR_TRACE_EVENTS + 1 : 1;
+    fprintf(f, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    fprintf(f, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, "
+            "\"args\": {\"name\": \"%s\"}}", pid, process);
+    for (seq = first; seq <= last; seq++) {
+        t_trace_event *e = &trace_events[(seq - 1) & (MPR_TRACE_EVENTS - 1)];
+        if (e->seq != seq)
+            continue;
+        fprintf(f, ",\n{\"name\": \"%s\", \"ph\": \"%c\", \"ts\": %.3f, \"pid\": %d, "
+                "\"tid\": %u}", e->name, e->phase, e->time * 0.001, pid, e->tid);
+        ++count;
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    return count;
+}
+
+#else
+
+#define TRACE_BEGIN(name)
+#define TRACE_END(name)
+
+#endif // MPR_TRACE
+
+#endif // MPR_BINDINGS_TRACE_H
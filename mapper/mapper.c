@@ -33,9 +33,31 @@
 #endif
 
 #include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+  #include <sys/inotify.h>
+#endif
+
+#include "../common/capture.h"
+#include "../common/definition.h"
+#include "../common/identity.h"
+#include "../common/mapping.h"
+#include "../common/qos.h"
+#include "../common/session.h"
+#include "../common/stats.h"
+#include "../common/trace.h"
 
 #define INTERVAL 1
 #define MAX_LIST 256
+#define MAX_POLL 10
+#define MAX_PATH_LEN 1024
+#define WATCH_INTERVAL 0.5    // seconds between checks where inotify is unavailable
+#define WATCH_SETTLE 0.1      // seconds a changed definition must be left alone
+#define LEARN_SETTLE 1.0      // default seconds a learned selector waits before promotion
+#define LEARN_MIN_COUNT 2     // default messages needed for automatic promotion
+#define LEARN_EXPIRE 10.0     // seconds after which unpromoted candidates are forgotten
+#define LEARN_BATCH 16        // signals promoted per poll
+#define LEARN_MAX_PENDING 256
 
 #ifdef MAXMSP
 #define POST(x, ...) { object_post((t_object *)x, __VA_ARGS__); }
@@ -43,6 +65,20 @@
 #define POST(x, ...) { post(__VA_ARGS__); }
 #endif
 
+// *********************************************************
+// -(namespace trie)----------------------------------------
+// signals are indexed by path segment so that OSC-style patterns can be
+// resolved by walking the tree instead of scanning the device's signal list
+typedef struct _mapper_node
+{
+    t_symbol *seg;                  // interned path segment
+    t_symbol *name;                 // full signal name, if sig is set
+    mpr_sig sig;
+    struct _mapper_sig *data;       // per-signal data of sig, if any
+    struct _mapper_node *child;     // first child
+    struct _mapper_node *next;      // next sibling
+} t_mapper_node;
+
 // *********************************************************
 // -(object struct)-----------------------------------------
 typedef struct _mapper
@@ -58,29 +94,122 @@ typedef struct _mapper
     void *outlet2;
     void *clock;          // pointer to clock object
     char *name;
+    char *recv_prefix;          // receive names are "<prefix>.<signal>"
     mpr_graph graph;
     mpr_dev device;
     mpr_time timetag;
     int updated;
     int ready;
     int learn_mode;
+    struct _mapper_candidate *candidates;   // selectors waiting to be learned
+    int num_candidates;
+    double learn_settle;
+    int learn_min_count;
+    t_mapper_node *names;
+    int num_inputs;             // kept as signals are created and freed
+    int num_outputs;
+    int counts_changed;         // directions whose count has not been output
+    int transaction;            // batches deferring count output
+    int staging;                // between 'begin' and 'commit'
+    struct _mapper_op *staged;
+    struct _mapper_op *staged_last;
     t_atom buffer[MAX_LIST];
-    char *definition;
-#ifdef MAXMSP
-    t_dictionary *d;
+    union {
+        int i[MAX_LIST];
+        float f[MAX_LIST];
+    } payload;                          // values being sent to libmapper
+    char *definition;           // resolved path of the definition file
+    int watch;                  // reload the definition when it changes
+    int watch_pending;          // changed, waiting for WATCH_SETTLE
+    int watch_fd;               // inotify instance on its directory, or -1
+    time_t watch_mtime;         // polled instead where there is no inotify
+    mpr_time watch_checked;
+    mpr_time watch_changed;
+    char *identity;             // file keeping the name, ordinal and port claimed
+    t_identity claimed;
+    char *session_path;         // file caching the maps of the device's signals
+    t_session *session;
+    t_mapping_load *maps_load;  // loaded maps waiting for their devices
+#ifndef MAXMSP
+    t_symbol *dir;              // patch directory, for relative file names
 #endif
+    t_stats stats;              // poll loop statistics, reported by the 'stats' message
+    int latency;                // collect latency histograms of received values
+    mpr_time recv_time;         // when the current mpr_dev_poll() call started
+    t_qos qos;                  // priority-ordered delivery of received values
+    t_capture *capture;         // traffic being recorded, if any
+    t_capture_player *play;     // log being played back, if any
+    void *play_clock;
 } t_mapper;
 
+// *********************************************************
+// -(staged signal message)---------------------------------
+// an add, remove or clear message held between 'begin' and 'commit'
+typedef struct _mapper_op
+{
+    void (*fn)(t_mapper *x, t_symbol *s, int argc, t_atom *argv);
+    t_symbol *sel;
+    int argc;
+    t_atom *argv;                   // allocated along with the op
+    struct _mapper_op *next;
+} t_mapper_op;
+
+// *********************************************************
+// -(learn candidate)---------------------------------------
+// an unknown selector seen in learn mode, not yet promoted to a signal
+typedef struct _mapper_candidate
+{
+    t_symbol *name;
+    mpr_type type;
+    int argc;
+    t_atom *argv;                   // last value, set on the signal when promoted
+    int size;                       // atoms allocated for it
+    unsigned long count;
+    mpr_time first_seen;
+    mpr_time last_seen;
+    struct _mapper_candidate *next;
+} t_mapper_candidate;
+
+// per-signal data stored as the MPR_PROP_DATA of the device's signals
+typedef struct _mapper_sig
+{
+    t_mapper *home;
+    t_symbol *name;
+    t_symbol *recv;     // receive name "<prefix>.<signal>"
+
+    // counters are kept next to the data already loaded for each update
+    unsigned long updates;      // values sent or received
+    unsigned long bytes;        // value payload
+    unsigned long dropped;      // malformed updates that were not sent
+    unsigned long coalesced;    // updates overwritten before being sent
+    unsigned long releases;     // instance releases
+    unsigned long overflows;    // instance overflows
+    unsigned long last_updates; // updates at the previous report
+    unsigned long poll_seq;     // poll during which the last value was set
+    mpr_id last_inst;
+    int defined;                // found in the definition being reloaded
+    t_qos_slot qos;             // priority and value held back under the budget
+
+    t_latency network;          // from being polled off the network to output
+    t_latency timetag;          // from the sender's timetag to output
+} t_mapper_sig;
+
 // *********************************************************
 // -(function prototypes)-----------------------------------
 static void *mapperobj_new(t_symbol *s, int argc, t_atom *argv);
 static void mapperobj_free(t_mapper *x);
 
 static void mapperobj_anything(t_mapper *x, t_symbol *s, int argc, t_atom *argv);
+static void mapperobj_set_sig(t_mapper *x, t_mapper_node *node, int argc, t_atom *argv);
 
 static void mapperobj_add_signal(t_mapper *x, t_symbol *s, int argc, t_atom *argv);
 static void mapperobj_remove_signal(t_mapper *x, t_symbol *s, int argc, t_atom *argv);
 static void mapperobj_clear_signals(t_mapper *x, t_symbol *s, int argc, t_atom *argv);
+static void mapperobj_begin(t_mapper *x);
+static void mapperobj_commit(t_mapper *x);
+static int mapperobj_stage(t_mapper *x, void (*fn)(t_mapper *, t_symbol *, int, t_atom *),
+                           t_symbol *s, int argc, t_atom *argv);
+static void mapperobj_output_counts(t_mapper *x);
 
 static void mapperobj_poll(t_mapper *x);
 
@@ -89,26 +218,89 @@ static void mapperobj_sig_handler(mpr_sig sig, mpr_sig_evt evt, mpr_id inst,
                                   mpr_time time);
 
 static void mapperobj_print_properties(t_mapper *x);
+static void mapperobj_stats(t_mapper *x, t_symbol *s, int argc, t_atom *argv);
+static void mapperobj_stats_report(t_mapper *x);
+static void mapperobj_latency(t_mapper *x, t_symbol *s, int argc, t_atom *argv);
+static void mapperobj_trace(t_mapper *x, t_symbol *s, int argc, t_atom *argv);
+static void mapperobj_record(t_mapper *x, t_symbol *s, int argc, t_atom *argv);
+static void mapperobj_record_stop(t_mapper *x);
+static void mapperobj_play(t_mapper *x, t_symbol *s, int argc, t_atom *argv);
+static void mapperobj_play_stop(t_mapper *x, int done);
+static void mapperobj_stop(t_mapper *x);
+
+static t_mapper_sig *mapperobj_sig_data_new(t_mapper *x, const char *sig_name);
+static void mapperobj_sig_init(t_mapper *x, mpr_sig sig, const char *sig_name);
+static void mapperobj_sig_free(t_mapper *x, mpr_sig sig);
+static void mapperobj_output(t_mapper_sig *data, int argc, t_atom *argv);
+static void mapperobj_deliver(t_mapper_sig *data, int poly, mpr_id inst, int len,
+                              mpr_type type, const void *val, mpr_time time,
+                              mpr_time recv_time);
+static void mapperobj_set_atoms(t_atom *a, int len, mpr_type type, const void *val);
+
+typedef void (*t_mapper_match_fn)(t_mapper *x, t_mapper_node *node,
+                                  int argc, t_atom *argv);
+static void mapperobj_names_add(t_mapper *x, const char *name, mpr_sig sig);
+static int mapperobj_names_remove(t_mapper_node **list, const char *path);
+static t_mapper_node *mapperobj_names_get(t_mapper *x, const char *path);
+static mpr_sig mapperobj_names_find(t_mapper *x, const char *path);
+static void mapperobj_names_match(t_mapper *x, t_mapper_node *list,
+                                  const char *pattern, t_mapper_match_fn fn,
+                                  int argc, t_atom *argv);
+static void mapperobj_names_free(t_mapper_node *list);
 
 static void mapperobj_learn(t_mapper *x, t_symbol *s, int argc, t_atom *argv);
+static void mapperobj_learn_candidate(t_mapper *x, t_symbol *s, int argc, t_atom *argv);
+static void mapperobj_learn_poll(t_mapper *x, mpr_time now, int commit);
+static void mapperobj_learn_clear(t_mapper *x);
 static void mapperobj_set(t_mapper *x, t_symbol *s, int argc, t_atom *argv);
+static void mapperobj_release(t_mapper *x, t_symbol *s, int argc, t_atom *argv);
+static void mapperobj_get(t_mapper *x, t_symbol *s, int argc, t_atom *argv);
+
+static t_definition *mapperobj_open_definition(t_mapper *x, const char *file);
+static t_definition *mapperobj_read_definition(t_mapper *x, const char *file);
+static void mapperobj_register_signals(t_mapper *x, t_definition *d);
+static mpr_sig mapperobj_definition_sig(t_mapper *x, const t_definition_sig *s);
+static int mapperobj_definition_props(t_mapper *x, mpr_sig sig,
+                                      const t_definition_sig *s, int fresh);
+static void mapperobj_reload(t_mapper *x, t_symbol *s, int argc, t_atom *argv);
+static void mapperobj_watch(t_mapper *x, t_symbol *s, int argc, t_atom *argv);
+static void mapperobj_watch_start(t_mapper *x);
+static void mapperobj_watch_stop(t_mapper *x);
+static void mapperobj_watch_poll(t_mapper *x, mpr_time now);
+static void mapperobj_write(t_mapper *x, t_symbol *s, int argc, t_atom *argv);
+static void mapperobj_maps(t_mapper *x, t_symbol *s, int argc, t_atom *argv);
+static void mapperobj_maps_poll(t_mapper *x, mpr_time now);
+static void mapperobj_maps_stop(t_mapper *x);
+static int mapperobj_locate_file(t_mapper *x, const char *file, char *path, int size);
+static const char *mapperobj_read_identity(t_mapper *x, const char *file, char *prefix);
+static void mapperobj_save_identity(t_mapper *x);
+static void mapperobj_session_poll(t_mapper *x, mpr_time now);
+static void mapperobj_save_session(t_mapper *x);
+static void mapperobj_budget(t_mapper *x, t_symbol *s, int argc, t_atom *argv);
+static void mapperobj_priority(t_mapper *x, t_symbol *s, int argc, t_atom *argv);
+static void mapperobj_qos_flush(t_mapper *x);
+static void mapperobj_set_priority(t_mapper *x, t_mapper_sig *data, int priority);
 
 #ifdef MAXMSP
 void mapperobj_assist(t_mapper *x, void *b, long m, long a, char *s);
-static void mapperobj_register_signals(t_mapper *x);
-static void mapperobj_read_definition(t_mapper *x);
 #endif
 
+static void maxpd_init_symbols(void);
 static int maxpd_atom_strcmp(t_atom *a, const char *string);
 static const char *maxpd_atom_get_string(t_atom *a);
+static t_symbol *maxpd_atom_get_symbol(t_atom *a);
 static void maxpd_atom_set_string(t_atom *a, const char *string);
+static void maxpd_atom_set_symbol(t_atom *a, t_symbol *s);
 static void maxpd_atom_set_int(t_atom *a, int i);
 static double maxpd_atom_get_float(t_atom *a);
 static void maxpd_atom_set_float(t_atom *a, float d);
+static int maxpd_osc_match(const char *pat, const char *end, const char *str);
 
 // *********************************************************
 // -(global class pointer variable)-------------------------
 static void *mapperobj_class;
+static t_symbol *ps_list, *ps_release, *ps_local, *ps_upstream, *ps_downstream,
+    *ps_overflow;
 
 // *********************************************************
 // -(main)--------------------------------------------------
@@ -124,9 +316,26 @@ static void *mapperobj_class;
         class_addmethod(c, (method)mapperobj_anything,       "anything", A_GIMME,    0);
         class_addmethod(c, (method)mapperobj_learn,          "learn",    A_GIMME,    0);
         class_addmethod(c, (method)mapperobj_set,            "set",      A_GIMME,    0);
+        class_addmethod(c, (method)mapperobj_release,        "release",  A_GIMME,    0);
+        class_addmethod(c, (method)mapperobj_get,            "get",      A_GIMME,    0);
         class_addmethod(c, (method)mapperobj_clear_signals,  "clear",    A_GIMME,    0);
+        class_addmethod(c, (method)mapperobj_begin,          "begin",    0);
+        class_addmethod(c, (method)mapperobj_commit,         "commit",   0);
+        class_addmethod(c, (method)mapperobj_stats,          "stats",    A_GIMME,    0);
+        class_addmethod(c, (method)mapperobj_latency,        "latency",  A_GIMME,    0);
+        class_addmethod(c, (method)mapperobj_trace,          "trace",    A_GIMME,    0);
+        class_addmethod(c, (method)mapperobj_record,         "record",   A_GIMME,    0);
+        class_addmethod(c, (method)mapperobj_play,           "play",     A_GIMME,    0);
+        class_addmethod(c, (method)mapperobj_stop,           "stop",     0);
+        class_addmethod(c, (method)mapperobj_reload,         "reload",   A_GIMME,    0);
+        class_addmethod(c, (method)mapperobj_watch,          "watch",    A_GIMME,    0);
+        class_addmethod(c, (method)mapperobj_write,          "write",    A_GIMME,    0);
+        class_addmethod(c, (method)mapperobj_maps,           "maps",     A_GIMME,    0);
+        class_addmethod(c, (method)mapperobj_budget,         "budget",   A_GIMME,    0);
+        class_addmethod(c, (method)mapperobj_priority,       "priority", A_GIMME,    0);
         class_register(CLASS_BOX, c); /* CLASS_NOBOX */
         mapperobj_class = c;
+        maxpd_init_symbols();
         return 0;
     }
 #else
@@ -140,8 +349,25 @@ static void *mapperobj_class;
         class_addanything(c, (t_method)mapperobj_anything);
         class_addmethod(c,   (t_method)mapperobj_learn,         gensym("learn"),  A_GIMME, 0);
         class_addmethod(c,   (t_method)mapperobj_set,           gensym("set"),    A_GIMME, 0);
+        class_addmethod(c,   (t_method)mapperobj_release,       gensym("release"), A_GIMME, 0);
+        class_addmethod(c,   (t_method)mapperobj_get,           gensym("get"),    A_GIMME, 0);
         class_addmethod(c,   (t_method)mapperobj_clear_signals, gensym("clear"),  A_GIMME, 0);
+        class_addmethod(c,   (t_method)mapperobj_begin,         gensym("begin"),  0);
+        class_addmethod(c,   (t_method)mapperobj_commit,        gensym("commit"), 0);
+        class_addmethod(c,   (t_method)mapperobj_stats,         gensym("stats"),  A_GIMME, 0);
+        class_addmethod(c,   (t_method)mapperobj_latency,       gensym("latency"), A_GIMME, 0);
+        class_addmethod(c,   (t_method)mapperobj_trace,         gensym("trace"),  A_GIMME, 0);
+        class_addmethod(c,   (t_method)mapperobj_record,        gensym("record"), A_GIMME, 0);
+        class_addmethod(c,   (t_method)mapperobj_play,          gensym("play"),   A_GIMME, 0);
+        class_addmethod(c,   (t_method)mapperobj_stop,          gensym("stop"),   0);
+        class_addmethod(c,   (t_method)mapperobj_reload,        gensym("reload"), A_GIMME, 0);
+        class_addmethod(c,   (t_method)mapperobj_watch,         gensym("watch"),  A_GIMME, 0);
+        class_addmethod(c,   (t_method)mapperobj_write,         gensym("write"),  A_GIMME, 0);
+        class_addmethod(c,   (t_method)mapperobj_maps,          gensym("maps"),   A_GIMME, 0);
+        class_addmethod(c,   (t_method)mapperobj_budget,        gensym("budget"), A_GIMME, 0);
+        class_addmethod(c,   (t_method)mapperobj_priority,      gensym("priority"), A_GIMME, 0);
         mapperobj_class = c;
+        maxpd_init_symbols();
         return 0;
     }
 #endif
@@ -155,6 +381,13 @@ static void *mapperobj_new(t_symbol *s, int argc, t_atom *argv)
     int learn = 0;
     const char *alias = NULL;
     const char *iface = NULL;
+    const char *definition = NULL;
+    t_definition *def = NULL;
+    const char *identity = NULL;
+    const char *session = NULL;
+    const char *receive = NULL;
+    char prefix[IDENTITY_MAX_NAME];
+    int watch = 0;
 
 #ifdef MAXMSP
     if ((x = object_alloc(mapperobj_class))) {
@@ -165,6 +398,7 @@ static void *mapperobj_new(t_symbol *s, int argc, t_atom *argv)
     if ((x = (t_mapper *) pd_new(mapperobj_class)) ) {
         x->outlet1 = outlet_new(&x->ob, gensym("list"));
         x->outlet2 = outlet_new(&x->ob, gensym("list"));
+        x->dir = canvas_getcurrentdir();
 #endif
 
         for (i = 0; i < argc; i++) {
@@ -175,16 +409,13 @@ static void *mapperobj_new(t_symbol *s, int argc, t_atom *argv)
                         i++;
                     }
                 }
-#ifdef MAXMSP
                 else if ((maxpd_atom_strcmp(argv+i, "@def") == 0) ||
                          (maxpd_atom_strcmp(argv+i, "@definition") == 0)) {
                     if ((argv+i+1)->a_type == A_SYM) {
-                        x->definition = strdup(maxpd_atom_get_string(argv+i+1));
-                        mapperobj_read_definition(x);
+                        definition = maxpd_atom_get_string(argv+i+1);
                         i++;
                     }
                 }
-#endif
                 else if (maxpd_atom_strcmp(argv+i, "@learn") == 0) {
                     if ((argv+i+1)->a_type == A_FLOAT) {
                         learn = (maxpd_atom_get_float(argv+i+1) > 1) ? 0 : 1;
@@ -203,9 +434,42 @@ static void *mapperobj_new(t_symbol *s, int argc, t_atom *argv)
                         i++;
                     }
                 }
+                else if (maxpd_atom_strcmp(argv+i, "@watch") == 0) {
+                    if (i + 1 < argc && (argv+i+1)->a_type != A_SYM) {
+                        watch = maxpd_atom_get_float(argv+i+1) != 0;
+                        i++;
+                    }
+                }
+                else if (maxpd_atom_strcmp(argv+i, "@identity") == 0) {
+                    if (i + 1 < argc && (argv+i+1)->a_type == A_SYM) {
+                        identity = maxpd_atom_get_string(argv+i+1);
+                        i++;
+                    }
+                }
+                else if (maxpd_atom_strcmp(argv+i, "@session") == 0) {
+                    if (i + 1 < argc && (argv+i+1)->a_type == A_SYM) {
+                        session = maxpd_atom_get_string(argv+i+1);
+                        i++;
+                    }
+                }
+                else if (maxpd_atom_strcmp(argv+i, "@receive") == 0) {
+                    if (i + 1 < argc && (argv+i+1)->a_type == A_SYM) {
+                        receive = maxpd_atom_get_string(argv+i+1);
+                        i++;
+                    }
+                }
             }
         }
+        // the definition's device name is read before any of its signals
+        if (definition)
+            def = mapperobj_read_definition(x, definition);
+        // a stored identity names the device unless it is given a name
+        if (identity && (identity = mapperobj_read_identity(x, identity, prefix))
+            && !alias && !x->name)
+            x->name = strdup(identity);
         if (alias) {
+            if (x->name)
+                free(x->name);
             x->name = *alias == '/' ? strdup(alias+1) : strdup(alias);
         }
         else if (!x->name) {
@@ -215,6 +479,17 @@ static void *mapperobj_new(t_symbol *s, int argc, t_atom *argv)
             x->name = strdup("puredata");
 #endif
         }
+        /* The default prefix leaves out the ordinal, which is only known
+         * once the device is ready and may change from run to run, so two
+         * objects of the same name share their receive names unless given
+         * their own with @receive. */
+        if (receive)
+            x->recv_prefix = strdup(receive);
+        else {
+            size_t len = strlen(x->name) + 8;
+            if ((x->recv_prefix = (char *)malloc(len)))
+                snprintf(x->recv_prefix, len, "mapper.%s", x->name);
+        }
 
         POST(x, "libmapper version %s – visit libmapper.org for more information.",
              mpr_get_version());
@@ -228,6 +503,18 @@ static void *mapperobj_new(t_symbol *s, int argc, t_atom *argv)
         if (iface)
             mpr_graph_set_interface(x->graph, iface);
         POST(x, "Using network interface %s.", mpr_graph_get_interface(x->graph));
+        // the ordinal only means something for the same name
+        if (identity && !strcmp(identity, x->name)) {
+            POST(x, "Asking for identity %s.", x->claimed.name);
+            identity_hint(x->device, &x->claimed);
+        }
+        if (session) {
+            char path[MAX_PATH_LEN];
+            if (mapperobj_locate_file(x, session, path, MAX_PATH_LEN))
+                snprintf(path, MAX_PATH_LEN, "%s", session);
+            x->session_path = strdup(path);
+            x->session = session_new(x->session_path, x->device);
+        }
 
         // add other declared properties
         for (i = 0; i < argc; i++) {
@@ -237,7 +524,11 @@ static void *mapperobj_new(t_symbol *s, int argc, t_atom *argv)
                 (maxpd_atom_strcmp(argv+i, "@def") == 0) ||
                 (maxpd_atom_strcmp(argv+i, "@definition") == 0) ||
                 (maxpd_atom_strcmp(argv+i, "@learn") == 0) ||
-                (maxpd_atom_strcmp(argv+i, "@interface") == 0)){
+                (maxpd_atom_strcmp(argv+i, "@interface") == 0) ||
+                (maxpd_atom_strcmp(argv+i, "@watch") == 0) ||
+                (maxpd_atom_strcmp(argv+i, "@identity") == 0) ||
+                (maxpd_atom_strcmp(argv+i, "@session") == 0) ||
+                (maxpd_atom_strcmp(argv+i, "@receive") == 0)){
                 i++;
                 continue;
             }
@@ -280,8 +571,23 @@ static void *mapperobj_new(t_symbol *s, int argc, t_atom *argv)
         x->ready = 0;
         x->updated = 0;
         x->learn_mode = learn;
+        x->candidates = 0;
+        x->num_candidates = 0;
+        x->learn_settle = LEARN_SETTLE;
+        x->learn_min_count = LEARN_MIN_COUNT;
+        x->names = 0;
+        x->num_inputs = x->num_outputs = x->counts_changed = 0;
+        x->transaction = x->staging = 0;
+        x->staged = x->staged_last = 0;
+        x->stats.interval = 0;
+        stats_reset(&x->stats);
+        x->latency = 0;
+        x->watch_fd = -1;
+        if (def)
+            mapperobj_register_signals(x, def);
+        if (watch)
+            mapperobj_watch_start(x);
 #ifdef MAXMSP
-        mapperobj_register_signals(x);
         // Create the timing clock
         x->clock = clock_new(x, (method)mapperobj_poll);
 #else
@@ -299,17 +605,44 @@ static void mapperobj_free(t_mapper *x)
 {
     clock_unset(x->clock);      // Remove clock routine from the scheduler
     clock_free(x->clock);       // Frees memeory used by clock
-
-#ifdef MAXMSP
-    object_free(x->d);          // Frees memory used by dictionary
-#endif
+    mapperobj_stop(x);
+    while (x->staged) {
+        t_mapper_op *op = x->staged;
+        x->staged = op->next;
+        free(op);
+    }
+    mapperobj_watch_stop(x);
+    mapperobj_learn_clear(x);
+    mapperobj_maps_stop(x);
+    if (x->play_clock)
+        clock_free(x->play_clock);
+    if (x->session) {
+        // keep changes made since the last save
+        if (x->session->dirty)
+            mapperobj_save_session(x);
+        session_free(x->session);
+        free(x->session_path);
+    }
 
     if (x->device) {
+        mpr_list sigs = mpr_dev_get_sigs(x->device, MPR_DIR_ANY);
+        while (sigs) {
+            mpr_sig sig = *sigs;
+            sigs = mpr_list_get_next(sigs);
+            mapperobj_sig_free(x, sig);
+        }
         mpr_dev_free(x->device);
     }
+    mapperobj_names_free(x->names);
     if (x->name) {
         free(x->name);
     }
+    if (x->recv_prefix)
+        free(x->recv_prefix);
+    if (x->definition)
+        free(x->definition);
+    if (x->identity)
+        free(x->identity);
 }
 
 // *********************************************************
@@ -337,13 +670,9 @@ static void mapperobj_print_properties(t_mapper *x)
         maxpd_atom_set_int(x->buffer, mpr_obj_get_prop_as_int32(x->device, MPR_PROP_ORDINAL, NULL));
         outlet_anything(x->outlet2, gensym("ordinal"), 1, x->buffer);
 
-        //output numInputs
-        maxpd_atom_set_int(x->buffer, mpr_list_get_size(mpr_dev_get_sigs(x->device, MPR_DIR_IN)));
-        outlet_anything(x->outlet2, gensym("numInputs"), 1, x->buffer);
-
-        //output numOutputs
-        maxpd_atom_set_int(x->buffer, mpr_list_get_size(mpr_dev_get_sigs(x->device, MPR_DIR_OUT)));
-        outlet_anything(x->outlet2, gensym("numOutputs"), 1, x->buffer);
+        //output numInputs and numOutputs
+        x->counts_changed = MPR_DIR_ANY;
+        mapperobj_output_counts(x);
     }
 }
 
@@ -395,6 +724,8 @@ static void mapperobj_add_signal(t_mapper *x, t_symbol *s,
 
     // get signal name
     sig_name = maxpd_atom_get_string(argv+1);
+    if (mapperobj_stage(x, mapperobj_add_signal, s, argc, argv))
+        return;
 
     // get signal type, length, and units
     for (i = 2; i < argc; i++) {
@@ -438,11 +769,11 @@ static void mapperobj_add_signal(t_mapper *x, t_symbol *s,
 
     sig = mpr_sig_new(x->device, dir, sig_name, sig_length, sig_type, sig_units,
                       0, 0, 0, mapperobj_sig_handler, MPR_SIG_ALL);
-    mpr_obj_set_prop(sig, MPR_PROP_DATA, NULL, 1, MPR_PTR, x, 0);
     if (!sig) {
         POST(x, "Error adding signal!");
         return;
     }
+    mapperobj_sig_init(x, sig, sig_name);
 
     // add other declared properties
     for (i = 2; i < argc; i++) {
@@ -496,6 +827,18 @@ static void mapperobj_add_signal(t_mapper *x, t_symbol *s,
             if (prop_int > 1)
                 mpr_sig_reserve_inst(sig, prop_int, 0, 0);
         }
+        else if (maxpd_atom_strcmp(argv+i, "@priority") == 0) {
+            if ((argv+i+1)->a_type == A_SYM) {
+                t_mapper_sig *data = (void*)mpr_obj_get_prop_as_ptr(sig, MPR_PROP_DATA, NULL);
+                int priority = qos_parse(maxpd_atom_get_string(argv+i+1));
+                if (priority < 0) {
+                    POST(x, "priority must be high, normal or low");
+                }
+                else
+                    mapperobj_set_priority(x, data, priority);
+                i++;
+            }
+        }
         else if (maxpd_atom_strcmp(argv+i, "@stealing") == 0) {
             if ((argv+i+1)->a_type == A_SYM) {
                 int stl = MPR_STEAL_NONE;
@@ -546,11 +889,7 @@ static void mapperobj_add_signal(t_mapper *x, t_symbol *s,
     }
 
     // Update status outlet
-    maxpd_atom_set_int(x->buffer, mpr_list_get_size(mpr_dev_get_sigs(x->device, dir)));
-    if (dir == MPR_DIR_OUT)
-        outlet_anything(x->outlet2, gensym("numOutputs"), 1, x->buffer);
-    else
-        outlet_anything(x->outlet2, gensym("numInputs"), 1, x->buffer);
+    mapperobj_output_counts(x);
 }
 
 // *********************************************************
@@ -567,21 +906,19 @@ static void mapperobj_remove_signal(t_mapper *x, t_symbol *s,
         POST(x, "Unable to parse remove message!");
         return;
     }
+    if (mapperobj_stage(x, mapperobj_remove_signal, s, argc, argv))
+        return;
     direction = maxpd_atom_get_string(argv);
     sig_name = maxpd_atom_get_string(argv+1);
 
-    mpr_list sigs = mpr_dev_get_sigs(x->device, MPR_DIR_ANY);
-    sigs = mpr_list_filter(sigs, MPR_PROP_NAME, NULL, 1, MPR_STR, sig_name, MPR_OP_EQ);
-    if (sigs && *sigs)
-        mpr_sig_free(*sigs);
-    if (strcmp(direction, "output") == 0) {
-        maxpd_atom_set_int(x->buffer, mpr_list_get_size(mpr_dev_get_sigs(x->device, MPR_DIR_OUT)));
-        outlet_anything(x->outlet2, gensym("numOutputs"), 1, x->buffer);
-    }
-    else if (strcmp(direction, "input") == 0) {
-        maxpd_atom_set_int(x->buffer, mpr_list_get_size(mpr_dev_get_sigs(x->device, MPR_DIR_IN)));
-        outlet_anything(x->outlet2, gensym("numInputs"), 1, x->buffer);
-    }
+    mpr_sig sig = mapperobj_names_find(x, sig_name);
+    if (sig)
+        mapperobj_sig_free(x, sig);
+    if (strcmp(direction, "output") == 0)
+        x->counts_changed |= MPR_DIR_OUT;
+    else if (strcmp(direction, "input") == 0)
+        x->counts_changed |= MPR_DIR_IN;
+    mapperobj_output_counts(x);
 }
 
 // *********************************************************
@@ -599,6 +936,8 @@ static void mapperobj_clear_signals(t_mapper *x, t_symbol *s,
         dir |= MPR_DIR_OUT;
     else
         return;
+    if (mapperobj_stage(x, mapperobj_clear_signals, s, argc, argv))
+        return;
 
     mpr_list sigs;
     POST(x, "Clearing signals");
@@ -606,31 +945,204 @@ static void mapperobj_clear_signals(t_mapper *x, t_symbol *s,
     while (sigs) {
         mpr_sig sig = *sigs;
         sigs = mpr_list_get_next(sigs);
-        mpr_sig_free(sig);
+        mapperobj_sig_free(x, sig);
+    }
+    x->counts_changed |= dir;
+    mapperobj_output_counts(x);
+}
+
+// *********************************************************
+// -(transactions)------------------------------------------
+static void mapperobj_begin(t_mapper *x)
+{
+    /* 'begin' holds back add, remove and clear messages until 'commit',
+     * which applies them all at once: libmapper then announces the changes
+     * together on the next poll, and numInputs and numOutputs are output
+     * once. Staged signals cannot be used before the commit. */
+    if (x->staging) {
+        POST(x, "Transaction already open.");
+        return;
+    }
+    x->staging = 1;
+}
+
+static void mapperobj_commit(t_mapper *x)
+{
+    t_mapper_op *op;
+
+    if (!x->staging) {
+        POST(x, "No transaction to commit.");
+        return;
+    }
+    x->staging = 0;
+    ++x->transaction;
+    while ((op = x->staged)) {
+        x->staged = op->next;
+        op->fn(x, op->sel, op->argc, op->argv);
+        free(op);
+    }
+    x->staged_last = 0;
+    --x->transaction;
+    mapperobj_output_counts(x);
+}
+
+// keep a copy of a signal message for the commit if a transaction is being
+// staged, returning 0 if it should be applied now
+static int mapperobj_stage(t_mapper *x, void (*fn)(t_mapper *, t_symbol *, int, t_atom *),
+                           t_symbol *s, int argc, t_atom *argv)
+{
+    t_mapper_op *op;
+
+    if (!x->staging)
+        return 0;
+    if (!(op = (t_mapper_op *)malloc(sizeof(t_mapper_op) + argc * sizeof(t_atom)))) {
+        POST(x, "Could not stage message; applying it now.");
+        return 0;
     }
+    op->fn = fn;
+    op->sel = s;
+    op->argc = argc;
+    op->argv = (t_atom *)(op + 1);
+    memcpy(op->argv, argv, argc * sizeof(t_atom));
+    op->next = 0;
+    if (x->staged_last)
+        x->staged_last->next = op;
+    else
+        x->staged = op;
+    x->staged_last = op;
+    return 1;
+}
 
-    if (dir & MPR_DIR_IN) {
-        maxpd_atom_set_int(x->buffer, mpr_list_get_size(mpr_dev_get_sigs(x->device, MPR_DIR_IN)));
+// output the signal counts that changed, unless a transaction or the
+// device not being ready yet holds them back
+static void mapperobj_output_counts(t_mapper *x)
+{
+    if (x->transaction || !x->ready)
+        return;
+    if (x->counts_changed & MPR_DIR_IN) {
+        maxpd_atom_set_int(x->buffer, x->num_inputs);
         outlet_anything(x->outlet2, gensym("numInputs"), 1, x->buffer);
     }
-    if (dir & MPR_DIR_OUT) {
-        maxpd_atom_set_int(x->buffer, mpr_list_get_size(mpr_dev_get_sigs(x->device, MPR_DIR_OUT)));
+    if (x->counts_changed & MPR_DIR_OUT) {
+        maxpd_atom_set_int(x->buffer, x->num_outputs);
         outlet_anything(x->outlet2, gensym("numOutputs"), 1, x->buffer);
     }
+    x->counts_changed = 0;
 }
 
 // *********************************************************
 // -(set signal value)--------------------------------------
+static void mapperobj_set_node(t_mapper *x, t_mapper_node *node,
+                               int argc, t_atom *argv)
+{
+    mapperobj_set_sig(x, node, argc, argv);
+}
+
 static void mapperobj_set(t_mapper *x, t_symbol *s, int argc, t_atom *argv)
 {
     /* This method sets the value of an input signal.
      * This allows storing of input signal state changes generated by
      * user actions rather than libmapper messaging. This state storage
      * is used by libmapper for (e.g.) retreiving information for training
-     * implicit mapping algorithms. */
+     * implicit mapping algorithms.
+     * The signal name may be an OSC-style pattern, in which case every
+     * matching signal is updated with the same value. */
+
+    if (!x->ready || argc < 2 || argv->a_type != A_SYM)
+        return;
+
+    const char *path = maxpd_atom_get_string(argv);
+    if (strpbrk(path, "*?[{"))
+        mapperobj_names_match(x, x->names, path, mapperobj_set_node,
+                              argc - 1, argv + 1);
+    else
+        mapperobj_anything(x, maxpd_atom_get_symbol(argv), argc - 1, argv + 1);
+}
+
+// *********************************************************
+// -(release signal instances)------------------------------
+static void mapperobj_release_sig(t_mapper *x, t_mapper_node *node,
+                                  int argc, t_atom *argv)
+{
+    int i, num_inst;
+
+    if (argc) {
+        // release a single instance
+        mpr_id id = (mpr_id)maxpd_atom_get_float(argv);
+        mpr_sig_release_inst(node->sig, id);
+        if (x->capture)
+            capture_update(x->capture, MPR_DIR_OUT, node->sig, id, 0, 0, 0, MPR_NOW);
+        return;
+    }
+
+    // release all active instances; collect ids first since releasing
+    // instances changes their indices
+    num_inst = mpr_sig_get_num_inst(node->sig, MPR_STATUS_ACTIVE);
+    if (num_inst < 1)
+        return;
+    mpr_id ids[num_inst];
+    for (i = 0; i < num_inst; i++)
+        ids[i] = mpr_sig_get_inst_id(node->sig, i, MPR_STATUS_ACTIVE);
+    for (i = 0; i < num_inst; i++) {
+        mpr_sig_release_inst(node->sig, ids[i]);
+        if (x->capture)
+            capture_update(x->capture, MPR_DIR_OUT, node->sig, ids[i], 0, 0, 0, MPR_NOW);
+    }
+}
+
+static void mapperobj_release(t_mapper *x, t_symbol *s, int argc, t_atom *argv)
+{
+    if (!x->ready || !argc || argv->a_type != A_SYM)
+        return;
+
+    if (argc > 1 && (argv+1)->a_type == A_SYM) {
+        POST(x, "Instance ID is not int or float!");
+        return;
+    }
+    mapperobj_names_match(x, x->names, maxpd_atom_get_string(argv),
+                          mapperobj_release_sig, argc - 1, argv + 1);
+}
+
+// *********************************************************
+// -(get signal value)--------------------------------------
+static void mapperobj_get_sig(t_mapper *x, t_mapper_node *node,
+                              int argc, t_atom *argv)
+{
+    mpr_sig sig = node->sig;
+    int i, num_inst = 1, poly = 0;
+    int len = mpr_obj_get_prop_as_int32(sig, MPR_PROP_LEN, NULL);
+    mpr_type type = (mpr_type)mpr_obj_get_prop_as_int32(sig, MPR_PROP_TYPE, NULL);
+    mpr_id id = 0;
+
+    if (mpr_sig_get_num_inst(sig, MPR_STATUS_ALL) > 1) {
+        num_inst = mpr_sig_get_num_inst(sig, MPR_STATUS_ACTIVE);
+        poly = 1;
+    }
+    if (len > (MAX_LIST-1)) {
+        POST(x, "Maximum list length is %i!", MAX_LIST-1);
+        len = MAX_LIST-1;
+    }
 
-    // forward to 'anything' handler
-    mapperobj_anything(x, s, argc, argv);
+    for (i = 0; i < num_inst; i++) {
+        if (poly) {
+            id = mpr_sig_get_inst_id(sig, i, MPR_STATUS_ACTIVE);
+            maxpd_atom_set_int(x->buffer, id);
+        }
+        const void *val = mpr_sig_get_value(sig, id, NULL);
+        if (!val)
+            continue;
+        mapperobj_set_atoms(x->buffer + poly, len, type, val);
+        outlet_anything(x->outlet1, node->name, len + poly, x->buffer);
+    }
+}
+
+static void mapperobj_get(t_mapper *x, t_symbol *s, int argc, t_atom *argv)
+{
+    if (!argc || argv->a_type != A_SYM)
+        return;
+
+    mapperobj_names_match(x, x->names, maxpd_atom_get_string(argv),
+                          mapperobj_get_sig, 0, NULL);
 }
 
 // *********************************************************
@@ -640,40 +1152,30 @@ static void mapperobj_anything(t_mapper *x, t_symbol *s, int argc, t_atom *argv)
     if (!x->ready)
         return;
 
-    int i = 0, j = 0, id = 0;
     if (!argc)
         return;
 
     //find signal
-    mpr_sig sig = NULL;
-    mpr_list sigs = mpr_dev_get_sigs(x->device, MPR_DIR_ANY);
-    sigs = mpr_list_filter(sigs, MPR_PROP_NAME, NULL, 1, MPR_STR, s->s_name, MPR_OP_EQ);
-    if (sigs && *sigs)
-        sig = *sigs;
-
-    if (!sig) {
-        if (!x->learn_mode)
-            return;
+    t_mapper_node *node = mapperobj_names_get(x, s->s_name);
 
-        // register as new signal
-        if (argv->a_type == A_FLOAT) {
-            sig = mpr_sig_new(x->device, MPR_DIR_OUT, s->s_name, argc,
-                              MPR_FLT, 0, 0, 0, 0, 0, 0);
-        }
-#ifdef MAXMSP
-        else if (argv->a_type == A_LONG) {
-            sig = mpr_sig_new(x->device, MPR_DIR_OUT, s->s_name, argc,
-                              MPR_INT32, 0, 0, 0, 0, 0, 0);
-        }
-#endif
-        else {
-            return;
-        }
-        //output updated numOutputs
-        maxpd_atom_set_float(x->buffer, mpr_list_get_size(mpr_dev_get_sigs(x->device, MPR_DIR_OUT)));
-        outlet_anything(x->outlet2, gensym("numOutputs"), 1, x->buffer);
+    if (!node || !node->sig) {
+        // promoted to a signal by mapperobj_learn_poll() once it settles
+        if (x->learn_mode)
+            mapperobj_learn_candidate(x, s, argc, argv);
+        return;
     }
 
+    mapperobj_set_sig(x, node, argc, argv);
+}
+
+// *********************************************************
+// -(update a single signal)--------------------------------
+static void mapperobj_set_sig(t_mapper *x, t_mapper_node *node, int argc, t_atom *argv)
+{
+    mpr_sig sig = node->sig;
+    t_mapper_sig *data = node->data;
+    int i = 0, j = 0, id = 0;
+
     int len = mpr_obj_get_prop_as_int32(sig, MPR_PROP_LEN, NULL);
     mpr_type type = (mpr_type)mpr_obj_get_prop_as_int32(sig, MPR_PROP_TYPE, NULL);
 
@@ -688,8 +1190,13 @@ static void mapperobj_anything(t_mapper *x, t_symbol *s, int argc, t_atom *argv)
         else
             return;
 #endif
-        if (maxpd_atom_strcmp(argv+1, "release") == 0)
+        if (maxpd_atom_strcmp(argv+1, "release") == 0) {
             mpr_sig_release_inst(sig, id);
+            if (x->capture)
+                capture_update(x->capture, MPR_DIR_OUT, sig, id, 0, type, 0, MPR_NOW);
+            if (data)
+                ++data->releases;
+        }
         return;
     }
 
@@ -707,13 +1214,24 @@ static void mapperobj_anything(t_mapper *x, t_symbol *s, int argc, t_atom *argv)
 #endif
         else {
             POST(x, "Instance ID is not int or float!");
+            if (data)
+                ++data->dropped;
             return;
         }
     }
-    else if (argc != len)
+    else if (argc != len) {
+        if (data)
+            ++data->dropped;
+        return;
+    }
+    if (len > MAX_LIST) {
+        POST(x, "Maximum list length is %i!", MAX_LIST);
+        if (data)
+            ++data->dropped;
         return;
+    }
     if (MPR_INT32 == type) {
-        int payload[len];
+        int *payload = x->payload.i;
         for (i = 0; i < len; i++) {
             if ((argv + i + j)->a_type == A_FLOAT)
                 payload[i] = (int)atom_getfloat(argv + i + j);
@@ -726,7 +1244,7 @@ static void mapperobj_anything(t_mapper *x, t_symbol *s, int argc, t_atom *argv)
         mpr_sig_set_value(sig, id, len, MPR_INT32, payload);
     }
     else if (MPR_FLT == type) {
-        float payload[len];
+        float *payload = x->payload.f;
         for (i = 0; i < len; i++) {
             if ((argv + i + j)->a_type == A_FLOAT)
                 payload[i] = atom_getfloat(argv + i + j);
@@ -739,8 +1257,23 @@ static void mapperobj_anything(t_mapper *x, t_symbol *s, int argc, t_atom *argv)
         mpr_sig_set_value(sig, id, len, MPR_FLT, payload);
     }
     else {
+        if (data)
+            ++data->dropped;
         return;
     }
+    if (x->capture)
+        capture_update(x->capture, MPR_DIR_OUT, sig, id, len, type, &x->payload, MPR_NOW);
+
+    if (data) {
+        // values are only sent when the device is next polled
+        if (data->updates && data->poll_seq == x->stats.polls
+            && data->last_inst == (mpr_id)id)
+            ++data->coalesced;
+        data->poll_seq = x->stats.polls;
+        data->last_inst = id;
+        ++data->updates;
+        data->bytes += len * sizeof(float);   // int32 and float are the same size
+    }
 }
 
 // *********************************************************
@@ -749,59 +1282,53 @@ static void mapperobj_sig_handler(mpr_sig sig, mpr_sig_evt evt, mpr_id inst,
                                   int len, mpr_type type, const void *val,
                                   mpr_time time)
 {
-    t_mapper *x = (void*)mpr_obj_get_prop_as_ptr(sig, MPR_PROP_DATA, NULL);
-    t_symbol *name = gensym(mpr_obj_get_prop_as_str(sig, MPR_PROP_NAME, NULL));
+    t_mapper_sig *data = (void*)mpr_obj_get_prop_as_ptr(sig, MPR_PROP_DATA, NULL);
+    if (!data)
+        return;
+    t_mapper *x = data->home;
 
+    TRACE_BEGIN("mapper_sig_handler");
+    if (x->capture && (evt & (MPR_SIG_UPDATE | MPR_SIG_REL_UPSTRM))) {
+        capture_update(x->capture, MPR_DIR_IN, sig, inst, len, type,
+                       MPR_SIG_UPDATE == evt ? val : 0, time);
+    }
     switch (evt) {
         case MPR_SIG_UPDATE: {
-            int poly = 0;
-            if (mpr_sig_get_num_inst(sig, MPR_STATUS_ALL) > 1) {
-                maxpd_atom_set_int(x->buffer, inst);
-                poly = 1;
-            }
+            int poly = mpr_sig_get_num_inst(sig, MPR_STATUS_ALL) > 1;
             if (val) {
-                int i;
-
-                if (len > (MAX_LIST-1)) {
-                    POST(x, "Maximum list length is %i!", MAX_LIST-1);
-                    len = MAX_LIST-1;
-                }
-#ifdef MAXMSP
-                if (MPR_INT32 == type) {
-                    int *v = (int*)val;
-                    for (i = 0; i < len; i++)
-                        maxpd_atom_set_int(x->buffer + i + poly, v[i]);
-                }
-                else if (MPR_FLT == type) {
-#endif
-                    float *v = (float*)val;
-                    for (i = 0; i < len; i++)
-                        maxpd_atom_set_float(x->buffer + i + poly, v[i]);
-#ifdef MAXMSP
-                }
-#endif
-                outlet_anything(x->outlet1, name, len + poly, x->buffer);
+                // under a delivery budget only the newest value of a signal is
+                // kept, so instances are always output as they arrive
+                if (!poly && x->qos.budget
+                    && !qos_admit(&x->qos, &data->qos, inst, len, type, val, time,
+                                  x->recv_time))
+                    break;
+                mapperobj_deliver(data, poly, inst, len, type, val, time, x->recv_time);
             }
             else if (poly) {
-                maxpd_atom_set_string(x->buffer+1, "release");
-                maxpd_atom_set_string(x->buffer+2, "local");
-                outlet_anything(x->outlet1, name, 3, x->buffer);
+                maxpd_atom_set_int(x->buffer, inst);
+                maxpd_atom_set_symbol(x->buffer+1, ps_release);
+                maxpd_atom_set_symbol(x->buffer+2, ps_local);
+                mapperobj_output(data, 3, x->buffer);
+                ++data->releases;
             }
             break;
         }
         case MPR_SIG_REL_UPSTRM:
+            ++data->releases;
             maxpd_atom_set_int(x->buffer, inst);
-            maxpd_atom_set_string(x->buffer+1, "release");
-            maxpd_atom_set_string(x->buffer+2, "upstream");
-            outlet_anything(x->outlet1, name, 3, x->buffer);
+            maxpd_atom_set_symbol(x->buffer+1, ps_release);
+            maxpd_atom_set_symbol(x->buffer+2, ps_upstream);
+            mapperobj_output(data, 3, x->buffer);
             break;
         case MPR_SIG_REL_DNSTRM:
+            ++data->releases;
             maxpd_atom_set_int(x->buffer, inst);
-            maxpd_atom_set_string(x->buffer+1, "release");
-            maxpd_atom_set_string(x->buffer+2, "downstream");
-            outlet_anything(x->outlet1, name, 3, x->buffer);
+            maxpd_atom_set_symbol(x->buffer+1, ps_release);
+            maxpd_atom_set_symbol(x->buffer+2, ps_downstream);
+            mapperobj_output(data, 3, x->buffer);
             break;
         case MPR_SIG_INST_OFLW: {
+            ++data->overflows;
             maxpd_atom_set_int(x->buffer, inst);
             int mode = mpr_obj_get_prop_as_int32(sig, MPR_PROP_STEAL_MODE, NULL);
             switch (mode) {
@@ -816,8 +1343,8 @@ static void mapperobj_sig_handler(mpr_sig sig, mpr_sig_evt evt, mpr_id inst,
                         mpr_sig_release_inst(sig, inst);
                     break;
                 case 0:
-                    maxpd_atom_set_string(x->buffer+1, "overflow");
-                    outlet_anything(x->outlet1, name, 2, x->buffer);
+                    maxpd_atom_set_symbol(x->buffer+1, ps_overflow);
+                    mapperobj_output(data, 2, x->buffer);
                     break;
                 default:
                     break;
@@ -827,257 +1354,1432 @@ static void mapperobj_sig_handler(mpr_sig sig, mpr_sig_evt evt, mpr_id inst,
         default:
             break;
     }
+    TRACE_END("mapper_sig_handler");
 }
 
-// *********************************************************
-// -(read device definition - maxmsp only)------------------
-#ifdef MAXMSP
-static void mapperobj_read_definition (t_mapper *x)
+// recv_time is when the value was taken off the network
+static void mapperobj_deliver(t_mapper_sig *data, int poly, mpr_id inst, int len,
+                              mpr_type type, const void *val, mpr_time time,
+                              mpr_time recv_time)
 {
-    if (x->d) {
-        object_free(x->d);
-    }
-    t_object *info;
-    t_symbol *sym_device = gensym("device");
-    t_symbol *sym_name = gensym("name");
-    const char *my_name = 0;
-    short path;
-    unsigned int filetype = 'JSON', outtype;
+    t_mapper *x = data->home;
 
-    // TODO: add ".json" to end of string if missing (or pick new filetype!)
-
-    if (locatefile_extended(x->definition, &path, &outtype, &filetype, 1) == 0) {
-        POST(x, "Located file %s", x->definition);
-        if (dictionary_read(x->definition, path, &(x->d)) == 0) {
-            //check that first key is "device"
-            if (dictionary_entryisdictionary(x->d, sym_device)) {
-                //recover name from dictionary
-                dictionary_getdictionary(x->d, sym_device, &info);
-                dictionary_getstring((t_dictionary *)info, sym_name, &my_name);
-                if (my_name) {
-                    free(x->name);
-                    x->name = *my_name == '/' ? strdup(my_name+1) : strdup(my_name);
-                }
-            }
-        }
-        else {
-            POST(x, "Could not parse file %s", x->definition);
-        }
+    if (poly)
+        maxpd_atom_set_int(x->buffer, inst);
+    if (len > (MAX_LIST-1)) {
+        POST(x, "Maximum list length is %i!", MAX_LIST-1);
+        len = MAX_LIST-1;
     }
-    else {
-        POST(x, "Could not locate file %s", x->definition);
+    mapperobj_set_atoms(x->buffer + poly, len, type, val);
+    mapperobj_output(data, len + poly, x->buffer);
+    ++data->updates;
+    data->bytes += len * (MPR_DBL == type ? sizeof(double) : sizeof(float));
+    if (x->latency) {
+        mpr_time now;
+        mpr_time_set(&now, MPR_NOW);
+        latency_add(&data->network, mpr_time_get_diff(now, recv_time));
+        latency_add(&data->timetag, mpr_time_get_diff(now, time));
     }
 }
-#endif // MAXMSP
 
 // *********************************************************
-// -(register signals from dictionary - maxmsp only)--------
-#ifdef MAXMSP
-static void mapperobj_register_signals(t_mapper *x) {
-    t_atom *signals;
-    long num_signals, i;
-    t_object *device, *inputs, *outputs, *temp;
-    t_symbol *sym_device = gensym("device");
-    t_symbol *sym_inputs = gensym("inputs");
-    t_symbol *sym_outputs = gensym("outputs");
-    t_symbol *sym_name = gensym("name");
-    t_symbol *sym_type = gensym("type");
-    t_symbol *sym_units = gensym("units");
-    t_symbol *sym_minimum = gensym("minimum");
-    t_symbol *sym_maximum = gensym("maximum");
-    t_symbol *sym_length = gensym("length");
-
-    const char *sig_name, *sig_units, *sig_type_str;
-    mpr_type sig_type = 0;
-    double val_d;
-    long long val_l, sig_length;
-
-    mpr_sig temp_sig;
-    short range_known[2];
-
-    if (!x->d)
-        return;
-
-    // Get pointer to dictionary "device"
-    if (dictionary_getdictionary(x->d, sym_device, &device) != MAX_ERR_NONE)
-        return;
-
-    // Get pointer to atom array "inputs"
-    if (dictionary_getatomarray((t_dictionary *)device, sym_inputs,
-                                &inputs) == MAX_ERR_NONE) {
-        atomarray_getatoms((t_atomarray *)inputs, &num_signals, &signals);
-        // iterate through array of atoms
-        for (i=0; i<num_signals; i++) {
-            // initialize variables
-            range_known[0] = 0;
-            range_known[1] = 0;
-
-            // each atom object points to a dictionary, need to recover atoms by key
-            temp = atom_getobj(&(signals[i]));
-            if (dictionary_getstring((t_dictionary *)temp, sym_name,
-                                     &sig_name) != MAX_ERR_NONE)
-                continue;
-            if (dictionary_getstring((t_dictionary *)temp, sym_type,
-                                     &sig_type_str) != MAX_ERR_NONE)
-                continue;
-            if (dictionary_getlong((t_dictionary *)temp, sym_length,
-                                   &sig_length) != MAX_ERR_NONE)
-                sig_length = 1;
-            if (dictionary_getstring((t_dictionary *)temp, sym_units,
-                                     &sig_units) != MAX_ERR_NONE)
-                sig_units = 0;
-
-            if ((strcmp(sig_type_str, "int") == 0) || (strcmp(sig_type_str, "i") == 0))
-                sig_type = MPR_INT32;
-            else if ((strcmp(sig_type_str, "float") == 0) || (strcmp(sig_type_str, "f") == 0))
-                sig_type = MPR_FLT;
-            else {
-                POST(x, "Skipping registration of signal %s (unknown type).",
-                     sig_name);
-                continue;
-            }
-
-            temp_sig = mpr_sig_new(x->device, MPR_DIR_IN, sig_name,
-                                   (int)sig_length, sig_type, sig_units,
-                                   0, 0, 0, mapperobj_sig_handler, MPR_SIG_ALL);
-            mpr_obj_set_prop(temp_sig, MPR_PROP_DATA, NULL, 1, MPR_PTR, x, 0);
-
-            if (!temp_sig)
-                continue;
+// -(per-signal data)---------------------------------------
+static t_mapper_sig *mapperobj_sig_data_new(t_mapper *x, const char *sig_name)
+{
+    char recv[256];
+    t_mapper_sig *data = (t_mapper_sig *)calloc(1, sizeof(t_mapper_sig));
+    data->home = x;
+    data->name = gensym((char *)sig_name);
+    snprintf(recv, 256, "%s.%s", x->recv_prefix ? x->recv_prefix : x->name,
+             *sig_name == '/' ? sig_name + 1 : sig_name);
+    data->recv = gensym(recv);
+    qos_slot_init(&data->qos, data);
+    return data;
+}
 
-            if (dictionary_getfloat((t_dictionary *)temp, sym_minimum,
-                                    &val_d) == MAX_ERR_NONE) {
-                mpr_obj_set_prop(temp_sig, MPR_PROP_MIN, NULL, 1, MPR_DBL,
-                                 &val_d, 1);
-            }
-            else if (dictionary_getlong((t_dictionary *)temp, sym_minimum,
-                                        &val_l) == MAX_ERR_NONE) {
-                int val_i = (int)val_l;
-                mpr_obj_set_prop(temp_sig, MPR_PROP_MIN, NULL, 1, MPR_INT32,
-                                 &val_i, 1);
-            }
-            if (dictionary_getfloat((t_dictionary *)temp, sym_maximum,
-                                    &val_d) == MAX_ERR_NONE) {
-                mpr_obj_set_prop(temp_sig, MPR_PROP_MAX, NULL, 1, MPR_DBL,
-                                 &val_d, 1);
-            }
-            else if (dictionary_getlong((t_dictionary *)temp, sym_maximum,
-                                        &val_l) == MAX_ERR_NONE) {
-                int val_i = (int)val_l;
-                mpr_obj_set_prop(temp_sig, MPR_PROP_MAX, NULL, 1, MPR_INT32,
-                                 &val_i, 1);
-            }
-        }
+// attach data to a new signal, index it and count it
+static void mapperobj_sig_init(t_mapper *x, mpr_sig sig, const char *sig_name)
+{
+    mpr_obj_set_prop(sig, MPR_PROP_DATA, NULL, 1, MPR_PTR,
+                     mapperobj_sig_data_new(x, sig_name), 0);
+    mapperobj_names_add(x, sig_name, sig);
+    if (MPR_DIR_OUT == mpr_obj_get_prop_as_int32(sig, MPR_PROP_DIR, NULL)) {
+        ++x->num_outputs;
+        x->counts_changed |= MPR_DIR_OUT;
     }
+    else {
+        ++x->num_inputs;
+        x->counts_changed |= MPR_DIR_IN;
+    }
+}
 
-    // Get pointer to atom array "outputs"
-    if (dictionary_getatomarray((t_dictionary *)device, sym_outputs,
-                                &outputs) == MAX_ERR_NONE) {
-        atomarray_getatoms((t_atomarray *)outputs, &num_signals, &signals);
-        // iterate through array of atoms
-        for (i=0; i<num_signals; i++) {
-            // initialize variables
-            range_known[0] = 0;
-            range_known[1] = 0;
-
-            // each atom object points to a dictionary, need to recover atoms by key
-            temp = atom_getobj(&(signals[i]));
-            if (dictionary_getstring((t_dictionary *)temp, sym_name,
-                                     &sig_name) != MAX_ERR_NONE)
-                continue;
-            if (dictionary_getstring((t_dictionary *)temp, sym_type,
-                                     &sig_type_str) != MAX_ERR_NONE)
-                continue;
-            if (dictionary_getlong((t_dictionary *)temp, sym_length,
-                                   &sig_length) != MAX_ERR_NONE)
-                sig_length = 1;
-            if (dictionary_getstring((t_dictionary *)temp, sym_units,
-                                     &sig_units) != MAX_ERR_NONE)
-                sig_units = 0;
-
-            if ((strcmp(sig_type_str, "int") == 0) || (strcmp(sig_type_str, "i") == 0))
-                sig_type = MPR_INT32;
-            else if ((strcmp(sig_type_str, "float") == 0) || (strcmp(sig_type_str, "f") == 0))
-                sig_type = MPR_FLT;
-            else {
-                POST("Skipping registration of signal %s (unknown type).",
-                     sig_name);
-                continue;
-            }
-
-            temp_sig = mpr_sig_new(x->device, MPR_DIR_OUT, sig_name,
-                                   (int)sig_length, sig_type, sig_units,
-                                   0, 0, 0, 0, 0);
-
-            if (!temp_sig)
-                continue;
-
-            if (dictionary_getfloat((t_dictionary *)temp, sym_minimum,
-                                    &val_d) == MAX_ERR_NONE) {
-                mpr_obj_set_prop(temp_sig, MPR_PROP_MIN, NULL, 1, MPR_DBL,
-                                 &val_d, 1);
-            }
-            else if (dictionary_getlong((t_dictionary *)temp, sym_minimum,
-                                        &val_l) == MAX_ERR_NONE) {
-                int val_i = (int)val_l;
-                mpr_obj_set_prop(temp_sig, MPR_PROP_MIN, NULL, 1, MPR_INT32,
-                                 &val_i, 1);
-            }
-            if (dictionary_getfloat((t_dictionary *)temp, sym_maximum,
-                                    &val_d) == MAX_ERR_NONE) {
-                mpr_obj_set_prop(temp_sig, MPR_PROP_MAX, NULL, 1, MPR_DBL,
-                                 &val_d, 1);
-            }
-            else if (dictionary_getlong((t_dictionary *)temp, sym_maximum,
-                                        &val_l) == MAX_ERR_NONE) {
-                int val_i = (int)val_l;
-                mpr_obj_set_prop(temp_sig, MPR_PROP_MAX, NULL, 1, MPR_INT32,
-                                 &val_i, 1);
-            }
-        }
+static void mapperobj_sig_free(t_mapper *x, mpr_sig sig)
+{
+    t_mapper_sig *data = (void*)mpr_obj_get_prop_as_ptr(sig, MPR_PROP_DATA, NULL);
+    if (MPR_DIR_OUT == mpr_obj_get_prop_as_int32(sig, MPR_PROP_DIR, NULL)) {
+        --x->num_outputs;
+        x->counts_changed |= MPR_DIR_OUT;
+    }
+    else {
+        --x->num_inputs;
+        x->counts_changed |= MPR_DIR_IN;
+    }
+    // playback refers to signals directly
+    mapperobj_play_stop(x, 0);
+    mapperobj_names_remove(&x->names, mpr_obj_get_prop_as_str(sig, MPR_PROP_NAME, NULL));
+    mpr_sig_free(sig);
+    if (data) {
+        qos_slot_free(&x->qos, &data->qos);
+        free(data);
     }
 }
-#endif // MAXMSP
 
 // *********************************************************
-// -(poll libmapper)----------------------------------------
-static void mapperobj_poll(t_mapper *x)
+// -(output signal data)------------------------------------
+static void mapperobj_output(t_mapper_sig *data, int argc, t_atom *argv)
 {
-    int count = 10;
-#ifdef MAXMSP
-    critical_enter(0);
-#endif
-    while(count-- && mpr_dev_poll(x->device, 0)) {};
+    TRACE_BEGIN("outlet");
+    outlet_anything(data->home->outlet1, data->name, argc, argv);
+
+    // also deliver to any receive objects bound to this signal
+    if (data->recv->s_thing) {
 #ifdef MAXMSP
-    critical_exit(0);
+        typedmess(data->recv->s_thing, ps_list, argc, argv);
+#else
+        pd_list(data->recv->s_thing, ps_list, argc, argv);
 #endif
-    if (!x->ready) {
-        if (mpr_dev_get_is_ready(x->device)) {
-            POST(x, "Joining mapping network as '%s'",
-                 mpr_obj_get_prop_as_str(x->device, MPR_PROP_NAME, NULL));
-            x->ready = 1;
+    }
+    TRACE_END("outlet");
+}
+
+static void mapperobj_set_atoms(t_atom *a, int len, mpr_type type, const void *val)
+{
+    int i;
 #ifdef MAXMSP
-            defer_low((t_object *)x, (method)mapperobj_print_properties, NULL, 0, NULL);
-#else
-            mapperobj_print_properties(x);
+    if (MPR_INT32 == type) {
+        int *v = (int*)val;
+        for (i = 0; i < len; i++)
+            maxpd_atom_set_int(a + i, v[i]);
+        return;
+    }
 #endif
-        }
+    if (MPR_FLT == type) {
+        float *v = (float*)val;
+        for (i = 0; i < len; i++)
+            maxpd_atom_set_float(a + i, v[i]);
     }
-    clock_delay(x->clock, INTERVAL);  // Set clock to go off after delay
+#ifndef MAXMSP
+    else if (MPR_INT32 == type) {
+        int *v = (int*)val;
+        for (i = 0; i < len; i++)
+            maxpd_atom_set_int(a + i, v[i]);
+    }
+#endif
 }
 
 // *********************************************************
-// -(toggle learning mode)----------------------------------
-static void mapperobj_learn(t_mapper *x, t_symbol *s,
-                            int argc, t_atom *argv)
+// -(signal namespace)--------------------------------------
+static t_mapper_node *mapperobj_names_child(t_mapper_node *list,
+                                            const char *seg, int len)
 {
-    int mode = x->learn_mode;
-    if (argc > 0) {
-        if (argv->a_type == A_FLOAT) {
-            mode = (int)atom_getfloat(argv);
+    for (; list; list = list->next) {
+        if (strncmp(list->seg->s_name, seg, len) == 0 && !list->seg->s_name[len])
+            return list;
+    }
+    return NULL;
+}
+
+static void mapperobj_names_add(t_mapper *x, const char *name, mpr_sig sig)
+{
+    t_mapper_node **list = &x->names, *node = NULL;
+    const char *path = name;
+    char seg[MAX_LIST];
+    int len;
+
+    while (*path) {
+        while (*path == '/')
+            path++;
+        if (!*path)
+            break;
+        len = (int)strcspn(path, "/");
+        node = mapperobj_names_child(*list, path, len);
+        if (!node) {
+            if (len >= MAX_LIST)
+                len = MAX_LIST - 1;
+            memcpy(seg, path, len);
+            seg[len] = 0;
+            node = (t_mapper_node *)calloc(1, sizeof(t_mapper_node));
+            node->seg = gensym(seg);
+            node->next = *list;
+            *list = node;
         }
-#ifdef MAXMSP
-        else if (argv->a_type == A_LONG) {
+        list = &node->child;
+        path += len;
+    }
+    if (node) {
+        node->sig = sig;
+        node->data = (t_mapper_sig *)mpr_obj_get_prop_as_ptr(sig, MPR_PROP_DATA, NULL);
+        node->name = gensym((char *)name);
+        // signals added while recording are described before their first update
+        if (x->capture)
+            capture_sig(x->capture, sig);
+    }
+}
+
+// remove a signal from the namespace, pruning any branches left empty
+static int mapperobj_names_remove(t_mapper_node **list, const char *path)
+{
+    t_mapper_node *node;
+    int len;
+
+    if (!path)
+        return 0;
+    while (*path == '/')
+        path++;
+    if (!*path)
+        return 0;
+    len = (int)strcspn(path, "/");
+    while ((node = *list)) {
+        if (strncmp(node->seg->s_name, path, len) == 0 && !node->seg->s_name[len])
+            break;
+        list = &node->next;
+    }
+    if (!node)
+        return 0;
+
+    path += len;
+    while (*path == '/')
+        path++;
+    if (*path) {
+        if (!mapperobj_names_remove(&node->child, path))
+            return 0;
+    }
+    else {
+        node->sig = NULL;
+        node->data = NULL;
+        node->name = NULL;
+    }
+    if (!node->sig && !node->child) {
+        *list = node->next;
+        free(node);
+    }
+    return 1;
+}
+
+static t_mapper_node *mapperobj_names_get(t_mapper *x, const char *path)
+{
+    t_mapper_node *list = x->names, *node = NULL;
+    int len;
+
+    while (*path) {
+        while (*path == '/')
+            path++;
+        if (!*path)
+            break;
+        len = (int)strcspn(path, "/");
+        if (!(node = mapperobj_names_child(list, path, len)))
+            return NULL;
+        list = node->child;
+        path += len;
+    }
+    return node;
+}
+
+static mpr_sig mapperobj_names_find(t_mapper *x, const char *path)
+{
+    t_mapper_node *node = mapperobj_names_get(x, path);
+    return node ? node->sig : NULL;
+}
+
+// call fn for every signal whose name matches an OSC address pattern
+static void mapperobj_names_match(t_mapper *x, t_mapper_node *list,
+                                  const char *pattern, t_mapper_match_fn fn,
+                                  int argc, t_atom *argv)
+{
+    const char *end;
+    int len;
+
+    while (*pattern == '/')
+        pattern++;
+    if (!*pattern)
+        return;
+    len = (int)strcspn(pattern, "/");
+    end = pattern + len;
+
+    if ((int)strcspn(pattern, "*?[{") >= len) {
+        // literal segment: follow a single branch
+        if (!(list = mapperobj_names_child(list, pattern, len)))
+            return;
+        if (*end)
+            mapperobj_names_match(x, list->child, end, fn, argc, argv);
+        else if (list->sig)
+            fn(x, list, argc, argv);
+        return;
+    }
+
+    for (; list; list = list->next) {
+        if (!maxpd_osc_match(pattern, end, list->seg->s_name))
+            continue;
+        if (*end)
+            mapperobj_names_match(x, list->child, end, fn, argc, argv);
+        else if (list->sig)
+            fn(x, list, argc, argv);
+    }
+}
+
+static void mapperobj_names_free(t_mapper_node *list)
+{
+    while (list) {
+        t_mapper_node *next = list->next;
+        mapperobj_names_free(list->child);
+        free(list);
+        list = next;
+    }
+}
+
+// *********************************************************
+// -(read device definition)--------------------------------
+// resolve a file the way the host resolves patch resources: through the
+// search path in Max, or relative to the patch in puredata
+static int mapperobj_locate_file(t_mapper *x, const char *file, char *path, int size)
+{
+#ifdef MAXMSP
+    char filename[MAX_PATH_CHARS], fullpath[MAX_PATH_CHARS];
+    short vol;
+    unsigned int filetype = 'JSON', outtype;
+
+    strncpy_zero(filename, file, MAX_PATH_CHARS);
+    if (locatefile_extended(filename, &vol, &outtype, &filetype, 1)
+        || path_toabsolutesystempath(vol, filename, fullpath))
+        return 1;
+    snprintf(path, size, "%s", fullpath);
+#else
+    if (*file == '/' || (*file && file[1] == ':') || !x->dir)
+        snprintf(path, size, "%s", file);
+    else
+        snprintf(path, size, "%s/%s", x->dir->s_name, file);
+#endif
+    return 0;
+}
+
+static t_definition *mapperobj_open_definition(t_mapper *x, const char *file)
+{
+    char path[MAX_PATH_LEN];
+    t_definition *d;
+
+    if (mapperobj_locate_file(x, file, path, MAX_PATH_LEN)) {
+        POST(x, "Could not locate file %s", file);
+        return 0;
+    }
+    if (!(d = definition_open(path))) {
+        POST(x, "Could not read file %s", path);
+        return 0;
+    }
+    if (x->definition)
+        free(x->definition);
+    x->definition = strdup(path);
+    return d;
+}
+
+// open the definition and read up to its first signal, taking the device
+// name from it; the signals are registered once the device exists
+static t_definition *mapperobj_read_definition(t_mapper *x, const char *file)
+{
+    t_definition *d = mapperobj_open_definition(x, file);
+
+    if (!d)
+        return 0;
+    while (DEFINITION_NAME == definition_next(d)) {
+        if (x->name)
+            free(x->name);
+        x->name = *d->name == '/' ? strdup(d->name+1) : strdup(d->name);
+    }
+    return d;
+}
+
+// *********************************************************
+// -(register signals from definition)----------------------
+// set a property unless it already holds the same value; returns 1 if set
+static int mapperobj_update_prop(mpr_obj obj, mpr_prop prop, const char *key,
+                                 mpr_type type, const void *val)
+{
+    const void *cur = NULL;
+    mpr_type cur_type = 0;
+    int len = 0, pub;
+
+    if (key)
+        mpr_obj_get_prop_by_key(obj, key, &len, &cur_type, &cur, &pub);
+    else
+        mpr_obj_get_prop_by_idx(obj, prop, NULL, &len, &cur_type, &cur, &pub);
+    if (1 == len && cur && cur_type == type
+        && (MPR_STR == type ? !strcmp((const char *)cur, (const char *)val)
+            : !memcmp(cur, val, MPR_DBL == type ? sizeof(double) : sizeof(int))))
+        return 0;
+    mpr_obj_set_prop(obj, prop, key, 1, type, val, 1);
+    return 1;
+}
+
+// set a signal's minimum or maximum, which libmapper keeps as a vector of
+// the signal's own type and length, unless it already holds that value
+static int mapperobj_update_range(mpr_sig sig, mpr_prop prop, double val)
+{
+    const void *cur = NULL;
+    mpr_type type = (mpr_type)mpr_obj_get_prop_as_int32(sig, MPR_PROP_TYPE, NULL), cur_type = 0;
+    int len = mpr_obj_get_prop_as_int32(sig, MPR_PROP_LEN, NULL), cur_len = 0, pub, i;
+    size_t size = MPR_DBL == type ? sizeof(double) : sizeof(int);
+    void *vec;
+
+    if (len < 1 || !(vec = malloc(len * size)))
+        return 0;
+    for (i = 0; i < len; i++) {
+        if (MPR_DBL == type)
+            ((double *)vec)[i] = val;
+        else if (MPR_FLT == type)
+            ((float *)vec)[i] = (float)val;
+        else
+            ((int *)vec)[i] = (int)val;
+    }
+    mpr_obj_get_prop_by_idx(sig, prop, NULL, &cur_len, &cur_type, &cur, &pub);
+    if (cur && cur_len == len && cur_type == type && !memcmp(cur, vec, len * size)) {
+        free(vec);
+        return 0;
+    }
+    mpr_obj_set_prop(sig, prop, NULL, len, type, vec, 1);
+    free(vec);
+    return 1;
+}
+
+// apply the declared properties of a signal, returning how many changed;
+// a fresh signal has just been created from the same declaration
+static int mapperobj_definition_props(t_mapper *x, mpr_sig sig,
+                                      const t_definition_sig *s, int fresh)
+{
+    int i, changed = 0, num_inst;
+
+    if (s->units && !fresh)
+        changed += mapperobj_update_prop(sig, MPR_PROP_UNIT, NULL, MPR_STR, s->units);
+    if (s->min_type)
+        changed += mapperobj_update_range(sig, MPR_PROP_MIN, s->min);
+    if (s->max_type)
+        changed += mapperobj_update_range(sig, MPR_PROP_MAX, s->max);
+
+    // instances can be added to a live signal but not taken away
+    num_inst = fresh ? 0 : mpr_sig_get_num_inst(sig, MPR_STATUS_ALL);
+    if (s->instances > 1 && s->instances > num_inst) {
+        mpr_sig_reserve_inst(sig, s->instances - num_inst, 0, 0);
+        ++changed;
+    }
+    if (s->steal != MPR_STEAL_NONE
+        || (!fresh && mpr_obj_get_prop_as_int32(sig, MPR_PROP_STEAL_MODE, NULL) != MPR_STEAL_NONE))
+        changed += mapperobj_update_prop(sig, MPR_PROP_STEAL_MODE, NULL, MPR_INT32, &s->steal);
+
+    // other declared properties
+    for (i = 0; i < s->num_props; i++) {
+        const t_definition_prop *p = &s->props[i];
+        if (MPR_STR == p->type)
+            changed += mapperobj_update_prop(sig, MPR_PROP_UNKNOWN, p->key, MPR_STR, p->str);
+        else if (MPR_INT32 == p->type) {
+            int val = (int)p->num;
+            changed += mapperobj_update_prop(sig, MPR_PROP_UNKNOWN, p->key, MPR_INT32, &val);
+        }
+        else {
+            float val = (float)p->num;
+            changed += mapperobj_update_prop(sig, MPR_PROP_UNKNOWN, p->key, MPR_FLT, &val);
+        }
+    }
+    return changed;
+}
+
+static mpr_sig mapperobj_definition_sig(t_mapper *x, const t_definition_sig *s)
+{
+    mpr_sig sig;
+
+    if (!s->name)
+        return 0;
+    if (!s->type) {
+        POST(x, "Skipping registration of signal %s (unknown type).", s->name);
+        return 0;
+    }
+    if (s->length < 1) {
+        POST(x, "Skipping registration of signal %s (length < 1).", s->name);
+        return 0;
+    }
+    sig = mpr_sig_new(x->device, s->dir, s->name, s->length, s->type, s->units,
+                      0, 0, 0, mapperobj_sig_handler, MPR_SIG_ALL);
+    if (!sig)
+        return 0;
+    mapperobj_sig_init(x, sig, s->name);
+    mapperobj_definition_props(x, sig, s, 1);
+    return sig;
+}
+
+// register the remaining signals of a definition opened by
+// mapperobj_read_definition() and close it
+static void mapperobj_register_signals(t_mapper *x, t_definition *d)
+{
+    mpr_time start, end;
+    int count = 0;
+
+    mpr_time_set(&start, MPR_NOW);
+    ++x->transaction;
+    for (; d->event > 0; definition_next(d)) {
+        if (DEFINITION_NAME == d->event) {
+            POST(x, "Ignoring device name %s declared after signals.", d->name);
+        }
+        else if (mapperobj_definition_sig(x, &d->sig))
+            ++count;
+    }
+    --x->transaction;
+    mapperobj_output_counts(x);
+    mpr_time_set(&end, MPR_NOW);
+    if (DEFINITION_ERROR == d->event)
+        POST(x, "Error in %s line %d: %s", x->definition, definition_line(d), d->error);
+    POST(x, "Registered %d signals from %s in %.2f ms", count, x->definition,
+         mpr_time_get_diff(end, start) * 1000);
+    definition_close(d);
+}
+
+// *********************************************************
+// -(reload device definition)------------------------------
+static void mapperobj_reload(t_mapper *x, t_symbol *s, int argc, t_atom *argv)
+{
+    /* 'reload [file]' reads the definition again (or a new one) and applies
+     * only the differences: signals missing from it are removed, new ones
+     * added, and those whose direction, type or length changed recreated.
+     * The others keep their maps and only have changed properties set. */
+    int added = 0, removed = 0, changed = 0, unchanged = 0, num_in, num_out;
+    const char *file = x->definition;
+    mpr_time start, end;
+    t_definition *d;
+    mpr_list sigs;
+
+    if (argc && argv->a_type == A_SYM)
+        file = maxpd_atom_get_string(argv);
+    if (!file) {
+        POST(x, "No definition to reload.");
+        return;
+    }
+    mpr_time_set(&start, MPR_NOW);
+    if (!(d = mapperobj_open_definition(x, file)))
+        return;
+    num_in = x->num_inputs;
+    num_out = x->num_outputs;
+    ++x->transaction;
+
+    sigs = mpr_dev_get_sigs(x->device, MPR_DIR_ANY);
+    while (sigs) {
+        t_mapper_sig *data = (t_mapper_sig *)mpr_obj_get_prop_as_ptr(*sigs, MPR_PROP_DATA, NULL);
+        if (data)
+            data->defined = 0;
+        sigs = mpr_list_get_next(sigs);
+    }
+
+    while (definition_next(d) > 0) {
+        const t_definition_sig *def = &d->sig;
+        t_mapper_sig *data;
+        mpr_sig sig;
+        int recreate = 0;
+
+        if (DEFINITION_NAME == d->event) {
+            if (strcmp(*d->name == '/' ? d->name + 1 : d->name, x->name))
+                POST(x, "Device name %s only applies when the object is created.", d->name);
+            continue;
+        }
+        if (!def->name)
+            continue;
+        sig = mapperobj_names_find(x, def->name);
+        if (!def->type || def->length < 1) {
+            // reported and skipped as on the first load, keeping the live signal
+            if (!sig)
+                mapperobj_definition_sig(x, def);
+            else {
+                POST(x, "Keeping signal %s (invalid declaration).", def->name);
+                if ((data = (t_mapper_sig *)mpr_obj_get_prop_as_ptr(sig, MPR_PROP_DATA, NULL)))
+                    data->defined = 1;
+            }
+            continue;
+        }
+        if (sig && (mpr_obj_get_prop_as_int32(sig, MPR_PROP_DIR, NULL) != (int)def->dir
+                    || mpr_obj_get_prop_as_int32(sig, MPR_PROP_TYPE, NULL) != def->type
+                    || mpr_obj_get_prop_as_int32(sig, MPR_PROP_LEN, NULL) != def->length)) {
+            mapperobj_sig_free(x, sig);
+            sig = 0;
+            recreate = 1;
+        }
+        if (sig) {
+            if (mapperobj_definition_props(x, sig, def, 0))
+                ++changed;
+            else
+                ++unchanged;
+        }
+        else if ((sig = mapperobj_definition_sig(x, def))) {
+            if (recreate)
+                ++changed;
+            else
+                ++added;
+        }
+        if (sig && (data = (t_mapper_sig *)mpr_obj_get_prop_as_ptr(sig, MPR_PROP_DATA, NULL)))
+            data->defined = 1;
+    }
+
+    // a partly read definition only adds and updates
+    if (DEFINITION_ERROR == d->event) {
+        POST(x, "Error in %s line %d: %s; keeping signals not yet read.",
+             x->definition, definition_line(d), d->error);
+    }
+    else {
+        sigs = mpr_dev_get_sigs(x->device, MPR_DIR_ANY);
+        while (sigs) {
+            mpr_sig sig = *sigs;
+            t_mapper_sig *data = (t_mapper_sig *)mpr_obj_get_prop_as_ptr(sig, MPR_PROP_DATA, NULL);
+            sigs = mpr_list_get_next(sigs);
+            if (data && !data->defined) {
+                mapperobj_sig_free(x, sig);
+                ++removed;
+            }
+        }
+    }
+    definition_close(d);
+    mpr_time_set(&end, MPR_NOW);
+    POST(x, "Reloaded %s in %.2f ms: %d added, %d removed, %d changed, %d unchanged",
+         x->definition, mpr_time_get_diff(end, start) * 1000, added, removed, changed,
+         unchanged);
+
+    // recreated signals leave their count as it was
+    --x->transaction;
+    if (num_in == x->num_inputs)
+        x->counts_changed &= ~MPR_DIR_IN;
+    if (num_out == x->num_outputs)
+        x->counts_changed &= ~MPR_DIR_OUT;
+    mapperobj_output_counts(x);
+    // a different file is watched from now on
+    if (x->watch && argc)
+        mapperobj_watch_start(x);
+}
+
+// *********************************************************
+// -(watch device definition)-------------------------------
+static void mapperobj_watch(t_mapper *x, t_symbol *s, int argc, t_atom *argv)
+{
+    /* 'watch 1' reloads the definition whenever its file changes, 'watch 0'
+     * stops. On Linux the file's directory is watched with inotify, since
+     * editors often replace a file rather than write it; elsewhere its
+     * modification time is checked every WATCH_INTERVAL seconds. */
+    if (!argc || argv->a_type == A_SYM)
+        return;
+    if (maxpd_atom_get_float(argv) != 0)
+        mapperobj_watch_start(x);
+    else
+        mapperobj_watch_stop(x);
+}
+
+static void mapperobj_watch_start(t_mapper *x)
+{
+    struct stat st;
+
+    mapperobj_watch_stop(x);
+    if (!x->definition) {
+        POST(x, "No definition to watch.");
+        return;
+    }
+    x->watch = 1;
+    x->watch_pending = 0;
+    x->watch_mtime = stat(x->definition, &st) ? 0 : st.st_mtime;
+    mpr_time_set(&x->watch_checked, MPR_NOW);
+#ifdef __linux__
+    {
+        char dir[MAX_PATH_LEN], *slash;
+        snprintf(dir, MAX_PATH_LEN, "%s", x->definition);
+        if (!(slash = strrchr(dir, '/')))
+            strcpy(dir, ".");
+        else
+            slash[slash == dir] = 0;
+        if ((x->watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) >= 0
+            && inotify_add_watch(x->watch_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+            close(x->watch_fd);
+            x->watch_fd = -1;
+        }
+    }
+#endif
+}
+
+static void mapperobj_watch_stop(t_mapper *x)
+{
+#ifdef __linux__
+    if (x->watch_fd >= 0)
+        close(x->watch_fd);
+#endif
+    x->watch_fd = -1;
+    x->watch = 0;
+}
+
+// called from the poll loop; the definition is reloaded once it has been
+// left alone for WATCH_SETTLE seconds, as it may be written in steps
+static void mapperobj_watch_poll(t_mapper *x, mpr_time now)
+{
+    int changed = 0;
+
+#ifdef __linux__
+    if (x->watch_fd >= 0) {
+        char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        const char *slash = strrchr(x->definition, '/');
+        const char *name = slash ? slash + 1 : x->definition;
+        ssize_t len;
+        while ((len = read(x->watch_fd, buf, sizeof(buf))) > 0) {
+            char *p = buf;
+            while (p < buf + len) {
+                struct inotify_event *e = (struct inotify_event *)p;
+                if (e->len && !strcmp(e->name, name))
+                    changed = 1;
+                p += sizeof(struct inotify_event) + e->len;
+            }
+        }
+    }
+    else
+#endif
+    if (mpr_time_get_diff(now, x->watch_checked) >= WATCH_INTERVAL) {
+        struct stat st;
+        x->watch_checked = now;
+        if (!stat(x->definition, &st) && st.st_mtime != x->watch_mtime) {
+            x->watch_mtime = st.st_mtime;
+            changed = 1;
+        }
+    }
+
+    if (changed) {
+        x->watch_pending = 1;
+        x->watch_changed = now;
+    }
+    else if (x->watch_pending && mpr_time_get_diff(now, x->watch_changed) >= WATCH_SETTLE) {
+        x->watch_pending = 0;
+#ifdef MAXMSP
+        defer_low((t_object *)x, (method)mapperobj_reload, NULL, 0, NULL);
+#else
+        mapperobj_reload(x, NULL, 0, NULL);
+#endif
+    }
+}
+
+
+// *********************************************************
+// -(write device definition)-------------------------------
+static void mapperobj_write(t_mapper *x, t_symbol *s, int argc, t_atom *argv)
+{
+    /* 'write <file>' saves the current signals, including those added by
+     * 'add' messages or learned, as a definition that @definition can load
+     * next time. */
+    char path[MAX_PATH_LEN];
+    const char *file;
+    int count;
+
+    if (argc != 1 || argv->a_type != A_SYM) {
+        POST(x, "usage: write <file>");
+        return;
+    }
+    file = maxpd_atom_get_string(argv);
+    // an existing file is overwritten where it was found
+    if (mapperobj_locate_file(x, file, path, MAX_PATH_LEN))
+        snprintf(path, MAX_PATH_LEN, "%s", file);
+    if ((count = definition_write(path, x->device, x->name)) < 0) {
+        POST(x, "Could not write definition to %s.", path);
+    }
+    else {
+        POST(x, "Wrote %d signals to %s.", count, path);
+    }
+}
+
+// *********************************************************
+// -(load maps)---------------------------------------------
+static void mapperobj_maps(t_mapper *x, t_symbol *s, int argc, t_atom *argv)
+{
+    /* 'maps load <file>' creates the maps listed in a JSON mapping file in
+     * one batch, between any signals the device's graph knows about; maps
+     * between devices it has not heard from yet wait for them to appear. */
+    char path[MAX_PATH_LEN];
+    const char *file;
+    t_definition *d;
+    t_mapping_map *maps = 0;
+    t_mapping_result r;
+    mpr_time start, end;
+    int count, i, waiting = 0;
+
+    if (argc != 2 || maxpd_atom_strcmp(argv, "load") || argv[1].a_type != A_SYM) {
+        POST(x, "usage: maps load <file>");
+        return;
+    }
+    file = maxpd_atom_get_string(argv + 1);
+    if (mapperobj_locate_file(x, file, path, MAX_PATH_LEN)) {
+        POST(x, "Could not locate file %s", file);
+        return;
+    }
+    // a new file replaces the maps still waiting from the last one
+    mapperobj_maps_stop(x);
+    mpr_time_set(&start, MPR_NOW);
+    if ((count = mapping_read(path, &maps, &d, &r)) > 0) {
+#ifdef MAXMSP
+        critical_enter(0);
+#endif
+        waiting = mapping_create_all(x->graph, d, maps, count, 1, &r);
+        mpr_time_set(&end, MPR_NOW);
+        if (waiting && !(x->maps_load = mapping_load_new(x->graph, path, d, maps, waiting, end))) {
+            for (i = 0; i < waiting; i++)
+                mapping_fail(d, &maps[i], "out of memory", &r);
+            waiting = 0;
+        }
+#ifdef MAXMSP
+        critical_exit(0);
+#endif
+    }
+    mpr_time_set(&end, MPR_NOW);
+    if (!x->maps_load)
+        mapping_close(d, maps);
+    if (r.error) {
+        if (r.line) {
+            POST(x, "Error loading maps from %s, line %d: %s.", path, r.line, r.error);
+        }
+        else {
+            POST(x, "Error loading maps from %s: %s.", path, r.error);
+        }
+        return;
+    }
+    POST(x, "Created %d maps from %s, %d failed, %d waiting for their devices, in %.2f ms.",
+         r.created, path, r.failed, waiting, mpr_time_get_diff(end, start) * 1000.);
+    if (r.failed) {
+        POST(x, "First failed map, line %d: %s.", r.line, r.failure);
+    }
+}
+
+static void mapperobj_maps_poll(t_mapper *x, mpr_time now)
+{
+    t_mapping_result r;
+    int changed, pending;
+
+#ifdef MAXMSP
+    critical_enter(0);
+#endif
+    changed = mapping_load_poll(x->maps_load, now, &r);
+    pending = x->maps_load->num_pending;
+#ifdef MAXMSP
+    critical_exit(0);
+#endif
+    if (!changed)
+        return;
+    if (r.error) {
+        POST(x, "Error loading maps from %s: %s.", x->maps_load->path, r.error);
+    }
+    else if (r.created || r.failed) {
+        POST(x, "Created %d more maps from %s, %d failed, %d waiting for their devices.",
+             r.created, x->maps_load->path, r.failed, pending);
+    }
+    if (r.failed) {
+        POST(x, "First failed map, line %d: %s.", r.line, r.failure);
+    }
+    if (!pending)
+        mapperobj_maps_stop(x);
+}
+
+static void mapperobj_maps_stop(t_mapper *x)
+{
+    if (!x->maps_load)
+        return;
+#ifdef MAXMSP
+    critical_enter(0);
+#endif
+    // the session may still need the graph's subscription
+    mapping_load_free(x->maps_load, x->session && x->session->subscribed);
+#ifdef MAXMSP
+    critical_exit(0);
+#endif
+    x->maps_load = 0;
+}
+
+// *********************************************************
+// -(device identity)---------------------------------------
+// resolve and read an identity file, returning the device name it holds
+// without its ordinal, or 0 if there is none yet
+static const char *mapperobj_read_identity(t_mapper *x, const char *file, char *prefix)
+{
+    char path[MAX_PATH_LEN];
+
+    if (mapperobj_locate_file(x, file, path, MAX_PATH_LEN))
+        snprintf(path, MAX_PATH_LEN, "%s", file);
+    x->identity = strdup(path);
+    if (!identity_read(x->identity, &x->claimed))
+        return 0;
+    return identity_prefix(&x->claimed, prefix, IDENTITY_MAX_NAME);
+}
+
+// once the device is ready, save what it claimed if that changed
+static void mapperobj_save_identity(t_mapper *x)
+{
+    char previous[IDENTITY_MAX_NAME];
+
+    snprintf(previous, IDENTITY_MAX_NAME, "%s", x->claimed.name);
+    if (!identity_update(&x->claimed, x->device))
+        return;
+    if (*previous && strcmp(previous, x->claimed.name))
+        POST(x, "Could not reclaim %s; now %s.", previous, x->claimed.name);
+    if (!identity_write(x->identity, &x->claimed))
+        POST(x, "Could not save identity to %s.", x->identity);
+}
+
+// *********************************************************
+// -(map session)-------------------------------------------
+static void mapperobj_session_poll(t_mapper *x, mpr_time now)
+{
+    int created, due, pending, subscribed;
+
+#ifdef MAXMSP
+    critical_enter(0);
+#endif
+    subscribed = x->session->subscribed;
+    due = session_poll(x->session, now, &created);
+    pending = x->session->num_pending;
+    // the session drops the graph's subscription once its maps are restored
+    if (subscribed && !x->session->subscribed && x->maps_load)
+        mpr_graph_subscribe(x->graph, NULL, MPR_DEV | MPR_SIG, -1);
+#ifdef MAXMSP
+    critical_exit(0);
+#endif
+    if (created)
+        POST(x, "Restored %d maps, %d not established yet.", created, pending);
+    if (due) {
+#ifdef MAXMSP
+        defer_low((t_object *)x, (method)mapperobj_save_session, NULL, 0, NULL);
+#else
+        mapperobj_save_session(x);
+#endif
+    }
+}
+
+static void mapperobj_save_session(t_mapper *x)
+{
+    char *text;
+    int count;
+
+#ifdef MAXMSP
+    critical_enter(0);
+#endif
+    text = session_format(x->session, &count);
+#ifdef MAXMSP
+    critical_exit(0);
+#endif
+    if (!text || !session_write(x->session_path, text))
+        POST(x, "Could not save maps to %s.", x->session_path);
+    free(text);
+}
+
+// *********************************************************
+// -(delivery priority)-------------------------------------
+static void mapperobj_qos_flush(t_mapper *x)
+{
+    t_qos_slot *slot;
+    while ((slot = qos_next(&x->qos)))
+        mapperobj_deliver((t_mapper_sig *)slot->owner, 0, slot->inst, slot->len,
+                          slot->type, slot->value, slot->time, slot->recv_time);
+    qos_tick(&x->qos);
+}
+
+// a value held back for a signal made high priority is output at once
+static void mapperobj_set_priority(t_mapper *x, t_mapper_sig *data, int priority)
+{
+    t_qos_slot *slot = &data->qos;
+
+    if (qos_set_priority(&x->qos, slot, priority))
+        mapperobj_deliver(data, 0, slot->inst, slot->len, slot->type, slot->value,
+                          slot->time, slot->recv_time);
+}
+
+static void mapperobj_budget(t_mapper *x, t_symbol *s, int argc, t_atom *argv)
+{
+    /* 'budget <count>' limits the received values output per poll. High
+     * priority signals are always output, normal ones while the budget
+     * lasts, and the newest value of the rest waits for a later poll.
+     * 'budget 0' outputs everything as it arrives again. */
+    int budget;
+
+    if (argc != 1 || argv->a_type == A_SYM) {
+        POST(x, "usage: budget <values per poll>");
+        return;
+    }
+    budget = (int)maxpd_atom_get_float(argv);
+#ifdef MAXMSP
+    critical_enter(0);
+#endif
+    x->qos.budget = budget > 0 ? budget : 0;
+    // nothing else would output values still waiting
+    if (!x->qos.budget)
+        mapperobj_qos_flush(x);
+#ifdef MAXMSP
+    critical_exit(0);
+#endif
+}
+
+static void mapperobj_priority_sig(t_mapper *x, t_mapper_node *node,
+                                   int argc, t_atom *argv)
+{
+    if (node->data)
+        mapperobj_set_priority(x, node->data, qos_parse(maxpd_atom_get_string(argv)));
+}
+
+static void mapperobj_priority(t_mapper *x, t_symbol *s, int argc, t_atom *argv)
+{
+    /* 'priority <signal> high|normal|low' sets the delivery class of the
+     * signals matching a name or OSC-style pattern. */
+    int priority;
+
+    if (argc != 2 || argv->a_type != A_SYM || (argv+1)->a_type != A_SYM
+        || (priority = qos_parse(maxpd_atom_get_string(argv+1))) < 0) {
+        POST(x, "usage: priority <signal> high|normal|low");
+        return;
+    }
+#ifdef MAXMSP
+    critical_enter(0);
+#endif
+    mapperobj_names_match(x, x->names, maxpd_atom_get_string(argv),
+                          mapperobj_priority_sig, 1, argv + 1);
+#ifdef MAXMSP
+    critical_exit(0);
+#endif
+}
+
+// *********************************************************
+// -(poll libmapper)----------------------------------------
+static void mapperobj_poll(t_mapper *x)
+{
+    int count = MAX_POLL, handled = 0;
+    mpr_time start, end;
+
+    TRACE_BEGIN("mapper_poll");
+    mpr_time_set(&start, MPR_NOW);
+#ifdef MAXMSP
+    TRACE_BEGIN("critical_enter");
+    critical_enter(0);
+    TRACE_END("critical_enter");
+#endif
+    while (count--) {
+        if (x->latency)
+            mpr_time_set(&x->recv_time, MPR_NOW);
+        TRACE_BEGIN("mpr_dev_poll");
+        handled = mpr_dev_poll(x->device, 0);
+        TRACE_END("mpr_dev_poll");
+        if (!handled)
+            break;
+        x->stats.messages += handled;
+    }
+    if (x->qos.budget)
+        mapperobj_qos_flush(x);
+#ifdef MAXMSP
+    critical_exit(0);
+#endif
+    mpr_time_set(&end, MPR_NOW);
+
+    // the loop only runs out of iterations while messages are still arriving
+    if (stats_poll(&x->stats, start, end, count < 0))
+        mapperobj_stats_report(x);
+    if (x->watch)
+        mapperobj_watch_poll(x, end);
+    if (x->candidates && x->ready)
+        mapperobj_learn_poll(x, end, 0);
+
+    if (!x->ready) {
+        if (mpr_dev_get_is_ready(x->device)) {
+            POST(x, "Joining mapping network as '%s'",
+                 mpr_obj_get_prop_as_str(x->device, MPR_PROP_NAME, NULL));
+            x->ready = 1;
+#ifdef MAXMSP
+            if (x->identity)
+                defer_low((t_object *)x, (method)mapperobj_save_identity, NULL, 0, NULL);
+            defer_low((t_object *)x, (method)mapperobj_print_properties, NULL, 0, NULL);
+#else
+            if (x->identity)
+                mapperobj_save_identity(x);
+            mapperobj_print_properties(x);
+#endif
+        }
+    }
+    if (x->ready && x->session)
+        mapperobj_session_poll(x, end);
+    if (x->maps_load)
+        mapperobj_maps_poll(x, end);
+    clock_delay(x->clock, INTERVAL);  // Set clock to go off after delay
+    TRACE_END("mapper_poll");
+}
+
+// *********************************************************
+// -(runtime statistics)------------------------------------
+static void mapperobj_stats_reset(t_mapper *x)
+{
+    mpr_list sigs = mpr_dev_get_sigs(x->device, MPR_DIR_ANY);
+    while (sigs) {
+        t_mapper_sig *data = (void*)mpr_obj_get_prop_as_ptr(*sigs, MPR_PROP_DATA, NULL);
+        if (data) {
+            data->updates = data->bytes = data->dropped = data->coalesced = 0;
+            data->releases = data->overflows = data->last_updates = 0;
+            data->qos.shed = data->qos.deferred = 0;
+        }
+        sigs = mpr_list_get_next(sigs);
+    }
+    x->qos.shed = x->qos.deferred = 0;
+    stats_reset(&x->stats);
+}
+
+static void mapperobj_stats_report(t_mapper *x)
+{
+    t_symbol *ps_stats = gensym("stats");
+    mpr_time now;
+    double period;
+    mpr_list sigs;
+    t_atom *a;
+
+    mpr_time_set(&now, MPR_NOW);
+    period = mpr_time_get_diff(now, x->stats.time);
+
+    a = stats_device(x->buffer, &x->stats, &x->qos, period);
+    outlet_anything(x->outlet2, ps_stats, (int)(a - x->buffer), x->buffer);
+
+    sigs = mpr_dev_get_sigs(x->device, MPR_DIR_ANY);
+    while (sigs) {
+        mpr_sig sig = *sigs;
+        t_mapper_sig *data = (void*)mpr_obj_get_prop_as_ptr(sig, MPR_PROP_DATA, NULL);
+        sigs = mpr_list_get_next(sigs);
+        if (!data)
+            continue;
+        a = stats_signal(x->buffer, data->name->s_name,
+                         MPR_DIR_OUT == mpr_obj_get_prop_as_int32(sig, MPR_PROP_DIR, NULL),
+                         data->updates, data->last_updates, period);
+        a = stats_count(a, "bytes", data->bytes);
+        a = stats_count(a, "dropped", data->dropped);
+        a = stats_count(a, "coalesced", data->coalesced);
+        a = stats_count(a, "releases", data->releases);
+        a = stats_count(a, "overflows", data->overflows);
+        a = stats_count(a, "shed", data->qos.shed);
+        a = stats_count(a, "deferred", data->qos.deferred);
+        outlet_anything(x->outlet2, ps_stats, (int)(a - x->buffer), x->buffer);
+        data->last_updates = data->updates;
+    }
+    stats_reported(&x->stats, now);
+}
+
+static void mapperobj_stats(t_mapper *x, t_symbol *s, int argc, t_atom *argv)
+{
+    /* 'stats' reports now, 'stats reset' clears the counters and
+     * 'stats <ms>' reports periodically from the poll loop (0 to stop). */
+    if (!argc) {
+        mapperobj_stats_report(x);
+        return;
+    }
+    if (maxpd_atom_strcmp(argv, "reset") == 0) {
+        mapperobj_stats_reset(x);
+        return;
+    }
+    if (argv->a_type == A_FLOAT)
+        x->stats.interval = maxpd_atom_get_float(argv) * 0.001;
+#ifdef MAXMSP
+    else if (argv->a_type == A_LONG)
+        x->stats.interval = atom_getlong(argv) * 0.001;
+#endif
+    else
+        POST(x, "usage: stats [reset | <interval ms>]");
+}
+
+// *********************************************************
+// -(latency histograms)------------------------------------
+static void mapperobj_latency_output(t_mapper *x, t_mapper_sig *data,
+                                     const char *kind, t_latency *l)
+{
+    t_atom *a = x->buffer;
+    maxpd_atom_set_symbol(a++, data->name);
+    maxpd_atom_set_string(a++, kind);
+    a = stats_latency(a, l);
+    outlet_anything(x->outlet2, gensym("latency"), (int)(a - x->buffer), x->buffer);
+}
+
+static void mapperobj_latency(t_mapper *x, t_symbol *s, int argc, t_atom *argv)
+{
+    /* 'latency 1' starts collecting and 'latency 0' stops. 'latency' outputs
+     * the percentiles in milliseconds for every input signal that received
+     * values, then clears the histograms. */
+    mpr_list sigs;
+
+    if (argc) {
+        if (argv->a_type == A_FLOAT)
+            x->latency = maxpd_atom_get_float(argv) != 0;
+#ifdef MAXMSP
+        else if (argv->a_type == A_LONG)
+            x->latency = atom_getlong(argv) != 0;
+#endif
+        else
+            POST(x, "usage: latency [0 | 1]");
+        return;
+    }
+    sigs = mpr_dev_get_sigs(x->device, MPR_DIR_IN);
+    while (sigs) {
+        t_mapper_sig *data = (void*)mpr_obj_get_prop_as_ptr(*sigs, MPR_PROP_DATA, NULL);
+        sigs = mpr_list_get_next(sigs);
+        if (!data || !data->network.total)
+            continue;
+        mapperobj_latency_output(x, data, "network", &data->network);
+        mapperobj_latency_output(x, data, "timetag", &data->timetag);
+    }
+}
+
+// *********************************************************
+// -(tracing)-----------------------------------------------
+static void mapperobj_trace(t_mapper *x, t_symbol *s, int argc, t_atom *argv)
+{
+    /* 'trace write <file>' writes the recorded spans as Chrome trace-event
+     * JSON and 'trace clear' empties the buffer. Only available when built
+     * with -DMPR_TRACE. */
+#ifdef MPR_TRACE
+    if (argc == 2 && maxpd_atom_strcmp(argv, "write") == 0 && argv[1].a_type == A_SYM) {
+        const char *path = maxpd_atom_get_string(argv + 1);
+        int count = trace_write(path, x->name);
+        if (count < 0) {
+            POST(x, "could not open trace file '%s'", path);
+        }
+        else {
+            POST(x, "wrote %d trace events to '%s'", count, path);
+        }
+    }
+    else if (argc == 1 && maxpd_atom_strcmp(argv, "clear") == 0) {
+        trace_clear();
+    }
+    else {
+        POST(x, "usage: trace write <file> | trace clear");
+    }
+#else
+    POST(x, "tracing is not available in this build (compile with -DMPR_TRACE)");
+#endif
+}
+
+// *********************************************************
+// -(traffic capture)---------------------------------------
+static void mapperobj_record(t_mapper *x, t_symbol *s, int argc, t_atom *argv)
+{
+    /* 'record <file>' appends every value sent or received, with its
+     * timetag, to a binary log until 'stop'. See common/capture.h for
+     * the format. */
+    const char *path;
+    t_capture *capture;
+    mpr_list sigs;
+
+    if (argc != 1 || argv->a_type != A_SYM) {
+        POST(x, "usage: record <file>");
+        return;
+    }
+    mapperobj_record_stop(x);
+    path = maxpd_atom_get_string(argv);
+    if (!(capture = capture_open(path))) {
+        POST(x, "could not open capture file '%s'", path);
+        return;
+    }
+    sigs = mpr_dev_get_sigs(x->device, MPR_DIR_ANY);
+    while (sigs) {
+        capture_sig(capture, *sigs);
+        sigs = mpr_list_get_next(sigs);
+    }
+    x->capture = capture;
+    POST(x, "recording to '%s'", path);
+}
+
+static void mapperobj_record_stop(t_mapper *x)
+{
+    t_capture *capture = x->capture;
+    uint32_t records, dropped;
+
+    if (!capture)
+        return;
+#ifdef MAXMSP
+    critical_enter(0);
+#endif
+    x->capture = 0;
+#ifdef MAXMSP
+    critical_exit(0);
+#endif
+    records = capture_close(capture, &dropped);
+    if (dropped) {
+        POST(x, "recorded %u records, %u dropped", records, dropped);
+    }
+    else {
+        POST(x, "recorded %u records", records);
+    }
+}
+
+// *********************************************************
+// -(traffic playback)--------------------------------------
+static void *mapperobj_play_sig(void *ctx, const t_capture_record *r,
+                                const char *name, int *dir)
+{
+    t_mapper *x = (t_mapper *)ctx;
+    t_mapper_node *node = mapperobj_names_get(x, name);
+    if (!node || !node->sig
+        || mpr_obj_get_prop_as_int32(node->sig, MPR_PROP_LEN, NULL) != (int)r->len)
+        return 0;
+    *dir = mpr_obj_get_prop_as_int32(node->sig, MPR_PROP_DIR, NULL);
+    return node;
+}
+
+static void mapperobj_play_update(void *ctx, void *target, int dir,
+                                  const t_capture_record *r)
+{
+    // values are used in place in the mapped log
+    t_mapper_node *node = (t_mapper_node *)target;
+    const void *val = CAPTURE_UPDATE == r->kind ? (const void *)(r + 1) : 0;
+    mpr_time now;
+
+    if (MPR_DIR_OUT == dir) {
+        if (val)
+            mpr_sig_set_value(node->sig, r->inst, r->len, r->type, val);
+        else
+            mpr_sig_release_inst(node->sig, r->inst);
+    }
+    else if (!val || MPR_FLT == r->type || MPR_INT32 == r->type) {
+        // deliver as if received
+        mpr_time_set(&now, MPR_NOW);
+        mapperobj_sig_handler(node->sig, val ? MPR_SIG_UPDATE : MPR_SIG_REL_UPSTRM,
+                              r->inst, r->len, r->type, val, now);
+    }
+}
+
+static void mapperobj_play_tick(t_mapper *x)
+{
+    double next;
+
+    if (!x->play)
+        return;
+#ifdef MAXMSP
+    critical_enter(0);
+#endif
+    next = capture_play(x->play, mapperobj_play_sig, mapperobj_play_update, x);
+#ifdef MAXMSP
+    critical_exit(0);
+#endif
+    if (next < 0) {
+        mapperobj_play_stop(x, 1);
+        return;
+    }
+#ifdef MAXMSP
+    clock_fdelay(x->play_clock, next > 0 ? next * 1000 : INTERVAL);
+#else
+    clock_delay(x->play_clock, next > 0 ? next * 1000 : INTERVAL);
+#endif
+}
+
+static void mapperobj_play(t_mapper *x, t_symbol *s, int argc, t_atom *argv)
+{
+    /* 'play <file> [@speed <x>]' replays a log written by 'record'. Values
+     * recorded for a signal that is an output of this device are sent again,
+     * those for an input are output as if received. Timetags are followed,
+     * scaled by speed; speed 0 plays the log as fast as possible. */
+    const char *path;
+    double speed = 1;
+
+    if (argc < 1 || argv->a_type != A_SYM) {
+        POST(x, "usage: play <file> [@speed <x>]");
+        return;
+    }
+    if (argc == 3 && maxpd_atom_strcmp(argv + 1, "@speed") == 0 && argv[2].a_type != A_SYM)
+        speed = maxpd_atom_get_float(argv + 2);
+    mapperobj_play_stop(x, 0);
+    path = maxpd_atom_get_string(argv);
+    if (!(x->play = capture_player_open(path, speed))) {
+        POST(x, "could not read capture file '%s'", path);
+        return;
+    }
+    if (!x->play_clock) {
+#ifdef MAXMSP
+        x->play_clock = clock_new(x, (method)mapperobj_play_tick);
+#else
+        x->play_clock = clock_new(x, (t_method)mapperobj_play_tick);
+#endif
+    }
+    mapperobj_play_tick(x);
+}
+
+static void mapperobj_play_stop(t_mapper *x, int done)
+{
+    /* Outputs 'play done <updates> <ms>' when the end of the log is
+     * reached. */
+    t_capture_player *play = x->play;
+    mpr_time now;
+
+    if (!play)
+        return;
+    x->play = 0;
+    clock_unset(x->play_clock);
+    if (play->skipped) {
+        POST(x, "skipped %u updates of signals missing from this device", play->skipped);
+    }
+    if (done) {
+        mpr_time_set(&now, MPR_NOW);
+        maxpd_atom_set_string(x->buffer, "done");
+        maxpd_atom_set_int(x->buffer + 1, play->played);
+        maxpd_atom_set_float(x->buffer + 2, play->started
+                             ? mpr_time_get_diff(now, play->start) * 1000 : 0);
+        outlet_anything(x->outlet2, gensym("play"), 3, x->buffer);
+    }
+    capture_player_close(play);
+}
+
+static void mapperobj_stop(t_mapper *x)
+{
+    mapperobj_play_stop(x, 0);
+    mapperobj_record_stop(x);
+}
+
+// *********************************************************
+// -(toggle learning mode)----------------------------------
+static void mapperobj_learn(t_mapper *x, t_symbol *s,
+                            int argc, t_atom *argv)
+{
+    /* 'learn 0/1' turns learning off or on. Unknown selectors are first
+     * kept as candidates and only promoted to output signals, a batch at a
+     * time, once they have been seen 'learn min <count>' times and
+     * 'learn settle <seconds>' have passed since the first. 'learn commit'
+     * promotes every candidate now, 'learn clear' forgets them and
+     * 'learn pending' lists them. */
+    int mode = x->learn_mode;
+    if (argc > 0 && argv->a_type == A_SYM) {
+        if (maxpd_atom_strcmp(argv, "commit") == 0) {
+            mpr_time now;
+            mpr_time_set(&now, MPR_NOW);
+            mapperobj_learn_poll(x, now, 1);
+        }
+        else if (maxpd_atom_strcmp(argv, "clear") == 0) {
+            mapperobj_learn_clear(x);
+        }
+        else if (maxpd_atom_strcmp(argv, "pending") == 0) {
+            t_mapper_candidate *c;
+            mpr_time now;
+            mpr_time_set(&now, MPR_NOW);
+            POST(x, "%d learn candidates", x->num_candidates);
+            for (c = x->candidates; c; c = c->next) {
+                POST(x, "  %s: %lu messages, first %.1fs ago", c->name->s_name, c->count,
+                     mpr_time_get_diff(now, c->first_seen));
+            }
+        }
+        else if (argc == 2 && maxpd_atom_strcmp(argv, "settle") == 0
+                 && argv[1].a_type != A_SYM) {
+            double settle = maxpd_atom_get_float(argv + 1);
+            x->learn_settle = settle > 0 ? settle : 0;
+        }
+        else if (argc == 2 && maxpd_atom_strcmp(argv, "min") == 0
+                 && argv[1].a_type != A_SYM) {
+            int min = (int)maxpd_atom_get_float(argv + 1);
+            x->learn_min_count = min > 1 ? min : 1;
+        }
+        else {
+            POST(x, "usage: learn 0|1|commit|clear|pending|settle <seconds>|min <count>");
+        }
+        return;
+    }
+    if (argc > 0) {
+        if (argv->a_type == A_FLOAT) {
+            mode = (int)atom_getfloat(argv);
+        }
+#ifdef MAXMSP
+        else if (argv->a_type == A_LONG) {
             mode = (int)atom_getlong(argv);
         }
 #endif
@@ -1085,6 +2787,7 @@ static void mapperobj_learn(t_mapper *x, t_symbol *s,
             x->learn_mode = mode;
             if (mode == 0) {
                 POST(x, "Learning mode off.");
+                mapperobj_learn_clear(x);
             }
             else {
                 POST(x, "Learning mode on.");
@@ -1093,10 +2796,126 @@ static void mapperobj_learn(t_mapper *x, t_symbol *s,
     }
 }
 
+// note an unknown selector, keeping its type, length and latest value
+static void mapperobj_learn_candidate(t_mapper *x, t_symbol *s, int argc, t_atom *argv)
+{
+    t_mapper_candidate *c, **last = &x->candidates;
+    mpr_type type;
+
+    if (argv->a_type == A_FLOAT)
+        type = MPR_FLT;
+#ifdef MAXMSP
+    else if (argv->a_type == A_LONG)
+        type = MPR_INT32;
+#endif
+    else
+        return;
+    if (argc > MAX_LIST)
+        return;
+
+    // symbols are unique, so the pointer identifies the selector
+    for (c = x->candidates; c; c = c->next) {
+        if (c->name == s)
+            break;
+        last = &c->next;
+    }
+    if (!c) {
+        if (x->num_candidates >= LEARN_MAX_PENDING)
+            return;
+        if (!(c = (t_mapper_candidate *)calloc(1, sizeof(t_mapper_candidate))))
+            return;
+        c->name = s;
+        mpr_time_set(&c->first_seen, MPR_NOW);
+        c->last_seen = c->first_seen;
+        *last = c;
+        ++x->num_candidates;
+    }
+    else
+        mpr_time_set(&c->last_seen, MPR_NOW);
+    if (argc > c->size) {
+        t_atom *atoms = (t_atom *)realloc(c->argv, argc * sizeof(t_atom));
+        if (!atoms)
+            return;
+        c->argv = atoms;
+        c->size = argc;
+    }
+    memcpy(c->argv, argv, argc * sizeof(t_atom));
+    c->argc = argc;
+    c->type = type;
+    ++c->count;
+}
+
+static void mapperobj_learn_free(t_mapper *x, t_mapper_candidate **c)
+{
+    t_mapper_candidate *done = *c;
+    *c = done->next;
+    free(done->argv);
+    free(done);
+    --x->num_candidates;
+}
+
+// promote candidates that have settled, or all of them on 'learn commit',
+// a batch at a time; candidates left unpromoted for long are forgotten
+static void mapperobj_learn_poll(t_mapper *x, mpr_time now, int commit)
+{
+    t_mapper_candidate **c = &x->candidates;
+    int promoted = 0;
+
+    ++x->transaction;
+    while (*c && (commit || promoted < LEARN_BATCH)) {
+        t_mapper_candidate *cand = *c;
+        mpr_sig sig;
+
+        if (!commit && (cand->count < (unsigned long)x->learn_min_count
+                        || mpr_time_get_diff(now, cand->first_seen) < x->learn_settle)) {
+            if (mpr_time_get_diff(now, cand->last_seen) >= LEARN_EXPIRE)
+                mapperobj_learn_free(x, c);
+            else
+                c = &cand->next;
+            continue;
+        }
+        // a signal may have been added under this name meanwhile
+        if (!mapperobj_names_find(x, cand->name->s_name)) {
+            sig = mpr_sig_new(x->device, MPR_DIR_OUT, cand->name->s_name, cand->argc,
+                              cand->type, 0, 0, 0, 0, 0, 0);
+            if (sig) {
+                mapperobj_sig_init(x, sig, cand->name->s_name);
+                mapperobj_set_sig(x, mapperobj_names_get(x, cand->name->s_name),
+                                  cand->argc, cand->argv);
+                ++promoted;
+            }
+        }
+        mapperobj_learn_free(x, c);
+    }
+    --x->transaction;
+    if (promoted) {
+        POST(x, "Learned %d signals, %d pending.", promoted, x->num_candidates);
+        mapperobj_output_counts(x);
+    }
+}
+
+static void mapperobj_learn_clear(t_mapper *x)
+{
+    while (x->candidates)
+        mapperobj_learn_free(x, &x->candidates);
+}
+
 // *********************************************************
 // some helper functions for abtracting differences
 // between maxmsp and puredata
 
+// symbols output by the signal handlers are looked up once so that
+// delivering values never goes through gensym()
+static void maxpd_init_symbols(void)
+{
+    ps_list = gensym("list");
+    ps_release = gensym("release");
+    ps_local = gensym("local");
+    ps_upstream = gensym("upstream");
+    ps_downstream = gensym("downstream");
+    ps_overflow = gensym("overflow");
+}
+
 static int maxpd_atom_strcmp(t_atom *a, const char *string)
 {
     if (a->a_type != A_SYM || !string)
@@ -1117,6 +2936,15 @@ static const char *maxpd_atom_get_string(t_atom *a)
 #endif
 }
 
+static t_symbol *maxpd_atom_get_symbol(t_atom *a)
+{
+#ifdef MAXMSP
+    return atom_getsym(a);
+#else
+    return (a)->a_w.w_symbol;
+#endif
+}
+
 static void maxpd_atom_set_string(t_atom *a, const char *string)
 {
 #ifdef MAXMSP
@@ -1126,6 +2954,15 @@ static void maxpd_atom_set_string(t_atom *a, const char *string)
 #endif
 }
 
+static void maxpd_atom_set_symbol(t_atom *a, t_symbol *s)
+{
+#ifdef MAXMSP
+    atom_setsym(a, s);
+#else
+    SETSYMBOL(a, s);
+#endif
+}
+
 static void maxpd_atom_set_int(t_atom *a, int i)
 {
 #ifdef MAXMSP
@@ -1148,3 +2985,72 @@ static void maxpd_atom_set_float(t_atom *a, float d)
     SETFLOAT(a, d);
 #endif
 }
+
+// match a single OSC address pattern segment [pat, end) against a string,
+// supporting '*', '?', '[a-z]', '[!abc]' and '{foo,bar}'
+static int maxpd_osc_match(const char *pat, const char *end, const char *str)
+{
+    while (pat < end) {
+        switch (*pat) {
+            case '*':
+                while (pat < end && *pat == '*')
+                    pat++;
+                if (pat == end)
+                    return 1;
+                for (; *str; str++) {
+                    if (maxpd_osc_match(pat, end, str))
+                        return 1;
+                }
+                return 0;
+            case '?':
+                if (!*str)
+                    return 0;
+                pat++;
+                str++;
+                break;
+            case '[': {
+                int negate = 0, found = 0;
+                if (!*str)
+                    return 0;
+                if (++pat < end && *pat == '!') {
+                    negate = 1;
+                    pat++;
+                }
+                while (pat < end && *pat != ']') {
+                    if (pat + 2 < end && pat[1] == '-' && pat[2] != ']') {
+                        if (*str >= pat[0] && *str <= pat[2])
+                            found = 1;
+                        pat += 3;
+                    }
+                    else if (*pat++ == *str)
+                        found = 1;
+                }
+                if (pat == end || found == negate)
+                    return 0;
+                pat++;
+                str++;
+                break;
+            }
+            case '{': {
+                const char *close = memchr(pat, '}', end - pat), *alt = pat + 1;
+                if (!close)
+                    return 0;
+                while (alt <= close) {
+                    const char *sep = alt;
+                    while (sep < close && *sep != ',')
+                        sep++;
+                    if (strncmp(alt, str, sep - alt) == 0
+                        && maxpd_osc_match(close + 1, end, str + (sep - alt)))
+                        return 1;
+                    alt = sep + 1;
+                }
+                return 0;
+            }
+            default:
+                if (*pat++ != *str++)
+                    return 0;
+                break;
+        }
+    }
+    return !*str;
+}
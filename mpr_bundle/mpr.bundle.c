@@ -0,0 +1,530 @@
+//
+// mpr.bundle.c
+// a maxmsp external encapsulating the functionality of many libmapper
+// signals, addressed by message selector through a single inlet and outlet
+// http://www.libmapper.org
+// Joseph Malloch, 2013-2020
+//
+// This software was written in the Graphics and Experiential Media (GEM) Lab at Dalhousie
+// University in Halifax and the Input Devices and Music Interaction Laboratory (IDMIL) at McGill
+// University in Montreal, and is copyright those found in the AUTHORS file.  It is licensed under
+// the GNU Lesser Public General License version 2.1 or later.  Please see COPYING for details.
+//
+
+// *********************************************************
+// -(Includes)----------------------------------------------
+
+#include "ext.h"            // standard Max include, always required
+#include "ext_obex.h"       // required for new style Max object
+#include "ext_critical.h"
+#include "ext_dictionary.h"
+#include "ext_dictobj.h"
+#include "jpatcher_api.h"
+#include <mapper/mapper.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifndef WIN32
+  #include <arpa/inet.h>
+#endif
+
+#include <unistd.h>
+
+#include "../common/sigdata.h"
+
+#define MAX_LIST 256
+
+// *********************************************************
+// -(signal struct)-----------------------------------------
+typedef struct _bundle_sig
+{
+    t_sigdata           head;           // SIGDATA_BUNDLE
+    struct _mpr_bundle  *home;
+    t_symbol            *name;
+    t_symbol            *units;
+    mpr_sig             sig;
+    int                 length;
+    char                type;
+    char                dir;
+} t_bundle_sig;
+
+// *********************************************************
+// -(object struct)-----------------------------------------
+typedef struct _mpr_bundle
+{
+    t_object            ob;
+    void                *outlet;
+    t_object            *dev_obj;
+    mpr_dev             device;
+    t_symbol            *myobjname;
+    t_object            *patcher;
+    t_hashtab           *ht;
+    long                connect_state;
+    int                 num_sigs;
+    t_bundle_sig        *sigs;
+    int                 *table;     // selector -> signal index, open addressing
+    int                 table_mask;
+    t_atom              buffer[MAX_LIST];
+} t_mpr_bundle;
+
+// *********************************************************
+// -(function prototypes)-----------------------------------
+static void *mpr_bundle_new(t_symbol *s, int argc, t_atom *argv);
+static void mpr_bundle_free(t_mpr_bundle *x);
+
+static void add_to_hashtab(t_mpr_bundle *x, t_hashtab *ht);
+static void remove_from_hashtab(t_mpr_bundle *x);
+static t_max_err set_dev_obj(t_mpr_bundle *x, t_object *attr, long argc, t_atom *argv);
+static void attach_dev(t_mpr_bundle *x, t_object *dev_obj, mpr_dev dev);
+static void detach_dev(t_mpr_bundle *x);
+
+static void mpr_bundle_loadbang(t_mpr_bundle *x);
+static void mpr_bundle_anything(t_mpr_bundle *x, t_symbol *s, int argc, t_atom *argv);
+static void mpr_bundle_sig_handler(mpr_sig sig, mpr_sig_evt evt, mpr_id inst,
+                                   int len, mpr_type type, const void *val,
+                                   mpr_time time);
+
+static int mpr_bundle_declare(t_mpr_bundle *x, char dir, t_symbol *name,
+                              char type, int length, t_symbol *units);
+static void mpr_bundle_read_dict(t_mpr_bundle *x, t_symbol *name);
+static t_bundle_sig *mpr_bundle_lookup(t_mpr_bundle *x, t_symbol *name);
+
+static int atom_strcmp(t_atom *a, const char *string);
+static const char *atom_get_string(t_atom *a);
+
+// *********************************************************
+// -(global class pointer variable)-------------------------
+static void *mpr_bundle_class;
+
+// *********************************************************
+// -(main)--------------------------------------------------
+int main(void)
+{
+    t_class *c;
+    c = class_new("mpr.bundle", (method)mpr_bundle_new, (method)mpr_bundle_free,
+                  (long)sizeof(t_mpr_bundle), 0L, A_GIMME, 0);
+
+    class_addmethod(c, (method)mpr_bundle_loadbang, "loadbang", 0);
+    class_addmethod(c, (method)mpr_bundle_anything, "anything", A_GIMME, 0);
+    class_addmethod(c, (method)add_to_hashtab, "add_to_hashtab", A_CANT, 0);
+    class_addmethod(c, (method)remove_from_hashtab, "remove_from_hashtab", A_CANT, 0);
+    class_addmethod(c, (method)attach_dev, "attach_dev", A_CANT, 0);
+    class_addmethod(c, (method)detach_dev, "detach_dev", A_CANT, 0);
+
+    CLASS_ATTR_OBJ(c, "dev_obj", ATTR_GET_OPAQUE_USER | ATTR_SET_OPAQUE_USER, t_mpr_bundle, dev_obj);
+    CLASS_ATTR_ACCESSORS(c, "dev_obj", 0, set_dev_obj);
+
+    class_register(CLASS_BOX, c); /* CLASS_NOBOX */
+    mpr_bundle_class = c;
+    return 0;
+}
+
+static void mpr_bundle_usage()
+{
+    post("usage: [mpr.bundle @inputs <name> <type> <opt: length> ... "
+         "@outputs <name> <type> <opt: length> ... @dict <dictionary-name>]");
+}
+
+// *********************************************************
+// -(new)---------------------------------------------------
+static void *mpr_bundle_new(t_symbol *s, int argc, t_atom *argv)
+{
+    t_mpr_bundle *x = NULL;
+    long i = 0;
+    char dir = 0;
+
+    if (!argc) {
+        mpr_bundle_usage();
+        return 0;
+    }
+
+    if ((x = (t_mpr_bundle *)object_alloc(mpr_bundle_class))) {
+        x->outlet = listout((t_object *)x);
+        x->dev_obj = 0;
+        x->device = 0;
+        x->ht = 0;
+        x->connect_state = 0;
+        x->num_sigs = 0;
+        x->sigs = 0;
+        x->table = 0;
+        x->table_mask = 0;
+
+        // declarations take the form @inputs|@outputs followed by
+        // <name> <type> [<length>] entries
+        while (i < argc) {
+            if (atom_strcmp(argv+i, "@inputs") == 0) {
+                dir = MPR_DIR_IN;
+                ++i;
+            }
+            else if (atom_strcmp(argv+i, "@outputs") == 0) {
+                dir = MPR_DIR_OUT;
+                ++i;
+            }
+            else if (atom_strcmp(argv+i, "@dict") == 0) {
+                if (i + 1 < argc && (argv+i+1)->a_type == A_SYM)
+                    mpr_bundle_read_dict(x, atom_getsym(argv+i+1));
+                i += 2;
+            }
+            else if (dir && i + 1 < argc && (argv+i)->a_type == A_SYM
+                     && (argv+i+1)->a_type == A_SYM) {
+                t_symbol *name = atom_getsym(argv+i);
+                char type = atom_get_string(argv+i+1)[0];
+                int length = 1;
+                i += 2;
+                if (i < argc && (argv+i)->a_type == A_LONG) {
+                    length = (int)atom_getlong(argv+i);
+                    ++i;
+                }
+                mpr_bundle_declare(x, dir, name, type, length, NULL);
+            }
+            else {
+                object_post((t_object *)x, "could not parse argument %ld", i);
+                ++i;
+            }
+        }
+        if (!x->num_sigs) {
+            mpr_bundle_usage();
+            object_free(x);
+            return 0;
+        }
+
+        // cache the registered name so we can remove self from hashtab later
+        x = object_register(CLASS_BOX, x->myobjname = symbol_unique(), x);
+
+        x->patcher = (t_object *)gensym("#P")->s_thing;
+        mpr_bundle_loadbang(x);
+    }
+    return (x);
+}
+
+// *********************************************************
+// -(free)--------------------------------------------------
+static void mpr_bundle_free(t_mpr_bundle *x)
+{
+    detach_dev(x);
+    remove_from_hashtab(x);
+    if (x->sigs)
+        free(x->sigs);
+    if (x->table)
+        free(x->table);
+}
+
+void mpr_bundle_loadbang(t_mpr_bundle *x)
+{
+    t_hashtab *ht;
+
+    if (!x->patcher)
+        return;
+
+    t_object *patcher = x->patcher;
+    while (patcher) {
+        object_obex_lookup(patcher, gensym("mprhash"), (t_object **)&ht);
+        if (ht) {
+            add_to_hashtab(x, ht);
+            break;
+        }
+        patcher = jpatcher_get_parentpatcher(patcher);
+    }
+}
+
+void add_to_hashtab(t_mpr_bundle *x, t_hashtab *ht)
+{
+    if (x->connect_state) {
+        // already registered
+        return;
+    }
+
+    // a single hashtab entry stands for all signals of the bundle. IMPORTANT:
+    // set the OBJ_FLAG_REF flag so the hashtab knows not to free us.
+    hashtab_storeflags(ht, x->myobjname, (t_object *)x, OBJ_FLAG_REF);
+    x->ht = ht;
+    x->connect_state = 1;
+}
+
+void remove_from_hashtab(t_mpr_bundle *x)
+{
+    if (x->ht) {
+        hashtab_chuckkey(x->ht, x->myobjname);
+        x->ht = NULL;
+    }
+    x->dev_obj = 0;
+    x->connect_state = 0;
+}
+
+// *********************************************************
+// -(declare a signal)--------------------------------------
+static int mpr_bundle_declare(t_mpr_bundle *x, char dir, t_symbol *name,
+                              char type, int length, t_symbol *units)
+{
+    int i, size, slot;
+
+    if (type != 'i' && type != 'f') {
+        object_post((t_object *)x, "skipping signal %s (unknown type)", name->s_name);
+        return 1;
+    }
+    if (length < 1 || length > MAX_LIST) {
+        object_post((t_object *)x, "skipping signal %s (bad length)", name->s_name);
+        return 1;
+    }
+    if (mpr_bundle_lookup(x, name)) {
+        object_post((t_object *)x, "skipping duplicate signal %s", name->s_name);
+        return 1;
+    }
+
+    x->sigs = realloc(x->sigs, (x->num_sigs + 1) * sizeof(t_bundle_sig));
+    x->sigs[x->num_sigs].head.kind = SIGDATA_BUNDLE;
+    x->sigs[x->num_sigs].home = x;
+    x->sigs[x->num_sigs].name = name;
+    x->sigs[x->num_sigs].units = units;
+    x->sigs[x->num_sigs].sig = 0;
+    x->sigs[x->num_sigs].length = length;
+    x->sigs[x->num_sigs].type = type;
+    x->sigs[x->num_sigs].dir = dir;
+    ++x->num_sigs;
+
+    // keep the selector table at most half full
+    if (x->num_sigs * 2 > x->table_mask) {
+        for (size = 16; size < x->num_sigs * 4; size <<= 1) {};
+        x->table = realloc(x->table, size * sizeof(int));
+        x->table_mask = size - 1;
+        for (i = 0; i < size; i++)
+            x->table[i] = -1;
+        for (i = 0; i < x->num_sigs; i++) {
+            slot = ((size_t)x->sigs[i].name >> 4) & x->table_mask;
+            while (x->table[slot] >= 0)
+                slot = (slot + 1) & x->table_mask;
+            x->table[slot] = i;
+        }
+    }
+    else {
+        slot = ((size_t)name >> 4) & x->table_mask;
+        while (x->table[slot] >= 0)
+            slot = (slot + 1) & x->table_mask;
+        x->table[slot] = x->num_sigs - 1;
+    }
+    return 0;
+}
+
+// *********************************************************
+// -(find a signal by selector)-----------------------------
+static t_bundle_sig *mpr_bundle_lookup(t_mpr_bundle *x, t_symbol *name)
+{
+    // symbols are interned so they can be compared and hashed by address
+    int slot;
+    if (!x->table)
+        return 0;
+    slot = ((size_t)name >> 4) & x->table_mask;
+    while (x->table[slot] >= 0) {
+        if (x->sigs[x->table[slot]].name == name)
+            return &x->sigs[x->table[slot]];
+        slot = (slot + 1) & x->table_mask;
+    }
+    return 0;
+}
+
+// *********************************************************
+// -(read declarations from a named dictionary)-------------
+static void mpr_bundle_read_dict(t_mpr_bundle *x, t_symbol *name)
+{
+    t_dictionary *d = dictobj_findregistered_retain(name);
+    t_object *device = NULL, *sigs = NULL, *entry;
+    t_symbol *keys[2] = {gensym("inputs"), gensym("outputs")};
+    t_dictionary *root;
+    t_atom *atoms;
+    long num_atoms, i, j;
+
+    if (!d) {
+        object_post((t_object *)x, "could not find dictionary %s", name->s_name);
+        return;
+    }
+    // accept either a device definition or a bare inputs/outputs dictionary
+    root = d;
+    if (dictionary_getdictionary(d, gensym("device"), &device) == MAX_ERR_NONE)
+        root = (t_dictionary *)device;
+
+    for (j = 0; j < 2; j++) {
+        if (dictionary_getatomarray(root, keys[j], &sigs) != MAX_ERR_NONE)
+            continue;
+        atomarray_getatoms((t_atomarray *)sigs, &num_atoms, &atoms);
+        for (i = 0; i < num_atoms; i++) {
+            const char *sig_name, *sig_type, *sig_units;
+            t_atom_long sig_length;
+            entry = atom_getobj(atoms + i);
+            if (dictionary_getstring((t_dictionary *)entry, gensym("name"),
+                                     &sig_name) != MAX_ERR_NONE)
+                continue;
+            if (dictionary_getstring((t_dictionary *)entry, gensym("type"),
+                                     &sig_type) != MAX_ERR_NONE)
+                continue;
+            if (dictionary_getlong((t_dictionary *)entry, gensym("length"),
+                                   &sig_length) != MAX_ERR_NONE)
+                sig_length = 1;
+            if (dictionary_getstring((t_dictionary *)entry, gensym("units"),
+                                     &sig_units) != MAX_ERR_NONE)
+                sig_units = 0;
+            mpr_bundle_declare(x, j ? MPR_DIR_OUT : MPR_DIR_IN, gensym(sig_name),
+                               sig_type[0], (int)sig_length,
+                               sig_units ? gensym(sig_units) : NULL);
+        }
+    }
+    dictobj_release(d);
+}
+
+// *********************************************************
+// -(attach to a device)------------------------------------
+static void attach_dev(t_mpr_bundle *x, t_object *dev_obj, mpr_dev dev)
+{
+    int i;
+    t_bundle_sig *b;
+
+    if (x->device)
+        detach_dev(x);
+    x->dev_obj = dev_obj;
+    x->device = dev;
+
+    for (i = 0, b = x->sigs; i < x->num_sigs; i++, b++) {
+        // the device's other objects, or another bundle, may own the name
+        if (sigdata_find(dev, b->name->s_name)) {
+            object_post((t_object *)x, "error: signal %s is already in use by"
+                        " another object!", b->name->s_name);
+            b->sig = 0;
+            continue;
+        }
+        b->sig = mpr_sig_new(dev, b->dir, b->name->s_name, b->length, b->type,
+                             b->units ? b->units->s_name : 0, 0, 0, 0,
+                             mpr_bundle_sig_handler, MPR_SIG_UPDATE);
+        if (!b->sig) {
+            object_post((t_object *)x, "error adding signal %s", b->name->s_name);
+            continue;
+        }
+        mpr_obj_set_prop(b->sig, MPR_PROP_DATA, NULL, 1, MPR_PTR, b, 0);
+    }
+}
+
+// *********************************************************
+// -(detach from the device)--------------------------------
+static void detach_dev(t_mpr_bundle *x)
+{
+    int i;
+    if (!x->device)
+        return;
+    critical_enter(0);
+    for (i = 0; i < x->num_sigs; i++) {
+        if (x->sigs[i].sig)
+            mpr_sig_free(x->sigs[i].sig);
+        x->sigs[i].sig = 0;
+    }
+    critical_exit(0);
+    x->device = 0;
+}
+
+// *********************************************************
+// -(set the device pointer)--------------------------------
+t_max_err set_dev_obj(t_mpr_bundle *x, t_object *attr, long argc, t_atom *argv)
+{
+    // the device clears this pointer when it goes away
+    x->dev_obj = (t_object *)argv->a_w.w_obj;
+    if (!x->dev_obj)
+        detach_dev(x);
+    return 0;
+}
+
+// *********************************************************
+// -(anything: signal name as selector)---------------------
+static void mpr_bundle_anything(t_mpr_bundle *x, t_symbol *s, int argc, t_atom *argv)
+{
+    int i;
+    t_bundle_sig *b = mpr_bundle_lookup(x, s);
+
+    if (!b) {
+        object_post((t_object *)x, "no signal named %s", s->s_name);
+        return;
+    }
+    if (!b->sig || !argc)
+        return;
+    if (argc != b->length) {
+        object_post((t_object *)x, "Illegal list length for %s (expected %i)",
+                    s->s_name, b->length);
+        return;
+    }
+
+    if (b->type == 'i') {
+        int payload[argc];
+        for (i = 0; i < argc; i++) {
+            if ((argv+i)->a_type == A_FLOAT)
+                payload[i] = (int)atom_getfloat(argv+i);
+            else if ((argv+i)->a_type == A_LONG)
+                payload[i] = (int)atom_getlong(argv+i);
+            else {
+                object_post((t_object *)x, "Illegal data type in list!");
+                return;
+            }
+        }
+        critical_enter(0);
+        mpr_sig_set_value(b->sig, 0, argc, MPR_INT32, payload);
+        critical_exit(0);
+    }
+    else {
+        float payload[argc];
+        for (i = 0; i < argc; i++) {
+            if ((argv+i)->a_type == A_FLOAT)
+                payload[i] = atom_getfloat(argv+i);
+            else if ((argv+i)->a_type == A_LONG)
+                payload[i] = (float)atom_getlong(argv+i);
+            else {
+                object_post((t_object *)x, "Illegal data type in list!");
+                return;
+            }
+        }
+        critical_enter(0);
+        mpr_sig_set_value(b->sig, 0, argc, MPR_FLT, payload);
+        critical_exit(0);
+    }
+}
+
+// *********************************************************
+// -(sig handler)-------------------------------------------
+static void mpr_bundle_sig_handler(mpr_sig sig, mpr_sig_evt evt, mpr_id inst,
+                                   int len, mpr_type type, const void *val,
+                                   mpr_time time)
+{
+    t_bundle_sig *b = (t_bundle_sig *)mpr_obj_get_prop_as_ptr(sig, MPR_PROP_DATA, NULL);
+    t_mpr_bundle *x;
+    int i;
+
+    if (!b || !val || b->head.kind != SIGDATA_BUNDLE)
+        return;
+    x = b->home;
+    if (len > MAX_LIST)
+        len = MAX_LIST;
+
+    if (type == MPR_INT32) {
+        int *vi = (int*)val;
+        for (i = 0; i < len; i++)
+            atom_setlong(x->buffer + i, vi[i]);
+    }
+    else if (type == MPR_FLT) {
+        float *vf = (float*)val;
+        for (i = 0; i < len; i++)
+            atom_setfloat(x->buffer + i, vf[i]);
+    }
+    else
+        return;
+    outlet_anything(x->outlet, b->name, len, x->buffer);
+}
+
+// *********************************************************
+// some helper functions
+
+static int atom_strcmp(t_atom *a, const char *string)
+{
+    if (a->a_type != A_SYM || !string)
+        return 1;
+    return strcmp(atom_getsym(a)->s_name, string);
+}
+
+static const char *atom_get_string(t_atom *a)
+{
+    return atom_getsym(a)->s_name;
+}
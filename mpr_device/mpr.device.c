@@ -23,6 +23,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+
+#include "../common/capture.h"
+#include "../common/definition.h"
+#include "../common/identity.h"
+#include "../common/mapping.h"
+#include "../common/qos.h"
+#include "../common/session.h"
+#include "../common/sigdata.h"
+#include "../common/stats.h"
+#include "../common/trace.h"
 #ifndef WIN32
   #include <arpa/inet.h>
 #endif
@@ -31,6 +41,7 @@
 
 #define INTERVAL 1
 #define MAX_LIST 256
+#define NUM_OUT_STATS 4
 
 // *********************************************************
 // -(object struct)-----------------------------------------
@@ -48,6 +59,20 @@ typedef struct _mpr_device
     t_atom              buffer[MAX_LIST];
     t_object            *patcher;
     int                 throttle;
+    struct _mpr_ptrs    *sigs;          // signals created for mpr.in/mpr.out
+
+    t_stats             stats;          // poll loop statistics, reported by the 'stats' message
+    int                 latency;        // collect latency histograms of received values
+    mpr_time            recv_time;      // when the current mpr_dev_poll() call started
+    t_qos               qos;            // priority-ordered delivery of received values
+    t_capture           *capture;       // traffic being recorded, if any
+    t_capture_player    *play;          // log being played back, if any
+    void                *play_clock;
+    char                *identity;      // file keeping the name, ordinal and port claimed
+    t_identity          claimed;
+    char                *session_path;  // file caching the maps of the device's signals
+    t_session           *session;
+    t_mapping_load      *maps_load;     // loaded maps waiting for their devices
 } t_mpr_device;
 
 typedef struct
@@ -58,9 +83,29 @@ typedef struct
 
 typedef struct _mpr_ptrs
 {
+    t_sigdata           head;           // SIGDATA_DEVICE
     int                 num_objs;
     t_object            **objs;
     t_mpr_device        *home;
+    int                 block;
+    int                 block_count;
+    t_atom              *block_buf;
+    t_object            *poly;
+    method              poly_fn;
+    mpr_sig             sig;
+    struct _mpr_ptrs    *next;
+
+    // received values, counted next to the data loaded for each update;
+    // sent values are counted by the mpr.out objects themselves
+    t_atom_long         updates;
+    t_atom_long         bytes;
+    t_atom_long         releases;
+    t_atom_long         overflows;
+    t_atom_long         last_updates;   // updates at the previous report
+    t_qos_slot          qos;            // priority and value held back under the budget
+
+    t_latency           network;        // from being polled off the network to output
+    t_latency           timetag;        // from the sender's timetag to output
 } t_mpr_ptrs;
 
 // *********************************************************
@@ -78,14 +123,38 @@ static int mpr_device_attach(t_mpr_device *x);
 
 static void mpr_device_add_signal(t_mpr_device *x, t_object *obj);
 static void mpr_device_remove_signal(t_mpr_device *x, t_object *obj);
+static void mpr_device_set_block(t_mpr_device *x, mpr_sig sig, long block);
+static void mpr_device_set_priority(t_mpr_device *x, mpr_sig sig, long priority);
+static void mpr_device_budget(t_mpr_device *x, t_symbol *s, long argc, t_atom *argv);
+static void mpr_device_qos_flush(t_mpr_device *x);
 
 static void mpr_device_poll(t_mpr_device *x);
 
 static void mpr_device_sig_handler(mpr_sig sig, mpr_sig_evt evt, mpr_id inst,
                                    int length, mpr_type type, const void *value,
                                    mpr_time time);
+static void mpr_device_deliver(t_mpr_device *x, t_mpr_ptrs *ptrs, t_sigdata_inst *inst_ptrs,
+                               int len, mpr_type type, const void *val, mpr_time time,
+                               mpr_time recv_time);
 
 static void mpr_device_print_properties(t_mpr_device *x);
+static void mpr_device_stats(t_mpr_device *x, t_symbol *s, long argc, t_atom *argv);
+static void mpr_device_stats_report(t_mpr_device *x);
+static void mpr_device_latency(t_mpr_device *x, t_symbol *s, long argc, t_atom *argv);
+static void mpr_device_trace(t_mpr_device *x, t_symbol *s, long argc, t_atom *argv);
+static void mpr_device_record(t_mpr_device *x, t_symbol *s, long argc, t_atom *argv);
+static void mpr_device_record_stop(t_mpr_device *x);
+static void mpr_device_play(t_mpr_device *x, t_symbol *s, long argc, t_atom *argv);
+static void mpr_device_play_stop(t_mpr_device *x, int done);
+static void mpr_device_stop(t_mpr_device *x);
+static void mpr_device_set_capture(t_mpr_device *x, t_capture *capture);
+static void mpr_device_write(t_mpr_device *x, t_symbol *s, long argc, t_atom *argv);
+static void mpr_device_maps(t_mpr_device *x, t_symbol *s, long argc, t_atom *argv);
+static void mpr_device_maps_poll(t_mpr_device *x, mpr_time now);
+static void mpr_device_maps_stop(t_mpr_device *x);
+static void mpr_device_save_identity(t_mpr_device *x);
+static void mpr_device_session_poll(t_mpr_device *x, mpr_time now);
+static void mpr_device_save_session(t_mpr_device *x);
 
 static int atom_strcmp(t_atom *a, const char *string);
 static const char *atom_get_string(t_atom *a);
@@ -95,6 +164,9 @@ static void atom_set_string(t_atom *a, const char *string);
 // -(global class pointer variable)-------------------------
 static void *mpr_device_class;
 
+// symbols output by the signal handler, looked up once in main()
+static t_symbol *ps_release, *ps_upstream, *ps_downstream, *ps_overflow, *ps_set_capture;
+
 // *********************************************************
 // -(main)--------------------------------------------------
 int main(void)
@@ -104,9 +176,26 @@ int main(void)
                   (long)sizeof(t_mpr_device), 0L, A_GIMME, 0);
 
     class_addmethod(c, (method)mpr_device_notify, "notify", A_CANT, 0);
+    class_addmethod(c, (method)mpr_device_set_block, "set_block", A_CANT, 0);
+    class_addmethod(c, (method)mpr_device_set_priority, "set_priority", A_CANT, 0);
+    class_addmethod(c, (method)mpr_device_budget, "budget", A_GIMME, 0);
+    class_addmethod(c, (method)mpr_device_stats, "stats", A_GIMME, 0);
+    class_addmethod(c, (method)mpr_device_latency, "latency", A_GIMME, 0);
+    class_addmethod(c, (method)mpr_device_trace, "trace", A_GIMME, 0);
+    class_addmethod(c, (method)mpr_device_record, "record", A_GIMME, 0);
+    class_addmethod(c, (method)mpr_device_play, "play", A_GIMME, 0);
+    class_addmethod(c, (method)mpr_device_stop, "stop", 0);
+    class_addmethod(c, (method)mpr_device_write, "write", A_GIMME, 0);
+    class_addmethod(c, (method)mpr_device_maps, "maps", A_GIMME, 0);
 
     class_register(CLASS_BOX, c); /* CLASS_NOBOX */
     mpr_device_class = c;
+
+    ps_release = gensym("release");
+    ps_upstream = gensym("upstream");
+    ps_downstream = gensym("downstream");
+    ps_overflow = gensym("overflow");
+    ps_set_capture = gensym("set_capture");
     return 0;
 }
 
@@ -118,11 +207,17 @@ static void *mpr_device_new(t_symbol *s, int argc, t_atom *argv)
     long i;
     const char *alias = NULL;
     const char *iface = NULL;
+    const char *identity = NULL;
+    char prefix[IDENTITY_MAX_NAME];
 
     if ((x = object_alloc(mpr_device_class))) {
         x->outlet = listout((t_object *)x);
         x->name = 0;
         x->throttle = 10;
+        x->sigs = 0;
+        x->stats.interval = 0;
+        stats_reset(&x->stats);
+        x->latency = 0;
 
         if (argv->a_type == A_SYM && atom_get_string(argv)[0] != '@')
             alias = atom_get_string(argv);
@@ -141,6 +236,18 @@ static void *mpr_device_new(t_symbol *s, int argc, t_atom *argv)
                         i++;
                     }
                 }
+                else if (atom_strcmp(argv+i, "@identity") == 0) {
+                    if ((argv+i+1)->a_type == A_SYM) {
+                        x->identity = strdup(atom_get_string(argv+i+1));
+                        i++;
+                    }
+                }
+                else if (atom_strcmp(argv+i, "@session") == 0) {
+                    if ((argv+i+1)->a_type == A_SYM) {
+                        x->session_path = strdup(atom_get_string(argv+i+1));
+                        i++;
+                    }
+                }
                 else if (atom_strcmp(argv+i, "@throttle") == 0) {
                     if ((argv+i+1)->a_type == A_LONG) {
                         int throttle = atom_getlong(argv+i+1);
@@ -157,9 +264,14 @@ static void *mpr_device_new(t_symbol *s, int argc, t_atom *argv)
                 }
             }
         }
+        if (x->identity && identity_read(x->identity, &x->claimed))
+            identity = identity_prefix(&x->claimed, prefix, IDENTITY_MAX_NAME);
         if (alias) {
             x->name = *alias == '/' ? strdup(alias+1) : strdup(alias);
         }
+        else if (identity) {
+            x->name = strdup(identity);
+        }
         else {
             x->name = strdup("maxmsp");
         }
@@ -172,8 +284,15 @@ static void *mpr_device_new(t_symbol *s, int argc, t_atom *argv)
         x->graph = mpr_obj_get_graph(x->device);
         if (iface)
             mpr_graph_set_interface(x->graph, iface);
+        // the ordinal only means something for the same name
+        if (identity && !strcmp(identity, x->name))
+            identity_hint(x->device, &x->claimed);
+        if (x->session_path)
+            x->session = session_new(x->session_path, x->device);
 
         if (mpr_device_attach(x)) {
+            if (x->session)
+                session_free(x->session);
             mpr_dev_free(x->device);
             free(x->name);
             return 0;
@@ -189,7 +308,9 @@ static void *mpr_device_new(t_symbol *s, int argc, t_atom *argv)
             if (i > argc - 2) // need 2 arguments for key and value
                 break;
             if ((atom_strcmp(argv+i, "@alias") == 0) ||
-                (atom_strcmp(argv+i, "@interface") == 0)){
+                (atom_strcmp(argv+i, "@interface") == 0) ||
+                (atom_strcmp(argv+i, "@identity") == 0) ||
+                (atom_strcmp(argv+i, "@session") == 0)){
                 i++;
                 continue;
             }
@@ -242,16 +363,32 @@ static void *mpr_device_new(t_symbol *s, int argc, t_atom *argv)
 // -(free)--------------------------------------------------
 static void mpr_device_free(t_mpr_device *x)
 {
+    mpr_device_stop(x);
+    mpr_device_maps_stop(x);
+    if (x->session) {
+        // keep changes made since the last save
+        if (x->session->dirty)
+            mpr_device_save_session(x);
+        session_free(x->session);
+    }
     mpr_device_detach(x);
 
     clock_unset(x->clock);      // Remove clock routine from the scheduler
     clock_free(x->clock);       // Frees memeory used by clock
+    if (x->play_clock)
+        clock_free(x->play_clock);
     if (x->device) {
         mpr_dev_free(x->device);
     }
     if (x->name) {
         free(x->name);
     }
+    if (x->identity) {
+        free(x->identity);
+    }
+    if (x->session_path) {
+        free(x->session_path);
+    }
 }
 
 void mpr_device_notify(t_mpr_device *x, t_symbol *s, t_symbol *msg, void *sender,
@@ -325,7 +462,8 @@ long add_downstream(t_mpr_device *x, t_object *obj)
 {
     t_symbol *cls = object_classname(obj);
 
-    if (cls != gensym("mpr.in") && cls != gensym("mpr.out"))
+    if (cls != gensym("mpr.in") && cls != gensym("mpr.out") && cls != gensym("mpr.poly")
+        && cls != gensym("mpr.bundle"))
         return 0;
 
     object_method(obj, gensym("add_to_hashtab"), x->ht);
@@ -380,41 +518,85 @@ int mpr_device_attach(t_mpr_device *x)
     return 0;
 }
 
+static void mpr_device_add_bundle(t_mpr_device *x, t_object *obj)
+{
+    // mpr.bundle objects create and free their own signals
+    object_method(obj, gensym("attach_dev"), x, x->device);
+
+    atom_setlong(x->buffer, mpr_list_get_size(mpr_dev_get_sigs(x->device, MPR_DIR_IN)));
+    outlet_anything(x->outlet, gensym("numInputs"), 1, x->buffer);
+    atom_setlong(x->buffer, mpr_list_get_size(mpr_dev_get_sigs(x->device, MPR_DIR_OUT)));
+    outlet_anything(x->outlet, gensym("numOutputs"), 1, x->buffer);
+}
+
 static void mpr_device_add_signal(t_mpr_device *x, t_object *obj)
 {
+    if (object_classname(obj) == gensym("mpr.bundle")) {
+        mpr_device_add_bundle(x, obj);
+        return;
+    }
+
     mpr_sig sig = NULL;
     t_symbol *temp = object_attr_getsym(obj, gensym("sig_name"));
     const char *name = temp->s_name;
     char type = object_attr_getchar(obj, gensym("sig_type"));
     long length = object_attr_getlong(obj, gensym("sig_length"));
     mpr_dir dir = 0;
+    int is_poly = 0;
 
     if (object_classname(obj) == gensym("mpr.out"))
         dir = MPR_DIR_OUT;
     else if (object_classname(obj) == gensym("mpr.in"))
         dir = MPR_DIR_IN;
+    else if (object_classname(obj) == gensym("mpr.poly")) {
+        dir = MPR_DIR_IN;
+        is_poly = 1;
+    }
     else
         return;
 
-    mpr_list list = mpr_dev_get_sigs(x->device, MPR_DIR_ANY);
-    list = mpr_list_filter(list, MPR_PROP_NAME, NULL, 1, MPR_STR, name, MPR_OP_EQ);
-    if (list && (sig = *list)) {
+    if ((sig = sigdata_find(x->device, name))) {
         // another max object associated with this signal exists
+        if (sigdata_kind(sig) != SIGDATA_DEVICE) {
+            object_post((t_object *)x, "error: signal %s is already in use by"
+                        " an mpr.bundle!", name);
+            return;
+        }
         t_mpr_ptrs *ptrs = (t_mpr_ptrs *)mpr_obj_get_prop_as_ptr(sig, MPR_PROP_DATA, NULL);
+        if (is_poly || ptrs->poly) {
+            // mpr.poly allocates all instances of its signal so cannot share it
+            object_post((t_object *)x, "error: signal %s is already in use by"
+                        " another object!", name);
+            return;
+        }
         ptrs->objs = realloc(ptrs->objs, (ptrs->num_objs+1) * sizeof(t_object *));
         ptrs->objs[ptrs->num_objs] = obj;
         ptrs->num_objs++;
     }
     else {
-        t_mpr_ptrs *ptrs = (t_mpr_ptrs *)malloc(sizeof(struct _mpr_ptrs));
+        t_mpr_ptrs *ptrs = (t_mpr_ptrs *)calloc(1, sizeof(struct _mpr_ptrs));
+        ptrs->head.kind = SIGDATA_DEVICE;
         ptrs->home = x;
         ptrs->objs = (t_object **)malloc(sizeof(t_object *));
         ptrs->num_objs = 1;
         ptrs->objs[0] = obj;
+        ptrs->block = 0;
+        ptrs->block_count = 0;
+        ptrs->block_buf = 0;
+        ptrs->poly = is_poly ? obj : 0;
+        ptrs->poly_fn = is_poly ? zgetfn(obj, gensym("sig_event")) : 0;
+        qos_slot_init(&ptrs->qos, ptrs);
         sig = mpr_sig_new(x->device, dir, name, length, type, 0, 0, 0,
                           NULL, mpr_device_sig_handler, MPR_SIG_ALL);
         mpr_obj_set_prop(sig, MPR_PROP_DATA, NULL, 1, MPR_PTR, ptrs, 0);
+        ptrs->sig = sig;
+        ptrs->next = x->sigs;
+        x->sigs = ptrs;
+        if (x->capture)
+            capture_sig(x->capture, sig);
     }
+    if (x->capture && dir == MPR_DIR_OUT)
+        object_method(obj, ps_set_capture, x->capture);
     //output new numOutputs/numInputs
     atom_setlong(x->buffer, mpr_list_get_size(mpr_dev_get_sigs(x->device, dir)));
     if (dir == MPR_DIR_OUT)
@@ -433,43 +615,133 @@ static void mpr_device_remove_signal(t_mpr_device *x, t_object *obj)
     mpr_sig sig = 0;
     if (!obj)
         return;
+    if (object_classname(obj) == gensym("mpr.bundle")) {
+        object_method(obj, gensym("detach_dev"));
+        return;
+    }
     t_symbol *temp = object_attr_getsym(obj, gensym("sig_name"));
     const char *name = temp->s_name;
 
-    mpr_list list = mpr_dev_get_sigs(x->device, MPR_DIR_ANY);
-    list = mpr_list_filter(list, MPR_PROP_NAME, NULL, 1, MPR_STR, name, MPR_OP_EQ);
-    if (!list) {
+    sig = sigdata_find(x->device, name);
+    if (!sig || sigdata_kind(sig) != SIGDATA_DEVICE) {
+        // a signal of the same name may belong to an mpr.bundle
         object_post((t_object *)x, "error: signal named %s not found!", name);
         return;
     }
-    sig = *list;
 
-    if (sig) {
-        t_mpr_ptrs *ptrs = (t_mpr_ptrs *)mpr_obj_get_prop_as_ptr(sig, MPR_PROP_DATA, NULL);
-        if (ptrs->num_objs == 1) {
-            free(ptrs->objs);
-            free(ptrs);
-            mpr_sig_free(sig);
+    t_mpr_ptrs *ptrs = (t_mpr_ptrs *)mpr_obj_get_prop_as_ptr(sig, MPR_PROP_DATA, NULL);
+    if (ptrs->num_objs == 1) {
+        t_mpr_ptrs **list = &x->sigs;
+        // playback refers to signals directly
+        mpr_device_play_stop(x, 0);
+        while (*list && *list != ptrs)
+            list = &(*list)->next;
+        if (*list)
+            *list = ptrs->next;
+        free(ptrs->objs);
+        if (ptrs->block_buf)
+            free(ptrs->block_buf);
+        qos_slot_free(&x->qos, &ptrs->qos);
+        free(ptrs);
+        mpr_sig_free(sig);
+    }
+    else {
+        // need to realloc obj ptr memory
+        // find index of this obj in ptr array
+        int i;
+        for (i=0; i<ptrs->num_objs; i++) {
+            if (ptrs->objs[i] == obj)
+                break;
         }
-        else {
-            // need to realloc obj ptr memory
-            // find index of this obj in ptr array
-            int i;
-            for (i=0; i<ptrs->num_objs; i++) {
-                if (ptrs->objs[i] == obj)
-                    break;
-            }
-            if (i == ptrs->num_objs) {
-                object_post((t_object *)x, "error: obj ptr not found in signal user_data!");
-                return;
-            }
-            i++;
-            for (; i<ptrs->num_objs; i++)
-                ptrs->objs[i-1] = ptrs->objs[i];
-            ptrs->objs = realloc(ptrs->objs, (ptrs->num_objs-1) * sizeof(t_object *));
-            ptrs->num_objs--;
+        if (i == ptrs->num_objs) {
+            object_post((t_object *)x, "error: obj ptr not found in signal user_data!");
+            return;
         }
+        i++;
+        for (; i<ptrs->num_objs; i++)
+            ptrs->objs[i-1] = ptrs->objs[i];
+        ptrs->objs = realloc(ptrs->objs, (ptrs->num_objs-1) * sizeof(t_object *));
+        ptrs->num_objs--;
+    }
+}
+
+// *********************************************************
+// -(set block delivery)------------------------------------
+static void mpr_device_set_block(t_mpr_device *x, mpr_sig sig, long block)
+{
+    /* Received samples of a non-instanced signal can be gathered and output
+     * as a single list of 'block' samples rather than one list per sample. */
+    if (!sig || sigdata_kind(sig) != SIGDATA_DEVICE)
+        return;
+    t_mpr_ptrs *ptrs = (t_mpr_ptrs *)mpr_obj_get_prop_as_ptr(sig, MPR_PROP_DATA, NULL);
+    int len = mpr_obj_get_prop_as_int32(sig, MPR_PROP_LEN, NULL);
+    if (!ptrs)
+        return;
+    if (block * len > MAX_LIST) {
+        object_post((t_object *)x, "Maximum list length is %i!", MAX_LIST);
+        return;
+    }
+    ptrs->block_count = 0;
+    if (block > 1) {
+        ptrs->block_buf = realloc(ptrs->block_buf, block * len * sizeof(t_atom));
+        ptrs->block = (int)block;
+    }
+    else {
+        if (ptrs->block_buf)
+            free(ptrs->block_buf);
+        ptrs->block_buf = 0;
+        ptrs->block = 0;
+    }
+}
+
+// *********************************************************
+// -(delivery priority)-------------------------------------
+static void mpr_device_set_priority(t_mpr_device *x, mpr_sig sig, long priority)
+{
+    /* Set by mpr.in as high, normal or low: see qos.h for how each class is
+     * delivered once a budget is set. */
+    if (!sig || priority < 0 || priority >= QOS_CLASSES
+        || sigdata_kind(sig) != SIGDATA_DEVICE)
+        return;
+    t_mpr_ptrs *ptrs = (t_mpr_ptrs *)mpr_obj_get_prop_as_ptr(sig, MPR_PROP_DATA, NULL);
+    if (!ptrs)
+        return;
+    critical_enter(0);
+    // a value held back for a signal made high priority is output at once
+    if (qos_set_priority(&x->qos, &ptrs->qos, (int)priority))
+        mpr_device_deliver(x, ptrs, 0, ptrs->qos.len, ptrs->qos.type, ptrs->qos.value,
+                           ptrs->qos.time, ptrs->qos.recv_time);
+    critical_exit(0);
+}
+
+static void mpr_device_qos_flush(t_mpr_device *x)
+{
+    t_qos_slot *slot;
+    while ((slot = qos_next(&x->qos)))
+        mpr_device_deliver(x, (t_mpr_ptrs *)slot->owner, 0, slot->len, slot->type,
+                           slot->value, slot->time, slot->recv_time);
+    qos_tick(&x->qos);
+}
+
+static void mpr_device_budget(t_mpr_device *x, t_symbol *s, long argc, t_atom *argv)
+{
+    /* 'budget <count>' limits the received values output per poll. High
+     * priority signals are always output, normal ones while the budget
+     * lasts, and the newest value of the rest waits for a later poll.
+     * 'budget 0' outputs everything as it arrives again. */
+    long budget;
+
+    if (argc != 1 || (argv->a_type != A_LONG && argv->a_type != A_FLOAT)) {
+        object_post((t_object *)x, "usage: budget <values per poll>");
+        return;
     }
+    budget = atom_getlong(argv);
+    critical_enter(0);
+    x->qos.budget = budget > 0 ? (int)budget : 0;
+    // nothing else would output values still waiting
+    if (!x->qos.budget)
+        mpr_device_qos_flush(x);
+    critical_exit(0);
 }
 
 // *********************************************************
@@ -527,12 +799,14 @@ static void mpr_device_print_properties(t_mpr_device *x)
 
 static void outlet_data(void *outlet, char type, short length, t_atom *atoms)
 {
+    TRACE_BEGIN("outlet");
     if (length > 1)
         outlet_list(outlet, NULL, length, atoms);
     else if (type == 'i')
         outlet_int(outlet, atom_getlong(atoms));
     else
         outlet_float(outlet, atom_getfloat(atoms));
+    TRACE_END("outlet");
 }
 
 // *********************************************************
@@ -542,64 +816,68 @@ static void mpr_device_sig_handler(mpr_sig sig, mpr_sig_evt evt, mpr_id inst,
                                    mpr_time time)
 {
     t_mpr_ptrs *ptrs = (void*)mpr_obj_get_prop_as_ptr(sig, MPR_PROP_DATA, NULL);
-    t_mpr_ptrs *inst_ptrs = 0;
+    t_sigdata_inst *inst_ptrs = 0;
     t_mpr_device *x = ptrs->home;
 
     int i;
 
+    TRACE_BEGIN("mpr_device_sig_handler");
+    if (x->capture && (evt & (MPR_SIG_UPDATE | MPR_SIG_REL_UPSTRM))) {
+        capture_update(x->capture, MPR_DIR_IN, sig, inst, len, type,
+                       MPR_SIG_UPDATE == evt ? val : 0, time);
+    }
+    if (ptrs->poly_fn) {
+        // mpr.poly maps instances onto voices itself
+        (*ptrs->poly_fn)(ptrs->poly, sig, (long)evt, inst, (long)len, (long)type, val);
+        TRACE_END("mpr_device_sig_handler");
+        return;
+    }
+
     if (mpr_sig_get_num_inst(sig, MPR_STATUS_ALL) > 1) {
-        inst_ptrs = (t_mpr_ptrs*)mpr_sig_get_inst_data(sig, inst);
+        inst_ptrs = (t_sigdata_inst *)mpr_sig_get_inst_data(sig, inst);
     }
 
     switch (evt) {
         case MPR_SIG_UPDATE: {
             if (val) {
-                if (len > (MAX_LIST)) {
-                    object_post((t_object *)x, "Maximum list length is %i!", MAX_LIST);
-                    len = MAX_LIST;
-                }
-
-                if (type == 'i') {
-                    int *vi = (int*)val;
-                    for (i = 0; i < len; i++)
-                        atom_setlong(x->buffer + i, vi[i]);
-                }
-                else if (type == 'f') {
-                    float *vf = (float*)val;
-                    for (i = 0; i < len; i++)
-                        atom_setfloat(x->buffer + i, vf[i]);
-                }
-
-                if (inst_ptrs) {
-                    for (i = 0; i < inst_ptrs->num_objs; i++)
-                        outlet_data(((sig_obj)inst_ptrs->objs[i])->outlet, type, len, x->buffer);
-                }
-                else {
-                    for (i=0; i<ptrs->num_objs; i++)
-                        outlet_data(ptrs->objs[i]->o_outlet, type, len, x->buffer);
-                }
+                // under a delivery budget only the newest value of a signal is
+                // kept, so instances and blocks are always passed on as they arrive
+                if (x->qos.budget && !inst_ptrs && !ptrs->block
+                    && !qos_admit(&x->qos, &ptrs->qos, inst, len, type, val, time,
+                                  x->recv_time))
+                    break;
+                mpr_device_deliver(x, ptrs, inst_ptrs, len, type, val, time, x->recv_time);
             }
             else if (inst_ptrs) {
-                atom_set_string(x->buffer, "release");
-                atom_set_string(x->buffer+1, "upstream");
+                ++ptrs->releases;
+                atom_setsym(x->buffer, ps_release);
+                atom_setsym(x->buffer+1, ps_upstream);
                 for (i = 0; i < inst_ptrs->num_objs; i++)
                     outlet_list(((sig_obj)inst_ptrs->objs[i])->outlet, NULL, 2, x->buffer);
             }
             break;
         }
         case MPR_SIG_REL_UPSTRM:
-            atom_set_string(x->buffer, "release");
-            atom_set_string(x->buffer+1, "upstream");
+            // a replayed release may name an instance that is not active
+            if (!inst_ptrs)
+                break;
+            ++ptrs->releases;
+            atom_setsym(x->buffer, ps_release);
+            atom_setsym(x->buffer+1, ps_upstream);
             for (i = 0; i < inst_ptrs->num_objs; i++)
                 outlet_list(((sig_obj)inst_ptrs->objs[i])->outlet, NULL, 2, x->buffer);
             break;
         case MPR_SIG_REL_DNSTRM:
-            atom_set_string(x->buffer, "release");
-            atom_set_string(x->buffer+1, "downstream");
+            if (!inst_ptrs)
+                break;
+            ++ptrs->releases;
+            atom_setsym(x->buffer, ps_release);
+            atom_setsym(x->buffer+1, ps_downstream);
             for (i = 0; i < inst_ptrs->num_objs; i++)
                 outlet_list(((sig_obj)inst_ptrs->objs[i])->outlet, NULL, 2, x->buffer);
             break;
         case MPR_SIG_INST_OFLW: {
+            ++ptrs->overflows;
             atom_setlong(x->buffer, inst);
             int mode = mpr_obj_get_prop_as_int32(sig, MPR_PROP_STEAL_MODE, NULL);
             switch (mode) {
@@ -614,7 +892,7 @@ static void mpr_device_sig_handler(mpr_sig sig, mpr_sig_evt evt, mpr_id inst,
                         mpr_sig_release_inst(sig, inst);
                     break;
                 case 0:
-                    atom_set_string(x->buffer+1, "overflow");
+                    atom_setsym(x->buffer+1, ps_overflow);
                     // send overflow message to all instances
                     for (i=0; i<ptrs->num_objs; i++)
                         outlet_list(ptrs->objs[i]->o_outlet, NULL, 2, x->buffer);
@@ -627,16 +905,93 @@ static void mpr_device_sig_handler(mpr_sig sig, mpr_sig_evt evt, mpr_id inst,
         default:
             break;
     }
+    TRACE_END("mpr_device_sig_handler");
+}
+
+// recv_time is when the value was taken off the network
+static void mpr_device_deliver(t_mpr_device *x, t_mpr_ptrs *ptrs, t_sigdata_inst *inst_ptrs,
+                               int len, mpr_type type, const void *val, mpr_time time,
+                               mpr_time recv_time)
+{
+    t_atom *atoms = x->buffer;
+    int i;
+
+    if (len > (MAX_LIST)) {
+        object_post((t_object *)x, "Maximum list length is %i!", MAX_LIST);
+        len = MAX_LIST;
+    }
+    if (ptrs->block && !inst_ptrs)
+        atoms = ptrs->block_buf + ptrs->block_count * len;
+    ++ptrs->updates;
+    ptrs->bytes += len * (MPR_DBL == type ? sizeof(double) : sizeof(float));
+
+    if (type == 'i') {
+        int *vi = (int*)val;
+        for (i = 0; i < len; i++)
+            atom_setlong(atoms + i, vi[i]);
+    }
+    else if (type == 'f') {
+        float *vf = (float*)val;
+        for (i = 0; i < len; i++)
+            atom_setfloat(atoms + i, vf[i]);
+    }
+
+    if (ptrs->block && !inst_ptrs) {
+        // wait until the block is full before output
+        if (++ptrs->block_count < ptrs->block)
+            return;
+        ptrs->block_count = 0;
+        atoms = ptrs->block_buf;
+        len *= ptrs->block;
+    }
+
+    if (inst_ptrs) {
+        for (i = 0; i < inst_ptrs->num_objs; i++)
+            outlet_data(((sig_obj)inst_ptrs->objs[i])->outlet, type, len, atoms);
+    }
+    else {
+        for (i=0; i<ptrs->num_objs; i++)
+            outlet_data(ptrs->objs[i]->o_outlet, type, len, atoms);
+    }
+    if (x->latency) {
+        mpr_time now;
+        mpr_time_set(&now, MPR_NOW);
+        latency_add(&ptrs->network, mpr_time_get_diff(now, recv_time));
+        latency_add(&ptrs->timetag, mpr_time_get_diff(now, time));
+    }
 }
 
 // *********************************************************
 // -(poll libmpr)-------------------------------------------
 static void mpr_device_poll(t_mpr_device *x)
 {
-    int count = x->throttle;
+    int count = x->throttle, handled = 0;
+    mpr_time start, end;
+
+    TRACE_BEGIN("mpr_device_poll");
+    mpr_time_set(&start, MPR_NOW);
+    TRACE_BEGIN("critical_enter");
     critical_enter(0);
-    while (count-- && mpr_dev_poll(x->device, 0)) {};
+    TRACE_END("critical_enter");
+    while (count--) {
+        if (x->latency)
+            mpr_time_set(&x->recv_time, MPR_NOW);
+        TRACE_BEGIN("mpr_dev_poll");
+        handled = mpr_dev_poll(x->device, 0);
+        TRACE_END("mpr_dev_poll");
+        if (!handled)
+            break;
+        x->stats.messages += handled;
+    }
+    if (x->qos.budget)
+        mpr_device_qos_flush(x);
     critical_exit(0);
+    mpr_time_set(&end, MPR_NOW);
+
+    // the loop only reaches the throttle while messages are still arriving
+    if (stats_poll(&x->stats, start, end, count < 0))
+        mpr_device_stats_report(x);
+
     if (!x->ready) {
         if (mpr_dev_get_is_ready(x->device)) {
             object_post((t_object *)x, "Joining mapping network as '%s'",
@@ -644,12 +999,486 @@ static void mpr_device_poll(t_mpr_device *x)
             if (!mpr_list_get_size(mpr_dev_get_sigs(x->device, MPR_DIR_ANY)))
                 object_post((t_object *)x, "Waiting for inputs and outputs...");
             x->ready = 1;
+            if (x->identity)
+                defer_low((t_object *)x, (method)mpr_device_save_identity, NULL, 0, NULL);
             defer_low((t_object *)x, (method)mpr_device_print_properties, NULL, 0, NULL);
         }
     }
+    if (x->ready && x->session)
+        mpr_device_session_poll(x, end);
+    if (x->maps_load)
+        mpr_device_maps_poll(x, end);
     clock_delay(x->clock, INTERVAL);  // Set clock to go off after delay
+    TRACE_END("mpr_device_poll");
+}
+
+// *********************************************************
+// -(runtime statistics)------------------------------------
+static void mpr_device_out_stats(t_mpr_ptrs *ptrs, t_atom_long *counts, long reset)
+{
+    int i;
+    for (i = 0; i < NUM_OUT_STATS; i++)
+        counts[i] = 0;
+    for (i = 0; i < ptrs->num_objs; i++)
+        object_method(ptrs->objs[i], gensym("get_stats"), counts, (void *)reset);
+}
+
+static void mpr_device_stats_reset(t_mpr_device *x)
+{
+    t_atom_long counts[NUM_OUT_STATS];
+    t_mpr_ptrs *ptrs;
+    for (ptrs = x->sigs; ptrs; ptrs = ptrs->next) {
+        ptrs->updates = ptrs->bytes = ptrs->releases = ptrs->overflows = 0;
+        ptrs->last_updates = 0;
+        ptrs->qos.shed = ptrs->qos.deferred = 0;
+        if (MPR_DIR_OUT == mpr_obj_get_prop_as_int32(ptrs->sig, MPR_PROP_DIR, NULL))
+            mpr_device_out_stats(ptrs, counts, 1);
+    }
+    x->qos.shed = x->qos.deferred = 0;
+    stats_reset(&x->stats);
+}
+
+static void mpr_device_stats_report(t_mpr_device *x)
+{
+    t_symbol *ps_stats = gensym("stats");
+    t_atom_long counts[NUM_OUT_STATS];
+    t_mpr_ptrs *ptrs;
+    mpr_time now;
+    double period;
+    t_atom *a;
+
+    mpr_time_set(&now, MPR_NOW);
+    period = mpr_time_get_diff(now, x->stats.time);
+
+    a = stats_device(x->buffer, &x->stats, &x->qos, period);
+    outlet_anything(x->outlet, ps_stats, a - x->buffer, x->buffer);
+
+    for (ptrs = x->sigs; ptrs; ptrs = ptrs->next) {
+        int out = MPR_DIR_OUT == mpr_obj_get_prop_as_int32(ptrs->sig, MPR_PROP_DIR, NULL);
+        t_atom_long updates = ptrs->updates, bytes = ptrs->bytes, releases = ptrs->releases;
+        if (out) {
+            // updates, bytes, dropped and releases are counted by mpr.out
+            mpr_device_out_stats(ptrs, counts, 0);
+            updates = counts[0];
+            bytes = counts[1];
+            releases += counts[3];
+        }
+        a = stats_signal(x->buffer, mpr_obj_get_prop_as_str(ptrs->sig, MPR_PROP_NAME, NULL),
+                         out, updates, ptrs->last_updates, period);
+        a = stats_count(a, "bytes", bytes);
+        if (out)
+            a = stats_count(a, "dropped", counts[2]);
+        a = stats_count(a, "releases", releases);
+        a = stats_count(a, "overflows", ptrs->overflows);
+        if (!out) {
+            a = stats_count(a, "shed", ptrs->qos.shed);
+            a = stats_count(a, "deferred", ptrs->qos.deferred);
+        }
+        outlet_anything(x->outlet, ps_stats, a - x->buffer, x->buffer);
+        ptrs->last_updates = updates;
+    }
+    stats_reported(&x->stats, now);
+}
+
+static void mpr_device_stats(t_mpr_device *x, t_symbol *s, long argc, t_atom *argv)
+{
+    /* 'stats' reports now, 'stats reset' clears the counters and
+     * 'stats <ms>' reports periodically from the poll loop (0 to stop). */
+    if (!argc)
+        mpr_device_stats_report(x);
+    else if (atom_strcmp(argv, "reset") == 0)
+        mpr_device_stats_reset(x);
+    else if (argv->a_type == A_LONG || argv->a_type == A_FLOAT)
+        x->stats.interval = atom_getfloat(argv) * 0.001;
+    else
+        object_post((t_object *)x, "usage: stats [reset | <interval ms>]");
+}
+
+// *********************************************************
+// -(latency histograms)------------------------------------
+static void latency_output(t_mpr_device *x, t_mpr_ptrs *ptrs, const char *kind,
+                           t_latency *l)
+{
+    t_atom *a = x->buffer;
+    atom_set_string(a++, mpr_obj_get_prop_as_str(ptrs->sig, MPR_PROP_NAME, NULL));
+    atom_set_string(a++, kind);
+    a = stats_latency(a, l);
+    outlet_anything(x->outlet, gensym("latency"), a - x->buffer, x->buffer);
+}
+
+static void mpr_device_latency(t_mpr_device *x, t_symbol *s, long argc, t_atom *argv)
+{
+    /* 'latency 1' starts collecting and 'latency 0' stops. 'latency' outputs
+     * the percentiles in milliseconds for every input signal that received
+     * values, then clears the histograms. */
+    t_mpr_ptrs *ptrs;
+
+    if (argc) {
+        if (argv->a_type == A_LONG || argv->a_type == A_FLOAT)
+            x->latency = atom_getfloat(argv) != 0;
+        else
+            object_post((t_object *)x, "usage: latency [0 | 1]");
+        return;
+    }
+    for (ptrs = x->sigs; ptrs; ptrs = ptrs->next) {
+        if (!ptrs->network.total)
+            continue;
+        latency_output(x, ptrs, "network", &ptrs->network);
+        latency_output(x, ptrs, "timetag", &ptrs->timetag);
+    }
+}
+
+// *********************************************************
+// -(tracing)-----------------------------------------------
+static void mpr_device_trace(t_mpr_device *x, t_symbol *s, long argc, t_atom *argv)
+{
+    /* 'trace write <file>' writes the recorded spans as Chrome trace-event
+     * JSON and 'trace clear' empties the buffer. Only available when built
+     * with -DMPR_TRACE. */
+#ifdef MPR_TRACE
+    if (argc == 2 && atom_strcmp(argv, "write") == 0 && argv[1].a_type == A_SYM) {
+        const char *path = atom_getsym(argv + 1)->s_name;
+        int count = trace_write(path, x->name);
+        if (count < 0)
+            object_post((t_object *)x, "could not open trace file '%s'", path);
+        else
+            object_post((t_object *)x, "wrote %d trace events to '%s'", count, path);
+    }
+    else if (argc == 1 && atom_strcmp(argv, "clear") == 0)
+        trace_clear();
+    else
+        object_post((t_object *)x, "usage: trace write <file> | trace clear");
+#else
+    object_post((t_object *)x, "tracing is not available in this build (compile with -DMPR_TRACE)");
+#endif
+}
+
+// *********************************************************
+// -(traffic capture)---------------------------------------
+static void mpr_device_set_capture(t_mpr_device *x, t_capture *capture)
+{
+    // values sent by mpr.out are recorded by the objects themselves
+    t_mpr_ptrs *ptrs;
+    int i;
+    critical_enter(0);
+    x->capture = capture;
+    for (ptrs = x->sigs; ptrs; ptrs = ptrs->next) {
+        if (mpr_obj_get_prop_as_int32(ptrs->sig, MPR_PROP_DIR, NULL) != MPR_DIR_OUT)
+            continue;
+        for (i = 0; i < ptrs->num_objs; i++)
+            object_method(ptrs->objs[i], ps_set_capture, capture);
+    }
+    critical_exit(0);
+}
+
+static void mpr_device_record(t_mpr_device *x, t_symbol *s, long argc, t_atom *argv)
+{
+    /* 'record <file>' appends every value sent or received, with its
+     * timetag, to a binary log until 'stop'. See common/capture.h for
+     * the format. */
+    const char *path;
+    t_capture *capture;
+    t_mpr_ptrs *ptrs;
+
+    if (argc != 1 || argv->a_type != A_SYM) {
+        object_post((t_object *)x, "usage: record <file>");
+        return;
+    }
+    mpr_device_record_stop(x);
+    path = atom_getsym(argv)->s_name;
+    if (!(capture = capture_open(path))) {
+        object_post((t_object *)x, "could not open capture file '%s'", path);
+        return;
+    }
+    for (ptrs = x->sigs; ptrs; ptrs = ptrs->next)
+        capture_sig(capture, ptrs->sig);
+    mpr_device_set_capture(x, capture);
+    object_post((t_object *)x, "recording to '%s'", path);
+}
+
+static void mpr_device_record_stop(t_mpr_device *x)
+{
+    t_capture *capture = x->capture;
+    uint32_t records, dropped;
+
+    if (!capture)
+        return;
+    mpr_device_set_capture(x, 0);
+    records = capture_close(capture, &dropped);
+    if (dropped)
+        object_post((t_object *)x, "recorded %u records, %u dropped", records, dropped);
+    else
+        object_post((t_object *)x, "recorded %u records", records);
+}
+
+// *********************************************************
+// -(traffic playback)--------------------------------------
+static void *mpr_device_play_sig(void *ctx, const t_capture_record *r,
+                                 const char *name, int *dir)
+{
+    t_mpr_device *x = (t_mpr_device *)ctx;
+    t_mpr_ptrs *ptrs;
+    for (ptrs = x->sigs; ptrs; ptrs = ptrs->next) {
+        if (strcmp(mpr_obj_get_prop_as_str(ptrs->sig, MPR_PROP_NAME, NULL), name) == 0)
+            break;
+    }
+    if (!ptrs || mpr_obj_get_prop_as_int32(ptrs->sig, MPR_PROP_LEN, NULL) != (int)r->len)
+        return 0;
+    *dir = mpr_obj_get_prop_as_int32(ptrs->sig, MPR_PROP_DIR, NULL);
+    return ptrs;
+}
+
+static void mpr_device_play_update(void *ctx, void *target, int dir,
+                                   const t_capture_record *r)
+{
+    // values are used in place in the mapped log
+    t_mpr_ptrs *ptrs = (t_mpr_ptrs *)target;
+    const void *val = CAPTURE_UPDATE == r->kind ? (const void *)(r + 1) : 0;
+    mpr_time now;
+
+    if (MPR_DIR_OUT == dir) {
+        if (val)
+            mpr_sig_set_value(ptrs->sig, r->inst, r->len, r->type, val);
+        else
+            mpr_sig_release_inst(ptrs->sig, r->inst);
+    }
+    else if (val ? (MPR_FLT == r->type || MPR_INT32 == r->type)
+                 : mpr_sig_get_num_inst(ptrs->sig, MPR_STATUS_ALL) > 1) {
+        // deliver as if received
+        mpr_time_set(&now, MPR_NOW);
+        mpr_device_sig_handler(ptrs->sig, val ? MPR_SIG_UPDATE : MPR_SIG_REL_UPSTRM,
+                               r->inst, r->len, r->type, val, now);
+    }
+}
+
+static void mpr_device_play_tick(t_mpr_device *x)
+{
+    double next;
+
+    if (!x->play)
+        return;
+    critical_enter(0);
+    next = capture_play(x->play, mpr_device_play_sig, mpr_device_play_update, x);
+    critical_exit(0);
+    if (next < 0)
+        mpr_device_play_stop(x, 1);
+    else
+        clock_fdelay(x->play_clock, next > 0 ? next * 1000 : INTERVAL);
+}
+
+static void mpr_device_play(t_mpr_device *x, t_symbol *s, long argc, t_atom *argv)
+{
+    /* 'play <file> [@speed <x>]' replays a log written by 'record'. Values
+     * recorded for a signal that is an output of this device are sent again,
+     * those for an input are output as if received. Timetags are followed,
+     * scaled by speed; speed 0 plays the log as fast as possible. */
+    const char *path;
+    double speed = 1;
+
+    if (argc < 1 || argv->a_type != A_SYM) {
+        object_post((t_object *)x, "usage: play <file> [@speed <x>]");
+        return;
+    }
+    if (argc == 3 && atom_strcmp(argv + 1, "@speed") == 0 && argv[2].a_type != A_SYM)
+        speed = atom_getfloat(argv + 2);
+    mpr_device_play_stop(x, 0);
+    path = atom_getsym(argv)->s_name;
+    if (!(x->play = capture_player_open(path, speed))) {
+        object_post((t_object *)x, "could not read capture file '%s'", path);
+        return;
+    }
+    if (!x->play_clock)
+        x->play_clock = clock_new(x, (method)mpr_device_play_tick);
+    mpr_device_play_tick(x);
+}
+
+static void mpr_device_play_stop(t_mpr_device *x, int done)
+{
+    /* Outputs 'play done <updates> <ms>' when the end of the log is
+     * reached. */
+    t_capture_player *play = x->play;
+    mpr_time now;
+
+    if (!play)
+        return;
+    x->play = 0;
+    clock_unset(x->play_clock);
+    if (play->skipped)
+        object_post((t_object *)x, "skipped %u updates of signals missing from this device",
+                    play->skipped);
+    if (done) {
+        mpr_time_set(&now, MPR_NOW);
+        atom_setsym(x->buffer, gensym("done"));
+        atom_setlong(x->buffer + 1, play->played);
+        atom_setfloat(x->buffer + 2, play->started
+                      ? mpr_time_get_diff(now, play->start) * 1000 : 0);
+        outlet_anything(x->outlet, gensym("play"), 3, x->buffer);
+    }
+    capture_player_close(play);
+}
+
+static void mpr_device_stop(t_mpr_device *x)
+{
+    mpr_device_play_stop(x, 0);
+    mpr_device_record_stop(x);
 }
 
+// *********************************************************
+// -(definition export)-------------------------------------
+static void mpr_device_write(t_mpr_device *x, t_symbol *s, long argc, t_atom *argv)
+{
+    /* 'write <file>' saves the signals of the attached mpr.in and mpr.out
+     * objects as a JSON device definition, which a mapper object can load
+     * with @definition. */
+    const char *path;
+    int count;
+
+    if (argc != 1 || argv->a_type != A_SYM) {
+        object_post((t_object *)x, "usage: write <file>");
+        return;
+    }
+    path = atom_getsym(argv)->s_name;
+    if ((count = definition_write(path, x->device, x->name)) < 0)
+        object_post((t_object *)x, "could not write definition to '%s'", path);
+    else
+        object_post((t_object *)x, "wrote %d signals to '%s'", count, path);
+}
+
+// *********************************************************
+// -(load maps)---------------------------------------------
+static void mpr_device_maps(t_mpr_device *x, t_symbol *s, long argc, t_atom *argv)
+{
+    /* 'maps load <file>' creates the maps listed in a JSON mapping file in
+     * one batch, between any signals the device's graph knows about; maps
+     * between devices it has not heard from yet wait for them to appear. */
+    const char *path;
+    t_definition *d;
+    t_mapping_map *maps = 0;
+    t_mapping_result r;
+    mpr_time start, end;
+    int count, i, waiting = 0;
+
+    if (argc != 2 || atom_strcmp(argv, "load") || argv[1].a_type != A_SYM) {
+        object_post((t_object *)x, "usage: maps load <file>");
+        return;
+    }
+    path = atom_get_string(argv + 1);
+    // a new file replaces the maps still waiting from the last one
+    mpr_device_maps_stop(x);
+    mpr_time_set(&start, MPR_NOW);
+    if ((count = mapping_read(path, &maps, &d, &r)) > 0) {
+        critical_enter(0);
+        waiting = mapping_create_all(x->graph, d, maps, count, 1, &r);
+        mpr_time_set(&end, MPR_NOW);
+        if (waiting && !(x->maps_load = mapping_load_new(x->graph, path, d, maps, waiting, end))) {
+            for (i = 0; i < waiting; i++)
+                mapping_fail(d, &maps[i], "out of memory", &r);
+            waiting = 0;
+        }
+        critical_exit(0);
+    }
+    mpr_time_set(&end, MPR_NOW);
+    if (!x->maps_load)
+        mapping_close(d, maps);
+    if (r.error) {
+        if (r.line)
+            object_post((t_object *)x, "error loading maps from '%s', line %d: %s", path,
+                        r.line, r.error);
+        else
+            object_post((t_object *)x, "error loading maps from '%s': %s", path, r.error);
+        return;
+    }
+    object_post((t_object *)x, "created %d maps from '%s', %d failed, %d waiting for their "
+                "devices, in %.2f ms", r.created, path, r.failed, waiting,
+                mpr_time_get_diff(end, start) * 1000.);
+    if (r.failed)
+        object_post((t_object *)x, "first failed map, line %d: %s", r.line, r.failure);
+}
+
+static void mpr_device_maps_poll(t_mpr_device *x, mpr_time now)
+{
+    t_mapping_result r;
+    int changed, pending;
+
+    critical_enter(0);
+    changed = mapping_load_poll(x->maps_load, now, &r);
+    pending = x->maps_load->num_pending;
+    critical_exit(0);
+    if (!changed)
+        return;
+    if (r.error)
+        object_post((t_object *)x, "error loading maps from '%s': %s", x->maps_load->path,
+                    r.error);
+    else if (r.created || r.failed)
+        object_post((t_object *)x, "created %d more maps from '%s', %d failed, %d waiting "
+                    "for their devices", r.created, x->maps_load->path, r.failed, pending);
+    if (r.failed)
+        object_post((t_object *)x, "first failed map, line %d: %s", r.line, r.failure);
+    if (!pending)
+        mpr_device_maps_stop(x);
+}
+
+static void mpr_device_maps_stop(t_mpr_device *x)
+{
+    if (!x->maps_load)
+        return;
+    critical_enter(0);
+    // the session may still need the graph's subscription
+    mapping_load_free(x->maps_load, x->session && x->session->subscribed);
+    critical_exit(0);
+    x->maps_load = 0;
+}
+
+// *********************************************************
+// -(device identity)---------------------------------------
+// once the device is ready, save what it claimed if that changed
+static void mpr_device_save_identity(t_mpr_device *x)
+{
+    char previous[IDENTITY_MAX_NAME];
+
+    snprintf(previous, IDENTITY_MAX_NAME, "%s", x->claimed.name);
+    if (!identity_update(&x->claimed, x->device))
+        return;
+    if (*previous && strcmp(previous, x->claimed.name))
+        object_post((t_object *)x, "could not reclaim '%s', now '%s'", previous,
+                    x->claimed.name);
+    if (!identity_write(x->identity, &x->claimed))
+        object_post((t_object *)x, "could not save identity to '%s'", x->identity);
+}
+
+// *********************************************************
+// -(map session)-------------------------------------------
+static void mpr_device_session_poll(t_mpr_device *x, mpr_time now)
+{
+    int created, due, pending, subscribed;
+
+    critical_enter(0);
+    subscribed = x->session->subscribed;
+    due = session_poll(x->session, now, &created);
+    pending = x->session->num_pending;
+    // the session drops the graph's subscription once its maps are restored
+    if (subscribed && !x->session->subscribed && x->maps_load)
+        mpr_graph_subscribe(x->graph, NULL, MPR_DEV | MPR_SIG, -1);
+    critical_exit(0);
+    if (created)
+        object_post((t_object *)x, "restored %d maps, %d not established yet",
+                    created, pending);
+    if (due)
+        defer_low((t_object *)x, (method)mpr_device_save_session, NULL, 0, NULL);
+}
+
+static void mpr_device_save_session(t_mpr_device *x)
+{
+    char *text;
+    int count;
+
+    critical_enter(0);
+    text = session_format(x->session, &count);
+    critical_exit(0);
+    if (!text || !session_write(x->session_path, text))
+        object_post((t_object *)x, "could not save maps to '%s'", x->session_path);
+    free(text);
+}
 
 // *********************************************************
 // some helper functions
@@ -29,6 +29,10 @@
 
 #include <unistd.h>
 
+#include "../common/block.h"
+#include "../common/qos.h"
+#include "../common/sigdata.h"
+
 #define MAX_LIST 256
 
 // *********************************************************
@@ -51,14 +55,9 @@ typedef struct _mpr_in
     long                connect_state;
     int                 length;
     char                type;
+    t_block             block;          // lists sent as blocks of samples
 } t_mpr_in;
 
-typedef struct _mpr_ptrs
-{
-    int                 num_objs;
-    t_object            **objs;
-} t_mpr_ptrs;
-
 // *********************************************************
 // -(function prototypes)-----------------------------------
 static void *mpr_in_new(t_symbol *s, int argc, t_atom *argv);
@@ -74,6 +73,7 @@ static void mpr_in_int(t_mpr_in *x, long i);
 static void mpr_in_float(t_mpr_in *x, double f);
 static void mpr_in_list(t_mpr_in *x, t_symbol *s, int argc, t_atom *argv);
 static void mpr_in_release(t_mpr_in *x);
+static void mpr_in_timetags(t_mpr_in *x, t_symbol *s, int argc, t_atom *argv);
 static void mpr_in_anything(t_mpr_in *x, t_symbol *s, int argc, t_atom *argv);
 
 t_max_err mpr_in_instance_get(t_mpr_in *x, t_object *attr, long *argc, t_atom **argv);
@@ -102,6 +102,7 @@ int main(void)
     class_addmethod(c, (method)mpr_in_float, "float", A_FLOAT, 0);
     class_addmethod(c, (method)mpr_in_list, "list", A_GIMME, 0);
     class_addmethod(c, (method)mpr_in_release, "release", 0);
+    class_addmethod(c, (method)mpr_in_timetags, "timetags", A_GIMME, 0);
     class_addmethod(c, (method)mpr_in_anything, "anything", A_GIMME, 0);
     class_addmethod(c, (method)add_to_hashtab, "add_to_hashtab", A_CANT, 0);
     class_addmethod(c, (method)remove_from_hashtab, "remove_from_hashtab", A_CANT, 0);
@@ -159,6 +160,7 @@ static void *mpr_in_new(t_symbol *s, int argc, t_atom *argv)
         x->instance_id = 0;
         x->is_instanced = 0;
         x->connect_state = 0;
+        block_init(&x->block);
 
         if (argc >= 3 && (argv+2)->a_type == A_LONG) {
             x->sig_length = atom_getlong(argv+2);
@@ -191,33 +193,12 @@ static void mpr_in_free(t_mpr_in *x)
 {
     if (x->is_instanced) {
         // need to remove self from instance user_data
-        t_mpr_ptrs *ptrs = mpr_sig_get_inst_data(x->sig_ptr, x->instance_id);
-        if (ptrs && ptrs->num_objs > 0) {
-            int i, found = 0;
-            for (i = 0; i < ptrs->num_objs; i++) {
-                if (found) {
-                    ptrs->objs[i-1] = ptrs->objs[i];
-                }
-                else if (ptrs->objs[i] == (void*)x) {
-                    found = 1;
-                }
-            }
-            if (found) {
-                --ptrs->num_objs;
-                if (ptrs->num_objs <= 0) {
-                        // also free struct
-                    free(ptrs);
-                    mpr_sig_set_inst_data(x->sig_ptr, x->instance_id, NULL);
-                }
-                else {
-                    ptrs->objs = realloc(ptrs->objs, (ptrs->num_objs) * sizeof(t_object *));
-                }
-            }
-        }
+        sigdata_inst_detach(x->sig_ptr, x->instance_id, (t_object *)x);
     }
     remove_from_hashtab(x);
     if (x->args)
         object_free(x->args);
+    block_free(&x->block);
 }
 
 void mpr_in_loadbang(t_mpr_in *x)
@@ -365,19 +346,39 @@ void parse_extra_properties(t_mpr_in *x, int argc, t_atom *argv)
                 mpr_sig_remove_inst(x->sig_ptr, 0);
                 x->is_instanced = 1;
             }
-            t_mpr_ptrs *ptrs = mpr_sig_get_inst_data(x->sig_ptr, x->instance_id);
-            if (!ptrs) {
-                ptrs = (t_mpr_ptrs *)malloc(sizeof(struct _mpr_ptrs));
-                ptrs->objs = (t_object **)malloc(sizeof(t_object *));
-                ptrs->num_objs = 1;
-                ptrs->objs[0] = (void*)x;
-                mpr_sig_reserve_inst(x->sig_ptr, 1, &x->instance_id, (void **)&ptrs);
+            if (!sigdata_inst_attach(x->sig_ptr, &x->instance_id, (t_object *)x))
+                object_post((t_object *)x, "Could not attach to instance!");
+        }
+        else if (strcmp(prop_name, "rate") == 0) {
+            if (type != A_LONG && type != A_FLOAT) {
+                object_post((t_object*)x, "rate value must be a number");
+                i += length;
+                continue;
             }
-            else {
-                ptrs->objs = realloc(ptrs->objs, (ptrs->num_objs+1) * sizeof(t_object *));
-                ptrs->objs[ptrs->num_objs] = (void*)x;
-                ptrs->num_objs++;
+            // the declared rate also sets the spacing of samples sent as a block
+            float rate = atom_coerce_float(argv + i);
+            mpr_obj_set_prop(x->sig_ptr, MPR_PROP_RATE, NULL, 1, MPR_FLT, &rate, 1);
+            x->block.sample_period = rate > 0 ? 1.0 / rate : 0;
+        }
+        else if (strcmp(prop_name, "block") == 0) {
+            if (type != A_LONG && type != A_FLOAT) {
+                object_post((t_object*)x, "block value must be an integer");
+                i += length;
+                continue;
             }
+            // ask the device to gather this many received samples into one list
+            x->block.gather = atom_coerce_int(argv + i);
+            object_method(x->dev_obj, gensym("set_block"), x->sig_ptr, x->block.gather);
+        }
+        else if (strcmp(prop_name, "priority") == 0) {
+            long priority = type == A_SYM ? qos_parse(atom_get_string(argv + i)) : -1;
+            if (priority < 0) {
+                object_post((t_object*)x, "priority value must be high, normal or low");
+                i += length;
+                continue;
+            }
+            // the device decides when received values are output
+            object_method(x->dev_obj, gensym("set_priority"), x->sig_ptr, priority);
         }
         else if (   strcmp(prop_name, "minimum") == 0 || strcmp(prop_name, "min") == 0
                  || strcmp(prop_name, "maximum") == 0 || strcmp(prop_name, "max") == 0) {
@@ -470,6 +471,9 @@ t_max_err set_sig_ptr(t_mpr_in *x, t_object *attr, long argc, t_atom *argv)
         t_atom *atoms;
         atomarray_getatoms(x->args, &num_atoms, &atoms);
         parse_extra_properties(x, num_atoms, atoms);
+        // a block set by a later message is not among the cached arguments
+        if (x->block.gather)
+            object_method(x->dev_obj, gensym("set_block"), x->sig_ptr, x->block.gather);
     }
     return 0;
 }
@@ -516,10 +520,11 @@ static void mpr_in_float(t_mpr_in *x, double d)
 // -(set list input)----------------------------------------
 static void mpr_in_list(t_mpr_in *x, t_symbol *s, int argc, t_atom *argv)
 {
-    int i;
+    int num_samps;
+    mpr_type type = x->type == 'i' ? MPR_INT32 : MPR_FLT;
     void *value = 0;
 
-    if (check_ptrs(x) || !argc)
+    if (check_ptrs(x) || !argc || (x->type != 'i' && x->type != 'f'))
         return;
 
     if (argc < x->length || (argc % x->length) != 0) {
@@ -527,43 +532,26 @@ static void mpr_in_list(t_mpr_in *x, t_symbol *s, int argc, t_atom *argv)
                     x->length);
         return;
     }
+    num_samps = argc / x->length;
 
-    if (x->type == 'i') {
-        int payload[argc];
-        value = &payload;
-        for (i = 0; i < argc; i++) {
-            if ((argv+i)->a_type == A_FLOAT)
-                payload[i] = (int)atom_getfloat(argv+i);
-            else if ((argv+i)->a_type == A_LONG)
-                payload[i] = (int)atom_getlong(argv+i);
-            else {
-                object_post((t_object *)x, "Illegal data type in list!");
-                return;
-            }
-        }
-        //update signal
-        critical_enter(0);
-        mpr_sig_set_value(x->sig_ptr, x->instance_id, argc, MPR_INT32, value);
-        critical_exit(0);
-    }
-    else if (x->type == 'f') {
-        float payload[argc];
-        value = &payload;
-        for (i = 0; i < argc; i++) {
-            if ((argv+i)->a_type == A_FLOAT)
-                payload[i] = atom_getfloat(argv+i);
-            else if ((argv+i)->a_type == A_LONG)
-                payload[i] = (float)atom_getlong(argv+i);
-            else {
-                object_post((t_object *)x, "Illegal data type in list!");
-                return;
-            }
-        }
-        //update signal
-        critical_enter(0);
-        mpr_sig_set_value(x->sig_ptr, x->instance_id, argc, MPR_FLT, value);
-        critical_exit(0);
-    }
+    if (!(value = block_payload(&x->block, (t_object *)x, x->type, argc, argv)))
+        return;
+
+    //update signal
+    critical_enter(0);
+    if (num_samps > 1)
+        block_send(&x->block, x->sig_ptr, x->instance_id, x->length, num_samps,
+                   type, value, 0, 0);
+    else
+        mpr_sig_set_value(x->sig_ptr, x->instance_id, argc, type, value);
+    critical_exit(0);
+}
+
+// *********************************************************
+// -(set timetags for next block)---------------------------
+static void mpr_in_timetags(t_mpr_in *x, t_symbol *s, int argc, t_atom *argv)
+{
+    block_set_timetags(&x->block, (t_object *)x, argc, argv);
 }
 
 // *********************************************************
@@ -616,19 +604,8 @@ t_max_err mpr_in_instance_set(t_mpr_in *x, t_object *attr, long argc, t_atom *ar
         mpr_sig_remove_inst(x->sig_ptr, 0);
         x->is_instanced = 1;
     }
-    t_mpr_ptrs *ptrs = mpr_sig_get_inst_data(x->sig_ptr, x->instance_id);
-    if (!ptrs) {
-        ptrs = (t_mpr_ptrs *)malloc(sizeof(struct _mpr_ptrs));
-        ptrs->objs = (t_object **)malloc(sizeof(t_object *));
-        ptrs->num_objs = 1;
-        ptrs->objs[0] = (void*)x;
-        mpr_sig_reserve_inst(x->sig_ptr, 1, &x->instance_id, (void **)&ptrs);
-    }
-    else {
-        ptrs->objs = realloc(ptrs->objs, (ptrs->num_objs+1) * sizeof(t_object *));
-        ptrs->objs[ptrs->num_objs] = (void*)x;
-        ptrs->num_objs++;
-    }
+    if (!sigdata_inst_attach(x->sig_ptr, &x->instance_id, (t_object *)x))
+        object_post((t_object *)x, "Could not attach to instance!");
     return 0;
 }
 
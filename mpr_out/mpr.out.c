@@ -29,6 +29,10 @@
 
 #include <unistd.h>
 
+#include "../common/capture.h"
+#include "../common/sigdata.h"
+#include "../common/block.h"
+
 #define MAX_LIST 256
 
 // *********************************************************
@@ -51,14 +55,14 @@ typedef struct _mpr_out
     long                connect_state;
     int                 length;
     char                type;
+    t_block             block;          // lists sent as blocks of samples
+    t_atom_long         updates;        // counters collected by mpr.device 'stats'
+    t_atom_long         bytes;
+    t_atom_long         dropped;
+    t_atom_long         releases;
+    t_capture           *capture;       // set by mpr.device while recording
 } t_mpr_out;
 
-typedef struct _mpr_ptrs
-{
-    int                 num_objs;
-    t_object            **objs;
-} t_mpr_ptrs;
-
 // *********************************************************
 // -(function prototypes)-----------------------------------
 static void *mpr_out_new(t_symbol *s, int argc, t_atom *argv);
@@ -66,6 +70,8 @@ static void mpr_out_free(t_mpr_out *x);
 
 static void add_to_hashtab(t_mpr_out *x, t_hashtab *ht);
 static void remove_from_hashtab(t_mpr_out *x);
+static void get_stats(t_mpr_out *x, t_atom_long *counts, long reset);
+static void set_capture(t_mpr_out *x, t_capture *capture);
 static t_max_err set_sig_ptr(t_mpr_out *x, t_object *attr, long argc, t_atom *argv);
 static t_max_err set_dev_obj(t_mpr_out *x, t_object *attr, long argc, t_atom *argv);
 
@@ -74,6 +80,7 @@ static void mpr_out_int(t_mpr_out *x, long i);
 static void mpr_out_float(t_mpr_out *x, double f);
 static void mpr_out_list(t_mpr_out *x, t_symbol *s, int argc, t_atom *argv);
 static void mpr_out_release(t_mpr_out *x);
+static void mpr_out_timetags(t_mpr_out *x, t_symbol *s, int argc, t_atom *argv);
 static void mpr_out_anything(t_mpr_out *x, t_symbol *s, int argc, t_atom *argv);
 
 t_max_err mpr_out_instance_get(t_mpr_out *x, t_object *attr, long *argc, t_atom **argv);
@@ -102,9 +109,12 @@ int main(void)
     class_addmethod(c, (method)mpr_out_float, "float", A_FLOAT, 0);
     class_addmethod(c, (method)mpr_out_list, "list", A_GIMME, 0);
     class_addmethod(c, (method)mpr_out_release, "release", 0);
+    class_addmethod(c, (method)mpr_out_timetags, "timetags", A_GIMME, 0);
     class_addmethod(c, (method)mpr_out_anything, "anything", A_GIMME, 0);
     class_addmethod(c, (method)add_to_hashtab, "add_to_hashtab", A_CANT, 0);
     class_addmethod(c, (method)remove_from_hashtab, "remove_from_hashtab", A_CANT, 0);
+    class_addmethod(c, (method)get_stats, "get_stats", A_CANT, 0);
+    class_addmethod(c, (method)set_capture, "set_capture", A_CANT, 0);
 
     CLASS_ATTR_SYM(c, "sig_name", ATTR_GET_OPAQUE_USER | ATTR_SET_OPAQUE_USER, t_mpr_out, sig_name);
     CLASS_ATTR_LONG(c, "sig_length", ATTR_GET_OPAQUE_USER | ATTR_SET_OPAQUE_USER, t_mpr_out, sig_length);
@@ -159,6 +169,9 @@ static void *mpr_out_new(t_symbol *s, int argc, t_atom *argv)
         x->instance_id = 0;
         x->is_instanced = 0;
         x->connect_state = 0;
+        block_init(&x->block);
+        x->updates = x->bytes = x->dropped = x->releases = 0;
+        x->capture = 0;
 
         if (argc >= 3 && (argv+2)->a_type == A_LONG) {
             x->sig_length = atom_getlong(argv+2);
@@ -191,33 +204,12 @@ static void mpr_out_free(t_mpr_out *x)
 {
     if (x->is_instanced) {
         // need to remove self from instance user_data
-        t_mpr_ptrs *ptrs = mpr_sig_get_inst_data(x->sig_ptr, x->instance_id);
-        if (ptrs && ptrs->num_objs > 0) {
-            int i, found = 0;
-            for (i = 0; i < ptrs->num_objs; i++) {
-                if (found) {
-                    ptrs->objs[i-1] = ptrs->objs[i];
-                }
-                else if (ptrs->objs[i] == (void*)x) {
-                    found = 1;
-                }
-            }
-            if (found) {
-                --ptrs->num_objs;
-                if (ptrs->num_objs <= 0) {
-                    // also free struct
-                    free(ptrs);
-                    mpr_sig_set_inst_data(x->sig_ptr, x->instance_id, NULL);
-                }
-                else {
-                    ptrs->objs = realloc(ptrs->objs, (ptrs->num_objs) * sizeof(t_object *));
-                }
-            }
-        }
+        sigdata_inst_detach(x->sig_ptr, x->instance_id, (t_object *)x);
     }
     remove_from_hashtab(x);
     if (x->args)
         object_free(x->args);
+    block_free(&x->block);
 }
 
 void mpr_out_loadbang(t_mpr_out *x)
@@ -264,6 +256,27 @@ void remove_from_hashtab(t_mpr_out *x)
     x->connect_state = 0;
 }
 
+// *********************************************************
+// -(statistics)--------------------------------------------
+static void get_stats(t_mpr_out *x, t_atom_long *counts, long reset)
+{
+    // several objects may share a signal, so add to the device's totals
+    counts[0] += x->updates;
+    counts[1] += x->bytes;
+    counts[2] += x->dropped;
+    counts[3] += x->releases;
+    if (reset)
+        x->updates = x->bytes = x->dropped = x->releases = 0;
+}
+
+// *********************************************************
+// -(traffic capture)---------------------------------------
+static void set_capture(t_mpr_out *x, t_capture *capture)
+{
+    // called by mpr.device inside a critical section
+    x->capture = capture;
+}
+
 // *********************************************************
 // -(parse props from object arguments)---------------------
 void parse_extra_properties(t_mpr_out *x, int argc, t_atom *argv)
@@ -365,19 +378,29 @@ void parse_extra_properties(t_mpr_out *x, int argc, t_atom *argv)
                 mpr_sig_remove_inst(x->sig_ptr, 0);
                 x->is_instanced = 1;
             }
-            t_mpr_ptrs *ptrs = mpr_sig_get_inst_data(x->sig_ptr, x->instance_id);
-            if (!ptrs) {
-                ptrs = (t_mpr_ptrs *)malloc(sizeof(struct _mpr_ptrs));
-                ptrs->objs = (t_object **)malloc(sizeof(t_object *));
-                ptrs->num_objs = 1;
-                ptrs->objs[0] = (void*)x;
-                mpr_sig_reserve_inst(x->sig_ptr, 1, &x->instance_id, (void **)&ptrs);
+            if (!sigdata_inst_attach(x->sig_ptr, &x->instance_id, (t_object *)x))
+                object_post((t_object *)x, "Could not attach to instance!");
+        }
+        else if (strcmp(prop_name, "rate") == 0) {
+            if (type != A_LONG && type != A_FLOAT) {
+                object_post((t_object*)x, "rate value must be a number");
+                i += length;
+                continue;
             }
-            else {
-                ptrs->objs = realloc(ptrs->objs, (ptrs->num_objs+1) * sizeof(t_object *));
-                ptrs->objs[ptrs->num_objs] = (void*)x;
-                ptrs->num_objs++;
+            // the declared rate also sets the spacing of samples sent as a block
+            float rate = atom_coerce_float(argv + i);
+            mpr_obj_set_prop(x->sig_ptr, MPR_PROP_RATE, NULL, 1, MPR_FLT, &rate, 1);
+            x->block.sample_period = rate > 0 ? 1.0 / rate : 0;
+        }
+        else if (strcmp(prop_name, "block") == 0) {
+            if (type != A_LONG && type != A_FLOAT) {
+                object_post((t_object*)x, "block value must be an integer");
+                i += length;
+                continue;
             }
+            // ask the device to gather this many received samples into one list
+            x->block.gather = atom_coerce_int(argv + i);
+            object_method(x->dev_obj, gensym("set_block"), x->sig_ptr, x->block.gather);
         }
         else if (   strcmp(prop_name, "minimum") == 0 || strcmp(prop_name, "min") == 0
                  || strcmp(prop_name, "maximum") == 0 || strcmp(prop_name, "max") == 0) {
@@ -470,6 +493,9 @@ t_max_err set_sig_ptr(t_mpr_out *x, t_object *attr, long argc, t_atom *argv)
         t_atom *atoms;
         atomarray_getatoms(x->args, &num_atoms, &atoms);
         parse_extra_properties(x, num_atoms, atoms);
+        // a block set by a later message is not among the cached arguments
+        if (x->block.gather)
+            object_method(x->dev_obj, gensym("set_block"), x->sig_ptr, x->block.gather);
     }
     return 0;
 }
@@ -497,7 +523,14 @@ static void mpr_out_int(t_mpr_out *x, long l)
 
     critical_enter(0);
     mpr_sig_set_value(x->sig_ptr, x->instance_id, 1, MPR_INT32, &l);
+    if (x->capture) {
+        int i = (int)l;
+        capture_update(x->capture, MPR_DIR_OUT, x->sig_ptr, x->instance_id, 1,
+                       MPR_INT32, &i, MPR_NOW);
+    }
     critical_exit(0);
+    ++x->updates;
+    x->bytes += sizeof(int);
 }
 
 // *********************************************************
@@ -509,61 +542,67 @@ static void mpr_out_float(t_mpr_out *x, double d)
 
     critical_enter(0);
     mpr_sig_set_value(x->sig_ptr, x->instance_id, 1, MPR_DBL, &d);
+    if (x->capture)
+        capture_update(x->capture, MPR_DIR_OUT, x->sig_ptr, x->instance_id, 1,
+                       MPR_DBL, &d, MPR_NOW);
     critical_exit(0);
+    ++x->updates;
+    x->bytes += sizeof(float);
+}
+
+// *********************************************************
+// -(record a sample sent as part of a block)---------------
+static void capture_sample(void *context, mpr_sig sig, mpr_id inst, int len,
+                           mpr_type type, const void *val, mpr_time time)
+{
+    capture_update((t_capture *)context, MPR_DIR_OUT, sig, inst, len, type, val, time);
 }
 
 // *********************************************************
 // -(list input)--------------------------------------------
 static void mpr_out_list(t_mpr_out *x, t_symbol *s, int argc, t_atom *argv)
 {
-    int i;
+    int num_samps;
+    mpr_type type = x->type == 'i' ? MPR_INT32 : MPR_FLT;
     void *value = 0;
 
-    if (check_ptrs(x) || !argc)
+    if (check_ptrs(x) || !argc || (x->type != 'i' && x->type != 'f'))
         return;
 
     if (argc < x->length || (argc % x->length) != 0) {
         object_post((t_object *)x, "Illegal list length (expected factor of %i)",
                     x->length);
+        ++x->dropped;
         return;
     }
+    num_samps = argc / x->length;
 
-    if (x->type == 'i') {
-        int payload[argc];
-        value = &payload;
-        for (i = 0; i < argc; i++) {
-            if ((argv+i)->a_type == A_FLOAT)
-                payload[i] = (int)atom_getfloat(argv+i);
-            else if ((argv+i)->a_type == A_LONG)
-                payload[i] = (int)atom_getlong(argv+i);
-            else {
-                object_post((t_object *)x, "Illegal data type in list!");
-                return;
-            }
-        }
-        //update signal
-        critical_enter(0);
-        mpr_sig_set_value(x->sig_ptr, x->instance_id, argc, MPR_INT32, value);
-        critical_exit(0);
+    if (!(value = block_payload(&x->block, (t_object *)x, x->type, argc, argv))) {
+        ++x->dropped;
+        return;
     }
-    else if (x->type == 'f') {
-        float payload[argc];
-        value = &payload;
-        for (i = 0; i < argc; i++) {
-            if ((argv+i)->a_type == A_FLOAT)
-                payload[i] = atom_getfloat(argv+i);
-            else if ((argv+i)->a_type == A_LONG)
-                payload[i] = (float)atom_getlong(argv+i);
-            else {
-                object_post((t_object *)x, "Illegal data type in list!");
-                return;
-            }
-        }
-        //update signal
-        critical_enter(0);
-        mpr_sig_set_value(x->sig_ptr, x->instance_id, argc, MPR_FLT, value);
-        critical_exit(0);
+
+    //update signal
+    critical_enter(0);
+    if (num_samps > 1)
+        block_send(&x->block, x->sig_ptr, x->instance_id, x->length, num_samps,
+                   type, value, x->capture ? capture_sample : 0, x->capture);
+    else {
+        mpr_sig_set_value(x->sig_ptr, x->instance_id, argc, type, value);
+        if (x->capture)
+            capture_update(x->capture, MPR_DIR_OUT, x->sig_ptr, x->instance_id,
+                           argc, type, value, MPR_NOW);
     }
+    critical_exit(0);
+    x->updates += num_samps;
+    x->bytes += argc * sizeof(float);   // int32 and float are the same size
+}
+
+// *********************************************************
+// -(set timetags for next block)---------------------------
+static void mpr_out_timetags(t_mpr_out *x, t_symbol *s, int argc, t_atom *argv)
+{
+    block_set_timetags(&x->block, (t_object *)x, argc, argv);
 }
 
 // *********************************************************
@@ -589,7 +628,10 @@ static void mpr_out_release(t_mpr_out *x)
 
     critical_enter(0);
     mpr_sig_release_inst(x->sig_ptr, x->instance_id);
+    if (x->capture)
+        capture_update(x->capture, MPR_DIR_OUT, x->sig_ptr, x->instance_id, 0, 0, 0, MPR_NOW);
     critical_exit(0);
+    ++x->releases;
 }
 
 // *********************************************************
@@ -615,19 +657,8 @@ t_max_err mpr_out_instance_set(t_mpr_out *x, t_object *attr, long argc, t_atom *
         mpr_sig_remove_inst(x->sig_ptr, 0);
         x->is_instanced = 1;
     }
-    t_mpr_ptrs *ptrs = mpr_sig_get_inst_data(x->sig_ptr, x->instance_id);
-    if (!ptrs) {
-        ptrs = (t_mpr_ptrs *)malloc(sizeof(struct _mpr_ptrs));
-        ptrs->objs = (t_object **)malloc(sizeof(t_object *));
-        ptrs->num_objs = 1;
-        ptrs->objs[0] = (void*)x;
-        mpr_sig_reserve_inst(x->sig_ptr, 1, &x->instance_id, (void **)&ptrs);
-    }
-    else {
-        ptrs->objs = realloc(ptrs->objs, (ptrs->num_objs+1) * sizeof(t_object *));
-        ptrs->objs[ptrs->num_objs] = (void*)x;
-        ptrs->num_objs++;
-    }
+    if (!sigdata_inst_attach(x->sig_ptr, &x->instance_id, (t_object *)x))
+        object_post((t_object *)x, "Could not attach to instance!");
     return 0;
 }
 
@@ -0,0 +1,799 @@
+//
+// mpr.poly.c
+// a maxmsp external encapsulating the functionality of an instanced
+// libmapper input signal, allocating signal instances to poly~ voices
+// http://www.libmapper.org
+// Joseph Malloch, 2013-2020
+//
+// This software was written in the Graphics and Experiential Media (GEM) Lab at Dalhousie
+// University in Halifax and the Input Devices and Music Interaction Laboratory (IDMIL) at McGill
+// University in Montreal, and is copyright those found in the AUTHORS file.  It is licensed under
+// the GNU Lesser Public General License version 2.1 or later.  Please see COPYING for details.
+//
+
+// *********************************************************
+// -(Includes)----------------------------------------------
+
+#include "ext.h"            // standard Max include, always required
+#include "ext_obex.h"       // required for new style Max object
+#include "ext_critical.h"
+#include "jpatcher_api.h"
+#include <mapper/mapper.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifndef WIN32
+  #include <arpa/inet.h>
+#endif
+
+#include <unistd.h>
+
+#define MAX_LIST 256
+#define MAX_VOICES 1024
+
+enum {
+    POLY_STEAL_NONE,
+    POLY_STEAL_LRU,
+    POLY_STEAL_LOWEST,
+    POLY_STEAL_HIGHEST
+};
+
+// *********************************************************
+// -(voice struct)------------------------------------------
+typedef struct _poly_voice
+{
+    mpr_id              inst;       // instance currently using this voice
+    int                 prev;       // neighbours in least-recently-updated list
+    int                 next;
+    unsigned long       stamp;      // order of the latest update
+    int                 heap_pos;   // position in the value heap
+    float               value;      // first element of the latest update
+    char                active;
+    char                remote;     // allocated for a libmapper signal instance
+} t_poly_voice;
+
+// *********************************************************
+// -(object struct)-----------------------------------------
+typedef struct _mpr_poly
+{
+    t_object            ob;
+    void                *outlet;
+    void                *outlet2;
+    t_symbol            *sig_name;
+    long                sig_length;
+    char                sig_type;
+    mpr_dev             dev_obj;
+    mpr_sig             sig_ptr;
+    t_symbol            *myobjname;
+    t_object            *patcher;
+    t_hashtab           *ht;
+    long                connect_state;
+    int                 length;
+    char                type;
+
+    // voice allocator
+    int                 num_voices;
+    int                 num_active;
+    t_poly_voice        *voices;
+    int                 *free_voices;   // stack of unused voice indices
+    int                 num_free;
+    int                 *table;         // instance id -> voice index, open addressing
+    int                 table_mask;
+    // voices of list input [0] and of signal instances [1] are kept apart, so
+    // that an instance overflow finds its victim without passing the others
+    int                 lru_head[2];    // least recently updated
+    int                 lru_tail[2];    // most recently updated
+    unsigned long       stamp;
+    int                 *heap[2];       // ordered by value, next victim first
+    int                 heap_size[2];
+    int                 steal;
+    long                mute;
+    long                num_stolen;
+    long                num_dropped;
+    t_atom              buffer[MAX_LIST];
+} t_mpr_poly;
+
+// *********************************************************
+// -(function prototypes)-----------------------------------
+static void *mpr_poly_new(t_symbol *s, int argc, t_atom *argv);
+static void mpr_poly_free(t_mpr_poly *x);
+
+static void add_to_hashtab(t_mpr_poly *x, t_hashtab *ht);
+static void remove_from_hashtab(t_mpr_poly *x);
+static t_max_err set_sig_ptr(t_mpr_poly *x, t_object *attr, long argc, t_atom *argv);
+static t_max_err set_dev_obj(t_mpr_poly *x, t_object *attr, long argc, t_atom *argv);
+
+static void mpr_poly_loadbang(t_mpr_poly *x);
+static void mpr_poly_list(t_mpr_poly *x, t_symbol *s, int argc, t_atom *argv);
+static void mpr_poly_release(t_mpr_poly *x, t_symbol *s, int argc, t_atom *argv);
+static void mpr_poly_clear(t_mpr_poly *x);
+static void mpr_poly_stealing(t_mpr_poly *x, t_symbol *s, int argc, t_atom *argv);
+static void mpr_poly_sig_event(t_mpr_poly *x, mpr_sig sig, long evt, mpr_id inst,
+                               long len, long type, const void *val);
+
+static int voice_lookup(t_mpr_poly *x, mpr_id inst);
+static int voice_alloc(t_mpr_poly *x, mpr_id inst, int remote);
+static void voice_release(t_mpr_poly *x, int v);
+static int voice_victim(t_mpr_poly *x, int remote);
+static void voice_update(t_mpr_poly *x, int v, long len, char type, const void *val);
+
+static int atom_strcmp(t_atom *a, const char *string);
+static const char *atom_get_string(t_atom *a);
+static int atom_coerce_int(t_atom *a);
+
+// *********************************************************
+// -(global class pointer variable)-------------------------
+static void *mpr_poly_class;
+static t_symbol *ps_target, *ps_on, *ps_off, *ps_mute, *ps_overflow, *ps_stolen;
+
+// *********************************************************
+// -(main)--------------------------------------------------
+int main(void)
+{
+    t_class *c;
+    c = class_new("mpr.poly", (method)mpr_poly_new, (method)mpr_poly_free,
+                  (long)sizeof(t_mpr_poly), 0L, A_GIMME, 0);
+
+    class_addmethod(c, (method)mpr_poly_loadbang, "loadbang", 0);
+    class_addmethod(c, (method)mpr_poly_list, "list", A_GIMME, 0);
+    class_addmethod(c, (method)mpr_poly_release, "release", A_GIMME, 0);
+    class_addmethod(c, (method)mpr_poly_clear, "clear", 0);
+    class_addmethod(c, (method)mpr_poly_stealing, "stealing", A_GIMME, 0);
+    class_addmethod(c, (method)mpr_poly_sig_event, "sig_event", A_CANT, 0);
+    class_addmethod(c, (method)add_to_hashtab, "add_to_hashtab", A_CANT, 0);
+    class_addmethod(c, (method)remove_from_hashtab, "remove_from_hashtab", A_CANT, 0);
+
+    CLASS_ATTR_SYM(c, "sig_name", ATTR_GET_OPAQUE_USER | ATTR_SET_OPAQUE_USER, t_mpr_poly, sig_name);
+    CLASS_ATTR_LONG(c, "sig_length", ATTR_GET_OPAQUE_USER | ATTR_SET_OPAQUE_USER, t_mpr_poly, sig_length);
+    CLASS_ATTR_CHAR(c, "sig_type", ATTR_GET_OPAQUE_USER | ATTR_SET_OPAQUE_USER, t_mpr_poly, sig_type);
+    CLASS_ATTR_OBJ(c, "dev_obj", ATTR_GET_OPAQUE_USER | ATTR_SET_OPAQUE_USER, t_mpr_poly, dev_obj);
+    CLASS_ATTR_ACCESSORS(c, "dev_obj", 0, set_dev_obj);
+    CLASS_ATTR_OBJ(c, "sig_ptr", ATTR_GET_OPAQUE_USER | ATTR_SET_OPAQUE_USER, t_mpr_poly, sig_ptr);
+    CLASS_ATTR_ACCESSORS(c, "sig_ptr", 0, set_sig_ptr);
+
+    CLASS_ATTR_LONG(c, "mute", 0, t_mpr_poly, mute);
+
+    class_register(CLASS_BOX, c); /* CLASS_NOBOX */
+    mpr_poly_class = c;
+
+    ps_target = gensym("target");
+    ps_on = gensym("on");
+    ps_off = gensym("off");
+    ps_mute = gensym("mute");
+    ps_overflow = gensym("overflow");
+    ps_stolen = gensym("stolen");
+    return 0;
+}
+
+static void mpr_poly_usage()
+{
+    post("usage: [mpr.poly <signal-name> <datatype> <opt: vectorlength> "
+         "@voices <count> @stealing <none|lru|lowest|highest>]");
+}
+
+// *********************************************************
+// -(new)---------------------------------------------------
+static void *mpr_poly_new(t_symbol *s, int argc, t_atom *argv)
+{
+    t_mpr_poly *x = NULL;
+    long i = 0;
+    int voices = 8, size;
+
+    if (argc < 2) {
+        mpr_poly_usage();
+        return 0;
+    }
+    if ((argv)->a_type != A_SYM || (argv+1)->a_type != A_SYM) {
+        mpr_poly_usage();
+        return 0;
+    }
+
+    if ((x = (t_mpr_poly *)object_alloc(mpr_poly_class))) {
+        x->outlet2 = listout((t_object *)x);
+        x->outlet = listout((t_object *)x);
+
+        x->sig_name = gensym(atom_getsym(argv)->s_name);
+
+        char *temp = atom_getsym(argv+1)->s_name;
+        x->sig_type = temp[0];
+        if (x->sig_type != 'i' && x->sig_type != 'f')
+            return 0;
+
+        x->sig_ptr = 0;
+        x->length = 0;
+        x->connect_state = 0;
+        x->steal = POLY_STEAL_NONE;
+        x->num_voices = 0;
+        x->mute = 0;
+        x->num_stolen = 0;
+        x->num_dropped = 0;
+
+        if (argc >= 3 && (argv+2)->a_type == A_LONG) {
+            x->sig_length = atom_getlong(argv+2);
+            if (x->sig_length > 100) {
+                post("vector lengths > 100 not currently supported.");
+                return 0;
+            }
+            i = 3;
+        }
+        else {
+            x->sig_length = 1;
+            i = 2;
+        }
+
+        for (; i < argc - 1; i++) {
+            if (atom_strcmp(argv+i, "@voices") == 0) {
+                voices = atom_coerce_int(argv+i+1);
+                i++;
+            }
+            else if (atom_strcmp(argv+i, "@stealing") == 0) {
+                mpr_poly_stealing(x, NULL, 1, argv+i+1);
+                i++;
+            }
+            else if (atom_strcmp(argv+i, "@mute") == 0) {
+                x->mute = atom_coerce_int(argv+i+1);
+                i++;
+            }
+        }
+        if (voices < 1 || voices > MAX_VOICES) {
+            post("number of voices must be between 1 and %d.", MAX_VOICES);
+            return 0;
+        }
+
+        // allocate all voice bookkeeping up front so that voice allocation
+        // and release never touch the heap
+        x->num_voices = voices;
+        x->voices = (t_poly_voice *)malloc(voices * sizeof(t_poly_voice));
+        x->free_voices = (int *)malloc(voices * sizeof(int));
+        for (size = 2; size < voices * 2; size <<= 1) {};
+        x->table = (int *)malloc(size * sizeof(int));
+        x->table_mask = size - 1;
+        x->heap[0] = (int *)malloc(voices * sizeof(int));
+        x->heap[1] = (int *)malloc(voices * sizeof(int));
+        x->num_active = 0;
+        mpr_poly_clear(x);
+
+        // cache the registered name so we can remove self from hashtab later
+        x = object_register(CLASS_BOX, x->myobjname = symbol_unique(), x);
+
+        x->patcher = (t_object *)gensym("#P")->s_thing;
+        mpr_poly_loadbang(x);
+    }
+    return (x);
+}
+
+// *********************************************************
+// -(free)--------------------------------------------------
+static void mpr_poly_free(t_mpr_poly *x)
+{
+    remove_from_hashtab(x);
+    if (x->voices)
+        free(x->voices);
+    if (x->free_voices)
+        free(x->free_voices);
+    if (x->table)
+        free(x->table);
+    if (x->heap[0])
+        free(x->heap[0]);
+    if (x->heap[1])
+        free(x->heap[1]);
+}
+
+void mpr_poly_loadbang(t_mpr_poly *x)
+{
+    t_hashtab *ht;
+
+    if (!x->patcher)
+        return;
+
+    t_object *patcher = x->patcher;
+    while (patcher) {
+        object_obex_lookup(patcher, gensym("mprhash"), (t_object **)&ht);
+        if (ht) {
+            add_to_hashtab(x, ht);
+            break;
+        }
+        patcher = jpatcher_get_parentpatcher(patcher);
+    }
+}
+
+void add_to_hashtab(t_mpr_poly *x, t_hashtab *ht)
+{
+    if (x->connect_state) {
+        // already registered
+        return;
+    }
+
+    // store self in the hashtab. IMPORTANT: set the OBJ_FLAG_REF flag so the
+    // hashtab knows not to free us when it is freed.
+    hashtab_storeflags(ht, x->myobjname, (t_object *)x, OBJ_FLAG_REF);
+    x->ht = ht;
+    x->connect_state = 1;
+}
+
+void remove_from_hashtab(t_mpr_poly *x)
+{
+    if (x->ht) {
+        hashtab_chuckkey(x->ht, x->myobjname);
+        x->ht = NULL;
+    }
+    x->dev_obj = 0;
+    x->sig_ptr = 0;
+    x->length = 0;
+    x->connect_state = 0;
+}
+
+// *********************************************************
+// -(set the device pointer)--------------------------------
+t_max_err set_dev_obj(t_mpr_poly *x, t_object *attr, long argc, t_atom *argv)
+{
+    x->dev_obj = (t_object *)argv->a_w.w_obj;
+    return 0;
+}
+
+// *********************************************************
+// -(set the signal pointer)--------------------------------
+t_max_err set_sig_ptr(t_mpr_poly *x, t_object *attr, long argc, t_atom *argv)
+{
+    x->sig_ptr = (mpr_sig)argv->a_w.w_obj;
+    if (x->sig_ptr) {
+        /* Reserve one signal instance per voice; libmapper will report an
+         * overflow once they are all in use, at which point we steal. */
+        int one = 1;
+        mpr_obj_set_prop(x->sig_ptr, MPR_PROP_USE_INST, NULL, 1, MPR_BOOL, &one, 1);
+        mpr_sig_remove_inst(x->sig_ptr, 0);
+        mpr_sig_reserve_inst(x->sig_ptr, x->num_voices, 0, 0);
+        x->length = mpr_obj_get_prop_as_int32(x->sig_ptr, MPR_PROP_LEN, NULL);
+        x->type = mpr_obj_get_prop_as_int32(x->sig_ptr, MPR_PROP_TYPE, NULL);
+        critical_enter(0);
+        mpr_obj_push(x->sig_ptr);
+        critical_exit(0);
+    }
+    return 0;
+}
+
+// *********************************************************
+// -(voice allocator)---------------------------------------
+
+static inline int hash_id(t_mpr_poly *x, mpr_id inst)
+{
+    inst ^= inst >> 33;
+    inst *= 0xff51afd7ed558ccdULL;
+    inst ^= inst >> 33;
+    return (int)(inst & x->table_mask);
+}
+
+static int voice_lookup(t_mpr_poly *x, mpr_id inst)
+{
+    int slot = hash_id(x, inst);
+    while (x->table[slot] >= 0) {
+        if (x->voices[x->table[slot]].inst == inst)
+            return x->table[slot];
+        slot = (slot + 1) & x->table_mask;
+    }
+    return -1;
+}
+
+static void lru_unlink(t_mpr_poly *x, int v)
+{
+    t_poly_voice *voice = &x->voices[v];
+    if (voice->prev >= 0)
+        x->voices[voice->prev].next = voice->next;
+    else
+        x->lru_head[(int)voice->remote] = voice->next;
+    if (voice->next >= 0)
+        x->voices[voice->next].prev = voice->prev;
+    else
+        x->lru_tail[(int)voice->remote] = voice->prev;
+    voice->prev = voice->next = -1;
+}
+
+static void lru_append(t_mpr_poly *x, int v)
+{
+    t_poly_voice *voice = &x->voices[v];
+    int r = voice->remote;
+    voice->prev = x->lru_tail[r];
+    voice->next = -1;
+    voice->stamp = ++x->stamp;
+    if (x->lru_tail[r] >= 0)
+        x->voices[x->lru_tail[r]].next = v;
+    else
+        x->lru_head[r] = v;
+    x->lru_tail[r] = v;
+}
+
+// the voice to steal first is at the top: the lowest or the highest value
+static inline int heap_before(t_mpr_poly *x, int a, int b)
+{
+    if (POLY_STEAL_HIGHEST == x->steal)
+        return x->voices[a].value > x->voices[b].value;
+    return x->voices[a].value < x->voices[b].value;
+}
+
+static inline void heap_place(t_mpr_poly *x, int *heap, int pos, int v)
+{
+    heap[pos] = v;
+    x->voices[v].heap_pos = pos;
+}
+
+// move a voice whose value changed to its place in the heap
+static void heap_sift(t_mpr_poly *x, int v)
+{
+    int r = x->voices[v].remote, *heap = x->heap[r], size = x->heap_size[r];
+    int pos = x->voices[v].heap_pos, child;
+
+    while (pos > 0 && heap_before(x, v, heap[(pos - 1) / 2])) {
+        heap_place(x, heap, pos, heap[(pos - 1) / 2]);
+        pos = (pos - 1) / 2;
+    }
+    while ((child = pos * 2 + 1) < size) {
+        if (child + 1 < size && heap_before(x, heap[child + 1], heap[child]))
+            ++child;
+        if (!heap_before(x, heap[child], v))
+            break;
+        heap_place(x, heap, pos, heap[child]);
+        pos = child;
+    }
+    heap_place(x, heap, pos, v);
+}
+
+static void heap_insert(t_mpr_poly *x, int v)
+{
+    int r = x->voices[v].remote;
+    heap_place(x, x->heap[r], x->heap_size[r]++, v);
+    heap_sift(x, v);
+}
+
+static void heap_remove(t_mpr_poly *x, int v)
+{
+    int r = x->voices[v].remote, last = x->heap[r][--x->heap_size[r]];
+    if (last != v) {
+        heap_place(x, x->heap[r], x->voices[v].heap_pos, last);
+        heap_sift(x, last);
+    }
+}
+
+// reorder the heaps after the stealing policy changed
+static void heap_build(t_mpr_poly *x)
+{
+    int v;
+    x->heap_size[0] = x->heap_size[1] = 0;
+    for (v = 0; v < x->num_voices; v++) {
+        if (x->voices[v].active)
+            heap_insert(x, v);
+    }
+}
+
+static void output_target(t_mpr_poly *x, int v)
+{
+    // poly~ voices are numbered from 1
+    atom_setlong(x->buffer, v + 1);
+    outlet_anything(x->outlet, ps_target, 1, x->buffer);
+}
+
+static void output_mute(t_mpr_poly *x, int v, int state)
+{
+    atom_setlong(x->buffer, v + 1);
+    atom_setlong(x->buffer + 1, state);
+    outlet_anything(x->outlet, ps_mute, 2, x->buffer);
+}
+
+// the allocator is shared with signal events from mpr.device's poll, so
+// callers hold the critical region
+static int voice_alloc(t_mpr_poly *x, mpr_id inst, int remote)
+{
+    int v, slot;
+
+    if (!x->num_free) {
+        v = voice_victim(x, 0);
+        if (v < 0) {
+            ++x->num_dropped;
+            atom_setlong(x->buffer, (t_atom_long)inst);
+            outlet_anything(x->outlet2, ps_overflow, 1, x->buffer);
+            return -1;
+        }
+        atom_setlong(x->buffer, (t_atom_long)x->voices[v].inst);
+        outlet_anything(x->outlet2, ps_stolen, 1, x->buffer);
+        ++x->num_stolen;
+        if (x->voices[v].remote && x->sig_ptr)
+            mpr_sig_release_inst(x->sig_ptr, x->voices[v].inst);
+        voice_release(x, v);
+    }
+
+    v = x->free_voices[--x->num_free];
+    x->voices[v].inst = inst;
+    x->voices[v].active = 1;
+    x->voices[v].remote = remote;
+    x->voices[v].value = 0;
+    lru_append(x, v);
+    heap_insert(x, v);
+    ++x->num_active;
+
+    slot = hash_id(x, inst);
+    while (x->table[slot] >= 0)
+        slot = (slot + 1) & x->table_mask;
+    x->table[slot] = v;
+
+    if (x->mute)
+        output_mute(x, v, 0);
+    output_target(x, v);
+    atom_setlong(x->buffer, (t_atom_long)inst);
+    outlet_anything(x->outlet, ps_on, 1, x->buffer);
+    return v;
+}
+
+static void voice_release(t_mpr_poly *x, int v)
+{
+    int slot, next, home;
+    t_poly_voice *voice = &x->voices[v];
+    if (!voice->active)
+        return;
+
+    // remove from the instance table, shifting back any displaced entries
+    slot = hash_id(x, voice->inst);
+    while (x->table[slot] != v)
+        slot = (slot + 1) & x->table_mask;
+    x->table[slot] = -1;
+    next = (slot + 1) & x->table_mask;
+    while (x->table[next] >= 0) {
+        home = hash_id(x, x->voices[x->table[next]].inst);
+        if (((next - home) & x->table_mask) >= ((next - slot) & x->table_mask)) {
+            x->table[slot] = x->table[next];
+            x->table[next] = -1;
+            slot = next;
+        }
+        next = (next + 1) & x->table_mask;
+    }
+
+    lru_unlink(x, v);
+    heap_remove(x, v);
+    voice->active = 0;
+    x->free_voices[x->num_free++] = v;
+    --x->num_active;
+
+    output_target(x, v);
+    atom_setlong(x->buffer, (t_atom_long)voice->inst);
+    outlet_anything(x->outlet, ps_off, 1, x->buffer);
+    if (x->mute)
+        output_mute(x, v, 1);
+}
+
+// choose a voice to steal, only among those of signal instances if remote
+// is set, or return -1 if there is none; the victim is always at the head of
+// a list or the top of a heap
+static int voice_victim(t_mpr_poly *x, int remote)
+{
+    int a, b;
+
+    switch (x->steal) {
+        case POLY_STEAL_LRU:
+            a = x->lru_head[1];
+            b = remote ? -1 : x->lru_head[0];
+            if (a < 0 || (b >= 0 && x->voices[b].stamp < x->voices[a].stamp))
+                return b;
+            return a;
+        case POLY_STEAL_LOWEST:
+        case POLY_STEAL_HIGHEST:
+            a = x->heap_size[1] ? x->heap[1][0] : -1;
+            b = remote || !x->heap_size[0] ? -1 : x->heap[0][0];
+            if (a < 0 || (b >= 0 && heap_before(x, b, a)))
+                return b;
+            return a;
+        default:
+            return -1;
+    }
+}
+
+static void voice_update(t_mpr_poly *x, int v, long len, char type, const void *val)
+{
+    int i;
+    if (len > MAX_LIST)
+        len = MAX_LIST;
+
+    if (x->lru_tail[(int)x->voices[v].remote] != v) {
+        lru_unlink(x, v);
+        lru_append(x, v);
+    }
+    else
+        x->voices[v].stamp = ++x->stamp;
+    output_target(x, v);
+
+    if (type == 'i') {
+        int *vi = (int*)val;
+        x->voices[v].value = (float)vi[0];
+        for (i = 0; i < len; i++)
+            atom_setlong(x->buffer + i, vi[i]);
+        if (len == 1)
+            outlet_int(x->outlet, vi[0]);
+        else
+            outlet_list(x->outlet, NULL, len, x->buffer);
+    }
+    else if (type == 'f') {
+        float *vf = (float*)val;
+        x->voices[v].value = vf[0];
+        for (i = 0; i < len; i++)
+            atom_setfloat(x->buffer + i, vf[i]);
+        if (len == 1)
+            outlet_float(x->outlet, vf[0]);
+        else
+            outlet_list(x->outlet, NULL, len, x->buffer);
+    }
+    // only the value policies need the heaps in order
+    if (POLY_STEAL_LOWEST == x->steal || POLY_STEAL_HIGHEST == x->steal)
+        heap_sift(x, v);
+}
+
+// *********************************************************
+// -(signal events forwarded by mpr.device)-----------------
+static void mpr_poly_sig_event(t_mpr_poly *x, mpr_sig sig, long evt, mpr_id inst,
+                               long len, long type, const void *val)
+{
+    int v = voice_lookup(x, inst);
+
+    switch (evt) {
+        case MPR_SIG_UPDATE:
+            if (val) {
+                if (v < 0 && (v = voice_alloc(x, inst, 1)) < 0)
+                    break;
+                voice_update(x, v, len, (char)type, val);
+            }
+            else if (v >= 0)
+                voice_release(x, v);
+            break;
+        case MPR_SIG_REL_UPSTRM:
+            if (v >= 0)
+                voice_release(x, v);
+            mpr_sig_release_inst(sig, inst);
+            break;
+        case MPR_SIG_INST_OFLW:
+            // all reserved instances are busy: free one according to policy;
+            // voices of list input hold no instance, so stealing one would
+            // not make room
+            if ((v = voice_victim(x, 1)) >= 0) {
+                atom_setlong(x->buffer, (t_atom_long)x->voices[v].inst);
+                outlet_anything(x->outlet2, ps_stolen, 1, x->buffer);
+                ++x->num_stolen;
+                mpr_sig_release_inst(sig, x->voices[v].inst);
+                voice_release(x, v);
+            }
+            else {
+                ++x->num_dropped;
+                atom_setlong(x->buffer, (t_atom_long)inst);
+                outlet_anything(x->outlet2, ps_overflow, 1, x->buffer);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// *********************************************************
+// -(list input: instance id followed by value)-------------
+static void mpr_poly_list(t_mpr_poly *x, t_symbol *s, int argc, t_atom *argv)
+{
+    int i, v, len = argc - 1;
+    mpr_id inst;
+
+    if (argc < 2) {
+        object_post((t_object *)x, "expected instance id followed by value");
+        return;
+    }
+    inst = (mpr_id)atom_coerce_int(argv);
+    critical_enter(0);
+    if ((v = voice_lookup(x, inst)) < 0 && (v = voice_alloc(x, inst, 0)) < 0) {
+        critical_exit(0);
+        return;
+    }
+
+    if (x->sig_type == 'i') {
+        int payload[len];
+        for (i = 0; i < len; i++)
+            payload[i] = atom_coerce_int(argv + i + 1);
+        voice_update(x, v, len, 'i', payload);
+    }
+    else {
+        float payload[len];
+        for (i = 0; i < len; i++)
+            payload[i] = (argv+i+1)->a_type == A_FLOAT ? atom_getfloat(argv+i+1)
+                                                       : (float)atom_getlong(argv+i+1);
+        voice_update(x, v, len, 'f', payload);
+    }
+    critical_exit(0);
+}
+
+// *********************************************************
+// -(release instance)--------------------------------------
+static void mpr_poly_release(t_mpr_poly *x, t_symbol *s, int argc, t_atom *argv)
+{
+    int v;
+    mpr_id inst;
+    if (!argc)
+        return;
+    inst = (mpr_id)atom_coerce_int(argv);
+    critical_enter(0);
+    if ((v = voice_lookup(x, inst)) >= 0) {
+        voice_release(x, v);
+        if (x->voices[v].remote && x->sig_ptr)
+            mpr_sig_release_inst(x->sig_ptr, inst);
+    }
+    critical_exit(0);
+}
+
+// *********************************************************
+// -(release all voices)------------------------------------
+static void mpr_poly_clear(t_mpr_poly *x)
+{
+    int i;
+    critical_enter(0);
+    for (i = 0; i < 2; i++) {
+        while (x->num_active && x->lru_head[i] >= 0)
+            voice_release(x, x->lru_head[i]);
+    }
+    for (i = 0; i < x->num_voices; i++) {
+        x->voices[i].active = 0;
+        x->voices[i].remote = 0;
+        x->voices[i].prev = x->voices[i].next = -1;
+        // push in reverse so that voice 1 is handed out first
+        x->free_voices[i] = x->num_voices - i - 1;
+    }
+    for (i = 0; i <= x->table_mask; i++)
+        x->table[i] = -1;
+    x->num_free = x->num_voices;
+    x->num_active = 0;
+    x->lru_head[0] = x->lru_tail[0] = x->lru_head[1] = x->lru_tail[1] = -1;
+    x->heap_size[0] = x->heap_size[1] = 0;
+    critical_exit(0);
+}
+
+// *********************************************************
+// -(set stealing policy)-----------------------------------
+static void mpr_poly_stealing(t_mpr_poly *x, t_symbol *s, int argc, t_atom *argv)
+{
+    int steal;
+    if (!argc || argv->a_type != A_SYM)
+        return;
+    if (atom_strcmp(argv, "none") == 0)
+        steal = POLY_STEAL_NONE;
+    else if (atom_strcmp(argv, "lru") == 0 || atom_strcmp(argv, "oldest") == 0)
+        steal = POLY_STEAL_LRU;
+    else if (atom_strcmp(argv, "lowest") == 0)
+        steal = POLY_STEAL_LOWEST;
+    else if (atom_strcmp(argv, "highest") == 0)
+        steal = POLY_STEAL_HIGHEST;
+    else {
+        object_post((t_object *)x, "unknown stealing mode '%s'", atom_get_string(argv));
+        return;
+    }
+    critical_enter(0);
+    x->steal = steal;
+    // the heaps are only kept in order under the value policies
+    if (x->num_voices)
+        heap_build(x);
+    critical_exit(0);
+}
+
+// *********************************************************
+// some helper functions
+
+static int atom_strcmp(t_atom *a, const char *string)
+{
+    if (a->a_type != A_SYM || !string)
+        return 1;
+    return strcmp(atom_getsym(a)->s_name, string);
+}
+
+static const char *atom_get_string(t_atom *a)
+{
+    return atom_getsym(a)->s_name;
+}
+
+static int atom_coerce_int(t_atom *a)
+{
+    if (a->a_type == A_LONG)
+        return (int)atom_getlong(a);
+    else if (a->a_type == A_FLOAT)
+        return (int)atom_getfloat(a);
+    else
+        return 0;
+}
@@ -62,6 +62,20 @@ mv ./mpr_out/build/maxmsp/mpr.out.mxo ./dist/Max/Mapper/externals/
 cp ./mpr_out/mpr.out.maxhelp ./dist/Max/Mapper/help/
 ./dylibbundler/dylibbundler -cd -b -p '@loader_path/../libs/' -x ./dist/Max/Mapper/externals/mpr.out.mxo/Contents/MacOS/mpr.out -d ./dist/Max/Mapper/externals/mpr.out.mxo/Contents/libs/
 
+echo building mpr.bundle.mxo...
+cd mpr_bundle/
+xcodebuild build
+cd ..
+mv ./mpr_bundle/build/maxmsp/mpr.bundle.mxo ./dist/Max/Mapper/externals/
+./dylibbundler/dylibbundler -cd -b -p '@loader_path/../libs/' -x ./dist/Max/Mapper/externals/mpr.bundle.mxo/Contents/MacOS/mpr.bundle -d ./dist/Max/Mapper/externals/mpr.bundle.mxo/Contents/libs/
+
+echo building mpr.poly.mxo...
+cd mpr_poly/
+xcodebuild build
+cd ..
+mv ./mpr_poly/build/maxmsp/mpr.poly.mxo ./dist/Max/Mapper/externals/
+./dylibbundler/dylibbundler -cd -b -p '@loader_path/../libs/' -x ./dist/Max/Mapper/externals/mpr.poly.mxo/Contents/MacOS/mpr.poly -d ./dist/Max/Mapper/externals/mpr.poly.mxo/Contents/libs/
+
 echo copying oscmulticast...
 cp -r ./oscmulticast/oscmulticast.mxo ./dist/Max/Mapper/externals/
 cp ./oscmulticast/oscmulticast.maxhelp ./dist/Max/Mapper/help/